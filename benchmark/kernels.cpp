@@ -0,0 +1,436 @@
+// Microbenchmarks for the individual hot paths of the mapping pipeline at
+// increasing scales (number of points or number of vertices).
+//
+// Usage: slam3d_kernels [options]
+//   --filter <text>       only run benchmarks whose name contains text
+//   --min-scale <n>       smallest number of points / vertices (default 1000)
+//   --max-scale <n>       largest number of points / vertices (default 1000000)
+//   --min-time <ms>       minimum measuring time per benchmark (default 200)
+//   --output <file>       write the report to a file instead of stdout
+
+#include <BoostMapper.hpp>
+#include <PointCloudSensor.hpp>
+#include <G2oSolver.hpp>
+#include <NativeSolver.hpp>
+#include <SubmapSolver.hpp>
+#include <PoseGraphGenerator.hpp>
+#include <Journal.hpp>
+#include <FileLogger.hpp>
+
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
+#include <boost/uuid/uuid_generators.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+
+using namespace slam3d;
+
+typedef std::chrono::steady_clock StopClock;
+
+/**
+ * @brief Gives access to the internal kernels of the BoostMapper.
+ */
+class KernelMapper : public BoostMapper
+{
+public:
+	KernelMapper(Logger* log) : BoostMapper(log) {}
+	
+	using BoostMapper::buildNeighborIndex;
+	using BoostMapper::getNearbyVertices;
+	using BoostMapper::getVerticesInRange;
+	using BoostMapper::calculateGraphDistance;
+	
+	Vertex getDescriptor(IdType id) const { return mIndexMap.at(id); }
+};
+
+/**
+ * @brief Runs benchmarks and writes their results as JSON.
+ */
+class BenchmarkRunner
+{
+public:
+	BenchmarkRunner(std::ostream& out, const std::string& filter, double min_time)
+	 : mOut(out), mFilter(filter), mMinTime(min_time), mFirst(true)
+	{
+		mOut << "{\n  \"benchmarks\": [\n";
+	}
+	
+	~BenchmarkRunner()
+	{
+		mOut << "\n  ]\n}" << std::endl;
+	}
+	
+	bool enabled(const std::string& name) const
+	{
+		return name.find(mFilter) != std::string::npos;
+	}
+	
+	/**
+	 * @brief Repeat the function until the minimum time has passed.
+	 * @return mean time per repetition in milliseconds
+	 */
+	double run(const std::string& name, size_t scale, boost::function<void ()> function)
+	{
+		return run(name, scale, boost::function<void ()>(), function);
+	}
+	
+	/**
+	 * @brief Repeat the function until the minimum time has passed.
+	 * @details The setup is called before each repetition but not measured.
+	 * @return mean time per repetition in milliseconds
+	 */
+	double run(const std::string& name, size_t scale, boost::function<void ()> setup, boost::function<void ()> function)
+	{
+		if(!enabled(name))
+			return 0;
+		
+		unsigned iterations = 0;
+		double total = 0;
+		double best = 0;
+		do
+		{
+			if(setup)
+				setup();
+			StopClock::time_point start = StopClock::now();
+			function();
+			double time = std::chrono::duration<double, std::milli>(StopClock::now() - start).count();
+			total += time;
+			if(iterations == 0 || time < best)
+				best = time;
+			iterations++;
+		}while(total < mMinTime);
+		
+		mOut << (mFirst ? "" : ",\n")
+		     << "    {\"name\": \"" << name << "\", \"scale\": " << scale
+		     << ", \"iterations\": " << iterations
+		     << ", \"mean_ms\": " << total / iterations
+		     << ", \"min_ms\": " << best << "}";
+		mOut.flush();
+		mFirst = false;
+		return total / iterations;
+	}
+	
+	/**
+	 * @brief Report a value derived from other benchmarks.
+	 */
+	void report(const std::string& name, size_t scale, const std::string& key, double value)
+	{
+		mOut << (mFirst ? "" : ",\n")
+		     << "    {\"name\": \"" << name << "\", \"scale\": " << scale
+		     << ", \"" << key << "\": " << value << "}";
+		mOut.flush();
+		mFirst = false;
+	}
+	
+private:
+	std::ostream& mOut;
+	std::string mFilter;
+	double mMinTime;
+	bool mFirst;
+};
+
+/**
+ * @brief Synthetic measurement with sensor data of a fixed size.
+ */
+class PayloadMeasurement : public SyntheticMeasurement
+{
+public:
+	PayloadMeasurement(const SyntheticMeasurement& m, size_t size)
+	 : SyntheticMeasurement(m), mPayload(size, 1) {}
+	
+	size_t getPayloadSize() const { return mPayload.size(); }
+	void writePayload(char* buffer) const { memcpy(buffer, mPayload.data(), mPayload.size()); }
+	
+private:
+	std::vector<char> mPayload;
+};
+
+/**
+ * @brief Creates a room-like cloud with floor and walls, so it can be matched.
+ */
+PointCloud::Ptr createCloud(size_t points)
+{
+	PointCloud::Ptr cloud(new PointCloud);
+	cloud->resize(points);
+	for(size_t i = 0; i < points; i++)
+	{
+		float u = 20.0 * rand() / RAND_MAX - 10.0;
+		float v = 5.0 * rand() / RAND_MAX;
+		PointType& p = cloud->points[i];
+		switch(i % 4)
+		{
+		case 0: p.x = u; p.y = 10.0 * rand() / RAND_MAX - 5.0; p.z = 0; break;
+		case 1: p.x = u; p.y = 5;  p.z = v; break;
+		case 2: p.x = -10; p.y = u / 2; p.z = v; break;
+		case 3: p.x = u; p.y = -5 + 0.2 * sin(u); p.z = v; break;
+		}
+	}
+	return cloud;
+}
+
+/**
+ * @brief Creates a zigzag trajectory of the given length with a loop
+ * closure every 100 vertices.
+ */
+void createGraph(BoostMapper& mapper, size_t vertices)
+{
+	boost::uuids::random_generator generator;
+	boost::uuids::uuid source = boost::uuids::nil_uuid();
+	std::vector<boost::uuids::uuid> ids;
+	ids.reserve(vertices);
+	Covariance cov = Covariance::Identity();
+	timeval stamp = {0, 0};
+	for(size_t i = 0; i < vertices; i++)
+	{
+		Transform step = Transform::Identity();
+		step.translation() = Vector3(1, (i / 100) % 2 ? 0.1 : -0.1, 0);
+		Measurement::Ptr m(new Measurement("bench", "bench", Transform::Identity(), generator(), stamp));
+		mapper.addExternalReading(m, source, step, cov, "bench");
+		source = m->getUniqueId();
+		ids.push_back(source);
+		if(i >= 100 && i % 100 == 0)
+		{
+			Transform loop = Transform::Identity();
+			loop.translation() = Vector3(100, 0, 0);
+			mapper.addExternalConstraint(ids[i - 100], ids[i], loop, cov, "bench");
+		}
+	}
+}
+
+void benchmarkCloud(BenchmarkRunner& runner, PointCloudSensor& sensor, size_t points)
+{
+	PointCloud::Ptr cloud = createCloud(points);
+	Transform tf = Transform::Identity();
+	tf.translation() = Vector3(0.3, 0.1, 0);
+	tf.linear() = Eigen::AngleAxisd(0.05, Vector3::UnitZ()).toRotationMatrix();
+	
+	runner.run("downsample", points, boost::bind(&PointCloudSensor::downsample, &sensor, cloud, 0.1));
+	runner.run("removeOutliers", points, boost::bind(&PointCloudSensor::removeOutliers, &sensor, cloud, 0.5, 3));
+	runner.run("transform", points, boost::bind(&PointCloudSensor::transform, &sensor, cloud, tf));
+	
+	if(runner.enabled("calculateTransform"))
+	{
+		PointCloudMeasurement::Ptr source(new PointCloudMeasurement(cloud, "bench", sensor.getName(), Transform::Identity()));
+		PointCloudMeasurement::Ptr target(new PointCloudMeasurement(sensor.transform(cloud, tf.inverse()), "bench", sensor.getName(), Transform::Identity()));
+		Transform guess = Transform::Identity();
+		runner.run("calculateTransform/coarse", points, [&]{
+			try { sensor.calculateTransform(source, target, guess, true); } catch(NoMatch &e) {} });
+		runner.run("calculateTransform/fine", points, [&]{
+			try { sensor.calculateTransform(source, target, guess, false); } catch(NoMatch &e) {} });
+	}
+}
+
+void benchmarkGraph(BenchmarkRunner& runner, Logger& logger, size_t vertices)
+{
+	if(!runner.enabled("buildNeighborIndex") && !runner.enabled("getNearbyVertices")
+	   && !runner.enabled("getVerticesInRange") && !runner.enabled("calculateGraphDistance"))
+		return;
+	
+	KernelMapper mapper(&logger);
+	createGraph(mapper, vertices);
+	Vertex first = mapper.getDescriptor(1);
+	Vertex middle = mapper.getDescriptor(vertices / 2);
+	Vertex last = mapper.getDescriptor(vertices);
+	Transform query = mapper.getVertex(vertices / 2).corrected_pose;
+	
+	runner.run("buildNeighborIndex", vertices, boost::bind(&KernelMapper::buildNeighborIndex, &mapper, "bench"));
+	mapper.buildNeighborIndex("bench");
+	runner.run("getNearbyVertices", vertices, boost::bind(&KernelMapper::getNearbyVertices, &mapper, query, 5.0));
+	runner.run("getVerticesInRange", vertices, boost::bind(&KernelMapper::getVerticesInRange, &mapper, middle, 5));
+	runner.run("calculateGraphDistance", vertices, boost::bind(&KernelMapper::calculateGraphDistance, &mapper, first, last));
+}
+
+void benchmarkInsertion(BenchmarkRunner& runner, Logger& logger, size_t vertices)
+{
+	GeneratorConfiguration config;
+	boost::shared_ptr<SyntheticSensor> sensor;
+	boost::shared_ptr<PoseGraphGenerator> generator;
+	boost::shared_ptr<BoostMapper> mapper;
+	
+	// Only the cost of the graph storage, the generator finds the loops
+	config.trajectory = TRAJECTORY_GRID;
+	runner.run("addExternalReadings", vertices, [&]{
+		mapper.reset();
+		generator.reset();
+		sensor.reset(new SyntheticSensor("synthetic", &logger, config));
+		generator.reset(new PoseGraphGenerator(*sensor, config));
+		mapper.reset(new BoostMapper(&logger));
+		mapper->registerSensor(sensor.get());
+	}, [&]{
+		generator->addExternalReadings(*mapper, vertices);
+	});
+	
+	// The complete pipeline grows with the map, because the neighbor index
+	// is rebuilt for every reading, so large scales would take hours.
+	if(vertices > 10000)
+		return;
+	config.trajectory = TRAJECTORY_MANHATTAN;
+	config.area = 30;
+	runner.run("addReading", vertices, [&]{
+		mapper.reset();
+		generator.reset();
+		sensor.reset(new SyntheticSensor("synthetic", &logger, config));
+		generator.reset(new PoseGraphGenerator(*sensor, config));
+		mapper.reset(new BoostMapper(&logger));
+		mapper->registerSensor(sensor.get());
+		mapper->setNeighborRadius(config.loop_range, config.max_loop_links);
+		generator->addReadings(*mapper, vertices / 2);
+	}, [&]{
+		// Only the second half is measured, when the map already has the full size
+		generator->addReadings(*mapper, vertices / 2);
+	});
+}
+
+void benchmarkJournal(BenchmarkRunner& runner, Logger& logger, size_t vertices)
+{
+	// Like addReading in benchmarkInsertion, so the map has the same size
+	if(vertices > 10000 || !runner.enabled("addReading"))
+		return;
+	
+	// Measurements carry about as much data as a downsampled scan
+	const size_t payload_size = 100 * 1024;
+	const char* filename = "kernels.journal";
+	GeneratorConfiguration config;
+	config.trajectory = TRAJECTORY_MANHATTAN;
+	config.area = 30;
+	boost::shared_ptr<SyntheticSensor> sensor;
+	boost::shared_ptr<PoseGraphGenerator> generator;
+	boost::shared_ptr<BoostMapper> mapper;
+	boost::shared_ptr<Journal> journal;
+	bool journaling = false;
+	bool payloads = false;
+	
+	boost::function<void (size_t)> addReadings = [&](size_t count)
+	{
+		for(size_t i = 0; i < count; i++)
+		{
+			SyntheticMeasurement::Ptr m = generator->nextMeasurement();
+			if(payloads)
+				m.reset(new PayloadMeasurement(*m, payload_size));
+			mapper->addReading(m, true);
+		}
+	};
+	
+	boost::function<void ()> setup = [&]
+	{
+		mapper.reset();
+		journal.reset();
+		generator.reset();
+		std::remove(filename);
+		sensor.reset(new SyntheticSensor("synthetic", &logger, config));
+		generator.reset(new PoseGraphGenerator(*sensor, config));
+		mapper.reset(new BoostMapper(&logger));
+		mapper->registerSensor(sensor.get());
+		mapper->setNeighborRadius(config.loop_range, config.max_loop_links);
+		if(journaling)
+		{
+			journal.reset(new Journal(&logger, filename));
+			journal->setWritePayloads(payloads);
+			mapper->setJournal(journal.get());
+		}
+		addReadings(vertices / 2);
+		if(journal)
+			journal->commit();
+	};
+	
+	// The final commit is included, so writing is not deferred past the measurement
+	boost::function<void ()> function = [&]
+	{
+		addReadings(vertices / 2);
+		if(journal)
+			journal->commit();
+	};
+	
+	double plain = runner.run("addReading/plain", vertices, setup, function);
+	journaling = true;
+	double journal_time = runner.run("addReading/journal", vertices, setup, function);
+	journaling = false;
+	payloads = true;
+	double payload_plain = runner.run("addReading/payload", vertices, setup, function);
+	journaling = true;
+	double payload_journal = runner.run("addReading/payload+journal", vertices, setup, function);
+	mapper.reset();
+	journal.reset();
+	std::remove(filename);
+	
+	// Relative overhead of journaling, without and with the sensor data
+	if(plain > 0 && journal_time > 0)
+		runner.report("addReading/journal_overhead", vertices, "ratio", journal_time / plain - 1.0);
+	if(payload_plain > 0 && payload_journal > 0)
+		runner.report("addReading/payload+journal_overhead", vertices, "ratio", payload_journal / payload_plain - 1.0);
+}
+
+template<class SolverType>
+void benchmarkSolver(BenchmarkRunner& runner, Logger& logger, const std::string& name, size_t vertices)
+{
+	if(!runner.enabled(name))
+		return;
+	
+	// A fresh solver for every run, so each optimization starts from the
+	// same initial guess instead of an already optimized graph
+	boost::shared_ptr<SolverType> solver;
+	boost::shared_ptr<BoostMapper> mapper;
+	runner.run(name, vertices, [&]{
+		mapper.reset();
+		solver.reset(new SolverType(&logger));
+		mapper.reset(new BoostMapper(&logger));
+		mapper->setSolver(solver.get());
+		createGraph(*mapper, vertices);
+	}, [&]{
+		solver->compute();
+	});
+}
+
+int main(int argc, char** argv)
+{
+	std::string filter;
+	std::string output;
+	size_t min_scale = 1000;
+	size_t max_scale = 1000000;
+	double min_time = 200;
+	
+	for(int i = 1; i < argc; i++)
+	{
+		std::string arg(argv[i]);
+		bool has_value = (i + 1 < argc);
+		if(arg == "--filter" && has_value)         filter = argv[++i];
+		else if(arg == "--min-scale" && has_value) min_scale = atol(argv[++i]);
+		else if(arg == "--max-scale" && has_value) max_scale = atol(argv[++i]);
+		else if(arg == "--min-time" && has_value)  min_time = atof(argv[++i]);
+		else if(arg == "--output" && has_value)    output = argv[++i];
+		else
+		{
+			std::cerr << "Unknown option '" << arg << "'" << std::endl;
+			return 1;
+		}
+	}
+	
+	std::ofstream file;
+	if(!output.empty())
+		file.open(output.c_str());
+	std::ostream& out = output.empty() ? std::cout : file;
+	
+	Clock clock;
+	FileLogger logger(clock, "kernels.log");
+	logger.setLogLevel(ERROR);
+	PointCloudSensor sensor("pcl_sensor", &logger, Transform::Identity());
+	srand(42);
+	
+	BenchmarkRunner runner(out, filter, min_time);
+	for(size_t scale = min_scale; scale <= max_scale; scale *= 10)
+	{
+		benchmarkCloud(runner, sensor, scale);
+		benchmarkGraph(runner, logger, scale);
+		benchmarkInsertion(runner, logger, scale);
+		benchmarkJournal(runner, logger, scale);
+		benchmarkSolver<G2oSolver>(runner, logger, "G2oSolver::compute", scale);
+		benchmarkSolver<NativeSolver>(runner, logger, "NativeSolver::compute", scale);
+		benchmarkSolver<SubmapSolver>(runner, logger, "SubmapSolver::compute", scale);
+	}
+	return 0;
+}
@@ -0,0 +1,312 @@
+// Replays scan datasets through the complete mapping pipeline and reports
+// throughput and per-stage latencies as JSON.
+//
+// Usage: slam3d_replay [options] [directory ...]
+//   --synthetic <n>       add a synthetic sequence of n scans
+//   --base <file>         scan used to generate synthetic sequences
+//   --resolution <m>      voxel size used for preprocessing
+//   --optimize-every <n>  run the optimization after every n scans
+//   --output <file>       write the report to a file instead of stdout
+
+#include <BoostMapper.hpp>
+#include <PointCloudSensor.hpp>
+#include <G2oSolver.hpp>
+#include <ScanLoader.hpp>
+#include <FileLogger.hpp>
+
+#include <boost/format.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <sys/resource.h>
+
+using namespace slam3d;
+
+typedef std::chrono::steady_clock StopClock;
+
+static double elapsed(const StopClock::time_point& start)
+{
+	return std::chrono::duration<double, std::milli>(StopClock::now() - start).count();
+}
+
+/**
+ * @brief Latency samples of one stage of the pipeline in milliseconds.
+ */
+struct Stage
+{
+	std::vector<double> samples;
+	
+	double percentile(double p) const
+	{
+		if(samples.empty())
+			return 0;
+		std::vector<double> sorted(samples);
+		std::sort(sorted.begin(), sorted.end());
+		size_t rank = std::min(sorted.size() - 1, (size_t)(p / 100.0 * sorted.size()));
+		return sorted[rank];
+	}
+	
+	double total() const
+	{
+		double sum = 0;
+		for(std::vector<double>::const_iterator s = samples.begin(); s != samples.end(); ++s)
+			sum += *s;
+		return sum;
+	}
+};
+
+/**
+ * @brief PointCloudSensor that measures the time spent for matching.
+ * @details Within addReading, the first match is against the previous
+ * scan, all following matches are loop closures with nearby vertices.
+ */
+class TimingSensor : public PointCloudSensor
+{
+public:
+	TimingSensor(const std::string& n, Logger* l, const Transform& p)
+	 : PointCloudSensor(n, l, p), mMatches(0), mSequential(0), mLoopClosure(0) {}
+	
+	TransformWithCovariance calculateTransform(Measurement::Ptr source, Measurement::Ptr target, Transform odometry, bool coarse = false) const
+	{
+		StopClock::time_point start = StopClock::now();
+		try
+		{
+			TransformWithCovariance twc = PointCloudSensor::calculateTransform(source, target, odometry, coarse);
+			account(elapsed(start));
+			return twc;
+		}catch(NoMatch &e)
+		{
+			account(elapsed(start));
+			throw;
+		}
+	}
+	
+	void reset() { mMatches = 0; mSequential = 0; mLoopClosure = 0; }
+	unsigned getMatches() const { return mMatches; }
+	double getSequentialTime() const { return mSequential; }
+	double getLoopClosureTime() const { return mLoopClosure; }
+	
+private:
+	void account(double time) const
+	{
+		if(mMatches == 0)
+			mSequential += time;
+		else
+			mLoopClosure += time;
+		mMatches++;
+	}
+	
+	mutable unsigned mMatches;
+	mutable double mSequential;
+	mutable double mLoopClosure;
+};
+
+/**
+ * @brief Source of scans, either from disk or generated.
+ */
+class ScanSource
+{
+public:
+	virtual ~ScanSource() {}
+	virtual bool next(PointCloud::Ptr& cloud) = 0;
+	virtual std::string getName() const = 0;
+};
+
+class DirectorySource : public ScanSource
+{
+public:
+	DirectorySource(const std::string& dir) : mDirectory(dir), mReader(dir) {}
+	bool next(PointCloud::Ptr& cloud) { return mReader.next(cloud); }
+	std::string getName() const { return mDirectory; }
+	
+private:
+	std::string mDirectory;
+	DatasetReader mReader;
+};
+
+/**
+ * @brief Moves a base scan along two rounds of a circle, so the second
+ * round revisits the places of the first and creates loop closures.
+ */
+class SyntheticSource : public ScanSource
+{
+public:
+	SyntheticSource(PointCloud::Ptr base, const PointCloudSensor& sensor, unsigned scans)
+	 : mBase(base), mSensor(sensor), mScans(scans), mCurrent(0) {}
+	
+	bool next(PointCloud::Ptr& cloud)
+	{
+		if(mCurrent >= mScans)
+			return false;
+		
+		// One meter between scans, two rounds in total
+		double radius = std::max(2.0, mScans / (4.0 * M_PI));
+		double angle = mCurrent / radius;
+		Transform pose = Transform::Identity();
+		pose.translation() = Vector3(radius * sin(angle), radius - radius * cos(angle), 0);
+		pose.linear() = Eigen::AngleAxisd(angle, Vector3::UnitZ()).toRotationMatrix();
+		cloud = mSensor.transform(mBase, pose.inverse());
+		mCurrent++;
+		return true;
+	}
+	
+	std::string getName() const { return (boost::format("synthetic-%1%") % mScans).str(); }
+	
+private:
+	PointCloud::Ptr mBase;
+	const PointCloudSensor& mSensor;
+	unsigned mScans;
+	unsigned mCurrent;
+};
+
+static void writeStage(std::ostream& out, const std::string& name, const Stage& stage, bool last = false)
+{
+	out << "      \"" << name << "\": {"
+	    << "\"count\": " << stage.samples.size()
+	    << ", \"total_ms\": " << stage.total()
+	    << ", \"p50_ms\": " << stage.percentile(50)
+	    << ", \"p95_ms\": " << stage.percentile(95)
+	    << ", \"p99_ms\": " << stage.percentile(99)
+	    << "}" << (last ? "" : ",") << "\n";
+}
+
+static void replay(ScanSource& source, Logger& logger, double resolution, unsigned optimize_every, std::ostream& out, bool last)
+{
+	TimingSensor sensor("pcl_sensor", &logger, Transform::Identity());
+	G2oSolver solver(&logger);
+	BoostMapper mapper(&logger);
+	mapper.setSolver(&solver);
+	mapper.registerSensor(&sensor);
+	mapper.setNeighborRadius(3.0, 5);
+	
+	Stage preprocess, sequential, other, loop_closure, optimization, total;
+	unsigned scans = 0;
+	uint64_t stamp = 0;
+	StopClock::time_point replay_start = StopClock::now();
+	PointCloud::Ptr cloud;
+	while(source.next(cloud))
+	{
+		StopClock::time_point start = StopClock::now();
+		PointCloud::Ptr filtered = sensor.downsample(cloud, resolution);
+		filtered->header.stamp = stamp;
+		preprocess.samples.push_back(elapsed(start));
+		
+		StopClock::time_point add_start = StopClock::now();
+		sensor.reset();
+		PointCloudMeasurement::Ptr m(new PointCloudMeasurement(filtered, "replay", sensor.getName(), Transform::Identity()));
+		mapper.addReading(m);
+		double add_time = elapsed(add_start);
+		
+		if(sensor.getMatches() > 0)
+			sequential.samples.push_back(sensor.getSequentialTime());
+		if(sensor.getMatches() > 1)
+			loop_closure.samples.push_back(sensor.getLoopClosureTime());
+		
+		// Remaining time of addReading: neighbor search, index updates and
+		// graph insertion are not timed separately
+		other.samples.push_back(add_time - sensor.getSequentialTime() - sensor.getLoopClosureTime());
+		total.samples.push_back(elapsed(start));
+		
+		scans++;
+		stamp += 100000;
+		if(optimize_every > 0 && scans % optimize_every == 0)
+		{
+			StopClock::time_point opt_start = StopClock::now();
+			mapper.optimize();
+			optimization.samples.push_back(elapsed(opt_start));
+		}
+	}
+	StopClock::time_point opt_start = StopClock::now();
+	mapper.optimize();
+	optimization.samples.push_back(elapsed(opt_start));
+	double duration = elapsed(replay_start);
+	
+	out << "    {\n"
+	    << "      \"dataset\": \"" << source.getName() << "\",\n"
+	    << "      \"scans\": " << scans << ",\n"
+	    << "      \"vertices\": " << mapper.getVertexObjectsFromSensor(sensor.getName()).size() << ",\n"
+	    << "      \"edges\": " << mapper.getEdgeObjectsFromSensor("").size() / 2 << ",\n"
+	    << "      \"duration_ms\": " << duration << ",\n"
+	    << "      \"scans_per_second\": " << (duration > 0 ? scans * 1000.0 / duration : 0) << ",\n";
+	writeStage(out, "preprocess", preprocess);
+	writeStage(out, "sequential_matching", sequential);
+	writeStage(out, "other", other);
+	writeStage(out, "loop_closure", loop_closure);
+	writeStage(out, "optimization", optimization);
+	writeStage(out, "total", total, true);
+	out << "    }" << (last ? "" : ",") << "\n";
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> directories;
+	std::vector<unsigned> synthetic;
+	std::string base = "../test/cloud1.bin";
+	std::string output;
+	double resolution = 0.5;
+	unsigned optimize_every = 10;
+	
+	for(int i = 1; i < argc; i++)
+	{
+		std::string arg(argv[i]);
+		bool has_value = (i + 1 < argc);
+		if(arg == "--synthetic" && has_value)           synthetic.push_back(atoi(argv[++i]));
+		else if(arg == "--base" && has_value)           base = argv[++i];
+		else if(arg == "--resolution" && has_value)     resolution = atof(argv[++i]);
+		else if(arg == "--optimize-every" && has_value) optimize_every = atoi(argv[++i]);
+		else if(arg == "--output" && has_value)         output = argv[++i];
+		else if(arg.compare(0, 2, "--") == 0)
+		{
+			std::cerr << "Unknown option '" << arg << "'" << std::endl;
+			return 1;
+		}
+		else directories.push_back(arg);
+	}
+	if(directories.empty() && synthetic.empty())
+	{
+		directories.push_back("../test");
+	}
+	
+	std::ofstream file;
+	if(!output.empty())
+		file.open(output.c_str());
+	std::ostream& out = output.empty() ? std::cout : file;
+	
+	Clock clock;
+	FileLogger logger(clock, "replay.log");
+	logger.setLogLevel(WARNING);
+	
+	try
+	{
+		out << "{\n  \"datasets\": [\n";
+		size_t count = directories.size() + synthetic.size();
+		size_t n = 0;
+		for(std::vector<std::string>::iterator d = directories.begin(); d != directories.end(); ++d)
+		{
+			DirectorySource source(*d);
+			replay(source, logger, resolution, optimize_every, out, ++n == count);
+		}
+		if(!synthetic.empty())
+		{
+			PointCloudSensor sensor("pcl_sensor", &logger, Transform::Identity());
+			PointCloud::Ptr base_cloud = ScanLoader::load(base);
+			for(std::vector<unsigned>::iterator s = synthetic.begin(); s != synthetic.end(); ++s)
+			{
+				SyntheticSource source(base_cloud, sensor, *s);
+				replay(source, logger, resolution, optimize_every, out, ++n == count);
+			}
+		}
+	}catch(std::exception &e)
+	{
+		std::cerr << "Replay failed: " << e.what() << std::endl;
+		return 1;
+	}
+	
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	out << "  ],\n  \"peak_rss_kb\": " << usage.ru_maxrss << "\n}" << std::endl;
+	return 0;
+}
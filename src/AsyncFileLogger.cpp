@@ -0,0 +1,197 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "AsyncFileLogger.hpp"
+
+#include <chrono>
+
+using namespace slam3d;
+
+typedef std::chrono::steady_clock StopClock;
+
+AsyncFileLogger::AsyncFileLogger(Clock c, const std::string& f, size_t capacity,
+                                 OverflowPolicy policy, unsigned flush_interval, size_t flush_size)
+ : Logger(c), mPolicy(policy), mFlushInterval(flush_interval), mFlushSize(flush_size),
+   mEnqueuePosition(0), mDequeuePosition(0), mDropped(0), mReportedDropped(0),
+   mRunning(true), mFlushedPosition(0), mFlushRequest(0)
+{
+	mLogFile.open(f.c_str());
+	
+	// Use a power of two, so the position can be masked instead of divided
+	size_t size = 2;
+	while(size < capacity)
+		size *= 2;
+	mSlots = std::vector<Slot>(size);
+	mMask = size - 1;
+	for(size_t i = 0; i < size; i++)
+	{
+		mSlots[i].sequence.store(i, std::memory_order_relaxed);
+	}
+	mThread = std::thread(&AsyncFileLogger::run, this);
+}
+
+AsyncFileLogger::~AsyncFileLogger()
+{
+	mRunning.store(false);
+	mThread.join();
+	mLogFile.close();
+}
+
+bool AsyncFileLogger::push(LOG_LEVEL lvl, const timeval& stamp, const std::string& message)
+{
+	size_t position = mEnqueuePosition.load(std::memory_order_relaxed);
+	while(true)
+	{
+		Slot& slot = mSlots[position & mMask];
+		size_t sequence = slot.sequence.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t)sequence - (intptr_t)position;
+		if(diff == 0)
+		{
+			if(mEnqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				slot.level = lvl;
+				slot.stamp = stamp;
+				slot.text = message;
+				slot.sequence.store(position + 1, std::memory_order_release);
+				return true;
+			}
+		}else if(diff < 0)
+		{
+			// The writer has not yet read the message from the last round
+			return false;
+		}else
+		{
+			position = mEnqueuePosition.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+void AsyncFileLogger::message(LOG_LEVEL lvl, const std::string& message)
+{
+	if(lvl < mLogLevel)
+		return;
+	
+	timeval stamp = mClock.now();
+	while(!push(lvl, stamp, message))
+	{
+		// FATAL messages are never dropped, they might explain the crash
+		if(mPolicy == OVERFLOW_DROP && lvl != FATAL)
+		{
+			mDropped++;
+			return;
+		}
+		std::this_thread::yield();
+	}
+	
+	if(lvl == FATAL)
+	{
+		flush();
+	}
+}
+
+void AsyncFileLogger::flush()
+{
+	size_t target = mEnqueuePosition.load();
+	size_t request = mFlushRequest.load();
+	while(request < target && !mFlushRequest.compare_exchange_weak(request, target));
+	
+	std::unique_lock<std::mutex> lock(mFlushMutex);
+	mFlushed.wait(lock, [&]{ return mFlushedPosition >= target; });
+}
+
+void AsyncFileLogger::write(const Slot& slot)
+{
+	switch(slot.level)
+	{
+	case DEBUG:
+		mLogFile << "[DEBUG][";
+		break;
+	case INFO:
+		mLogFile << "[INFO ][";
+		break;
+	case WARNING:
+		mLogFile << "[WARN ][";
+		break;
+	case ERROR:
+		mLogFile << "[ERROR][";
+		break;
+	case FATAL:
+		mLogFile << "[FATAL][";
+		break;
+	}
+	mLogFile << slot.stamp.tv_sec << "." << slot.stamp.tv_usec << "] " << slot.text << '\n';
+}
+
+void AsyncFileLogger::run()
+{
+	StopClock::time_point last_flush = StopClock::now();
+	size_t pending = 0;
+	while(true)
+	{
+		// Check before reading, so nothing is lost that was queued before stopping
+		bool running = mRunning.load();
+		
+		// Write all messages that are ready
+		size_t count = 0;
+		while(true)
+		{
+			Slot& slot = mSlots[mDequeuePosition & mMask];
+			if(slot.sequence.load(std::memory_order_acquire) != mDequeuePosition + 1)
+				break;
+			write(slot);
+			pending += slot.text.size() + 32;
+			slot.sequence.store(mDequeuePosition + mMask + 1, std::memory_order_release);
+			mDequeuePosition++;
+			count++;
+		}
+		
+		size_t dropped = mDropped.load();
+		if(dropped > mReportedDropped)
+		{
+			mLogFile << "[WARN ] " << (dropped - mReportedDropped) << " log messages have been dropped!\n";
+			mReportedDropped = dropped;
+		}
+		
+		// Flush when requested, after enough data (estimated) or after some time
+		bool requested = mFlushRequest.load() > mFlushedPosition;
+		bool timeout = StopClock::now() - last_flush > std::chrono::milliseconds(mFlushInterval);
+		if((pending > 0 && (pending >= mFlushSize || timeout)) || requested || !running)
+		{
+			mLogFile.flush();
+			pending = 0;
+			last_flush = StopClock::now();
+			{
+				std::lock_guard<std::mutex> lock(mFlushMutex);
+				mFlushedPosition = mDequeuePosition;
+			}
+			mFlushed.notify_all();
+		}
+		
+		if(!running)
+			break;
+		if(count == 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
@@ -0,0 +1,134 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_ASYNCFILELOGGER_HPP
+#define SLAM_ASYNCFILELOGGER_HPP
+
+#include "Logger.hpp"
+
+#include <fstream>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace slam3d
+{
+	/**
+	 * @brief What to do with new messages when the buffer is full.
+	 */
+	enum OverflowPolicy
+	{
+		OVERFLOW_DROP,   ///< discard the message and count it
+		OVERFLOW_BLOCK   ///< wait until the writer has made room
+	};
+	
+	/**
+	 * @class AsyncFileLogger
+	 * @brief Logger that writes messages to a file on a background thread.
+	 * @details Messages are pushed into a bounded lock-free ring buffer, so
+	 * logging threads never wait for the file system. The background thread
+	 * writes the messages in batches and flushes the file periodically or
+	 * when enough data has been written. FATAL messages and the destruction
+	 * of the logger wait until all previous messages are on disk. FATAL
+	 * messages are never dropped, they wait for space regardless of the policy.
+	 */
+	class AsyncFileLogger : public Logger
+	{
+	public:
+		/**
+		 * @brief Constructor, opens the log file and starts the writer.
+		 * @param c clock to get timestamps for messages
+		 * @param f filename for the loggers log-file
+		 * @param capacity number of messages the buffer can hold (rounded up to a power of two)
+		 * @param policy behaviour when the buffer is full
+		 * @param flush_interval maximum time between flushes in milliseconds
+		 * @param flush_size flush after this many bytes have been written
+		 */
+		AsyncFileLogger(Clock c, const std::string& f, size_t capacity = 4096,
+		                OverflowPolicy policy = OVERFLOW_BLOCK,
+		                unsigned flush_interval = 100, size_t flush_size = 64 * 1024);
+		
+		/**
+		 * @brief Destructor, writes all remaining messages.
+		 */
+		~AsyncFileLogger();
+		
+		/**
+		 * @brief Queue a message for writing.
+		 * @param lvl the message's log-level
+		 * @param message the message to be written
+		 */
+		virtual void message(LOG_LEVEL lvl, const std::string& message);
+		
+		/**
+		 * @brief Block until all messages queued so far are written and flushed.
+		 */
+		void flush();
+		
+		/**
+		 * @brief Get the number of messages that were dropped because the buffer was full.
+		 */
+		size_t getDroppedMessages() const { return mDropped.load(); }
+		
+	protected:
+		struct Slot
+		{
+			std::atomic<size_t> sequence;
+			LOG_LEVEL level;
+			timeval stamp;
+			std::string text;
+		};
+		
+		bool push(LOG_LEVEL lvl, const timeval& stamp, const std::string& message);
+		void run();
+		void write(const Slot& slot);
+		
+	protected:
+		std::ofstream mLogFile;
+		OverflowPolicy mPolicy;
+		unsigned mFlushInterval;
+		size_t mFlushSize;
+		
+		// Ring buffer, the sequence of each slot tells whether it can be
+		// written (sequence == position) or read (sequence == position + 1).
+		std::vector<Slot> mSlots;
+		size_t mMask;
+		std::atomic<size_t> mEnqueuePosition;
+		size_t mDequeuePosition;
+		std::atomic<size_t> mDropped;
+		size_t mReportedDropped;
+		
+		std::thread mThread;
+		std::atomic<bool> mRunning;
+		std::mutex mFlushMutex;
+		std::condition_variable mFlushed;
+		size_t mFlushedPosition;
+		std::atomic<size_t> mFlushRequest;
+	};
+}
+
+#endif
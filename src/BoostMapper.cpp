@@ -5,6 +5,8 @@
 
 #include "BoostMapper.hpp"
 #include "Solver.hpp"
+#include "Serialization.hpp"
+#include "Marginalization.hpp"
 
 #include <boost/format.hpp>
 #include <boost/graph/visitors.hpp>
@@ -13,6 +15,10 @@
 #include <boost/property_map/property_map.hpp>
 #include <boost/graph/graphviz.hpp>
 
+#include <Eigen/Eigenvalues>
+
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 
 using namespace slam3d;
@@ -34,7 +40,13 @@ BoostMapper::BoostMapper(Logger* log)
 	mVertexIndex.insert(UuidMap::value_type(origin->getUniqueId(), root));
 
 	mLastVertex = 0;
+	mCovarianceReference = id;
+	mDeadReckoningCovariance = Covariance::Zero();
 	mPatchSolver = NULL;
+	mPatchWindowSolver = NULL;
+	mPatchUseCount = 0;
+	mMeasurementBytes = 0;
+	mFullHandOff = false;
 }
 
 BoostMapper::~BoostMapper()
@@ -88,9 +100,13 @@ EdgeObjectList BoostMapper::getEdgeObjectsFromSensor(const std::string& sensor)
 
 void BoostMapper::buildNeighborIndex(const std::string& sensor)
 {
+	ScopedTimer timer(mMetrics, "mapper.build_neighbor_index");
 	VertexList vertices = getVerticesFromSensor(sensor);
 	int numOfVertices = vertices.size();
-	flann::Matrix<float> points(new float[numOfVertices * 3], numOfVertices, 3);
+	
+	// The index keeps pointers into this buffer, so it lives until the next rebuild
+	mNeighborPoints.resize(numOfVertices * 3);
+	flann::Matrix<float> points(mNeighborPoints.data(), numOfVertices, 3);
 
 	IdType row = 0;
 	mNeighborMap.clear();
@@ -105,17 +121,22 @@ void BoostMapper::buildNeighborIndex(const std::string& sensor)
 	}
 	
 	mNeighborIndex.buildIndex(points);
+	if(mMetrics)
+		mMetrics->increment("mapper.indexed_vertices", numOfVertices);
 }
 
 VertexList BoostMapper::getNearbyVertices(const Transform &tf, float radius)
 {
+	ScopedTimer timer(mMetrics, "mapper.neighbor_search");
+
 	// Fill in the query point
-	flann::Matrix<float> query(new float[3], 1, 3);
+	float query_point[3];
+	flann::Matrix<float> query(query_point, 1, 3);
 	Transform::ConstTranslationPart t = tf.translation();
 	query[0][0] = t[0];
 	query[0][1] = t[1];
 	query[0][2] = t[2];
-	mLogger->message(DEBUG, (boost::format("Doing NN search from (%1%, %2%, %3%) with radius %4%.")%t[0]%t[1]%t[2]%radius).str());
+	SLAM3D_LOG(mLogger, DEBUG, (boost::format("Doing NN search from (%1%, %2%, %3%) with radius %4%.")%t[0]%t[1]%t[2]%radius).str());
 	
 	// Find points nearby
 	std::vector< std::vector<int> > neighbors;
@@ -128,33 +149,92 @@ VertexList BoostMapper::getNearbyVertices(const Transform &tf, float radius)
 	std::vector<NeighborIndex::DistanceType>::iterator d = distances[0].begin();
 	for(; it < neighbors[0].end(); ++it, ++d)
 	{
-		Vertex n = mNeighborMap[*it];
+		// Removed vertices stay in the index until it is rebuilt
+		IndexMap::iterator entry = mNeighborMap.find(*it);
+		if(entry == mNeighborMap.end())
+			continue;
+		Vertex n = entry->second;
 		result.push_back(n);
-		mLogger->message(DEBUG, (boost::format(" - vertex %1% nearby (d = %2%)") % mPoseGraph[n].index % *d).str());
+		SLAM3D_LOG(mLogger, DEBUG, (boost::format(" - vertex %1% nearby (d = %2%)") % mPoseGraph[n].index % *d).str());
 	}
 	
-	mLogger->message(DEBUG, (boost::format("Neighbor search found %1% vertices nearby.") % found).str());
+	SLAM3D_LOG(mLogger, DEBUG, (boost::format("Neighbor search found %1% vertices nearby.") % found).str());
+	timer.addValue("found", found);
 	return result;
 }
 
+void BoostMapper::getMemoryUsage(MemoryUsageMap& usage) const
+{
+	// Estimated size of a node in a std::map (color and three pointers)
+	const size_t map_node = 4 * sizeof(void*);
+	
+	if(mMeasurementStorage)
+	{
+		usage["measurements"] = MemoryUsage(mMeasurementStorage->getResidentSize(),
+		                                    mMeasurementStorage->getNumberOfResidentMeasurements());
+	}else
+	{
+		usage["measurements"] = MemoryUsage(mMeasurementBytes, mVertexIndex.size());
+	}
+	
+	// Each vertex is stored in a vector together with the head of its
+	// out-edge list and is referenced from the id, uuid and payload index.
+	size_t vertices = boost::num_vertices(mPoseGraph);
+	usage["vertices"] = MemoryUsage(vertices * (sizeof(VertexObject) + 3 * sizeof(void*)
+		+ 3 * map_node + sizeof(IndexMap::value_type) + sizeof(UuidMap::value_type)
+		+ sizeof(std::map<IdType, size_t>::value_type)), vertices);
+	
+	// Every edge is stored twice, once for each direction, in a list node
+	// that holds the target and a pointer to the edge property
+	size_t edges = boost::num_edges(mPoseGraph);
+	usage["edges"] = MemoryUsage(edges * (sizeof(EdgeObject) + sizeof(void*) * 4), edges);
+	
+	usage["neighbor_index"] = MemoryUsage(mNeighborIndex.usedMemory()
+		+ mNeighborPoints.capacity() * sizeof(float)
+		+ mNeighborMap.size() * (map_node + sizeof(IndexMap::value_type)), mNeighborMap.size());
+}
+
 bool BoostMapper::optimize()
+{
+	return optimize(OptimizationBudget());
+}
+
+bool BoostMapper::optimize(const OptimizationBudget& budget)
 {
 	if(!mSolver)
 	{
-		mLogger->message(ERROR, "A solver must be set before optimize() is called!");
+		SLAM3D_LOG(mLogger, ERROR, "A solver must be set before optimize() is called!");
 		return false;
 	}
+	ScopedTimer timer(mMetrics, "mapper.optimize");
 
 	// Optimize
-	if(!mSolver->compute())
+	if(!mSolver->compute(budget))
 	{
 		return false;
 	}
 	mOptimized = true;
+	
+	// Covariances of the solver are known up to the last vertex
+	if(mLastVertex)
+	{
+		mCovarianceReference = mPoseGraph[mLastVertex].index;
+		mDeadReckoningCovariance.setZero();
+	}
 
-	// Retrieve results
-	IdPoseVector res = mSolver->getCorrections();
-	for(IdPoseVector::iterator it = res.begin(); it < res.end(); it++)
+	// Retrieve the poses that have changed
+	IdPoseVector corrections;
+	if(mFullHandOff)
+	{
+		corrections = mSolver->getCorrections();
+		mFullHandOff = false;
+	}
+	const IdPoseVector& res = corrections.empty() ? mSolver->getChangedPoses() : corrections;
+	if(mJournal && !res.empty())
+	{
+		mJournal->addPoses(res);
+	}
+	for(IdPoseVector::const_iterator it = res.begin(); it < res.end(); it++)
 	{
 		unsigned int id = it->first;
 		Transform tf = it->second;
@@ -162,24 +242,32 @@ bool BoostMapper::optimize()
 		{
 			Vertex v = mIndexMap.at(id);
 			mPoseGraph[v].corrected_pose = tf;
+			if(mMeasurementStorage)
+			{
+				mMeasurementStorage->setPosition(mPoseGraph[v].measurement, tf.translation());
+			}
 		}catch(std::out_of_range &e)
 		{
-			mLogger->message(ERROR, (boost::format("Vertex with id %1% does not exist!") % id).str());
+			SLAM3D_LOG(mLogger, ERROR, (boost::format("Vertex with id %1% does not exist!") % id).str());
 		}
 	}
+	republishCurrentPose();
+	updateMemoryStats();
 	return true;
 }
 
 bool BoostMapper::addReading(Measurement::Ptr m, bool force)
 {
+	ScopedTimer timer(mMetrics, "mapper.add_reading");
+
 	// Get the sensor responsible for this measurement
 	Sensor* sensor = NULL;
 	if(!getSensorForMeasurement(m, sensor))
 	{
-		mLogger->message(ERROR, (boost::format("Sensor '%1%' has not been registered!") % m->getSensorName()).str());
+		SLAM3D_LOG(mLogger, ERROR, (boost::format("Sensor '%1%' has not been registered!") % m->getSensorName()).str());
 		return false;
 	}
-	mLogger->message(DEBUG, (boost::format("Add reading from own Sensor '%1%'.") % m->getSensorName()).str());
+	SLAM3D_LOG(mLogger, DEBUG, (boost::format("Add reading from own Sensor '%1%'.") % m->getSensorName()).str());
 
 	// Get the odometric pose for this measurement
 	Transform odometry = Transform::Identity();
@@ -190,7 +278,7 @@ bool BoostMapper::addReading(Measurement::Ptr m, bool force)
 			odometry = mOdometry->getOdometricPose(m->getTimestamp());
 		}catch(OdometryException &e)
 		{
-			mLogger->message(ERROR, "Could not get Odometry data!");
+			SLAM3D_LOG(mLogger, ERROR, "Could not get Odometry data!");
 			return false;
 		}
 	}
@@ -206,12 +294,22 @@ bool BoostMapper::addReading(Measurement::Ptr m, bool force)
 		}
 		mLastVertex = addVertex(m, mCurrentPose);
 		mLastOdometricPose = odometry;
-		mLogger->message(INFO, "Added first node to the graph.");
+		SLAM3D_LOG(mLogger, INFO, "Added first node to the graph.");
 		addEdge(root, mLastVertex, mCurrentPose, Covariance::Identity() * 100, "none", "root-link");
 
 		buildNeighborIndex(sensor->getName());
 		linkToNeighbors(mLastVertex, sensor, mMaxNeighorLinks);
 		mCurrentPose = Transform::Identity();
+		updateMemoryStats();
+		if(mMeasurementStorage)
+		{
+			mMeasurementStorage->enforceBudget(mPoseGraph[mLastVertex].corrected_pose.translation());
+		}
+		if(mJournal)
+		{
+			mJournal->addState(mPoseGraph[mLastVertex].index, mLastOdometricPose);
+		}
+		publishCurrentPose(m->getTimestamp(), odometry);
 		return true;
 	}
 
@@ -224,7 +322,10 @@ bool BoostMapper::addReading(Measurement::Ptr m, bool force)
 		odom_dist = orthogonalize(mLastOdometricPose.inverse() * odometry);
 		mCurrentPose = odom_dist;
 		if(!force && !checkMinDistance(odom_dist))
+		{
+			publishCurrentPose(m->getTimestamp(), odometry);
 			return false;
+		}
 	}
 	
 	if(mAddOdometryEdges)
@@ -233,7 +334,7 @@ bool BoostMapper::addReading(Measurement::Ptr m, bool force)
 		newVertex = addVertex(m, orthogonalize(mPoseGraph[mLastVertex].corrected_pose * mCurrentPose));
 
 		// Add an edge representing the odometry information
-		Covariance odom_cov = mOdometry->calculateCovariance(odom_dist);
+		Covariance odom_cov = getOdometryCovariance(odom_dist, m->getTimestamp());
 		addEdge(mLastVertex, newVertex, odom_dist, odom_cov, "Odometry", "odom");
 	}
 	
@@ -244,6 +345,9 @@ bool BoostMapper::addReading(Measurement::Ptr m, bool force)
 		if(mPatchBuildingRange > 0)
 		{
 			target_m = buildPatch(mLastVertex, sensor);
+		}else
+		{
+			loadMeasurement(target_m);
 		}
 		TransformWithCovariance twc = sensor->calculateTransform(target_m, m, mCurrentPose);
 		mCurrentPose = twc.transform;
@@ -251,22 +355,33 @@ bool BoostMapper::addReading(Measurement::Ptr m, bool force)
 		if(newVertex)
 		{
 			mPoseGraph[newVertex].corrected_pose = orthogonalize(mPoseGraph[mLastVertex].corrected_pose * twc.transform);
+			if(mJournal)
+			{
+				mJournal->addPoses(IdPoseVector(1, IdPose(mPoseGraph[newVertex].index, mPoseGraph[newVertex].corrected_pose)));
+			}
 		}else
 		{
 			if(!force && !checkMinDistance(twc.transform))
+			{
+				publishCurrentPose(m->getTimestamp(), odometry);
 				return false;
+			}
 			newVertex = addVertex(m, orthogonalize(mPoseGraph[mLastVertex].corrected_pose * twc.transform));
 		}
 		addEdge(mLastVertex, newVertex, twc.transform, twc.covariance, sensor->getName(), "seq");
+		propagateCovariance(twc.transform, twc.covariance);
 	}catch(NoMatch &e)
 	{
+		if(mMetrics)
+			mMetrics->increment("mapper.match_failures");
 		if(newVertex)
 		{
-			mLogger->message(WARNING, (boost::format("Failed to match new vertex %1% to previous, because %2%.")
+			SLAM3D_LOG(mLogger, WARNING, (boost::format("Failed to match new vertex %1% to previous, because %2%.")
 				% mPoseGraph[newVertex].index % e.what()).str());
+			propagateCovariance(odom_dist, getOdometryCovariance(odom_dist, m->getTimestamp()));
 		}else
 		{
-			mLogger->message(WARNING, (boost::format("Measurement could not be matched because %1%, and no odometry was availabe!")
+			SLAM3D_LOG(mLogger, WARNING, (boost::format("Measurement could not be matched because %1%, and no odometry was availabe!")
 				% e.what()).str());
 			return false;
 		}
@@ -280,24 +395,63 @@ bool BoostMapper::addReading(Measurement::Ptr m, bool force)
 	mLastVertex = newVertex;
 	mLastOdometricPose = odometry;
 	mCurrentPose = Transform::Identity();
+	updateMemoryStats();
+	if(mMeasurementStorage)
+	{
+		mMeasurementStorage->enforceBudget(mPoseGraph[mLastVertex].corrected_pose.translation());
+	}
+	if(mJournal)
+	{
+		mJournal->addState(mPoseGraph[mLastVertex].index, mLastOdometricPose);
+	}
+	publishCurrentPose(m->getTimestamp(), odometry);
 	return true;
 }
 
-Vertex BoostMapper::addVertex(Measurement::Ptr m, const Transform &corrected)
+Vertex BoostMapper::insertVertex(IdType id, const std::string& label, Measurement::Ptr m, const Transform &corrected)
 {
+	ScopedTimer timer(mMetrics, "mapper.insert_vertex");
+
 	// Create the new VertexObject and add it to the PoseGraph
-	IdType id = mIndexer.getNext();
-	boost::format v_name("%1%:%2%(%3%)");
-	v_name % m->getRobotName() % m->getSensorName() % id;
 	Vertex newVertex = boost::add_vertex(mPoseGraph);
 	mPoseGraph[newVertex].index = id;
-	mPoseGraph[newVertex].label = v_name.str();
+	mPoseGraph[newVertex].label = label;
 	mPoseGraph[newVertex].corrected_pose = corrected;
 	mPoseGraph[newVertex].measurement = m;
 
 	// Add it to the indexes, so we can find it by its id and uuid
 	mIndexMap.insert(IndexMap::value_type(id, newVertex));
 	mVertexIndex.insert(UuidMap::value_type(m->getUniqueId(), newVertex));
+	mRevisionLog.push_back(EdgeKey(id, id, std::string(), std::string()));
+	mPayloadSizes[id] = m->getPayloadSize();
+	mMeasurementBytes += mPayloadSizes[id];
+	return newVertex;
+}
+
+Vertex BoostMapper::createVertex(Measurement::Ptr m, const Transform &corrected)
+{
+	IdType id = mIndexer.getNext();
+	boost::format v_name("%1%:%2%(%3%)");
+	v_name % m->getRobotName() % m->getSensorName() % id;
+	Vertex newVertex = insertVertex(id, v_name.str(), m, corrected);
+	
+	// Let the storage manage the measurement's memory
+	if(mMeasurementStorage)
+	{
+		mMeasurementStorage->add(m, corrected.translation());
+	}
+	
+	if(mJournal)
+	{
+		mJournal->addVertex(mPoseGraph[newVertex]);
+	}
+	return newVertex;
+}
+
+Vertex BoostMapper::addVertex(Measurement::Ptr m, const Transform &corrected)
+{
+	Vertex newVertex = createVertex(m, corrected);
+	IdType id = mPoseGraph[newVertex].index;
 	
 	// Add it to the SLAM-Backend for incremental optimization
 	if(mSolver)
@@ -305,13 +459,14 @@ Vertex BoostMapper::addVertex(Measurement::Ptr m, const Transform &corrected)
 		mSolver->addNode(id, corrected);
 	}
 	
-	mLogger->message(INFO, (boost::format("Created vertex %1% (from %2%:%3%).") % id % m->getRobotName() % m->getSensorName()).str());
+	SLAM3D_LOG(mLogger, INFO, (boost::format("Created vertex %1% (from %2%:%3%).") % id % m->getRobotName() % m->getSensorName()).str());
 	return newVertex;
 }
 
-void BoostMapper::addEdge(Vertex source, Vertex target,
+Edge BoostMapper::insertEdge(Vertex source, Vertex target,
 	const Transform &t, const Covariance &c, const std::string& sensor, const std::string& label)
 {
+	ScopedTimer timer(mMetrics, "mapper.insert_edge");
 	Edge forward_edge, inverse_edge;
 	bool inserted_forward, inserted_inverse;
 	boost::tie(forward_edge, inserted_forward) = boost::add_edge(source, target, mPoseGraph);
@@ -333,12 +488,33 @@ void BoostMapper::addEdge(Vertex source, Vertex target,
 	mPoseGraph[inverse_edge].label = label;
 	mPoseGraph[inverse_edge].source = target_id;
 	mPoseGraph[inverse_edge].target = source_id;
+	mRevisionLog.push_back(EdgeKey(source_id, target_id, sensor, label));
+	return forward_edge;
+}
+
+Edge BoostMapper::createEdge(Vertex source, Vertex target,
+	const Transform &t, const Covariance &c, const std::string& sensor, const std::string& label)
+{
+	Edge e = insertEdge(source, target, t, c, sensor, label);
+	if(mJournal)
+	{
+		mJournal->addEdge(mPoseGraph[e]);
+	}
+	return e;
+}
+
+void BoostMapper::addEdge(Vertex source, Vertex target,
+	const Transform &t, const Covariance &c, const std::string& sensor, const std::string& label)
+{
+	createEdge(source, target, t, c, sensor, label);
+	unsigned source_id = mPoseGraph[source].index;
+	unsigned target_id = mPoseGraph[target].index;
 	
 	if(mSolver)
 	{
 		mSolver->addConstraint(source_id, target_id, t, c);
 	}
-	mLogger->message(INFO, (boost::format("Created '%4%' edge from node %1% to node %2% (from %3%).") % source_id % target_id % sensor % label).str());
+	SLAM3D_LOG(mLogger, INFO, (boost::format("Created '%4%' edge from node %1% to node %2% (from %3%).") % source_id % target_id % sensor % label).str());
 }
 
 TransformWithCovariance BoostMapper::link(Vertex source, Vertex target, Sensor* sensor)
@@ -359,6 +535,10 @@ TransformWithCovariance BoostMapper::link(Vertex source, Vertex target, Sensor*
 	{
 		source_m = buildPatch(source, sensor);
 		target_m = buildPatch(target, sensor);
+	}else
+	{
+		loadMeasurement(source_m);
+		loadMeasurement(target_m);
 	}
 	
 	// Estimate the transform from source to target
@@ -373,209 +553,1405 @@ TransformWithCovariance BoostMapper::link(Vertex source, Vertex target, Sensor*
 
 Measurement::Ptr BoostMapper::buildPatch(Vertex source, Sensor* sensor)
 {
+	ScopedTimer timer(mMetrics, "mapper.build_patch");
 	VertexList vertices = getVerticesInRange(source, mPatchBuildingRange);
 	
 	VertexObjectList v_objects;
+	std::map<IdType, size_t> positions;
 	for(VertexList::iterator it = vertices.begin(); it != vertices.end(); ++it)
 	{
+		loadMeasurement(mPoseGraph[*it].measurement);
+		positions[mPoseGraph[*it].index] = v_objects.size();
 		v_objects.push_back(mPoseGraph[*it]);
 	}
 	
 	if(mPatchSolver)
 	{
-		mPatchSolver->clear();
-		for(VertexObjectList::iterator v = v_objects.begin(); v < v_objects.end(); v++)
-		{
-			mPatchSolver->addNode(v->index, v->corrected_pose);
-		}
-		
-		EdgeObjectList e_objects = getEdgeObjects(v_objects);
-		for(EdgeObjectList::iterator e = e_objects.begin(); e < e_objects.end(); e++)
-		{
-			mPatchSolver->addConstraint(e->source, e->target, e->transform, e->covariance);
-		}
-		
-		mPatchSolver->setFixed(mPoseGraph[source].index);
+		updatePatchWindow(vertices, source);
 		mPatchSolver->compute();
 		IdPoseVector res = mPatchSolver->getCorrections();
+		
+		// Nodes that stayed in the window may have drifted from the graph,
+		// so the result is aligned with the source vertex' pose in the graph.
+		Transform offset = Transform::Identity();
 		for(IdPoseVector::iterator it = res.begin(); it < res.end(); it++)
 		{
-			bool ok = false;
-			for(VertexObjectList::iterator v = v_objects.begin(); v < v_objects.end(); v++)
+			if(it->first == (int)mPoseGraph[source].index)
 			{
-				if(v->index == it->first)
-				{
-					v->corrected_pose = it->second;
-					ok = true;
-					break;
-				}
+				offset = mPoseGraph[source].corrected_pose * it->second.inverse();
+				break;
 			}
-			if(!ok)
+		}
+		
+		// The result also contains the nodes of the other window
+		for(IdPoseVector::iterator it = res.begin(); it < res.end(); it++)
+		{
+			std::map<IdType, size_t>::iterator p = positions.find(it->first);
+			if(p != positions.end())
 			{
-				mLogger->message(ERROR, "Could not apply patch-solver result, this is a bug!");
+				v_objects[p->second].corrected_pose = offset * it->second;
 			}
 		}
 	}
 	return sensor->createCombinedMeasurement(v_objects, mPoseGraph[source].corrected_pose);
 }
 
-void BoostMapper::addExternalReading(Measurement::Ptr m, boost::uuids::uuid s, const Transform& tf, const Covariance& cov, const std::string& sensor)
+void BoostMapper::updatePatchWindow(const VertexList& vertices, Vertex source)
 {
-	if(mVertexIndex.find(m->getUniqueId()) != mVertexIndex.end())
+	// Start over when a different solver has been set
+	if(mPatchWindowSolver != mPatchSolver)
 	{
-		throw DuplicateMeasurement();
+		mPatchSolver->clear();
+		mPatchWindowSolver = mPatchSolver;
+		mPatchWindows[0] = PatchWindow();
+		mPatchWindows[1] = PatchWindow();
+		mPatchNodes.clear();
+		mPatchEdges.clear();
 	}
 	
-	Vertex source = mVertexIndex.at(s);
-	Transform pose = mPoseGraph[source].corrected_pose * tf;
-	Vertex target = addVertex(m, pose);
-	addEdge(source, target, tf, cov, sensor, "ext");
-}
-
-void BoostMapper::addExternalConstraint(boost::uuids::uuid s, boost::uuids::uuid t, const Transform& tf, const Covariance& cov, const std::string& sensor)
-{
-	Vertex source = mVertexIndex.at(s);
-	Vertex target = mVertexIndex.at(t);
-	try
+	std::set<IdType> window;
+	for(VertexList::const_iterator v = vertices.begin(); v != vertices.end(); ++v)
 	{
-		IdType s_id = mPoseGraph[source].index;
-		IdType t_id = mPoseGraph[target].index;
-		getEdge(s_id, t_id, sensor);
-		throw DuplicateEdge(s_id, t_id, sensor);
-	}catch(InvalidEdge &ie)
+		window.insert(mPoseGraph[*v].index);
+	}
+	
+	// Reuse the window with the largest overlap or replace the least recently used one
+	size_t overlap[2] = {0, 0};
+	for(int i = 0; i < 2; i++)
 	{
-		addEdge(source, target, tf, cov, sensor, "ext");
+		for(std::set<IdType>::iterator n = mPatchWindows[i].nodes.begin(); n != mPatchWindows[i].nodes.end(); ++n)
+		{
+			if(window.find(*n) != window.end())
+				overlap[i]++;
+		}
 	}
-}
-										   
-void BoostMapper::linkToNeighbors(Vertex vertex, Sensor* sensor, int max_links)
-{
-	// Get all edges to/from this node
-	std::set<Vertex> previously_matched_vertices;
-	previously_matched_vertices.insert(vertex);
+	int current;
+	if(overlap[0] > 0 || overlap[1] > 0)
+		current = overlap[0] >= overlap[1] ? 0 : 1;
+	else
+		current = mPatchWindows[0].last_use <= mPatchWindows[1].last_use ? 0 : 1;
+	PatchWindow& patch = mPatchWindows[current];
+	PatchWindow& other = mPatchWindows[1 - current];
 	
-	OutEdgeIterator out_it, out_end;
-	boost::tie(out_it, out_end) = boost::out_edges(vertex, mPoseGraph);
-	for(; out_it != out_end; ++out_it)
+	// Windows must stay disjoint, so each has exactly one fixed node
+	if(overlap[1 - current] > 0)
 	{
-		if(mPoseGraph[*out_it].sensor == sensor->getName())
+		for(std::set<IdType>::iterator n = other.nodes.begin(); n != other.nodes.end(); ++n)
 		{
-			previously_matched_vertices.insert(boost::target(*out_it, mPoseGraph));
+			if(window.find(*n) == window.end())
+				removeFromPatchWindow(*n);
 		}
+		if(other.has_fixed && window.find(other.fixed) != window.end() && other.fixed != mPoseGraph[source].index)
+		{
+			mPatchSolver->unsetFixed(other.fixed);
+		}
+		other = PatchWindow();
 	}
 	
-	std::vector<Vertex> neighbors = getNearbyVertices(mPoseGraph[vertex].corrected_pose, mNeighborRadius);
+	// Remove nodes that left the window, their constraints are removed with them
+	for(std::set<IdType>::iterator n = patch.nodes.begin(); n != patch.nodes.end(); ++n)
+	{
+		if(window.find(*n) == window.end())
+		{
+			removeFromPatchWindow(*n);
+			if(patch.has_fixed && patch.fixed == *n)
+				patch.has_fixed = false;
+		}
+	}
+	patch.nodes = window;
+	patch.last_use = ++mPatchUseCount;
 	
-	int count = 0;
-	for(std::vector<Vertex>::iterator it = neighbors.begin(); it != neighbors.end() && count < max_links; ++it)
+	// Add new nodes, the others start from their previous solution
+	for(VertexList::const_iterator v = vertices.begin(); v != vertices.end(); ++v)
 	{
-		if(previously_matched_vertices.find(*it) != previously_matched_vertices.end())
-			continue;
-
-		try
+		if(mPatchNodes.insert(mPoseGraph[*v].index).second)
 		{
-			float dist = calculateGraphDistance(*it, vertex);
-			mLogger->message(DEBUG, (boost::format("Distance(%2%,%3%) in Graph is: %1%") % dist % mPoseGraph[*it].index % mPoseGraph[vertex].index).str());
-			if(dist < mPatchBuildingRange * 2)
+			mPatchSolver->addNode(mPoseGraph[*v].index, mPoseGraph[*v].corrected_pose);
+		}
+	}
+	
+	// Add new constraints, each edge is stored in both directions but added only once
+	for(VertexList::const_iterator v = vertices.begin(); v != vertices.end(); ++v)
+	{
+		OutEdgeIterator out_it, out_end;
+		boost::tie(out_it, out_end) = boost::out_edges(*v, mPoseGraph);
+		for(; out_it != out_end; ++out_it)
+		{
+			const EdgeObject& e = mPoseGraph[*out_it];
+			if(e.source > e.target || window.find(e.target) == window.end())
 				continue;
-			count++;
-			link(*it, vertex, sensor);
-//			optimize();
-		}catch(NoMatch &e)
+			if(mPatchEdges.insert(PatchEdge(e.source, e.target, e.sensor, e.label)).second)
+			{
+				mPatchSolver->addConstraint(e.source, e.target, e.transform, e.covariance);
+			}
+		}
+	}
+	
+	// Hold the source in place
+	IdType fixed = mPoseGraph[source].index;
+	if(!patch.has_fixed || patch.fixed != fixed)
+	{
+		if(patch.has_fixed)
 		{
-			mLogger->message(WARNING, (boost::format("Failed to match vertex %1% and %2%, because %3%.") % mPoseGraph[*it].index % mPoseGraph[vertex].index % e.what()).str());
-			continue;
+			mPatchSolver->unsetFixed(patch.fixed);
 		}
+		mPatchSolver->setFixed(fixed);
+		patch.fixed = fixed;
+		patch.has_fixed = true;
 	}
 }
 
-VertexObjectList BoostMapper::getVertexObjectsFromSensor(const std::string& sensor) const
+void BoostMapper::removeFromPatchWindow(IdType id)
 {
-	VertexObjectList objectList;
-	VertexRange vertices = boost::vertices(mPoseGraph);
-	for(VertexIterator it = vertices.first; it != vertices.second; ++it)
+	mPatchSolver->removeNode(id);
+	mPatchNodes.erase(id);
+	OutEdgeIterator out_it, out_end;
+	boost::tie(out_it, out_end) = boost::out_edges(mIndexMap.at(id), mPoseGraph);
+	for(; out_it != out_end; ++out_it)
 	{
-		if(mPoseGraph[*it].measurement->getSensorName() == sensor)
-		{
-			objectList.push_back(mPoseGraph[*it]);
-		}
+		const EdgeObject& e = mPoseGraph[*out_it];
+		mPatchEdges.erase(PatchEdge(std::min(e.source, e.target), std::max(e.source, e.target), e.sensor, e.label));
 	}
-	return objectList;
 }
 
-const VertexObject& BoostMapper::getVertex(IdType id) const
+void BoostMapper::removeVertex(Vertex vertex)
 {
-	return mPoseGraph[mIndexMap.at(id)];
+	detachVertex(vertex);
+	compactGraph();
 }
 
-const VertexObject& BoostMapper::getVertex(boost::uuids::uuid id) const
+void BoostMapper::detachVertex(Vertex vertex)
 {
-	return mPoseGraph[mVertexIndex.at(id)];
+	IdType id = mPoseGraph[vertex].index;
+	Measurement::Ptr m = mPoseGraph[vertex].measurement;
+	
+	// The patch solver must forget the node while its edges are still known
+	if(mPatchNodes.find(id) != mPatchNodes.end())
+	{
+		removeFromPatchWindow(id);
+	}
+	for(int i = 0; i < 2; i++)
+	{
+		mPatchWindows[i].nodes.erase(id);
+		if(mPatchWindows[i].has_fixed && mPatchWindows[i].fixed == id)
+			mPatchWindows[i].has_fixed = false;
+	}
+	
+	// Each edge is stored in both directions, so the incoming edges are found at the neighbors
+	std::set<Vertex> neighbors;
+	AdjacencyIterator n, n_end;
+	for(boost::tie(n, n_end) = boost::adjacent_vertices(vertex, mPoseGraph); n != n_end; ++n)
+	{
+		neighbors.insert(*n);
+	}
+	for(std::set<Vertex>::iterator it = neighbors.begin(); it != neighbors.end(); ++it)
+	{
+		boost::remove_edge(*it, vertex, mPoseGraph);
+	}
+	boost::clear_out_edges(vertex, mPoseGraph);
+	
+	mIndexMap.erase(id);
+	mVertexIndex.erase(m->getUniqueId());
+	std::map<IdType, size_t>::iterator payload = mPayloadSizes.find(id);
+	if(payload != mPayloadSizes.end())
+	{
+		mMeasurementBytes -= std::min(mMeasurementBytes, payload->second);
+		mPayloadSizes.erase(payload);
+	}
+	if(mMeasurementStorage)
+	{
+		mMeasurementStorage->remove(m);
+	}
+	mDetachedVertices.push_back(vertex);
 }
 
-const EdgeObject& BoostMapper::getEdge(IdType source, IdType target, const std::string& sensor) const
+void BoostMapper::compactGraph(VertexList* vertices)
 {
-	OutEdgeIterator it, it_end;
-	boost::tie(it, it_end) = boost::out_edges(mIndexMap.at(source), mPoseGraph);
-	while(it != it_end)
+	if(mDetachedVertices.empty())
+		return;
+	
+	std::vector<bool> detached(boost::num_vertices(mPoseGraph), false);
+	for(std::vector<Vertex>::iterator it = mDetachedVertices.begin(); it != mDetachedVertices.end(); ++it)
 	{
-		const VertexObject& tObject = mPoseGraph[boost::target(*it, mPoseGraph)];
-		if(tObject.index == target && mPoseGraph[*it].sensor == sensor)
+		detached[*it] = true;
+	}
+	mDetachedVertices.clear();
+	
+	// Vertices are stored in a vector and boost::remove_vertex shifts all
+	// later ones, so the graph is copied once instead of removing each vertex.
+	std::vector<Vertex> descriptor(detached.size(), 0);
+	AdjacencyGraph graph;
+	for(Vertex v = 0; v < detached.size(); v++)
+	{
+		if(detached[v])
+			continue;
+		descriptor[v] = boost::add_vertex(graph);
+		std::swap(graph[descriptor[v]], mPoseGraph[v]);
+	}
+	for(Vertex v = 0; v < detached.size(); v++)
+	{
+		OutEdgeIterator out_it, out_end;
+		for(boost::tie(out_it, out_end) = boost::out_edges(v, mPoseGraph); out_it != out_end; ++out_it)
 		{
-			return mPoseGraph[*it];
+			Edge e = boost::add_edge(descriptor[v], descriptor[boost::target(*out_it, mPoseGraph)], graph).first;
+			std::swap(graph[e], mPoseGraph[*out_it]);
 		}
-		++it;
 	}
-	throw InvalidEdge(source, target);
-}
-
-EdgeObjectList BoostMapper::getOutEdges(IdType source) const
-{
-	OutEdgeIterator it, it_end;
-	boost::tie(it, it_end) = boost::out_edges(mIndexMap.at(source), mPoseGraph);
-	EdgeObjectList edges;
-	while(it != it_end)
+	mPoseGraph.swap(graph);
+	
+	// Renumber all descriptors held by the mapper
+	for(IndexMap::iterator it = mIndexMap.begin(); it != mIndexMap.end(); ++it)
 	{
-		edges.push_back(mPoseGraph[*it]);
+		it->second = descriptor[it->second];
+	}
+	for(UuidMap::iterator it = mVertexIndex.begin(); it != mVertexIndex.end(); ++it)
+	{
+		it->second = descriptor[it->second];
+	}
+	for(IndexMap::iterator it = mNeighborMap.begin(); it != mNeighborMap.end();)
+	{
+		if(detached[it->second])
+		{
+			mNeighborMap.erase(it++);
+			continue;
+		}
+		it->second = descriptor[it->second];
 		++it;
 	}
-	return edges;
+	mLastVertex = detached[mLastVertex] ? 0 : descriptor[mLastVertex];
+	if(vertices)
+	{
+		VertexList kept;
+		kept.reserve(vertices->size());
+		for(VertexList::iterator v = vertices->begin(); v != vertices->end(); ++v)
+		{
+			if(!detached[*v])
+				kept.push_back(descriptor[*v]);
+		}
+		vertices->swap(kept);
+	}
 }
 
-EdgeObjectList BoostMapper::getEdgeObjects(const VertexObjectList& vertices)
+bool BoostMapper::marginalize(Vertex vertex)
 {
-	std::set<int> v_ids;
-	for(VertexObjectList::const_iterator v = vertices.begin(); v != vertices.end(); v++)
+	IdType id = mPoseGraph[vertex].index;
+	if(id == 0 || vertex == mLastVertex)
 	{
-		v_ids.insert(v->index);
+		SLAM3D_LOG(mLogger, WARNING, (boost::format("Vertex %1% cannot be removed.") % id).str());
+		return false;
 	}
-	EdgeObjectList objectList;
-	EdgeRange edges = boost::edges(mPoseGraph);
-	for(EdgeIterator it = edges.first; it != edges.second; ++it)
+	
+	// Collect all edges in the direction they have been added
+	Marginalization marginalization(mPoseGraph[vertex].corrected_pose);
+	OutEdgeIterator out_it, out_end;
+	for(boost::tie(out_it, out_end) = boost::out_edges(vertex, mPoseGraph); out_it != out_end; ++out_it)
 	{
-		EdgeObject ed = mPoseGraph[*it];
-		if(v_ids.find(ed.source) != v_ids.end() && v_ids.find(ed.target) != v_ids.end())
-			objectList.push_back(ed);
+		Vertex neighbor = boost::target(*out_it, mPoseGraph);
+		if(neighbor == vertex)
+			continue;
+		const EdgeObject& e = mPoseGraph[*out_it];
+		if(e.source < e.target)
+		{
+			marginalization.addConstraint(e.target, mPoseGraph[neighbor].corrected_pose, e.transform, e.covariance, false);
+		}else
+		{
+			marginalization.addConstraint(e.target, mPoseGraph[neighbor].corrected_pose, e.transform.inverse(), e.covariance, true);
+		}
 	}
-	return objectList;
-}
-
-void BoostMapper::writeGraphToFile(const std::string& name)
-{
-	std::string file = name + ".dot";
-	mLogger->message(INFO, (boost::format("Writing graph to file '%1%'.") % file).str());
-	std::ofstream ofs;
-	ofs.open(file.c_str());
-	boost::write_graphviz(
-			ofs,
-			mPoseGraph,
-			boost::make_label_writer(boost::get(&VertexObject::label, mPoseGraph)),
-			boost::make_label_writer(boost::get(&EdgeObject::label, mPoseGraph)),
-			boost::default_writer(),
+	
+	MarginalConstraintList constraints;
+	if(!marginalization.computeChowLiuTree(constraints))
+	{
+		SLAM3D_LOG(mLogger, WARNING, (boost::format("Marginal of vertex %1% is degenerated, it is kept in the graph.") % id).str());
+		return false;
+	}
+	
+	// The solver is asked first, so nothing is changed if it cannot remove nodes
+	if(mSolver)
+	{
+		try
+		{
+			mSolver->removeNode(id);
+		}catch(Solver::UnsupportedOperation &e)
+		{
+			SLAM3D_LOG(mLogger, WARNING, (boost::format("Vertex %1% is kept in the graph: %2%") % id % e.what()).str());
+			return false;
+		}
+	}
+	std::string sensor = mPoseGraph[vertex].measurement->getSensorName();
+	detachVertex(vertex);
+	if(mJournal)
+	{
+		mJournal->removeVertex(id);
+	}
+	
+	std::string label = (boost::format("marginal(%1%)") % id).str();
+	for(MarginalConstraintList::iterator c = constraints.begin(); c != constraints.end(); ++c)
+	{
+		addEdge(mIndexMap.at(c->source), mIndexMap.at(c->target), c->transform, c->covariance, sensor, label);
+	}
+	SLAM3D_LOG(mLogger, INFO, (boost::format("Marginalized vertex %1% into %2% edges between %3% neighbors.")
+		% id % constraints.size() % marginalization.getNumberOfNeighbors()).str());
+	return true;
+}
+
+bool BoostMapper::marginalizeVertex(IdType id)
+{
+	ScopedTimer timer(mMetrics, "mapper.marginalize");
+	Vertex vertex = mIndexMap.at(id);
+	std::string sensor = mPoseGraph[vertex].measurement->getSensorName();
+	if(!marginalize(vertex))
+	{
+		return false;
+	}
+	compactGraph();
+	buildNeighborIndex(sensor);
+	updateMemoryStats();
+	return true;
+}
+
+unsigned BoostMapper::sparsify(const std::string& sensor, float radius)
+{
+	ScopedTimer timer(mMetrics, "mapper.sparsify");
+	buildNeighborIndex(sensor);
+	
+	// Keep the oldest vertex in each area, vertices are ordered by id
+	VertexList vertices = getVerticesFromSensor(sensor);
+	std::set<IdType> removed;
+	for(VertexList::iterator v = vertices.begin(); v != vertices.end(); ++v)
+	{
+		if(removed.find(mPoseGraph[*v].index) != removed.end())
+			continue;
+		VertexList nearby = getNearbyVertices(mPoseGraph[*v].corrected_pose, radius);
+		for(VertexList::iterator n = nearby.begin(); n != nearby.end(); ++n)
+		{
+			if(mPoseGraph[*n].index > mPoseGraph[*v].index && *n != mLastVertex)
+				removed.insert(mPoseGraph[*n].index);
+		}
+	}
+	
+	// Vertices are only detached, so the graph is compacted once at the end
+	unsigned count = 0;
+	for(std::set<IdType>::iterator id = removed.begin(); id != removed.end(); ++id)
+	{
+		if(marginalize(mIndexMap.at(*id)))
+			count++;
+	}
+	compactGraph();
+	buildNeighborIndex(sensor);
+	updateMemoryStats();
+	timer.addValue("removed", count);
+	SLAM3D_LOG(mLogger, INFO, (boost::format("Sparsification removed %1% of %2% vertices from sensor '%3%'.")
+		% count % vertices.size() % sensor).str());
+	return count;
+}
+
+void BoostMapper::addExternalReading(Measurement::Ptr m, boost::uuids::uuid s, const Transform& tf, const Covariance& cov, const std::string& sensor)
+{
+	if(mVertexIndex.find(m->getUniqueId()) != mVertexIndex.end())
+	{
+		throw DuplicateMeasurement();
+	}
+	
+	Vertex source = mVertexIndex.at(s);
+	Transform pose = mPoseGraph[source].corrected_pose * tf;
+	Vertex target = addVertex(m, pose);
+	addEdge(source, target, tf, cov, sensor, "ext");
+}
+
+void BoostMapper::addExternalConstraint(boost::uuids::uuid s, boost::uuids::uuid t, const Transform& tf, const Covariance& cov, const std::string& sensor)
+{
+	Vertex source = mVertexIndex.at(s);
+	Vertex target = mVertexIndex.at(t);
+	if(hasEdge(source, target, sensor))
+	{
+		throw DuplicateEdge(mPoseGraph[source].index, mPoseGraph[target].index, sensor);
+	}
+	addEdge(source, target, tf, cov, sensor, "ext");
+}
+
+ImportResult BoostMapper::addExternalReadings(const ExternalReadingList& readings)
+{
+	ScopedTimer timer(mMetrics, "mapper.add_external_readings");
+	ImportResult result;
+	
+	// Skip measurements that are already known, the batch itself might contain duplicates
+	std::unordered_map<boost::uuids::uuid, size_t, boost::hash<boost::uuids::uuid> > batch;
+	batch.reserve(readings.size());
+	std::vector<size_t> pending;
+	pending.reserve(readings.size());
+	for(size_t i = 0; i < readings.size(); i++)
+	{
+		const boost::uuids::uuid& id = readings[i].measurement->getUniqueId();
+		if(mVertexIndex.find(id) != mVertexIndex.end() || !batch.insert(std::make_pair(id, i)).second)
+		{
+			result.duplicates++;
+			continue;
+		}
+		pending.push_back(i);
+	}
+	
+	// Insert in temporal order, so a sequence usually finds its sources in the first pass
+	std::stable_sort(pending.begin(), pending.end(), [&readings](size_t a, size_t b)
+	{
+		timeval ta = readings[a].measurement->getTimestamp();
+		timeval tb = readings[b].measurement->getTimestamp();
+		return ta.tv_sec < tb.tv_sec || (ta.tv_sec == tb.tv_sec && ta.tv_usec < tb.tv_usec);
+	});
+	
+	std::vector<Vertex> new_vertices;
+	EdgeObjectList new_edges;
+	new_vertices.reserve(pending.size());
+	new_edges.reserve(pending.size());
+	while(!pending.empty())
+	{
+		std::vector<size_t> deferred;
+		for(std::vector<size_t>::iterator i = pending.begin(); i != pending.end(); ++i)
+		{
+			const ExternalReading& r = readings[*i];
+			UuidMap::iterator source = mVertexIndex.find(r.source);
+			if(source == mVertexIndex.end())
+			{
+				// The source might still be added from this batch
+				if(batch.find(r.source) != batch.end())
+					deferred.push_back(*i);
+				else
+					result.unresolved++;
+				continue;
+			}
+			Transform pose = mPoseGraph[source->second].corrected_pose * r.transform;
+			Vertex target = createVertex(r.measurement, pose);
+			Edge e = createEdge(source->second, target, r.transform, r.covariance, r.sensor, "ext");
+			new_vertices.push_back(target);
+			new_edges.push_back(mPoseGraph[e]);
+			result.added++;
+		}
+		
+		// Readings that only refer to each other can never be linked
+		if(deferred.size() == pending.size())
+		{
+			result.unresolved += deferred.size();
+			break;
+		}
+		pending.swap(deferred);
+	}
+	
+	addToSolver(new_vertices, new_edges);
+	SLAM3D_LOG(mLogger, INFO, (boost::format("Added %1% external readings (%2% duplicates, %3% unresolved).")
+		% result.added % result.duplicates % result.unresolved).str());
+	return result;
+}
+
+ImportResult BoostMapper::addExternalConstraints(const ExternalConstraintList& constraints)
+{
+	ScopedTimer timer(mMetrics, "mapper.add_external_constraints");
+	ImportResult result;
+	EdgeObjectList new_edges;
+	new_edges.reserve(constraints.size());
+	for(ExternalConstraintList::const_iterator c = constraints.begin(); c != constraints.end(); ++c)
+	{
+		UuidMap::iterator source = mVertexIndex.find(c->source);
+		UuidMap::iterator target = mVertexIndex.find(c->target);
+		if(source == mVertexIndex.end() || target == mVertexIndex.end())
+		{
+			result.unresolved++;
+			continue;
+		}
+		if(hasEdge(source->second, target->second, c->sensor))
+		{
+			result.duplicates++;
+			continue;
+		}
+		Edge e = createEdge(source->second, target->second, c->transform, c->covariance, c->sensor, "ext");
+		new_edges.push_back(mPoseGraph[e]);
+		result.added++;
+	}
+	
+	addToSolver(std::vector<Vertex>(), new_edges);
+	SLAM3D_LOG(mLogger, INFO, (boost::format("Added %1% external constraints (%2% duplicates, %3% unresolved).")
+		% result.added % result.duplicates % result.unresolved).str());
+	return result;
+}
+
+unsigned BoostMapper::getRevision() const
+{
+	return mRevisionLog.size();
+}
+
+void BoostMapper::exportSince(unsigned revision, ExternalReadingList& readings, ExternalConstraintList& constraints) const
+{
+	ScopedTimer timer(mMetrics, "mapper.export");
+	readings.clear();
+	constraints.clear();
+	
+	// Export each vertex linked to its newest older neighbor, these
+	// edges must not be exported a second time as constraints
+	std::set<EdgeKey> links;
+	for(size_t i = revision; i < mRevisionLog.size(); i++)
+	{
+		IdType id = std::get<0>(mRevisionLog[i]);
+		if(id != std::get<1>(mRevisionLog[i]))
+			continue;
+		IndexMap::const_iterator vertex = mIndexMap.find(id);
+		if(vertex == mIndexMap.end())
+			continue;
+		
+		OutEdgeIterator it, it_end, link;
+		bool linked = false;
+		IdType link_id = 0;
+		for(boost::tie(it, it_end) = boost::out_edges(vertex->second, mPoseGraph); it != it_end; ++it)
+		{
+			IdType neighbor = mPoseGraph[boost::target(*it, mPoseGraph)].index;
+			if(neighbor < id && (!linked || neighbor > link_id))
+			{
+				link = it;
+				link_id = neighbor;
+				linked = true;
+			}
+		}
+		if(!linked)
+		{
+			SLAM3D_LOG(mLogger, WARNING, (boost::format("Vertex %1% has no older neighbor and is not exported.") % id).str());
+			continue;
+		}
+		
+		// The edge is stored from the vertex to its source, so the reading uses the inverse
+		const EdgeObject& edge = mPoseGraph[*link];
+		ExternalReading reading;
+		reading.measurement = mPoseGraph[vertex->second].measurement;
+		loadMeasurement(reading.measurement);
+		reading.source = mPoseGraph[boost::target(*link, mPoseGraph)].measurement->getUniqueId();
+		reading.transform = edge.transform.inverse();
+		reading.covariance = edge.covariance;
+		reading.sensor = edge.sensor;
+		readings.push_back(reading);
+		links.insert(EdgeKey(link_id, id, edge.sensor, edge.label));
+	}
+	
+	for(size_t i = revision; i < mRevisionLog.size(); i++)
+	{
+		const EdgeKey& key = mRevisionLog[i];
+		IdType source_id = std::get<0>(key);
+		IdType target_id = std::get<1>(key);
+		if(source_id == target_id)
+			continue;
+		if(links.find(EdgeKey(std::min(source_id, target_id), std::max(source_id, target_id), std::get<2>(key), std::get<3>(key))) != links.end())
+			continue;
+		IndexMap::const_iterator source = mIndexMap.find(source_id);
+		IndexMap::const_iterator target = mIndexMap.find(target_id);
+		if(source == mIndexMap.end() || target == mIndexMap.end())
+			continue;
+		
+		OutEdgeIterator it, it_end;
+		for(boost::tie(it, it_end) = boost::out_edges(source->second, mPoseGraph); it != it_end; ++it)
+		{
+			const EdgeObject& edge = mPoseGraph[*it];
+			if(boost::target(*it, mPoseGraph) == target->second && edge.sensor == std::get<2>(key) && edge.label == std::get<3>(key))
+			{
+				ExternalConstraint constraint;
+				constraint.source = mPoseGraph[source->second].measurement->getUniqueId();
+				constraint.target = mPoseGraph[target->second].measurement->getUniqueId();
+				constraint.transform = edge.transform;
+				constraint.covariance = edge.covariance;
+				constraint.sensor = edge.sensor;
+				constraints.push_back(constraint);
+				break;
+			}
+		}
+	}
+	SLAM3D_LOG(mLogger, DEBUG, (boost::format("Exported %1% readings and %2% constraints since revision %3%.")
+		% readings.size() % constraints.size() % revision).str());
+}
+										   
+void BoostMapper::linkToNeighbors(Vertex vertex, Sensor* sensor, int max_links)
+{
+	// Get all edges to/from this node
+	std::set<Vertex> previously_matched_vertices;
+	previously_matched_vertices.insert(vertex);
+	
+	OutEdgeIterator out_it, out_end;
+	boost::tie(out_it, out_end) = boost::out_edges(vertex, mPoseGraph);
+	for(; out_it != out_end; ++out_it)
+	{
+		if(mPoseGraph[*out_it].sensor == sensor->getName())
+		{
+			previously_matched_vertices.insert(boost::target(*out_it, mPoseGraph));
+		}
+	}
+	
+	std::vector<Vertex> neighbors;
+	if(mSearchSigma <= 0 || !getOverlapCandidates(vertex, neighbors))
+	{
+		neighbors = getNearbyVertices(mPoseGraph[vertex].corrected_pose, mNeighborRadius);
+	}
+	
+	int count = 0;
+	for(std::vector<Vertex>::iterator it = neighbors.begin(); it != neighbors.end() && count < max_links; ++it)
+	{
+		if(previously_matched_vertices.find(*it) != previously_matched_vertices.end())
+			continue;
+
+		try
+		{
+			float dist = calculateGraphDistance(*it, vertex);
+			SLAM3D_LOG(mLogger, DEBUG, (boost::format("Distance(%2%,%3%) in Graph is: %1%") % dist % mPoseGraph[*it].index % mPoseGraph[vertex].index).str());
+			if(dist < mPatchBuildingRange * 2)
+				continue;
+			count++;
+			link(*it, vertex, sensor);
+//			optimize();
+		}catch(NoMatch &e)
+		{
+			if(mMetrics)
+				mMetrics->increment("mapper.match_failures");
+			SLAM3D_LOG(mLogger, WARNING, (boost::format("Failed to match vertex %1% and %2%, because %3%.") % mPoseGraph[*it].index % mPoseGraph[vertex].index % e.what()).str());
+			continue;
+		}
+	}
+}
+
+void BoostMapper::propagateCovariance(const Transform& tf, const Covariance& cov)
+{
+	Vector6 inverse_scale = errorScale().cwiseInverse();
+	Matrix6 adj = adjoint(tf.inverse());
+	mDeadReckoningCovariance = adj * mDeadReckoningCovariance * adj.transpose()
+		+ inverse_scale.asDiagonal() * cov * inverse_scale.asDiagonal();
+}
+
+Covariance BoostMapper::getOdometryCovariance(const Transform& odom_dist, const timeval& stamp)
+{
+	try
+	{
+		return mOdometry->getRelativePose(mPoseGraph[mLastVertex].measurement->getTimestamp(), stamp).covariance;
+	}catch(OdometryException &e)
+	{
+		return mOdometry->calculateCovariance(odom_dist);
+	}
+}
+
+bool BoostMapper::getOverlapCandidates(Vertex vertex, VertexList& candidates)
+{
+	ScopedTimer timer(mMetrics, "mapper.overlap_candidates");
+	Vector6 inverse_scale = errorScale().cwiseInverse();
+	const Transform& pose = mPoseGraph[vertex].corrected_pose;
+	
+	// Marginal of the new vertex to size the search region
+	Covariance reference_cov;
+	Vertex reference;
+	try
+	{
+		reference = mIndexMap.at(mCovarianceReference);
+		if(!mSolver || !mSolver->getMarginalCovariance(mCovarianceReference, reference_cov))
+			return false;
+	}catch(std::exception& e)
+	{
+		return false;
+	}
+	Transform reference_to_vertex = mPoseGraph[reference].corrected_pose.inverse() * pose;
+	Matrix6 to_vertex = adjoint(reference_to_vertex.inverse());
+	Matrix6 marginal = to_vertex * inverse_scale.asDiagonal() * reference_cov * inverse_scale.asDiagonal() * to_vertex.transpose()
+		+ mDeadReckoningCovariance;
+	Eigen::SelfAdjointEigenSolver<Eigen::Matrix<ScalarType,3,3> > eigen(marginal.topLeftCorner<3,3>());
+	float sigma = std::sqrt(std::max<ScalarType>(eigen.eigenvalues().maxCoeff(), 0));
+	float radius = std::min(mNeighborRadius + mSearchSigma * sigma, std::max(mMaxSearchRadius, mNeighborRadius));
+	VertexList nearby = getNearbyVertices(pose, radius);
+	
+	// Let the solver compute the covariances of all candidates at once
+	std::vector<std::pair<unsigned, unsigned> > pairs;
+	pairs.reserve(nearby.size());
+	for(VertexList::iterator c = nearby.begin(); c != nearby.end(); ++c)
+	{
+		pairs.push_back(std::make_pair(mPoseGraph[*c].index, mCovarianceReference));
+	}
+	mSolver->prepareRelativeCovariances(pairs);
+	
+	std::vector<std::pair<double, Vertex> > ranked;
+	ranked.reserve(nearby.size());
+	for(VertexList::iterator c = nearby.begin(); c != nearby.end(); ++c)
+	{
+		Transform relative = mPoseGraph[*c].corrected_pose.inverse() * pose;
+		double distance = relative.translation().norm();
+		
+		// Covariance of the relative pose from the candidate to the new vertex
+		Covariance candidate_cov;
+		bool known;
+		try
+		{
+			known = mSolver->getRelativeCovariance(mPoseGraph[*c].index, mCovarianceReference, candidate_cov);
+		}catch(Solver::UnknownVertex& e)
+		{
+			known = false;
+		}
+		if(!known)
+		{
+			if(distance <= mNeighborRadius)
+				ranked.push_back(std::make_pair(1.0, *c));
+			continue;
+		}
+		Matrix6 relative_cov = to_vertex * inverse_scale.asDiagonal() * candidate_cov * inverse_scale.asDiagonal() * to_vertex.transpose()
+			+ mDeadReckoningCovariance;
+		
+		// Probability that the candidate is within the radius along the line of sight
+		double probability;
+		Eigen::Matrix<ScalarType,3,3> position_cov = relative.linear() * relative_cov.topLeftCorner<3,3>() * relative.linear().transpose();
+		double variance = distance > 0 ? relative.translation().dot(position_cov * relative.translation()) / (distance * distance) : 0;
+		if(variance > 0)
+		{
+			probability = 0.5 * std::erfc((distance - mNeighborRadius) / std::sqrt(2 * variance));
+		}else
+		{
+			probability = distance <= mNeighborRadius ? 1.0 : 0.0;
+		}
+		if(probability >= mMinOverlapProbability)
+			ranked.push_back(std::make_pair(probability, *c));
+	}
+	std::stable_sort(ranked.begin(), ranked.end(),
+		[](const std::pair<double, Vertex>& a, const std::pair<double, Vertex>& b){ return a.first > b.first; });
+	
+	candidates.clear();
+	for(std::vector<std::pair<double, Vertex> >::iterator r = ranked.begin(); r != ranked.end(); ++r)
+		candidates.push_back(r->second);
+	timer.addValue("radius", radius);
+	timer.addValue("candidates", candidates.size());
+	timer.addValue("rejected", nearby.size() - candidates.size());
+	return true;
+}
+
+VertexObjectList BoostMapper::getVertexObjectsFromSensor(const std::string& sensor) const
+{
+	VertexObjectList objectList;
+	VertexRange vertices = boost::vertices(mPoseGraph);
+	for(VertexIterator it = vertices.first; it != vertices.second; ++it)
+	{
+		if(mPoseGraph[*it].measurement->getSensorName() == sensor)
+		{
+			loadMeasurement(mPoseGraph[*it].measurement);
+			objectList.push_back(mPoseGraph[*it]);
+		}
+	}
+	return objectList;
+}
+
+const VertexObject& BoostMapper::getVertex(IdType id) const
+{
+	const VertexObject& v = mPoseGraph[mIndexMap.at(id)];
+	loadMeasurement(v.measurement);
+	return v;
+}
+
+const VertexObject& BoostMapper::getVertex(boost::uuids::uuid id) const
+{
+	const VertexObject& v = mPoseGraph[mVertexIndex.at(id)];
+	loadMeasurement(v.measurement);
+	return v;
+}
+
+const VertexObject& BoostMapper::getLastVertex() const
+{
+	loadMeasurement(mPoseGraph[mLastVertex].measurement);
+	return mPoseGraph[mLastVertex];
+}
+
+const EdgeObject& BoostMapper::getEdge(IdType source, IdType target, const std::string& sensor) const
+{
+	OutEdgeIterator it, it_end;
+	boost::tie(it, it_end) = boost::out_edges(mIndexMap.at(source), mPoseGraph);
+	while(it != it_end)
+	{
+		const VertexObject& tObject = mPoseGraph[boost::target(*it, mPoseGraph)];
+		if(tObject.index == target && mPoseGraph[*it].sensor == sensor)
+		{
+			return mPoseGraph[*it];
+		}
+		++it;
+	}
+	throw InvalidEdge(source, target);
+}
+
+EdgeObjectList BoostMapper::getOutEdges(IdType source) const
+{
+	OutEdgeIterator it, it_end;
+	boost::tie(it, it_end) = boost::out_edges(mIndexMap.at(source), mPoseGraph);
+	EdgeObjectList edges;
+	while(it != it_end)
+	{
+		edges.push_back(mPoseGraph[*it]);
+		++it;
+	}
+	return edges;
+}
+
+EdgeObjectList BoostMapper::getEdgeObjects(const VertexObjectList& vertices)
+{
+	std::set<int> v_ids;
+	for(VertexObjectList::const_iterator v = vertices.begin(); v != vertices.end(); v++)
+	{
+		v_ids.insert(v->index);
+	}
+	EdgeObjectList objectList;
+	EdgeRange edges = boost::edges(mPoseGraph);
+	for(EdgeIterator it = edges.first; it != edges.second; ++it)
+	{
+		EdgeObject ed = mPoseGraph[*it];
+		if(v_ids.find(ed.source) != v_ids.end() && v_ids.find(ed.target) != v_ids.end())
+			objectList.push_back(ed);
+	}
+	return objectList;
+}
+
+void BoostMapper::writeGraphToFile(const std::string& name)
+{
+	std::string file = name + ".dot";
+	SLAM3D_LOG(mLogger, INFO, (boost::format("Writing graph to file '%1%'.") % file).str());
+	std::ofstream ofs;
+	ofs.open(file.c_str());
+	boost::write_graphviz(
+			ofs,
+			mPoseGraph,
+			boost::make_label_writer(boost::get(&VertexObject::label, mPoseGraph)),
+			boost::make_label_writer(boost::get(&EdgeObject::label, mPoseGraph)),
+			boost::default_writer(),
 			boost::get(&VertexObject::index, mPoseGraph));
 	ofs.close();
 }
 
+// ================================================================
+// Binary session format
+// ================================================================
+// The file starts with a fixed size header, followed by the payloads of
+// all measurements. The vertex and edge tables are written at the end,
+// so that measurements can be evicted again while the file is written.
+
+#define SESSION_MAGIC "SLAM3DSN"
+#define SESSION_VERSION 1
+#define SESSION_HEADER_SIZE 148
+
+struct SessionHeader
+{
+	uint64_t vertices;
+	uint64_t edges;
+	uint64_t vertex_table;
+	uint64_t edge_table;
+	uint32_t next_id;
+	uint32_t last_vertex;
+	Transform last_odometric_pose;
+};
+
+static void writeSessionHeader(std::vector<char>& buffer, const SessionHeader& header)
+{
+	BinaryWriter writer(buffer);
+	writer.writeBytes(SESSION_MAGIC, 8);
+	writer.write<uint32_t>(SESSION_VERSION);
+	writer.write<uint64_t>(header.vertices);
+	writer.write<uint64_t>(header.edges);
+	writer.write<uint64_t>(header.vertex_table);
+	writer.write<uint64_t>(header.edge_table);
+	writer.write<uint32_t>(header.next_id);
+	writer.write<uint32_t>(header.last_vertex);
+	writer.writeTransform(header.last_odometric_pose);
+}
+
+static SessionHeader readSessionHeader(BinaryReader& reader)
+{
+	if(memcmp(reader.skip(8), SESSION_MAGIC, 8) != 0)
+	{
+		throw SerializationError("File is not a session file!");
+	}
+	uint32_t version = reader.read<uint32_t>();
+	if(version != SESSION_VERSION)
+	{
+		throw SerializationError((boost::format("Unsupported session version %1%!") % version).str());
+	}
+	SessionHeader header;
+	header.vertices = reader.read<uint64_t>();
+	header.edges = reader.read<uint64_t>();
+	header.vertex_table = reader.read<uint64_t>();
+	header.edge_table = reader.read<uint64_t>();
+	header.next_id = reader.read<uint32_t>();
+	header.last_vertex = reader.read<uint32_t>();
+	header.last_odometric_pose = reader.readTransform();
+	return header;
+}
+
+bool BoostMapper::saveSession(const std::string& filename)
+{
+	std::ofstream file(filename.c_str(), std::ios::binary | std::ios::trunc);
+	if(!file.is_open())
+	{
+		SLAM3D_LOG(mLogger, ERROR, (boost::format("Could not open session file '%1%'.") % filename).str());
+		return false;
+	}
+	SLAM3D_LOG(mLogger, INFO, (boost::format("Writing session to file '%1%'.") % filename).str());
+	
+	// Reserve space for the header, it is written when all offsets are known
+	SessionHeader header;
+	header.next_id = mIndexer.peekNext();
+	header.last_vertex = mLastVertex ? mPoseGraph[mLastVertex].index : 0;
+	header.last_odometric_pose = mLastOdometricPose;
+	file.write(std::string(SESSION_HEADER_SIZE, 0).data(), SESSION_HEADER_SIZE);
+	uint64_t offset = SESSION_HEADER_SIZE;
+	
+	// Write the payloads of all measurements
+	std::vector<uint64_t> payload_offsets;
+	std::vector<uint64_t> payload_sizes;
+	std::vector<char> buffer;
+	Vector3 position = getCurrentPose().translation();
+	VertexRange vertices = boost::vertices(mPoseGraph);
+	for(VertexIterator it = vertices.first; it != vertices.second; ++it)
+	{
+		Measurement::Ptr m = mPoseGraph[*it].measurement;
+		loadMeasurement(m);
+		size_t size = m->getPayloadSize();
+		buffer.resize(size);
+		if(size > 0)
+		{
+			m->writePayload(&buffer[0]);
+			file.write(&buffer[0], size);
+		}
+		payload_offsets.push_back(offset);
+		payload_sizes.push_back(size);
+		offset += size;
+		if(mMeasurementStorage)
+		{
+			mMeasurementStorage->enforceBudget(position);
+		}
+	}
+
+	// Write the vertex table (without the root node)
+	header.vertex_table = offset;
+	header.vertices = 0;
+	unsigned i = 0;
+	for(VertexIterator it = vertices.first; it != vertices.second; ++it, ++i)
+	{
+		const VertexObject& v = mPoseGraph[*it];
+		if(v.index == 0)
+			continue;
+		
+		buffer.clear();
+		BinaryWriter writer(buffer);
+		writer.write<uint32_t>(v.index);
+		writer.writeString(v.label);
+		writer.writeUuid(v.measurement->getUniqueId());
+		writer.writeString(v.measurement->getRobotName());
+		writer.writeString(v.measurement->getSensorName());
+		writer.writeTimestamp(v.measurement->getTimestamp());
+		writer.writeTransform(v.measurement->getSensorPose());
+		writer.writeTransform(v.corrected_pose);
+		writer.write<uint64_t>(payload_offsets[i]);
+		writer.write<uint64_t>(payload_sizes[i]);
+		file.write(&buffer[0], buffer.size());
+		offset += buffer.size();
+		header.vertices++;
+	}
+	
+	// Write the edge table, the inverse edges are restored on loading
+	header.edge_table = offset;
+	header.edges = 0;
+	EdgeRange edges = boost::edges(mPoseGraph);
+	for(EdgeIterator it = edges.first; it != edges.second; ++it)
+	{
+		const EdgeObject& e = mPoseGraph[*it];
+		if(e.source > e.target)
+			continue;
+		
+		buffer.clear();
+		BinaryWriter writer(buffer);
+		writer.write<uint32_t>(e.source);
+		writer.write<uint32_t>(e.target);
+		writer.writeTransform(e.transform);
+		writer.writeCovariance(e.covariance);
+		writer.writeString(e.sensor);
+		writer.writeString(e.label);
+		file.write(&buffer[0], buffer.size());
+		offset += buffer.size();
+		header.edges++;
+	}
+	
+	// Now write the header
+	buffer.clear();
+	writeSessionHeader(buffer, header);
+	assert(buffer.size() == SESSION_HEADER_SIZE);
+	file.seekp(0);
+	file.write(&buffer[0], buffer.size());
+	file.close();
+	
+	if(file.fail())
+	{
+		SLAM3D_LOG(mLogger, ERROR, (boost::format("Failed to write session file '%1%'.") % filename).str());
+		return false;
+	}
+	SLAM3D_LOG(mLogger, INFO, (boost::format("Wrote session with %1% vertices and %2% edges (%3% bytes).")
+		% header.vertices % header.edges % offset).str());
+	return true;
+}
+
+bool BoostMapper::loadSession(const std::string& filename)
+{
+	if(boost::num_vertices(mPoseGraph) > 1)
+	{
+		SLAM3D_LOG(mLogger, ERROR, "A session can only be loaded into an empty map!");
+		return false;
+	}
+	
+	std::vector<Vertex> new_vertices;
+	EdgeObjectList new_edges;
+	try
+	{
+		boost::shared_ptr<MappedFile> file(new MappedFile(filename, false));
+		BinaryReader reader(file->data(), file->size());
+		SessionHeader header = readSessionHeader(reader);
+		
+		// Restore the vertices and their measurements
+		reader.seek(header.vertex_table);
+		new_vertices.reserve(header.vertices);
+		for(uint64_t n = 0; n < header.vertices; n++)
+		{
+			IdType id = reader.read<uint32_t>();
+			std::string label = reader.readString();
+			boost::uuids::uuid uuid = reader.readUuid();
+			std::string robot = reader.readString();
+			std::string sensor_name = reader.readString();
+			timeval stamp = reader.readTimestamp();
+			Transform sensor_pose = reader.readTransform();
+			Transform corrected = reader.readTransform();
+			uint64_t payload_offset = reader.read<uint64_t>();
+			uint64_t payload_size = reader.read<uint64_t>();
+			if(payload_offset + payload_size > file->size())
+			{
+				throw SerializationError("Payload exceeds the session file!");
+			}
+			
+			Measurement::Ptr m;
+			SensorList::iterator s = mSensors.find(sensor_name);
+			if(s != mSensors.end())
+			{
+				m = s->second->createMeasurement(robot, uuid, stamp, sensor_pose);
+				if(mMeasurementStorage)
+				{
+					mMeasurementStorage->addMapped(m, corrected.translation(), file, payload_offset, payload_size);
+				}else if(payload_size > 0)
+				{
+					m->readPayload(file->data() + payload_offset, payload_size);
+				}
+			}else
+			{
+				SLAM3D_LOG(mLogger, WARNING, (boost::format("Sensor '%1%' has not been registered, data of vertex %2% is not restored.")
+					% sensor_name % id).str());
+				m.reset(new Measurement(robot, sensor_name, sensor_pose, uuid, stamp));
+			}
+			new_vertices.push_back(insertVertex(id, label, m, corrected));
+		}
+		
+		// Restore the edges
+		reader.seek(header.edge_table);
+		new_edges.reserve(header.edges);
+		for(uint64_t n = 0; n < header.edges; n++)
+		{
+			IdType source = reader.read<uint32_t>();
+			IdType target = reader.read<uint32_t>();
+			Transform tf = reader.readTransform();
+			Covariance cov = reader.readCovariance();
+			std::string sensor_name = reader.readString();
+			std::string label = reader.readString();
+			Edge e = insertEdge(mIndexMap.at(source), mIndexMap.at(target), tf, cov, sensor_name, label);
+			new_edges.push_back(mPoseGraph[e]);
+		}
+		
+		mIndexer.setNext(header.next_id);
+		mLastVertex = header.last_vertex ? mIndexMap.at(header.last_vertex) : 0;
+		mLastOdometricPose = header.last_odometric_pose;
+	}catch(FileMappingError &e)
+	{
+		SLAM3D_LOG(mLogger, ERROR, (boost::format("Could not load session: %1%") % e.what()).str());
+		return false;
+	}catch(SerializationError &e)
+	{
+		SLAM3D_LOG(mLogger, ERROR, (boost::format("Could not load session: %1%") % e.what()).str());
+		return false;
+	}catch(std::out_of_range &e)
+	{
+		SLAM3D_LOG(mLogger, ERROR, "Could not load session: Edge refers to unknown vertex!");
+		return false;
+	}
+	
+	// Pass the complete graph to the solver
+	addToSolver(new_vertices, new_edges);
+	if(mLastVertex)
+	{
+		publishCurrentPose(mPoseGraph[mLastVertex].measurement->getTimestamp(), mLastOdometricPose);
+	}
+	SLAM3D_LOG(mLogger, INFO, (boost::format("Loaded session with %1% vertices and %2% edges from '%3%'.")
+		% new_vertices.size() % new_edges.size() % filename).str());
+	return true;
+}
+
+void BoostMapper::addToSolver(const std::vector<Vertex>& vertices, const EdgeObjectList& edges)
+{
+	if(!mSolver)
+		return;
+	
+	for(std::vector<Vertex>::const_iterator v = vertices.begin(); v != vertices.end(); ++v)
+	{
+		mSolver->addNode(mPoseGraph[*v].index, mPoseGraph[*v].corrected_pose);
+	}
+	for(EdgeObjectList::const_iterator e = edges.begin(); e != edges.end(); ++e)
+	{
+		mSolver->addConstraint(e->source, e->target, e->transform, e->covariance);
+	}
+}
+
+bool BoostMapper::hasEdge(Vertex source, Vertex target, const std::string& sensor, const std::string& label) const
+{
+	OutEdgeIterator it, it_end;
+	for(boost::tie(it, it_end) = boost::out_edges(source, mPoseGraph); it != it_end; ++it)
+	{
+		if(boost::target(*it, mPoseGraph) == target && mPoseGraph[*it].sensor == sensor && mPoseGraph[*it].label == label)
+			return true;
+	}
+	return false;
+}
+
+unsigned BoostMapper::updatePoses(const UuidPoseVector& poses)
+{
+	IdPoseVector updated;
+	updated.reserve(poses.size());
+	for(UuidPoseVector::const_iterator p = poses.begin(); p != poses.end(); ++p)
+	{
+		UuidMap::iterator v = mVertexIndex.find(p->first);
+		if(v == mVertexIndex.end())
+			continue;
+		mPoseGraph[v->second].corrected_pose = p->second;
+		if(mMeasurementStorage)
+		{
+			mMeasurementStorage->setPosition(mPoseGraph[v->second].measurement, p->second.translation());
+		}
+		updated.push_back(IdPose(mPoseGraph[v->second].index, p->second));
+		
+		// The solver continues from the new pose instead of its own estimate
+		if(mSolver && !mFullHandOff)
+		{
+			try
+			{
+				mSolver->setPose(updated.back().first, p->second);
+			}catch(Solver::UnsupportedOperation &e)
+			{
+				mFullHandOff = true;
+			}catch(Solver::UnknownVertex &e)
+			{
+			}
+		}
+	}
+	if(mJournal && !updated.empty())
+	{
+		mJournal->addPoses(updated);
+	}
+	if(!updated.empty())
+	{
+		republishCurrentPose();
+	}
+	return updated.size();
+}
+
+bool BoostMapper::hasEdge(Vertex source, Vertex target, const std::string& sensor) const
+{
+	OutEdgeIterator it, it_end;
+	for(boost::tie(it, it_end) = boost::out_edges(source, mPoseGraph); it != it_end; ++it)
+	{
+		if(boost::target(*it, mPoseGraph) == target && mPoseGraph[*it].sensor == sensor)
+			return true;
+	}
+	return false;
+}
+
+bool BoostMapper::replayJournal(const std::string& filename)
+{
+	std::vector<Vertex> new_vertices;
+	EdgeObjectList new_edges;
+	std::set<IdType> removed_ids;
+	Vertex first_new = boost::num_vertices(mPoseGraph);
+	unsigned skipped = 0;
+	try
+	{
+		JournalReader journal(filename);
+		JournalRecordType type;
+		const char* data;
+		size_t size;
+		while(journal.next(type, data, size))
+		{
+			BinaryReader reader(data, size);
+			switch(type)
+			{
+			case JOURNAL_VERTEX:
+			{
+				IdType id = reader.read<uint32_t>();
+				std::string label = reader.readString();
+				boost::uuids::uuid uuid = reader.readUuid();
+				std::string robot = reader.readString();
+				std::string sensor_name = reader.readString();
+				timeval stamp = reader.readTimestamp();
+				Transform sensor_pose = reader.readTransform();
+				Transform corrected = reader.readTransform();
+				uint64_t payload_size = reader.read<uint64_t>();
+				
+				if(mVertexIndex.find(uuid) != mVertexIndex.end())
+				{
+					skipped++;
+					break;
+				}
+				if(mIndexMap.find(id) != mIndexMap.end())
+				{
+					throw SerializationError((boost::format("Vertex id %1% is already used by another measurement!") % id).str());
+				}
+				
+				Measurement::Ptr m;
+				SensorList::iterator s = mSensors.find(sensor_name);
+				if(s != mSensors.end())
+				{
+					m = s->second->createMeasurement(robot, uuid, stamp, sensor_pose);
+					if(payload_size > 0)
+					{
+						m->readPayload(reader.skip(payload_size), payload_size);
+					}
+				}else
+				{
+					m.reset(new Measurement(robot, sensor_name, sensor_pose, uuid, stamp));
+				}
+				if(mMeasurementStorage)
+				{
+					mMeasurementStorage->add(m, corrected.translation());
+				}
+				new_vertices.push_back(insertVertex(id, label, m, corrected));
+				if(id >= mIndexer.peekNext())
+				{
+					mIndexer.setNext(id + 1);
+				}
+				break;
+			}
+			case JOURNAL_EDGE:
+			{
+				IdType source_id = reader.read<uint32_t>();
+				IdType target_id = reader.read<uint32_t>();
+				Transform tf = reader.readTransform();
+				Covariance cov = reader.readCovariance();
+				std::string sensor_name = reader.readString();
+				std::string label = reader.readString();
+				
+				Vertex source = mIndexMap.at(source_id);
+				Vertex target = mIndexMap.at(target_id);
+				if(hasEdge(source, target, sensor_name, label))
+				{
+					skipped++;
+					break;
+				}
+				Edge e = insertEdge(source, target, tf, cov, sensor_name, label);
+				new_edges.push_back(mPoseGraph[e]);
+				break;
+			}
+			case JOURNAL_POSES:
+			{
+				uint32_t count = reader.read<uint32_t>();
+				for(uint32_t n = 0; n < count; n++)
+				{
+					IdType id = reader.read<uint32_t>();
+					Transform pose = reader.readTransform();
+					IndexMap::iterator v = mIndexMap.find(id);
+					if(v != mIndexMap.end())
+					{
+						mPoseGraph[v->second].corrected_pose = pose;
+					}
+				}
+				mOptimized = true;
+				break;
+			}
+			case JOURNAL_REMOVAL:
+			{
+				IdType id = reader.read<uint32_t>();
+				IndexMap::iterator v = mIndexMap.find(id);
+				if(v == mIndexMap.end())
+				{
+					skipped++;
+					break;
+				}
+				
+				// Vertices from this journal are not in the solver yet
+				if(v->second < first_new && mSolver)
+				{
+					try
+					{
+						mSolver->removeNode(id);
+					}catch(Solver::UnsupportedOperation &e)
+					{
+						SLAM3D_LOG(mLogger, WARNING, (boost::format("Vertex %1% is kept in the graph: %2%") % id % e.what()).str());
+						skipped++;
+						break;
+					}
+				}
+				
+				// The graph is compacted once after all records
+				removed_ids.insert(id);
+				detachVertex(v->second);
+				break;
+			}
+			case JOURNAL_STATE:
+			{
+				IdType last_vertex = reader.read<uint32_t>();
+				mLastOdometricPose = reader.readTransform();
+				mLastVertex = mIndexMap.at(last_vertex);
+				break;
+			}
+			default:
+				SLAM3D_LOG(mLogger, WARNING, (boost::format("Skipping unknown journal record of type %1%.") % (int)type).str());
+			}
+		}
+		
+		if(journal.isTruncated())
+		{
+			SLAM3D_LOG(mLogger, WARNING, "Journal ends with an incomplete record, which has been ignored.");
+		}
+	}catch(FileMappingError &e)
+	{
+		SLAM3D_LOG(mLogger, ERROR, (boost::format("Could not replay journal: %1%") % e.what()).str());
+		compactGraph();
+		return false;
+	}catch(SerializationError &e)
+	{
+		SLAM3D_LOG(mLogger, ERROR, (boost::format("Could not replay journal: %1%") % e.what()).str());
+		compactGraph();
+		return false;
+	}catch(std::out_of_range &e)
+	{
+		SLAM3D_LOG(mLogger, ERROR, "Could not replay journal: Record refers to unknown vertex!");
+		compactGraph();
+		return false;
+	}
+	
+	// Remove the vertices of all removal records at once
+	compactGraph(&new_vertices);
+	if(!removed_ids.empty())
+	{
+		new_edges.erase(std::remove_if(new_edges.begin(), new_edges.end(), [&removed_ids](const EdgeObject& e)
+			{ return removed_ids.count(e.source) > 0 || removed_ids.count(e.target) > 0; }), new_edges.end());
+	}
+	
+	// Update the storage with the final poses of the restored vertices
+	if(mMeasurementStorage)
+	{
+		for(std::vector<Vertex>::iterator v = new_vertices.begin(); v != new_vertices.end(); ++v)
+		{
+			mMeasurementStorage->setPosition(mPoseGraph[*v].measurement, mPoseGraph[*v].corrected_pose.translation());
+		}
+	}
+	
+	addToSolver(new_vertices, new_edges);
+	if(mLastVertex)
+	{
+		publishCurrentPose(mPoseGraph[mLastVertex].measurement->getTimestamp(), mLastOdometricPose);
+	}
+	SLAM3D_LOG(mLogger, INFO, (boost::format("Replayed %1% vertices and %2% edges from journal '%3%' (%4% records already in the map).")
+		% new_vertices.size() % new_edges.size() % filename % skipped).str());
+	return true;
+}
+
 // ================================================================
 // BFS search for vertices with a maximum distance to a source node
 // ================================================================
@@ -648,7 +2024,10 @@ VertexList BoostMapper::getVerticesInRange(Vertex source, unsigned range)
 
 float BoostMapper::calculateGraphDistance(Vertex source, Vertex target)
 {
+	ScopedTimer timer(mMetrics, "mapper.graph_distance");
 	int num = boost::num_vertices(mPoseGraph);
+	if(mMetrics)
+		mMetrics->increment("mapper.graph_distance_vertices", num);
 	std::vector<Vertex> parent(num);
 	std::vector<float> distance(num);
 	std::map<Edge, float> weight;
@@ -5,8 +5,12 @@
 
 #include <boost/graph/adjacency_list.hpp>
 #include <boost/graph/graphviz.hpp>
+#include <boost/functional/hash.hpp>
 #include <flann/flann.hpp>
 
+#include <tuple>
+#include <unordered_map>
+
 namespace slam3d
 {
 	// Definitions of boost-graph related types
@@ -35,7 +39,13 @@ namespace slam3d
 	// Index types
 	typedef flann::Index< flann::L2<float> > NeighborIndex;
 	typedef std::map<IdType, Vertex> IndexMap;
-	typedef std::map<boost::uuids::uuid, Vertex> UuidMap;
+	typedef std::unordered_map<boost::uuids::uuid, Vertex, boost::hash<boost::uuids::uuid> > UuidMap;
+	
+	// Edge in the graph (source, target, sensor, label)
+	typedef std::tuple<IdType, IdType, std::string, std::string> EdgeKey;
+	
+	// Constraint in the patch solver
+	typedef EdgeKey PatchEdge;
 	
 	/**
 	 * @class BoostMapper
@@ -93,13 +103,61 @@ namespace slam3d
 		                           const Transform& relative_pose,
 		                           const Covariance& covariance,
 		                           const std::string& sensor);
+		
+		/**
+		 * @brief Add many measurements from other robots at once.
+		 * @details In contrast to calling addExternalReading for each element,
+		 * the readings are passed to the solver in a single step. They are
+		 * inserted in the order of their timestamps and may refer to other
+		 * readings in the same batch. Readings that are already in the graph
+		 * or whose source cannot be found are skipped instead of throwing.
+		 * @param readings measurements with their link to a source measurement
+		 * @return number of added and skipped readings
+		 */
+		ImportResult addExternalReadings(const ExternalReadingList& readings);
+		
+		/**
+		 * @brief Add many constraints from other robots at once.
+		 * @details Constraints that already exist or that refer to unknown
+		 * measurements are skipped instead of throwing.
+		 * @param constraints constraints between measurements
+		 * @return number of added and skipped constraints
+		 */
+		ImportResult addExternalConstraints(const ExternalConstraintList& constraints);
+		
+		/**
+		 * @brief Get the revision of the graph.
+		 * @details The revision is increased with every vertex and edge that
+		 * is added to the graph.
+		 */
+		unsigned getRevision() const;
+		
+		/**
+		 * @brief Export all vertices and edges added after the given revision.
+		 * @details Each vertex is exported as a reading linked to its newest
+		 * neighbor with a smaller id, which is either older than the revision
+		 * or exported before it. All other edges are exported as constraints.
+		 * @param revision revision as returned by getRevision, 0 for the whole graph
+		 * @param readings receives the new vertices
+		 * @param constraints receives the new edges
+		 */
+		void exportSince(unsigned revision, ExternalReadingList& readings, ExternalConstraintList& constraints) const;
+		
+		/**
+		 * @brief Set the poses of measurements, e.g. as optimized by another robot.
+		 * @details The solver keeps its own estimate, so the poses are replaced
+		 * again by the next optimization. Unknown measurements are ignored.
+		 * @param poses poses in map coordinates by the measurements' uuids
+		 * @return number of updated vertices
+		 */
+		unsigned updatePoses(const UuidPoseVector& poses);
 										   
 		/**
 		 * @brief Get the last vertex, that was locally added to the graph.
 		 * @details This will not return external vertices from other robots.
 		 * @return last added vertex
 		 */
-		const VertexObject& getLastVertex() const { return mPoseGraph[mLastVertex]; }
+		const VertexObject& getLastVertex() const;
 		
 		/**
 		 * @brief Start the backend optimization process.
@@ -108,6 +166,32 @@ namespace slam3d
 		 */
 		bool optimize();
 		
+		/**
+		 * @brief Start the backend optimization with limited iterations and duration.
+		 * @param budget maximum iterations and duration of the optimization
+		 * @return true if optimization was successful
+		 */
+		bool optimize(const OptimizationBudget& budget);
+		
+		/**
+		 * @brief Remove a vertex and replace its edges with a Chow-Liu tree.
+		 * @details See Marginalization for how the new edges are computed.
+		 * They are labeled "marginal(id)" and belong to the sensor of the
+		 * removed vertex, so patches are still built across the gap.
+		 * @param id identifier of the vertex
+		 * @return true if the vertex has been removed
+		 * @throw std::out_of_range
+		 */
+		bool marginalizeVertex(IdType id);
+		
+		/**
+		 * @brief Reduce the map to one vertex per area.
+		 * @param sensor name of the sensor whose vertices are reduced
+		 * @param radius minimum distance between the remaining vertices
+		 * @return number of removed vertices
+		 */
+		unsigned sparsify(const std::string& sensor, float radius);
+		
 		/**
 		 * @brief Gets a vertex object by its given id.
 		 * @param id
@@ -173,8 +257,148 @@ namespace slam3d
 		 */
 		void writeGraphToFile(const std::string &name);
 		
-	private:
+		/**
+		 * @brief Save the complete map to a binary session file.
+		 * @details The session contains all vertices and edges together
+		 * with the meta information and data of all measurements.
+		 * @param filename name of the session file
+		 * @return true if the session was written successfully
+		 */
+		bool saveSession(const std::string& filename);
+		
+		/**
+		 * @brief Restore a map from a binary session file.
+		 * @details The file is mapped into memory and the graph is inserted
+		 * in bulk into the mapper and the solver, so both have to be set up
+		 * (including all sensors) before calling this. If a MeasurementStorage
+		 * is used, the sensor data stays in the file until it is needed.
+		 * The mapper must not contain any measurements yet.
+		 * @param filename name of the session file
+		 * @return true if the session was loaded successfully
+		 */
+		bool loadSession(const std::string& filename);
+		
+		/**
+		 * @brief Restore all changes that have been recorded in a journal.
+		 * @details Vertices and edges that already exist in the graph are
+		 * skipped, so the journal can be replayed on top of a session that
+		 * was saved while the journal was running. New vertices and edges are
+		 * passed to the solver in bulk after the journal has been read.
+		 * Replay stops at the first incomplete record, which is expected
+		 * if the journal was not closed properly.
+		 * @param filename name of the journal file
+		 * @return true if the journal was replayed successfully
+		 */
+		bool replayJournal(const std::string& filename);
+		
+	protected:
 	
+		/**
+		 * @brief Inserts a vertex into the graph and its indexes.
+		 * @details In contrast to addVertex, this does not add the vertex to
+		 * the solver or the measurement storage.
+		 * @param id identifier of the new vertex
+		 * @param label description to be added to this vertex
+		 * @param m measurement to be attached to the vertex
+		 * @param corrected pose of the vertex in map coordinates
+		 * @return descriptor of the new vertex
+		 */
+		Vertex insertVertex(IdType id,
+		                    const std::string& label,
+		                    Measurement::Ptr m,
+		                    const Transform &corrected);
+
+		/**
+		 * @brief Inserts an edge and its inverse into the graph.
+		 * @details In contrast to addEdge, this does not add the edge to the solver.
+		 * @param source descriptor of source vertex
+		 * @param target descriptor of target vertex
+		 * @param t transformation from source to target
+		 * @param c covariance of transformation
+		 * @param sensor name of the sensor that created this edge
+		 * @param label description to be added to this edge
+		 * @return descriptor of the edge from source to target
+		 */
+		Edge insertEdge(Vertex source,
+		                Vertex target,
+		                const Transform &t,
+		                const Covariance &c,
+		                const std::string &sensor,
+		                const std::string &label);
+
+		/**
+		 * @brief Passes vertices and edges that were inserted in bulk to the solver.
+		 * @param vertices list of new vertices
+		 * @param edges list of new edges
+		 */
+		void addToSolver(const std::vector<Vertex>& vertices, const EdgeObjectList& edges);
+
+		/**
+		 * @brief Check if an edge from a sensor exists between two vertices.
+		 * @param source descriptor of source vertex
+		 * @param target descriptor of target vertex
+		 * @param sensor name of the sensor that created the edge
+		 * @param label label of the edge
+		 */
+		bool hasEdge(Vertex source, Vertex target, const std::string& sensor, const std::string& label) const;
+		
+		/**
+		 * @brief Check if an edge from a sensor exists between two vertices, regardless of its label.
+		 * @param source descriptor of source vertex
+		 * @param target descriptor of target vertex
+		 * @param sensor name of the sensor that created the edge
+		 */
+		bool hasEdge(Vertex source, Vertex target, const std::string& sensor) const;
+		
+		/**
+		 * @brief Removes a vertex and its edges from the graph and all indexes.
+		 * @details In contrast to marginalizeVertex, this neither changes the
+		 * solver nor adds new edges. The neighbor index has to be rebuilt
+		 * afterwards. Vertices are stored in a vector, so all descriptors
+		 * behind the removed one are shifted down by one. The indexes owned
+		 * by the mapper are updated, descriptors held elsewhere become invalid.
+		 * @param vertex descriptor of the vertex
+		 */
+		void removeVertex(Vertex vertex);
+		
+		/**
+		 * @brief Removes the edges of a vertex and drops it from all indexes.
+		 * @details The vertex itself stays in the graph without edges until
+		 * compactGraph() is called, so all descriptors remain valid. This
+		 * allows to remove many vertices with a single compaction.
+		 * @param vertex descriptor of the vertex
+		 */
+		void detachVertex(Vertex vertex);
+		
+		/**
+		 * @brief Removes all detached vertices from the graph.
+		 * @details The graph is rebuilt once, which takes linear time in the
+		 * number of vertices and edges regardless of how many vertices are
+		 * removed. The indexes owned by the mapper are renumbered.
+		 * @param vertices optional descriptors held by the caller, they are
+		 * renumbered as well and detached ones are dropped
+		 */
+		void compactGraph(VertexList* vertices = NULL);
+		
+		/**
+		 * @brief Replaces a vertex by a Chow-Liu tree of its marginal.
+		 * @details The vertex is only detached, compactGraph() and a rebuild
+		 * of the neighbor index have to follow.
+		 * @param vertex descriptor of the vertex
+		 * @return true if the vertex has been removed
+		 */
+		bool marginalize(Vertex vertex);
+
+		/**
+		 * @brief Adds a new vertex to the graph, the measurement storage and the journal.
+		 * @details In contrast to addVertex, this does not add the vertex to the solver.
+		 * @param m measurement to be attached to the vertex
+		 * @param corrected initial pose of the vertex in map coordinates
+		 * @return descriptor of the new vertex
+		 */
+		Vertex createVertex(Measurement::Ptr m,
+		                    const Transform &corrected);
+
 		/**
 		 * @brief Adds a new vertex to the graph.
 		 * @param m measurement to be attached to the vertex
@@ -184,6 +408,24 @@ namespace slam3d
 		Vertex addVertex(Measurement::Ptr m,
 		                 const Transform &corrected);
 
+		/**
+		 * @brief Adds a new edge to the graph and the journal.
+		 * @details In contrast to addEdge, this does not add the edge to the solver.
+		 * @param source descriptor of source vertex
+		 * @param target descriptor of target vertex
+		 * @param t transformation from source to target
+		 * @param c covariance of transformation
+		 * @param sensor name of the sensor that created this edge
+		 * @param label description to be added to this edge
+		 * @return descriptor of the edge from source to target
+		 */
+		Edge createEdge(Vertex source,
+		                Vertex target,
+		                const Transform &t,
+		                const Covariance &c,
+		                const std::string &sensor,
+		                const std::string &label);
+
 		/**
 		 * @brief Adds a new edge to the graph.
 		 * @param source descriptor of source vertex
@@ -219,6 +461,35 @@ namespace slam3d
 		 */
 		void linkToNeighbors(Vertex vertex, Sensor* sensor, int max_links);
 		
+		/**
+		 * @brief Get nearby vertices ordered by the probability of an overlap.
+		 * @details The relative covariance of each candidate to the vertex is
+		 * taken from the solver up to the reference vertex of the last
+		 * optimization and from the dead-reckoning covariance beyond it.
+		 * Candidates whose covariance is not known to the solver yet are
+		 * kept if they are within the neighbor radius.
+		 * @param vertex the newest vertex, whose sequential constraint has been propagated
+		 * @param candidates receives the candidates, most probable first
+		 * @return false if the solver does not provide covariances
+		 */
+		bool getOverlapCandidates(Vertex vertex, VertexList& candidates);
+		
+		/**
+		 * @brief Add a sequential constraint to the dead-reckoning covariance.
+		 * @param tf transformation from the last vertex to the new vertex
+		 * @param cov covariance of the transformation
+		 */
+		void propagateCovariance(const Transform& tf, const Covariance& cov);
+		
+		/**
+		 * @brief Get the covariance of the odometric motion since the last vertex.
+		 * @details Uses the relative pose from the odometry, so it can integrate
+		 * its own noise model, and falls back to the simple motion model.
+		 * @param odom_dist odometric transformation from the last vertex
+		 * @param stamp time of the new measurement
+		 */
+		Covariance getOdometryCovariance(const Transform& odom_dist, const timeval& stamp);
+		
 		/**
 		 * @brief Gets a list with all vertices from a given sensor.
 		 * @param sensor name of the sensor which vertices are requested
@@ -272,7 +543,30 @@ namespace slam3d
 		 */
 		Measurement::Ptr buildPatch(Vertex source, Sensor* sensor);
 		
-	private:
+		/**
+		 * @brief Updates the patch solver to contain the given vertices.
+		 * @details The patch solver keeps its nodes between calls. Only nodes
+		 * that left the window are removed and new nodes and constraints are
+		 * added, so the optimization starts from the previous solution.
+		 * As link() alternates between patches around both vertices, two
+		 * disjoint windows with their own fixed vertex are kept in the solver.
+		 * @param vertices vertices of the new patch
+		 * @param source vertex to be held fixed
+		 */
+		void updatePatchWindow(const VertexList& vertices, Vertex source);
+		
+		/**
+		 * @brief Removes a node and its constraints from the patch solver.
+		 */
+		void removeFromPatchWindow(IdType id);
+		
+		/**
+		 * @brief Adds the memory used by measurements, graph and indexes.
+		 * @param usage map of categories to be filled
+		 */
+		void getMemoryUsage(MemoryUsageMap& usage) const;
+		
+	protected:
 		// The boost graph object
 		AdjacencyGraph mPoseGraph;
 		Indexer mIndexer;
@@ -286,12 +580,49 @@ namespace slam3d
 		flann::SearchParams mSearchParams;
 		NeighborIndex mNeighborIndex;
 		IndexMap mNeighborMap;
+		std::vector<float> mNeighborPoints;
 
 		// Index to find Vertices by their unique id
 		UuidMap mVertexIndex;
 		
+		// Every vertex and edge in the order they have been added, the index
+		// is the revision. Vertices are logged with source and target equal.
+		std::vector<EdgeKey> mRevisionLog;
+		
+		// Current content of the patch solver
+		struct PatchWindow
+		{
+			PatchWindow() : fixed(0), has_fixed(false), last_use(0) {}
+			std::set<IdType> nodes;
+			IdType fixed;
+			bool has_fixed;
+			unsigned last_use;
+		};
+		Solver* mPatchWindowSolver;
+		PatchWindow mPatchWindows[2];
+		unsigned mPatchUseCount;
+		std::set<IdType> mPatchNodes;
+		std::set<PatchEdge> mPatchEdges;
+		
 		// Some special vertices
 		Vertex mLastVertex;
+		
+		// Covariance of the last vertex relative to the last vertex of the
+		// previous optimization, for increments applied from the right
+		IdType mCovarianceReference;
+		Covariance mDeadReckoningCovariance;
+		
+		// Payload of all measurements added to the graph, and of each
+		// vertex as it was when added, because payloads can be evicted
+		size_t mMeasurementBytes;
+		std::map<IdType, size_t> mPayloadSizes;
+		
+		// Vertices without edges that wait for compactGraph()
+		std::vector<Vertex> mDetachedVertices;
+		
+		// The solver did not accept the poses of updatePoses(), so the next
+		// optimization applies all of its poses instead of the changed ones
+		bool mFullHandOff;
 	};
 }
 
@@ -0,0 +1,285 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "BufferedOdometry.hpp"
+#include "Linearization.hpp"
+
+#include <boost/format.hpp>
+
+#include <cmath>
+
+using namespace slam3d;
+
+static int64_t toMicroseconds(const timeval& stamp)
+{
+	return (int64_t)stamp.tv_sec * 1000000 + stamp.tv_usec;
+}
+
+// Interpolate along the screw motion from the identity to tf
+static Transform interpolate(const Transform& tf, ScalarType alpha)
+{
+	Transform result = Transform::Identity();
+	Eigen::AngleAxis<ScalarType> rotation(tf.linear());
+	ScalarType angle = rotation.angle();
+	if(angle < 1e-9)
+	{
+		result.translation() = alpha * tf.translation();
+		return result;
+	}
+	
+	// The translation of exp((v, w)) is V(w) * v, so v is recovered from the
+	// translation of tf and scaled together with the rotation angle.
+	Eigen::Matrix<ScalarType,3,3> K = skew(rotation.axis());
+	Eigen::Matrix<ScalarType,3,3> V = Eigen::Matrix<ScalarType,3,3>::Identity()
+		+ ((1 - std::cos(angle)) / angle) * K + ((angle - std::sin(angle)) / angle) * K * K;
+	Vector3 v = V.inverse() * tf.translation();
+	
+	ScalarType partial = alpha * angle;
+	if(partial < 1e-9)
+	{
+		result.translation() = alpha * v;
+		return result;
+	}
+	Eigen::Matrix<ScalarType,3,3> Vp = Eigen::Matrix<ScalarType,3,3>::Identity()
+		+ ((1 - std::cos(partial)) / partial) * K + ((partial - std::sin(partial)) / partial) * K * K;
+	result.linear() = Eigen::AngleAxis<ScalarType>(partial, rotation.axis()).toRotationMatrix();
+	result.translation() = Vp * (alpha * v);
+	return result;
+}
+
+// Propagate the covariance of a relative pose by another motion
+static void propagate(Matrix6& cov, const Transform& motion, const Covariance& noise)
+{
+	Matrix6 adj = adjoint(motion.inverse());
+	cov = adj * cov * adj.transpose() + noise;
+}
+
+BufferedOdometry::BufferedOdometry(Logger* logger, const BufferedOdometryConfiguration& config)
+ : Odometry(logger), mConfig(config), mHead(0)
+{
+	// Use a power of two, so the position can be masked instead of divided
+	size_t size = 2;
+	while(size < (size_t)config.capacity + 1)
+		size *= 2;
+	mSlots = std::vector<Slot, Eigen::aligned_allocator<Slot> >(size);
+	mMask = size - 1;
+	for(size_t i = 0; i < size; i++)
+	{
+		mSlots[i].sequence.store(0, std::memory_order_relaxed);
+	}
+	mLast.time = 0;
+	mLast.pose = Transform::Identity();
+	mLast.noise = Covariance::Zero();
+}
+
+bool BufferedOdometry::addSample(const timeval& stamp, const Transform& pose, const Covariance& noise)
+{
+	size_t position = mHead.load(std::memory_order_relaxed);
+	Sample sample;
+	sample.time = toMicroseconds(stamp);
+	sample.pose = pose;
+	if(position > 0)
+	{
+		if(sample.time <= mLast.time)
+		{
+			SLAM3D_LOG(mLogger, WARNING, (boost::format("Rejected odometry sample at %1%.%2$06d, which is not newer than the previous one.")
+				% stamp.tv_sec % stamp.tv_usec).str());
+			return false;
+		}
+		Vector6 inverse_scale = errorScale().cwiseInverse();
+		sample.noise = inverse_scale.asDiagonal() * noise * inverse_scale.asDiagonal();
+	}else
+	{
+		sample.noise = Covariance::Zero();
+	}
+	
+	Slot& slot = mSlots[position & mMask];
+	slot.sequence.store(2 * position + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.sample = sample;
+	slot.sequence.store(2 * position + 2, std::memory_order_release);
+	mHead.store(position + 1, std::memory_order_release);
+	mLast = sample;
+	return true;
+}
+
+bool BufferedOdometry::addSample(const timeval& stamp, const Transform& pose)
+{
+	if(mHead.load(std::memory_order_relaxed) == 0)
+	{
+		return addSample(stamp, pose, Covariance::Zero());
+	}
+	return addSample(stamp, pose, calculateCovariance(mLast.pose.inverse() * pose));
+}
+
+bool BufferedOdometry::readSample(size_t position, Sample& sample) const
+{
+	const Slot& slot = mSlots[position & mMask];
+	size_t sequence = slot.sequence.load(std::memory_order_acquire);
+	if(sequence != 2 * position + 2)
+		return false;
+	sample = slot.sample;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return slot.sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+BufferedOdometry::Sample BufferedOdometry::lookup(int64_t time, size_t* position) const
+{
+	// Restart whenever a sample has been overwritten during the search
+	while(true)
+	{
+		size_t head = mHead.load(std::memory_order_acquire);
+		if(head == 0)
+			throw OdometryException();
+		size_t low = head > mMask ? head - mMask : 0;
+		size_t high = head - 1;
+		
+		Sample lower, upper;
+		if(!readSample(low, lower) || !readSample(high, upper))
+			continue;
+		if(time < lower.time || time > upper.time)
+			throw OdometryException();
+		if(time == upper.time)
+		{
+			low = high;
+			lower = upper;
+		}
+		
+		// Binary search for lower.time <= time < upper.time
+		bool valid = true;
+		while(valid && high - low > 1)
+		{
+			size_t middle = low + (high - low) / 2;
+			Sample sample;
+			if(!readSample(middle, sample))
+			{
+				valid = false;
+			}else if(sample.time <= time)
+			{
+				low = middle;
+				lower = sample;
+			}else
+			{
+				high = middle;
+				upper = sample;
+			}
+		}
+		if(!valid)
+			continue;
+		if(position)
+			*position = low;
+		if(time == lower.time)
+		{
+			lower.noise.setZero();
+			return lower;
+		}
+		
+		// Interpolate the pose and the part of the upper sample's noise
+		ScalarType alpha = (ScalarType)(time - lower.time) / (upper.time - lower.time);
+		Sample result;
+		result.time = time;
+		result.pose = lower.pose * interpolate(lower.pose.inverse() * upper.pose, alpha);
+		result.noise = alpha * upper.noise;
+		return result;
+	}
+}
+
+Transform BufferedOdometry::getOdometricPose(timeval stamp)
+{
+	return lookup(toMicroseconds(stamp)).pose;
+}
+
+TransformWithCovariance BufferedOdometry::getRelativePose(timeval last, timeval next)
+{
+	int64_t source_time = toMicroseconds(last);
+	int64_t target_time = toMicroseconds(next);
+	bool forward = target_time >= source_time;
+	int64_t first_time = forward ? source_time : target_time;
+	int64_t second_time = forward ? target_time : source_time;
+	
+	// Restart whenever a sample has been overwritten during the walk
+	while(true)
+	{
+		size_t first_position, second_position;
+		Sample first = lookup(first_time, &first_position);
+		Sample second = lookup(second_time, &second_position);
+		
+		// Compose the noise of all samples between both points in time,
+		// instead of subtracting the large covariances relative to the
+		// first sample, which would cancel out most significant digits.
+		Matrix6 cov = Matrix6::Zero();
+		Transform pose = first.pose;
+		Covariance consumed = first.noise;
+		bool valid = true;
+		for(size_t p = first_position + 1; valid && p <= second_position; p++)
+		{
+			Sample sample;
+			valid = readSample(p, sample);
+			if(valid)
+			{
+				propagate(cov, pose.inverse() * sample.pose, sample.noise - consumed);
+				pose = sample.pose;
+				consumed.setZero();
+			}
+		}
+		if(!valid)
+			continue;
+		propagate(cov, pose.inverse() * second.pose, second.noise - consumed);
+		
+		// Covariance of the inverse transform, if the target is the earlier one
+		TransformWithCovariance twc;
+		twc.transform = first.pose.inverse() * second.pose;
+		if(!forward)
+		{
+			Matrix6 adj = adjoint(twc.transform);
+			cov = adj * cov * adj.transpose();
+			twc.transform = twc.transform.inverse();
+		}
+		cov = 0.5 * (cov + cov.transpose());
+		Vector6 scale = errorScale();
+		twc.covariance = scale.asDiagonal() * cov * scale.asDiagonal();
+		return twc;
+	}
+}
+
+Covariance BufferedOdometry::calculateCovariance(const Transform &tf)
+{
+	ScalarType distance = tf.translation().norm();
+	ScalarType angle = Eigen::AngleAxis<ScalarType>(tf.linear()).angle();
+	ScalarType translation = mConfig.minimum_variance + mConfig.translation_variance * distance;
+	ScalarType rotation = mConfig.minimum_variance + mConfig.rotation_variance * angle;
+	
+	// Rotation variances are scaled from the rotation vector to the quaternion
+	Vector6 scale = errorScale();
+	Vector6 variances;
+	variances << translation, translation, translation, rotation, rotation, rotation;
+	return variances.cwiseProduct(scale.cwiseProduct(scale)).asDiagonal();
+}
+
+size_t BufferedOdometry::getSize() const
+{
+	size_t head = mHead.load(std::memory_order_acquire);
+	return head > mMask ? mMask : head;
+}
@@ -0,0 +1,161 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_BUFFEREDODOMETRY_HPP
+#define SLAM_BUFFEREDODOMETRY_HPP
+
+#include "Odometry.hpp"
+#include "BufferedOdometryConfiguration.hpp"
+
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+
+namespace slam3d
+{
+	/**
+	 * @class BufferedOdometry
+	 * @brief Odometry that buffers the poses of a high-rate integrator.
+	 * @details Samples are added by a single producer thread, e.g. the wheel
+	 * or IMU driver, and stored in a lock-free ring buffer. Any number of
+	 * threads can query poses concurrently, they never block the producer.
+	 * Each slot is guarded by a sequence number, so a reader detects when
+	 * a sample was overwritten while it was read and retries the lookup.
+	 * Poses between two samples are interpolated on SE(3).
+	 *
+	 * Every sample carries the covariance of the motion since the previous
+	 * sample. The covariance between two points in time is composed from
+	 * the samples in between, so it stays accurate no matter how long the
+	 * buffer has been running.
+	 */
+	class BufferedOdometry : public Odometry
+	{
+	public:
+		/**
+		 * @brief Constructor.
+		 * @param logger
+		 * @param config size of the buffer and the motion model
+		 */
+		BufferedOdometry(Logger* logger, const BufferedOdometryConfiguration& config = BufferedOdometryConfiguration());
+		
+		/**
+		 * @brief Add a new sample, must only be called from one thread.
+		 * @details Samples have to be added in chronological order, older
+		 * samples are rejected. When the buffer is full, the oldest sample
+		 * is overwritten.
+		 * @param stamp time of the sample
+		 * @param pose integrated odometric pose
+		 * @param noise covariance of the motion since the previous sample,
+		 * given in the same coordinates as the covariance of constraints
+		 * @return false if the sample is not newer than the previous one
+		 */
+		bool addSample(const timeval& stamp, const Transform& pose, const Covariance& noise);
+		
+		/**
+		 * @brief Add a new sample, using the motion model for its noise.
+		 * @param stamp time of the sample
+		 * @param pose integrated odometric pose
+		 * @return false if the sample is not newer than the previous one
+		 */
+		bool addSample(const timeval& stamp, const Transform& pose);
+		
+		/**
+		 * @brief Gets the robot's location at given point in time.
+		 * @param stamp
+		 * @throw OdometryException if stamp is not within the buffered samples
+		 */
+		virtual Transform getOdometricPose(timeval stamp);
+		
+		/**
+		 * @brief Gets relative pose and uncertainty between two points in time.
+		 * @details The covariance is accumulated from the noise of the
+		 * samples between both points in time, the cost grows with the
+		 * number of samples in between.
+		 * @param last
+		 * @param next
+		 * @return relative pose with covariance
+		 * @throw OdometryException if either stamp is not within the buffered samples
+		 */
+		virtual TransformWithCovariance getRelativePose(timeval last, timeval next);
+		
+		/**
+		 * @brief Calculates covariance from the configured motion model.
+		 * @details Variances grow linearly with the travelled distance and
+		 * rotation, like those of a random walk.
+		 * @param tf relative transform between two poses
+		 * @return covariance of the relative transform tf
+		 */
+		virtual Covariance calculateCovariance(const Transform &tf);
+		
+		/**
+		 * @brief Get the number of samples that can be queried.
+		 */
+		size_t getSize() const;
+		
+		/**
+		 * @brief Get the maximum number of samples that can be queried.
+		 */
+		size_t getCapacity() const { return mMask; }
+		
+	protected:
+		struct Sample
+		{
+			EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+			int64_t time;
+			Transform pose;
+			Covariance noise;
+		};
+		
+		struct Slot
+		{
+			EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+			std::atomic<size_t> sequence;
+			Sample sample;
+		};
+		
+		bool readSample(size_t position, Sample& sample) const;
+		
+		// Get the (interpolated) sample at the given time and the position
+		// of the last sample at or before it, the noise of the result is
+		// that of the motion since this sample.
+		Sample lookup(int64_t time, size_t* position = NULL) const;
+		
+	protected:
+		BufferedOdometryConfiguration mConfig;
+		
+		// Ring buffer, the sequence of a slot is odd while the sample at
+		// a position is written and 2 * (position + 1) once it is complete.
+		// One slot is kept free for the producer, so readers never have to
+		// wait for the slot that is currently written.
+		std::vector<Slot, Eigen::aligned_allocator<Slot> > mSlots;
+		size_t mMask;
+		std::atomic<size_t> mHead;
+		
+		// Only used by the producer
+		Sample mLast;
+	};
+}
+
+#endif
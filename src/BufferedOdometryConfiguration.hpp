@@ -0,0 +1,54 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_BUFFEREDODOMETRYCONFIGURATION_HPP
+#define SLAM_BUFFEREDODOMETRYCONFIGURATION_HPP
+
+namespace slam3d
+{
+	/**
+	 * @class BufferedOdometryConfiguration
+	 * @brief Parameters for the BufferedOdometry.
+	 */
+	struct BufferedOdometryConfiguration
+	{
+		/** @brief Minimum number of samples that can be queried */
+		unsigned capacity;
+		
+		/** @brief Translational variance in m² added per meter of motion */
+		double translation_variance;
+		
+		/** @brief Rotational variance in rad² added per radian of motion */
+		double rotation_variance;
+		
+		/** @brief Variance added to every sample, even without motion */
+		double minimum_variance;
+		
+		BufferedOdometryConfiguration()
+		 : capacity(4096), translation_variance(0.01), rotation_variance(0.001), minimum_variance(1e-8) {};
+	};
+}
+
+#endif
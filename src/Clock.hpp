@@ -2,6 +2,8 @@
 #define SLAM_CLOCK_HPP
 
 #include <sys/time.h>
+#include <time.h>
+#include <stdint.h>
 
 namespace slam3d
 {
@@ -28,6 +30,19 @@ namespace slam3d
 			gettimeofday(&tv, 0);
 			return tv;
 		}
+		
+		/**
+		 * @brief Returns a steadily increasing time to measure durations.
+		 * @details In contrast to now(), this is not affected by changes of
+		 * the system time. Only differences between two values are meaningful.
+		 * @return time in nanoseconds
+		 */
+		virtual int64_t monotonic()
+		{
+			timespec ts;
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+		}
 	};
 }
 
@@ -0,0 +1,412 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "DistributedSolver.hpp"
+#include "Serialization.hpp"
+
+#include <boost/format.hpp>
+
+#include <algorithm>
+#include <set>
+
+using namespace slam3d;
+
+DistributedSolver::DistributedSolver(Logger* logger, Transport* transport, const DistributedSolverConfiguration& config)
+ : Solver(logger), mLocal(logger, config.local_iterations), mTransport(transport), mConfiguration(config),
+   mSession(0), mFinishedSession(0), mRestarted(false), mLastRounds(0)
+{
+}
+
+DistributedSolver::~DistributedSolver()
+{
+}
+
+void DistributedSolver::addNode(unsigned id, Transform pose)
+{
+	mLocal.addNode(id, pose);
+	mReportedPoses[id] = pose;
+}
+
+void DistributedSolver::addRemoteNode(unsigned id, int agent, Transform pose)
+{
+	mLocal.addNode(id, pose);
+	mLocal.setFixed(id);
+	mRemoteNodes.insert(RemoteMap::value_type(id, agent));
+	mPeers[agent];
+}
+
+void DistributedSolver::addConstraint(unsigned source, unsigned target, Transform tf, Covariance cov)
+{
+	mLocal.addConstraint(source, target, tf, cov);
+	bool remote_source = mRemoteNodes.find(source) != mRemoteNodes.end();
+	bool remote_target = mRemoteNodes.find(target) != mRemoteNodes.end();
+	if(remote_source && !remote_target)
+		mSeparators.push_back(std::make_pair(target, source));
+	else if(remote_target && !remote_source)
+		mSeparators.push_back(std::make_pair(source, target));
+}
+
+void DistributedSolver::setFixed(unsigned id)
+{
+	mLocal.setFixed(id);
+}
+
+void DistributedSolver::unsetFixed(unsigned id)
+{
+	if(mRemoteNodes.find(id) != mRemoteNodes.end())
+		return;
+	mLocal.unsetFixed(id);
+}
+
+void DistributedSolver::removeNode(unsigned id)
+{
+	mLocal.removeNode(id);
+	mRemoteNodes.erase(id);
+	mReportedPoses.erase(id);
+	std::vector<std::pair<unsigned, unsigned> >::iterator end = std::remove_if(mSeparators.begin(), mSeparators.end(),
+		[id](const std::pair<unsigned, unsigned>& s){ return s.first == id || s.second == id; });
+	mSeparators.erase(end, mSeparators.end());
+	
+	// Only wait for agents that still own one of the remote nodes
+	std::set<int> owners;
+	for(RemoteMap::iterator r = mRemoteNodes.begin(); r != mRemoteNodes.end(); ++r)
+		owners.insert(r->second);
+	for(std::map<int, Peer>::iterator p = mPeers.begin(); p != mPeers.end();)
+	{
+		if(owners.find(p->first) == owners.end())
+			mPeers.erase(p++);
+		else
+			++p;
+	}
+}
+
+void DistributedSolver::setPose(unsigned id, const Transform& pose)
+{
+	mLocal.setPose(id, pose);
+	if(mRemoteNodes.find(id) == mRemoteNodes.end())
+		mReportedPoses[id] = pose;
+}
+
+bool DistributedSolver::compute()
+{
+	return compute(OptimizationBudget());
+}
+
+bool DistributedSolver::compute(const OptimizationBudget& budget)
+{
+	// Continue after the sessions this agent and its peers have finished,
+	// agents that are behind adopt the session from the first message.
+	mSession = std::max(mSession, mFinishedSession) + 1;
+	mLastRounds = 0;
+	mChangedPoses.clear();
+	
+	// Without peers this is a plain local optimization
+	if(mPeers.empty())
+	{
+		bool result = mLocal.compute(budget);
+		collectChangedPoses();
+		mLastRounds = 1;
+		return result;
+	}
+	
+	ScopedTimer timer(mMetrics, "solver.distributed");
+	int64_t deadline = budget.max_duration > 0 ? mClock.monotonic() + (int64_t)(budget.max_duration * 1e9) : 0;
+	for(std::map<int, Peer>::iterator p = mPeers.begin(); p != mPeers.end(); ++p)
+		p->second = Peer();
+	
+	bool result = true;
+	unsigned round = 1;
+	for(int iteration = 1; iteration <= mConfiguration.max_rounds; iteration++)
+	{
+		// Agents with lower ids go first in each round
+		mLastRounds = iteration;
+		mRestarted = false;
+		waitForPeers(round, true);
+		if(!mRestarted)
+		{
+			IdPoseVector previous = mLocal.getCorrections();
+			if(!mLocal.compute())
+			{
+				SLAM3D_LOG(mLogger, ERROR, (boost::format("Local optimization failed in round %1%!") % round).str());
+				result = false;
+				break;
+			}
+			bool converged = !relax(previous);
+			sendPoses(MESSAGE_POSES, round, converged);
+			waitForPeers(round, false);
+			
+			// Stop when neither this agent nor any of its peers moved
+			for(std::map<int, Peer>::iterator p = mPeers.begin(); p != mPeers.end(); ++p)
+				converged = converged && (p->second.done || p->second.converged);
+			if(converged && !mRestarted)
+				break;
+		}
+		
+		// The rounds of an adopted session start again with the first one
+		round = mRestarted ? 1 : round + 1;
+		if(deadline > 0 && mClock.monotonic() >= deadline)
+			break;
+	}
+	sendPoses(MESSAGE_DONE, round, true);
+	mFinishedSession = std::max(mFinishedSession, mSession);
+	collectChangedPoses();
+	timer.addValue("rounds", mLastRounds);
+	SLAM3D_LOG(mLogger, INFO, (boost::format("Distributed optimization finished after %1% rounds.") % mLastRounds).str());
+	return result;
+}
+
+void DistributedSolver::waitForPeers(unsigned round, bool lower)
+{
+	// Queued messages are handled even if no peer has to be waited for,
+	// as they may come from a newer session that has to be adopted.
+	TransportMessage message;
+	while(!mRestarted && mTransport->receive(message, 0))
+		handleMessage(message);
+	
+	int64_t deadline = mClock.monotonic() + (int64_t)(mConfiguration.round_timeout * 1e9);
+	while(true)
+	{
+		bool complete = true;
+		for(std::map<int, Peer>::iterator p = mPeers.begin(); p != mPeers.end(); ++p)
+		{
+			if(lower && p->first > mTransport->getAgentId())
+				break;
+			complete = complete && (p->second.done || p->second.round >= round);
+		}
+		if(complete || mRestarted)
+			return;
+		
+		int64_t remaining = deadline - mClock.monotonic();
+		if(remaining <= 0)
+		{
+			for(std::map<int, Peer>::iterator p = mPeers.begin(); p != mPeers.end(); ++p)
+			{
+				if(lower && p->first > mTransport->getAgentId())
+					break;
+				if(!p->second.done && p->second.round < round)
+				{
+					SLAM3D_LOG(mLogger, WARNING, (boost::format("Agent %1% did not answer in round %2%.") % p->first % round).str());
+					p->second.done = true;
+				}
+			}
+			return;
+		}
+		
+		if(mTransport->receive(message, remaining / 1e9))
+			handleMessage(message);
+	}
+}
+
+void DistributedSolver::sendPoses(MessageType type, unsigned round, bool converged)
+{
+	// Current poses of the separator nodes
+	std::unordered_map<unsigned, size_t> separators;
+	for(std::vector<std::pair<unsigned, unsigned> >::iterator s = mSeparators.begin(); s != mSeparators.end(); ++s)
+		separators[s->first] = 0;
+	IdPoseVector poses = mLocal.getCorrections();
+	for(size_t i = 0; i < poses.size(); i++)
+	{
+		std::unordered_map<unsigned, size_t>::iterator s = separators.find(poses[i].first);
+		if(s != separators.end())
+			s->second = i;
+	}
+	
+	for(std::map<int, Peer>::iterator p = mPeers.begin(); p != mPeers.end(); ++p)
+	{
+		if(type == MESSAGE_POSES && p->second.done)
+			continue;
+		
+		std::set<unsigned> nodes;
+		for(std::vector<std::pair<unsigned, unsigned> >::iterator s = mSeparators.begin(); s != mSeparators.end(); ++s)
+		{
+			if(mRemoteNodes.at(s->second) == p->first)
+				nodes.insert(s->first);
+		}
+		
+		std::vector<char> buffer;
+		BinaryWriter writer(buffer);
+		writer.write<uint8_t>(type);
+		writer.write<uint32_t>(mSession);
+		writer.write<uint32_t>(round);
+		writer.write<uint8_t>(converged);
+		writer.write<uint32_t>(nodes.size());
+		for(std::set<unsigned>::iterator n = nodes.begin(); n != nodes.end(); ++n)
+		{
+			writer.write<uint32_t>(*n);
+			writer.writeTransform(poses[separators[*n]].second);
+		}
+		
+		if(!mTransport->send(p->first, buffer) && !p->second.done)
+		{
+			SLAM3D_LOG(mLogger, WARNING, (boost::format("Agent %1% can not be reached.") % p->first).str());
+			p->second.done = true;
+		}
+	}
+}
+
+void DistributedSolver::handleMessage(const TransportMessage& message)
+{
+	std::map<int, Peer>::iterator peer = mPeers.find(message.sender);
+	if(peer == mPeers.end())
+	{
+		SLAM3D_LOG(mLogger, WARNING, (boost::format("Dropped message from unknown agent %1%.") % message.sender).str());
+		return;
+	}
+	
+	try
+	{
+		BinaryReader reader(message.payload.data(), message.payload.size());
+		uint8_t type = reader.read<uint8_t>();
+		uint32_t session = reader.read<uint32_t>();
+		if(session < mSession)
+			return;
+		if(session > mSession)
+		{
+			if(type == MESSAGE_DONE)
+			{
+				// The peer has already finished a newer session without this
+				// agent and will not answer, the next compute() continues after it.
+				mFinishedSession = std::max<unsigned>(mFinishedSession, session);
+			}else
+			{
+				// The peer is ahead, join its session from the first round
+				SLAM3D_LOG(mLogger, DEBUG, (boost::format("Agent %1% started session %2%, leaving session %3%.")
+					% message.sender % session % mSession).str());
+				mSession = session;
+				mRestarted = true;
+				for(std::map<int, Peer>::iterator p = mPeers.begin(); p != mPeers.end(); ++p)
+					p->second = Peer();
+			}
+		}
+		uint32_t round = reader.read<uint32_t>();
+		bool converged = reader.read<uint8_t>();
+		uint32_t count = reader.read<uint32_t>();
+		for(uint32_t i = 0; i < count; i++)
+		{
+			unsigned id = reader.read<uint32_t>();
+			Transform pose = reader.readTransform();
+			RemoteMap::iterator remote = mRemoteNodes.find(id);
+			if(remote == mRemoteNodes.end() || remote->second != message.sender)
+				continue;
+			
+			mLocal.setPose(id, pose);
+		}
+		
+		if(type == MESSAGE_DONE)
+		{
+			peer->second.done = true;
+		}else if(round >= peer->second.round)
+		{
+			peer->second.round = round;
+			peer->second.converged = converged;
+		}
+	}catch(SerializationError& e)
+	{
+		SLAM3D_LOG(mLogger, ERROR, (boost::format("Malformed message from agent %1%: %2%") % message.sender % e.what()).str());
+	}
+}
+
+bool DistributedSolver::relax(const IdPoseVector& previous)
+{
+	bool moved = false;
+	IdPoseVector poses = mLocal.getCorrections();
+	for(size_t i = 0; i < poses.size(); i++)
+	{
+		if(mRemoteNodes.find(poses[i].first) != mRemoteNodes.end())
+			continue;
+		
+		// Scale the step of the local solver in the tangent space
+		Transform step = previous[i].second.inverse() * poses[i].second;
+		if(mConfiguration.relaxation != 1.0)
+		{
+			Eigen::AngleAxis<ScalarType> rotation(step.linear());
+			rotation.angle() *= mConfiguration.relaxation;
+			step.linear() = rotation.toRotationMatrix();
+			step.translation() *= mConfiguration.relaxation;
+			mLocal.setPose(poses[i].first, previous[i].second * step);
+		}
+		if(step.translation().norm() > mConfiguration.translation_tolerance ||
+		   Eigen::AngleAxis<ScalarType>(step.linear()).angle() > mConfiguration.rotation_tolerance)
+		{
+			moved = true;
+		}
+	}
+	return moved;
+}
+
+void DistributedSolver::collectChangedPoses()
+{
+	IdPoseVector poses = getCorrections();
+	for(IdPoseVector::iterator p = poses.begin(); p != poses.end(); ++p)
+	{
+		Transform& reported = mReportedPoses[p->first];
+		Transform diff = reported.inverse() * p->second;
+		if(diff.translation().norm() > mTranslationTolerance ||
+		   Eigen::AngleAxis<ScalarType>(diff.linear()).angle() > mRotationTolerance)
+		{
+			mChangedPoses.push_back(*p);
+			reported = p->second;
+		}
+	}
+}
+
+void DistributedSolver::clear()
+{
+	mLocal.clear();
+	mRemoteNodes.clear();
+	mSeparators.clear();
+	mPeers.clear();
+	mChangedPoses.clear();
+	mReportedPoses.clear();
+}
+
+void DistributedSolver::saveGraph(std::string filename)
+{
+	mLocal.saveGraph(filename);
+}
+
+IdPoseVector DistributedSolver::getCorrections()
+{
+	IdPoseVector corrections = mLocal.getCorrections();
+	IdPoseVector::iterator end = std::remove_if(corrections.begin(), corrections.end(),
+		[this](const IdPose& p){ return mRemoteNodes.find(p.first) != mRemoteNodes.end(); });
+	corrections.erase(end, corrections.end());
+	return corrections;
+}
+
+const IdPoseVector& DistributedSolver::getChangedPoses()
+{
+	return mChangedPoses;
+}
+
+MemoryUsage DistributedSolver::getMemoryUsage() const
+{
+	MemoryUsage usage = mLocal.getMemoryUsage();
+	usage.bytes += mRemoteNodes.size() * (sizeof(RemoteMap::value_type) + 2 * sizeof(void*));
+	usage.bytes += mSeparators.capacity() * sizeof(std::pair<unsigned, unsigned>);
+	usage.bytes += mChangedPoses.capacity() * sizeof(IdPose);
+	usage.bytes += mReportedPoses.size() * (sizeof(PoseMap::value_type) + 2 * sizeof(void*));
+	return usage;
+}
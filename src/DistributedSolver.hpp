@@ -0,0 +1,218 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_DISTRIBUTED_SOLVER_HPP
+#define SLAM_DISTRIBUTED_SOLVER_HPP
+
+#include "NativeSolver.hpp"
+#include "DistributedSolverConfiguration.hpp"
+#include "Transport.hpp"
+
+#include <map>
+
+namespace slam3d
+{
+	/**
+	 * @class DistributedSolver
+	 * @brief Pose-graph optimization that is shared between several agents.
+	 * @details Each agent owns the nodes it added with addNode() and keeps
+	 * copies of the nodes of other agents that are connected to its own
+	 * nodes by constraints. These remote nodes are added with addRemoteNode()
+	 * and all agents have to agree on the ids of shared nodes.
+	 *
+	 * A call to compute() alternates between optimizing the own nodes with
+	 * the remote nodes held fixed and exchanging the poses of the separator
+	 * nodes with the peers, which is a distributed Gauss-Seidel scheme. In
+	 * each round, agents solve after their peers with lower ids, so agents
+	 * that are not connected solve in parallel. The steps are over-relaxed
+	 * to speed up the convergence. It converges to the optimum of the
+	 * combined graph, while each agent only solves its own part and only
+	 * separator poses are sent over the transport.
+	 *
+	 * All agents are expected to call compute() at about the same time.
+	 * Each call starts a new session, which is sent with every message. An
+	 * agent that receives a message of a newer session adopts it and starts
+	 * again with the first round, so agents that called compute() a
+	 * different number of times agree on the largest session. Rounds end
+	 * when the peers have answered or the round timeout expired, peers that
+	 * do not answer are not waited for during the rest of this compute().
+	 */
+	class DistributedSolver : public Solver
+	{
+	public:
+		/**
+		 * @brief Constructor
+		 * @param logger pointer to the logger used by the solver
+		 * @param transport connection to the other agents, not owned by the solver
+		 * @param config parameters of the local solver and the exchange
+		 */
+		DistributedSolver(Logger* logger, Transport* transport,
+		                  const DistributedSolverConfiguration& config = DistributedSolverConfiguration());
+		~DistributedSolver();
+		
+		void addNode(unsigned id, Transform pose);
+		
+		/**
+		 * @brief Adds a copy of a node that is owned by another agent.
+		 * @details Remote nodes are never moved by this agent, their poses
+		 * are updated from the messages of their owner.
+		 * @param id identifier of the node that is shared by all agents
+		 * @param agent id of the owning agent
+		 * @param pose current estimate of the node
+		 * @throw DuplicateVertex
+		 */
+		void addRemoteNode(unsigned id, int agent, Transform pose);
+		
+		void addConstraint(unsigned source, unsigned target, Transform tf, Covariance cov);
+		void setFixed(unsigned id);
+		
+		/**
+		 * @brief Release a node that has been fixed with setFixed.
+		 * @details Remote nodes always remain fixed.
+		 * @throw UnknownVertex
+		 */
+		void unsetFixed(unsigned id);
+		void removeNode(unsigned id);
+		void setPose(unsigned id, const Transform& pose);
+		bool compute();
+		
+		/**
+		 * @brief Optimize together with the peers.
+		 * @details The duration of the budget limits the whole exchange,
+		 * the local solver is limited by the configured number of iterations.
+		 * @param budget maximum duration of the optimization
+		 */
+		bool compute(const OptimizationBudget& budget);
+		
+		void clear();
+		void saveGraph(std::string filename);
+		
+		/**
+		 * @brief Get the poses of the own nodes.
+		 */
+		IdPoseVector getCorrections();
+		
+		/**
+		 * @brief Get the own nodes that moved during the last compute().
+		 */
+		const IdPoseVector& getChangedPoses();
+		
+		/**
+		 * @brief Get the number of rounds done by the last compute().
+		 * @details This includes the rounds before adopting a newer session.
+		 */
+		int getLastRounds() const { return mLastRounds; }
+		
+		/**
+		 * @brief Get the memory used by the local solver and the separators.
+		 */
+		MemoryUsage getMemoryUsage() const;
+		
+	protected:
+		enum MessageType
+		{
+			MESSAGE_POSES = 0,
+			MESSAGE_DONE = 1
+		};
+		
+		struct Peer
+		{
+			Peer() : round(0), converged(false), done(false) {}
+			
+			// Last round this peer has sent its poses for
+			unsigned round;
+			bool converged;
+			
+			// The peer finished the current compute() or did not answer
+			bool done;
+		};
+		
+		/**
+		 * @brief Receive messages until the peers have sent the given round.
+		 * @details Peers that do not answer within the round timeout are
+		 * marked as done.
+		 * @param round number of the current round
+		 * @param lower whether to wait only for peers with a lower id
+		 */
+		void waitForPeers(unsigned round, bool lower);
+		
+		/**
+		 * @brief Send the poses of the separator nodes to all peers.
+		 * @param type whether the exchange continues or this agent is done
+		 * @param round number of the current round
+		 * @param converged whether the own nodes did not move in this round
+		 */
+		void sendPoses(MessageType type, unsigned round, bool converged);
+		
+		/**
+		 * @brief Apply the poses from a peer's message.
+		 * @details Messages of older sessions are dropped. A message of a
+		 * newer session makes this agent adopt that session and restart
+		 * its rounds, unless the peer has already finished it.
+		 */
+		void handleMessage(const TransportMessage& message);
+		
+		/**
+		 * @brief Apply the relaxation to the step of the local solver.
+		 * @param previous poses of all nodes before the local optimization
+		 * @return whether an own node moved beyond the tolerance
+		 */
+		bool relax(const IdPoseVector& previous);
+		
+		/**
+		 * @brief Collect the own nodes that moved since they were last reported.
+		 */
+		void collectChangedPoses();
+		
+		NativeSolver mLocal;
+		Transport* mTransport;
+		DistributedSolverConfiguration mConfiguration;
+		
+		// Owning agent of each remote node
+		typedef std::unordered_map<unsigned, int> RemoteMap;
+		RemoteMap mRemoteNodes;
+		
+		// Constraints between an own node (first) and a remote node (second)
+		std::vector<std::pair<unsigned, unsigned> > mSeparators;
+		
+		std::map<int, Peer> mPeers;
+		
+		// Last reported pose of each own node
+		typedef std::unordered_map<unsigned, Transform, std::hash<unsigned>, std::equal_to<unsigned>,
+			Eigen::aligned_allocator<std::pair<const unsigned, Transform> > > PoseMap;
+		PoseMap mReportedPoses;
+		
+		// Current session and the latest one finished by any agent
+		unsigned mSession;
+		unsigned mFinishedSession;
+		
+		// Set when a newer session was adopted during the current round
+		bool mRestarted;
+		int mLastRounds;
+		Clock mClock;
+	};
+}
+
+#endif
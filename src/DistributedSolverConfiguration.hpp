@@ -0,0 +1,61 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_DISTRIBUTEDSOLVERCONFIGURATION_HPP
+#define SLAM_DISTRIBUTEDSOLVERCONFIGURATION_HPP
+
+namespace slam3d
+{
+	/**
+	 * @class DistributedSolverConfiguration
+	 * @brief Parameters for the DistributedSolver.
+	 */
+	struct DistributedSolverConfiguration
+	{
+		/** @brief Maximum iterations of the local solver in each round */
+		int local_iterations;
+		
+		/** @brief Maximum number of exchanges with the peers in one compute() */
+		int max_rounds;
+		
+		/** @brief Factor for the steps of the local solver, between 1 and 2 */
+		double relaxation;
+		
+		/** @brief Time in seconds to wait for the peers in each round */
+		double round_timeout;
+		
+		/** @brief Rounds stop when no pose moves more than this distance in meters */
+		double translation_tolerance;
+		
+		/** @brief Rounds stop when no pose rotates more than this angle in radians */
+		double rotation_tolerance;
+		
+		DistributedSolverConfiguration() : local_iterations(10), max_rounds(50),
+		                                   relaxation(1.6), round_timeout(1.0), translation_tolerance(1e-4),
+		                                   rotation_tolerance(1e-4) {};
+	};
+}
+
+#endif
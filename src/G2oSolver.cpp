@@ -26,35 +26,125 @@
 #include "G2oSolver.hpp"
 
 #include <g2o/core/block_solver.h>
+#include <g2o/core/sparse_block_matrix.h>
 #include <g2o/core/optimization_algorithm_gauss_newton.h>
+#include <g2o/core/optimization_algorithm_levenberg.h>
+#include <g2o/core/optimization_algorithm_dogleg.h>
 #include <g2o/types/slam3d/types_slam3d.h>
 #include <g2o/solvers/cholmod/linear_solver_cholmod.h>
+#include <g2o/solvers/csparse/linear_solver_csparse.h>
+#include <g2o/solvers/pcg/linear_solver_pcg.h>
 #include <g2o/core/sparse_optimizer_terminate_action.h>
 
 #include "boost/format.hpp"
 
+#include <algorithm>
+
 using namespace slam3d;
 
-typedef g2o::LinearSolverCholmod<g2o::BlockSolver_6_3::PoseMatrixType> SlamLinearSolver;
+typedef g2o::BlockSolver_6_3::LinearSolverType SlamLinearSolver;
+typedef g2o::LinearSolverCholmod<g2o::BlockSolver_6_3::PoseMatrixType> CholmodLinearSolver;
+typedef g2o::LinearSolverCSparse<g2o::BlockSolver_6_3::PoseMatrixType> CSparseLinearSolver;
+typedef g2o::LinearSolverPCG<g2o::BlockSolver_6_3::PoseMatrixType> PCGLinearSolver;
 
-G2oSolver::G2oSolver(Logger* logger) : Solver(logger)
+namespace slam3d
 {
-	// Initialize the SparseOptimizer
-	std::unique_ptr<SlamLinearSolver> linearSolver(new SlamLinearSolver);
-	linearSolver->setBlockOrdering(true);
+	/**
+	 * @class DeadlineAction
+	 * @brief Stops the optimization after an iteration, when the deadline has passed.
+	 */
+	class DeadlineAction : public g2o::HyperGraphAction
+	{
+	public:
+		DeadlineAction(Clock* clock, bool* stop) : mClock(clock), mStop(stop), mDeadline(0) {}
+		
+		void setDeadline(int64_t deadline) { mDeadline = deadline; }
+		
+		HyperGraphAction* operator()(const g2o::HyperGraph* graph, Parameters* parameters = 0)
+		{
+			if(mDeadline > 0 && mClock->monotonic() >= mDeadline)
+			{
+				*mStop = true;
+			}
+			return this;
+		}
+		
+	private:
+		Clock* mClock;
+		bool* mStop;
+		int64_t mDeadline;
+	};
+}
+
+G2oSolver::G2oSolver(Logger* logger, const G2oSolverConfiguration& config)
+ : Solver(logger), mConfiguration(config)
+{
+	// Create the linear solver
+	std::unique_ptr<SlamLinearSolver> linearSolver;
+	switch(mConfiguration.linear_solver)
+	{
+	case LINEAR_SOLVER_CSPARSE:
+	{
+		CSparseLinearSolver* csparse = new CSparseLinearSolver;
+		csparse->setBlockOrdering(true);
+		linearSolver.reset(csparse);
+		break;
+	}
+	case LINEAR_SOLVER_PCG:
+		linearSolver.reset(new PCGLinearSolver);
+		break;
+	default:
+	{
+		CholmodLinearSolver* cholmod = new CholmodLinearSolver;
+		cholmod->setBlockOrdering(true);
+		linearSolver.reset(cholmod);
+	}
+	}
 	std::unique_ptr<g2o::BlockSolver_6_3> blockSolver(new g2o::BlockSolver_6_3(std::move(linearSolver)));
-	mOptimizer.setAlgorithm(new g2o::OptimizationAlgorithmGaussNewton(std::move(blockSolver)));
 	
-	// Set the default terminate action
-	g2o::SparseOptimizerTerminateAction* terminateAction = new g2o::SparseOptimizerTerminateAction;
-	mOptimizer.addPostIterationAction(terminateAction);
+	// Initialize the SparseOptimizer
+	switch(mConfiguration.algorithm)
+	{
+	case ALGORITHM_LEVENBERG:
+		mOptimizer.setAlgorithm(new g2o::OptimizationAlgorithmLevenberg(std::move(blockSolver)));
+		break;
+	case ALGORITHM_DOGLEG:
+		mOptimizer.setAlgorithm(new g2o::OptimizationAlgorithmDogleg(std::move(blockSolver)));
+		break;
+	default:
+		mOptimizer.setAlgorithm(new g2o::OptimizationAlgorithmGaussNewton(std::move(blockSolver)));
+	}
+	
+	// Both actions stop the optimization by setting our own flag
+	mStopFlag = false;
+	mOptimizer.setForceStopFlag(&mStopFlag);
+	
+	// Stop when chi² does not decrease anymore
+	mTerminateAction = new g2o::SparseOptimizerTerminateAction;
+	mTerminateAction->setGainThreshold(mConfiguration.gain_threshold);
+	mOptimizer.addPostIterationAction(mTerminateAction);
+	
+	// Stop when the time budget is exceeded
+	mDeadlineAction = new DeadlineAction(&mClock, &mStopFlag);
+	mOptimizer.addPostIterationAction(mDeadlineAction);
 	
 	mInitialized = false;
+	mLinearized = false;
+	mLastBatch = true;
+	mLastIterations = 0;
+	mIncremental = false;
+	mLocalRange = 5;
+	mBatchInterval = 50;
+	mComputeCount = 0;
 }
 
 G2oSolver::~G2oSolver()
 {
 	clear();
+	mOptimizer.removePostIterationAction(mTerminateAction);
+	mOptimizer.removePostIterationAction(mDeadlineAction);
+	delete mTerminateAction;
+	delete mDeadlineAction;
 }
 
 void G2oSolver::addNode(unsigned id, Transform pose)
@@ -73,6 +163,7 @@ void G2oSolver::addNode(unsigned id, Transform pose)
 	// Add the vertex to the optimizer
 	mOptimizer.addVertex(poseVertex);
 	mNewVertices.insert(poseVertex);
+	mReportedPoses[id] = pose;
 }
 
 void G2oSolver::addConstraint(unsigned source, unsigned target, Transform tf, Covariance cov)
@@ -104,14 +195,71 @@ void G2oSolver::setFixed(unsigned id)
 	g2o::OptimizableGraph::Vertex* v = mOptimizer.vertex(id);
 	if(!v)
 	{
-		mLogger->message(ERROR, (boost::format("Could not fix node with ID %1%!") % id).str());
+		SLAM3D_LOG(mLogger, ERROR, (boost::format("Could not fix node with ID %1%!") % id).str());
 		throw UnknownVertex(id);
 	}
 	v->setFixed(true);
 }
 
+void G2oSolver::unsetFixed(unsigned id)
+{
+	g2o::OptimizableGraph::Vertex* v = mOptimizer.vertex(id);
+	if(!v)
+	{
+		throw UnknownVertex(id);
+	}
+	v->setFixed(false);
+}
+
+void G2oSolver::removeNode(unsigned id)
+{
+	g2o::OptimizableGraph::Vertex* v = mOptimizer.vertex(id);
+	if(!v)
+	{
+		throw UnknownVertex(id);
+	}
+	
+	// Removing the vertex also deletes its edges, so they are removed first
+	// to keep no dangling pointers in the set of new edges
+	g2o::HyperGraph::EdgeSet edges = v->edges();
+	for(g2o::HyperGraph::EdgeSet::iterator e = edges.begin(); e != edges.end(); ++e)
+	{
+		mNewEdges.erase(*e);
+		mOptimizer.removeEdge(*e);
+	}
+	mNewVertices.erase(v);
+	mLocalVertices.erase(v);
+	mReportedPoses.erase(id);
+	mOptimizer.removeVertex(v);
+	
+	// The active set and the structure of the linear system still refer to
+	// the removed elements. updateInitialization() can only add elements, so
+	// the next compute() has to run a full initializeOptimization().
+	mInitialized = false;
+	invalidateMarginals();
+}
+
+void G2oSolver::setPose(unsigned id, const Transform& pose)
+{
+	g2o::VertexSE3* v = dynamic_cast<g2o::VertexSE3*>(mOptimizer.vertex(id));
+	if(!v)
+	{
+		throw UnknownVertex(id);
+	}
+	v->setEstimate(pose.cast<double>());
+	mReportedPoses[id] = pose;
+}
+
 bool G2oSolver::compute()
 {
+	return compute(OptimizationBudget());
+}
+
+bool G2oSolver::compute(const OptimizationBudget& budget)
+{
+	mLastIterations = 0;
+	mChangedPoses.clear();
+	
 	// need to do something?
 	if(mOptimizer.activeVertices().size() == 0 && mNewVertices.size() < 2)
 		return true;
@@ -119,71 +267,398 @@ bool G2oSolver::compute()
 	// Check input
 	if(!mOptimizer.verifyInformationMatrices(true))
 	{
-		mLogger->message(ERROR, "Failed to verify information matrices!");
+		SLAM3D_LOG(mLogger, ERROR, "Failed to verify information matrices!");
 		return false;
 	}
 
-	// Reset the stop flag that is set by TerminateAction
-	bool* stopFlag = mOptimizer.forceStopFlag();
-	if(stopFlag)
+	// Reset the stop flag that is set by the post-iteration actions
+	mStopFlag = false;
+	if(budget.max_duration > 0)
+	{
+		mDeadlineAction->setDeadline(mClock.monotonic() + (int64_t)(budget.max_duration * 1e9));
+	}else
 	{
-		*stopFlag = false;
+		mDeadlineAction->setDeadline(0);
 	}
+	int iterations = budget.max_iterations > 0 ? budget.max_iterations : mConfiguration.max_iterations;
+	invalidateMarginals();
 	
 	// Do the graph optimization
-	if(mInitialized)
+	int iter;
+	bool batch = !mIncremental || mComputeCount == 0 || (mBatchInterval > 0 && mComputeCount % mBatchInterval == 0);
+	mComputeCount++;
+	if(batch)
 	{
-		mLogger->message(DEBUG, "Update Initialization.");
-		mOptimizer.updateInitialization(mNewVertices, mNewEdges);
+		iter = optimizeBatch(iterations);
 	}else
 	{
-		mLogger->message(DEBUG, "Do first Initialization.");
-		mInitialized = mOptimizer.initializeOptimization();
+		iter = optimizeLocal(iterations);
 	}
-	mNewVertices.clear();
-	mNewEdges.clear();
-	
-	int iter = mOptimizer.optimize(100, false);
+	mLastIterations = iter;
 	if (iter <= 0)
 	{		
-		mLogger->message(ERROR, "Optimization failed!");
+		SLAM3D_LOG(mLogger, ERROR, "Optimization failed!");
 		return false;
 	}
-	mLogger->message(INFO ,(boost::format("Optimization finished after %1% iterations.") % iter).str());
+	SLAM3D_LOG(mLogger, INFO ,(boost::format("Optimization finished after %1% iterations.") % iter).str());
 
-	// Clear previous optimization result
-	mCorrections.clear();
+	mLastBatch = batch;
+	mLinearized = true;
+	findChangedPoses(batch);
+	return true;
+}
 
-	// Write the result so it can be used by the mapper
-	g2o::SparseOptimizer::VertexContainer nodes = mOptimizer.activeVertices();
+void G2oSolver::findChangedPoses(bool batch)
+{
+	ScopedTimer timer(mMetrics, "solver.changed_poses");
+	mChangedPoses.clear();
+	const g2o::SparseOptimizer::VertexContainer& nodes = mOptimizer.activeVertices();
 	for (g2o::SparseOptimizer::VertexContainer::const_iterator n = nodes.begin(); n < nodes.end(); n++)
 	{
+		// Skip the fixed boundary of a local optimization
+		if(!batch && mLocalVertices.find(*n) == mLocalVertices.end())
+			continue;
 		g2o::VertexSE3* vertex = dynamic_cast<g2o::VertexSE3*>(*n);
 		assert(vertex);
-		Transform iso = Transform(vertex->estimate());
-		mCorrections.push_back(IdPose((*n)->id(), iso));
+		Transform pose = Transform(vertex->estimate());
+		Transform& reported = mReportedPoses[vertex->id()];
+		Transform diff = reported.inverse() * pose;
+		if(diff.translation().norm() > mTranslationTolerance ||
+		   Eigen::AngleAxis<ScalarType>(diff.linear()).angle() > mRotationTolerance)
+		{
+			reported = pose;
+			mChangedPoses.push_back(IdPose(vertex->id(), pose));
+		}
 	}
-	return true;
+	timer.addValue("changed", mChangedPoses.size());
+}
+
+int G2oSolver::optimizeBatch(int iterations)
+{
+	{
+		ScopedTimer timer(mMetrics, "solver.initialize");
+		if(mInitialized)
+		{
+			SLAM3D_LOG(mLogger, DEBUG, "Update Initialization.");
+			mOptimizer.updateInitialization(mNewVertices, mNewEdges);
+		}else
+		{
+			SLAM3D_LOG(mLogger, DEBUG, "Do first Initialization.");
+			mInitialized = mOptimizer.initializeOptimization();
+		}
+		timer.addValue("vertices", mNewVertices.size());
+		timer.addValue("edges", mNewEdges.size());
+	}
+	mNewVertices.clear();
+	mNewEdges.clear();
+	
+	ScopedTimer timer(mMetrics, "solver.optimize");
+	int iter = mOptimizer.optimize(iterations, false);
+	timer.addValue("iterations", iter);
+	return iter;
+}
+
+int G2oSolver::optimizeLocal(int iterations)
+{
+	ScopedTimer init_timer(mMetrics, "solver.initialize_local");
+	
+	// Start at all new vertices and the vertices of new edges
+	g2o::HyperGraph::VertexSet frontier = mNewVertices;
+	for(g2o::HyperGraph::EdgeSet::iterator e = mNewEdges.begin(); e != mNewEdges.end(); ++e)
+	{
+		frontier.insert((*e)->vertices().begin(), (*e)->vertices().end());
+	}
+	mNewVertices.clear();
+	mNewEdges.clear();
+	
+	// Breadth-first search up to the given range, the last ring is the fixed boundary
+	mLocalVertices.clear();
+	g2o::HyperGraph::VertexSet region;
+	for(unsigned hop = 0; hop <= mLocalRange + 1 && !frontier.empty(); hop++)
+	{
+		g2o::HyperGraph::VertexSet next;
+		for(g2o::HyperGraph::VertexSet::iterator v = frontier.begin(); v != frontier.end(); ++v)
+		{
+			if(!region.insert(*v).second)
+				continue;
+			if(hop > mLocalRange)
+				continue;
+			mLocalVertices.insert(*v);
+			for(g2o::HyperGraph::EdgeSet::iterator e = (*v)->edges().begin(); e != (*v)->edges().end(); ++e)
+			{
+				for(std::vector<g2o::HyperGraph::Vertex*>::iterator n = (*e)->vertices().begin(); n != (*e)->vertices().end(); ++n)
+				{
+					if(region.find(*n) == region.end())
+						next.insert(*n);
+				}
+			}
+		}
+		frontier.swap(next);
+	}
+	
+	// Hold the boundary in place
+	std::vector<g2o::OptimizableGraph::Vertex*> boundary;
+	for(g2o::HyperGraph::VertexSet::iterator v = region.begin(); v != region.end(); ++v)
+	{
+		g2o::OptimizableGraph::Vertex* vertex = static_cast<g2o::OptimizableGraph::Vertex*>(*v);
+		if(mLocalVertices.find(*v) == mLocalVertices.end() && !vertex->fixed())
+		{
+			vertex->setFixed(true);
+			boundary.push_back(vertex);
+		}
+	}
+	
+	SLAM3D_LOG(mLogger, DEBUG, (boost::format("Local optimization of %1% vertices with %2% fixed.") % mLocalVertices.size() % boundary.size()).str());
+	mOptimizer.initializeOptimization(region);
+	init_timer.addValue("vertices", region.size());
+	
+	int iter;
+	{
+		ScopedTimer timer(mMetrics, "solver.optimize_local");
+		iter = mOptimizer.optimize(iterations, false);
+		timer.addValue("iterations", iter);
+	}
+	
+	for(std::vector<g2o::OptimizableGraph::Vertex*>::iterator v = boundary.begin(); v != boundary.end(); ++v)
+	{
+		(*v)->setFixed(false);
+	}
+	
+	// The optimizer holds only the local region now, so the next batch has to initialize again
+	mInitialized = false;
+	return iter;
+}
+
+void G2oSolver::setIncremental(bool enable, unsigned range, unsigned batch_interval)
+{
+	mIncremental = enable;
+	mLocalRange = range;
+	mBatchInterval = batch_interval;
 }
 
 IdPoseVector G2oSolver::getCorrections()
 {
-	return mCorrections;
+	IdPoseVector corrections;
+	const g2o::SparseOptimizer::VertexContainer& nodes = mOptimizer.activeVertices();
+	corrections.reserve(nodes.size());
+	for (g2o::SparseOptimizer::VertexContainer::const_iterator n = nodes.begin(); n < nodes.end(); n++)
+	{
+		if(!mLastBatch && mLocalVertices.find(*n) == mLocalVertices.end())
+			continue;
+		g2o::VertexSE3* vertex = dynamic_cast<g2o::VertexSE3*>(*n);
+		assert(vertex);
+		corrections.push_back(IdPose((*n)->id(), Transform(vertex->estimate())));
+	}
+	return corrections;
+}
+
+const IdPoseVector& G2oSolver::getChangedPoses()
+{
+	return mChangedPoses;
+}
+
+void G2oSolver::invalidateMarginals()
+{
+	mLinearized = false;
+	mBlockCache.clear();
+}
+
+bool G2oSolver::hasMarginal(g2o::OptimizableGraph::Vertex* vertex) const
+{
+	// Vertices outside of a local region keep the index of an older system
+	if(!mLastBatch && mLocalVertices.find(vertex) == mLocalVertices.end())
+		return false;
+	return vertex->hessianIndex() >= 0;
+}
+
+bool G2oSolver::getMarginalBlocks(const std::vector<VertexPair>& pairs, BlockList& blocks)
+{
+	if(!mLinearized)
+		return false;
+	
+	// Blocks are cached for the upper triangle of the inverse Hessian,
+	// the key holds the id of the vertex with the lower index first
+	std::vector<uint64_t> keys;
+	std::vector<uint64_t> missing;
+	std::vector<std::pair<int, int> > indices;
+	for(std::vector<VertexPair>::const_iterator p = pairs.begin(); p != pairs.end(); ++p)
+	{
+		if(!hasMarginal(p->first) || !hasMarginal(p->second))
+			return false;
+		bool ordered = p->first->hessianIndex() <= p->second->hessianIndex();
+		g2o::OptimizableGraph::Vertex* row = ordered ? p->first : p->second;
+		g2o::OptimizableGraph::Vertex* col = ordered ? p->second : p->first;
+		uint64_t key = ((uint64_t)row->id() << 32) | (uint32_t)col->id();
+		keys.push_back(key);
+		if(mBlockCache.find(key) == mBlockCache.end() && std::find(missing.begin(), missing.end(), key) == missing.end())
+		{
+			missing.push_back(key);
+			indices.push_back(std::make_pair(row->hessianIndex(), col->hessianIndex()));
+		}
+	}
+	
+	if(!indices.empty())
+	{
+		ScopedTimer timer(mMetrics, "solver.marginals");
+		timer.addValue("blocks", indices.size());
+		g2o::SparseBlockMatrix<Eigen::MatrixXd> spinv;
+		bool valid = mOptimizer.computeMarginals(spinv, indices);
+		for(size_t i = 0; valid && i < indices.size(); i++)
+		{
+			const Eigen::MatrixXd* block = spinv.block(indices[i].first, indices[i].second);
+			valid = block && block->rows() == 6 && block->cols() == 6;
+			if(valid)
+				mBlockCache[missing[i]] = *block;
+		}
+		if(!valid)
+		{
+			SLAM3D_LOG(mLogger, ERROR, "Could not compute the marginal covariances!");
+			invalidateMarginals();
+			return false;
+		}
+	}
+	
+	blocks.clear();
+	for(size_t i = 0; i < pairs.size(); i++)
+	{
+		const Matrix6& block = mBlockCache.at(keys[i]);
+		if(pairs[i].first->hessianIndex() <= pairs[i].second->hessianIndex())
+			blocks.push_back(block);
+		else
+			blocks.push_back(block.transpose());
+	}
+	return true;
+}
+
+bool G2oSolver::getMarginalCovariance(unsigned id, Covariance& cov)
+{
+	g2o::OptimizableGraph::Vertex* v = mOptimizer.vertex(id);
+	if(!v)
+	{
+		throw UnknownVertex(id);
+	}
+	if(v->fixed())
+	{
+		cov.setZero();
+		return true;
+	}
+	
+	// The increments of VertexSE3 are already in the coordinates of the constraints
+	BlockList blocks;
+	if(!getMarginalBlocks(std::vector<VertexPair>(1, VertexPair(v, v)), blocks))
+		return false;
+	cov = blocks[0];
+	return true;
+}
+
+bool G2oSolver::getRelativeCovariance(unsigned source, unsigned target, Covariance& cov)
+{
+	g2o::OptimizableGraph::Vertex* s = mOptimizer.vertex(source);
+	if(!s)
+	{
+		throw UnknownVertex(source);
+	}
+	g2o::OptimizableGraph::Vertex* t = mOptimizer.vertex(target);
+	if(!t)
+	{
+		throw UnknownVertex(target);
+	}
+	
+	// Blocks of fixed vertices are zero
+	std::vector<VertexPair> pairs;
+	if(!s->fixed())
+		pairs.push_back(VertexPair(s, s));
+	if(!t->fixed())
+		pairs.push_back(VertexPair(t, t));
+	if(!s->fixed() && !t->fixed())
+		pairs.push_back(VertexPair(s, t));
+	BlockList blocks;
+	if(!getMarginalBlocks(pairs, blocks))
+		return false;
+	
+	Matrix6 source_cov = Matrix6::Zero();
+	Matrix6 target_cov = Matrix6::Zero();
+	Matrix6 cross = Matrix6::Zero();
+	size_t next = 0;
+	if(!s->fixed())
+		source_cov = blocks[next++];
+	if(!t->fixed())
+		target_cov = blocks[next++];
+	if(!s->fixed() && !t->fixed())
+		cross = blocks[next++];
+	
+	// Propagation is done for increments with a rotation vector
+	Vector6 inverse_scale = errorScale().cwiseInverse();
+	source_cov = inverse_scale.asDiagonal() * source_cov * inverse_scale.asDiagonal();
+	target_cov = inverse_scale.asDiagonal() * target_cov * inverse_scale.asDiagonal();
+	cross = inverse_scale.asDiagonal() * cross * inverse_scale.asDiagonal();
+	Matrix6 relative = relativeCovariance(Transform(static_cast<g2o::VertexSE3*>(s)->estimate()),
+	                                      Transform(static_cast<g2o::VertexSE3*>(t)->estimate()),
+	                                      source_cov, target_cov, cross);
+	cov = errorScale().asDiagonal() * relative * errorScale().asDiagonal();
+	return true;
+}
+
+void G2oSolver::prepareRelativeCovariances(const std::vector<std::pair<unsigned, unsigned> >& pairs)
+{
+	if(!mLinearized)
+		return;
+	
+	// Only blocks that can be computed are requested, so one unknown
+	// vertex does not fail the whole batch
+	std::vector<VertexPair> blocks;
+	for(std::vector<std::pair<unsigned, unsigned> >::const_iterator p = pairs.begin(); p != pairs.end(); ++p)
+	{
+		g2o::OptimizableGraph::Vertex* s = mOptimizer.vertex(p->first);
+		g2o::OptimizableGraph::Vertex* t = mOptimizer.vertex(p->second);
+		bool use_source = s && !s->fixed() && hasMarginal(s);
+		bool use_target = t && !t->fixed() && hasMarginal(t);
+		if(use_source)
+			blocks.push_back(VertexPair(s, s));
+		if(use_target)
+			blocks.push_back(VertexPair(t, t));
+		if(use_source && use_target)
+			blocks.push_back(VertexPair(s, t));
+	}
+	BlockList result;
+	getMarginalBlocks(blocks, result);
+}
+
+MemoryUsage G2oSolver::getMemoryUsage() const
+{
+	size_t vertices = mOptimizer.vertices().size();
+	size_t edges = mOptimizer.edges().size();
+	size_t bytes = vertices * sizeof(g2o::VertexSE3) + edges * sizeof(g2o::EdgeSE3);
+	if(mInitialized)
+	{
+		bytes += (vertices + edges) * 36 * sizeof(double);
+	}
+	bytes += mChangedPoses.capacity() * sizeof(IdPose);
+	bytes += mReportedPoses.size() * (sizeof(PoseMap::value_type) + sizeof(void*) * 2);
+	bytes += mBlockCache.size() * (sizeof(BlockCache::value_type) + sizeof(void*) * 2);
+	return MemoryUsage(bytes, vertices + edges);
 }
 
 void G2oSolver::clear()
 {
 	mOptimizer.clear();
+	mNewVertices.clear();
+	mNewEdges.clear();
+	mLocalVertices.clear();
+	mReportedPoses.clear();
+	mChangedPoses.clear();
 	mInitialized = false;
+	invalidateMarginals();
+	mComputeCount = 0;
 }
 
 void G2oSolver::saveGraph(std::string filename)
 {
 	if(mOptimizer.save(filename.c_str()))
 	{
-		mLogger->message(INFO, (boost::format("Saved current g2o graph in %1%.") % filename).str());
+		SLAM3D_LOG(mLogger, INFO, (boost::format("Saved current g2o graph in %1%.") % filename).str());
 	}else
 	{
-		mLogger->message(ERROR, (boost::format("Could not save %1%.") % filename).str());
+		SLAM3D_LOG(mLogger, ERROR, (boost::format("Could not save %1%.") % filename).str());
 	}
 }
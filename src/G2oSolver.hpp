@@ -27,10 +27,21 @@
 #define SLAM_G2O_SOLVER_HPP
 
 #include "Solver.hpp"
+#include "G2oSolverConfiguration.hpp"
+#include "Linearization.hpp"
 #include <g2o/core/sparse_optimizer.h>
 
+#include <unordered_map>
+
+namespace g2o
+{
+	class SparseOptimizerTerminateAction;
+}
+
 namespace slam3d
 {	
+	class DeadlineAction;
+	
 	/**
 	 * @class G2oSolver
 	 * @brief A solver for graph otimization that uses the g2o-backend.
@@ -40,25 +51,165 @@ namespace slam3d
 	class G2oSolver : public Solver
 	{
 	public:
-		G2oSolver(Logger* logger);
+		/**
+		 * @brief Constructor
+		 * @param logger pointer to the logger used by the solver
+		 * @param config optimization algorithm, linear solver and termination criteria
+		 */
+		G2oSolver(Logger* logger, const G2oSolverConfiguration& config = G2oSolverConfiguration());
 		~G2oSolver();
 		
 		void addNode(unsigned id, Transform pose);
 		void addConstraint(unsigned source, unsigned target, Transform tf, Covariance cov);
 		void setFixed(unsigned id);
+		void unsetFixed(unsigned id);
+		void removeNode(unsigned id);
+		void setPose(unsigned id, const Transform& pose);
 		bool compute();
+		
+		/**
+		 * @brief Start optimization with limited iterations and duration.
+		 * @details The optimization also stops early, when the relative
+		 * decrease of chi² is below the configured gain threshold.
+		 * @param budget maximum iterations and duration of the optimization
+		 */
+		bool compute(const OptimizationBudget& budget);
+		
+		/**
+		 * @brief Get the number of iterations done by the last compute().
+		 */
+		int getLastIterations() const { return mLastIterations; }
+		
 		void clear();
 		void saveGraph(std::string filename);
 		
 		IdPoseVector getCorrections();
 		
+		/**
+		 * @brief Get the poses that changed since they were last reported.
+		 * @details The comparison is done during compute() for the vertices
+		 * that took part in the optimization, in incremental mode these are
+		 * only the vertices of the local region.
+		 */
+		const IdPoseVector& getChangedPoses();
+		
+		/**
+		 * @brief Enable optimization of only the region affected by new nodes and constraints.
+		 * @details In incremental mode, compute() optimizes all nodes within
+		 * the given number of hops from the nodes and constraints added since
+		 * the last call, while the ring of nodes around this region is held
+		 * fixed. This keeps the cost per compute() independent of the size
+		 * of the map. Errors that are distributed over larger loops are
+		 * corrected by a full batch optimization every batch_interval calls.
+		 * getCorrections() only contains the nodes that have been optimized.
+		 * @param enable whether to use incremental optimization
+		 * @param range number of hops around new elements to be optimized
+		 * @param batch_interval number of compute() calls between full optimizations, 0 for never
+		 */
+		void setIncremental(bool enable, unsigned range = 5, unsigned batch_interval = 50);
+		
+		/**
+		 * @brief Get the marginal covariance of a node from g2o's last linear system.
+		 * @details Only nodes that took part in the last optimization are
+		 * known. In incremental mode these are the nodes of the local region,
+		 * and their covariance is relative to the fixed boundary of the
+		 * region, so it underestimates the uncertainty in the whole map.
+		 * Blocks of the inverse Hessian are cached until the next compute().
+		 * @throw UnknownVertex
+		 */
+		bool getMarginalCovariance(unsigned id, Covariance& cov);
+		
+		/**
+		 * @brief Get the covariance of the relative pose from source to target.
+		 * @throw UnknownVertex
+		 */
+		bool getRelativeCovariance(unsigned source, unsigned target, Covariance& cov);
+		
+		/**
+		 * @brief Compute the blocks for all pairs with a single call of computeMarginals.
+		 */
+		void prepareRelativeCovariances(const std::vector<std::pair<unsigned, unsigned> >& pairs);
+		
+		/**
+		 * @brief Get the memory used by the optimizer.
+		 * @details Besides vertices and edges, this contains an estimate of
+		 * the sparse Hessian with one 6x6 block per vertex and edge.
+		 */
+		MemoryUsage getMemoryUsage() const;
+		
 	protected:
 		g2o::SparseOptimizer mOptimizer;
 		g2o::HyperGraph::VertexSet mNewVertices;
 		g2o::HyperGraph::EdgeSet mNewEdges;
 		
-		IdPoseVector mCorrections;
+		/**
+		 * @brief Optimize only the neighborhood of new vertices and edges.
+		 * @return number of iterations or 0 if the optimization failed
+		 */
+		int optimizeLocal(int iterations);
+		
+		/**
+		 * @brief Optimize the complete graph.
+		 * @return number of iterations or 0 if the optimization failed
+		 */
+		int optimizeBatch(int iterations);
+		
+		G2oSolverConfiguration mConfiguration;
+		g2o::SparseOptimizerTerminateAction* mTerminateAction;
+		DeadlineAction* mDeadlineAction;
+		bool mStopFlag;
+		Clock mClock;
+		
+		typedef std::pair<g2o::OptimizableGraph::Vertex*, g2o::OptimizableGraph::Vertex*> VertexPair;
+		typedef std::vector<Matrix6, Eigen::aligned_allocator<Matrix6> > BlockList;
+		typedef std::unordered_map<uint64_t, Matrix6, std::hash<uint64_t>, std::equal_to<uint64_t>,
+			Eigen::aligned_allocator<std::pair<const uint64_t, Matrix6> > > BlockCache;
+		
+		/**
+		 * @brief Check if a vertex is part of the last linear system.
+		 */
+		bool hasMarginal(g2o::OptimizableGraph::Vertex* vertex) const;
+		
+		/**
+		 * @brief Get blocks of the inverse Hessian for the given pairs of vertices.
+		 * @details Blocks that are not cached yet are computed together.
+		 * @param pairs pairs of vertices that took part in the last optimization
+		 * @param blocks receives the block of each pair, rows belong to the first vertex
+		 * @return false if the blocks could not be computed
+		 */
+		bool getMarginalBlocks(const std::vector<VertexPair>& pairs, BlockList& blocks);
+		
+		/**
+		 * @brief Drop the linearization and all cached blocks.
+		 */
+		void invalidateMarginals();
+		
+		/**
+		 * @brief Collect the optimized vertices that moved beyond the tolerance.
+		 * @param batch whether the whole graph has been optimized
+		 */
+		void findChangedPoses(bool batch);
+		
+		// Last reported pose for each vertex
+		typedef std::unordered_map<int, Transform, std::hash<int>, std::equal_to<int>,
+			Eigen::aligned_allocator<std::pair<const int, Transform> > > PoseMap;
+		PoseMap mReportedPoses;
+		bool mLastBatch;
+		
 		bool mInitialized;
+		int mLastIterations;
+		
+		// The last compute() left a linear system for covariance queries,
+		// blocks of its inverse are cached by the ids of both vertices
+		bool mLinearized;
+		BlockCache mBlockCache;
+		
+		// Parameters for incremental optimization
+		bool mIncremental;
+		unsigned mLocalRange;
+		unsigned mBatchInterval;
+		unsigned mComputeCount;
+		g2o::HyperGraph::VertexSet mLocalVertices;
 	};
 }
 
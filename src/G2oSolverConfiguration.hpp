@@ -0,0 +1,51 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_G2OSOLVERCONFIGURATION_HPP
+#define SLAM_G2OSOLVERCONFIGURATION_HPP
+
+namespace slam3d
+{
+	enum G2oAlgorithm {ALGORITHM_GAUSS_NEWTON, ALGORITHM_LEVENBERG, ALGORITHM_DOGLEG};
+	enum G2oLinearSolver {LINEAR_SOLVER_CHOLMOD, LINEAR_SOLVER_CSPARSE, LINEAR_SOLVER_PCG};
+	
+	/**
+	 * @class G2oSolverConfiguration
+	 * @brief Parameters for the G2oSolver.
+	 */
+	struct G2oSolverConfiguration
+	{
+		G2oAlgorithm algorithm;
+		G2oLinearSolver linear_solver;
+		int max_iterations;
+		double gain_threshold;
+		
+		G2oSolverConfiguration() : algorithm(ALGORITHM_GAUSS_NEWTON),
+		                           linear_solver(LINEAR_SOLVER_CHOLMOD),
+		                           max_iterations(100), gain_threshold(1e-6) {};
+	};
+}
+
+#endif
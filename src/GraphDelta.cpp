@@ -0,0 +1,336 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "GraphDelta.hpp"
+
+#include <boost/format.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace slam3d;
+
+#define DELTA_MAGIC "S3DD"
+#define DELTA_VERSION 2
+
+// Sizes of the fixed parts of the format
+#define TRANSFORM_SIZE (12 * sizeof(ScalarType))
+#define COVARIANCE_SIZE (21 * sizeof(ScalarType))
+#define HEADER_SIZE (4 + 2 + 1 + sizeof(ScalarType) + 4 + 4)
+#define FRAME_SIZE (2 + 2 + TRANSFORM_SIZE)
+#define READING_SIZE (16 + 2 + 8 + 16 + TRANSFORM_SIZE + COVARIANCE_SIZE + 2 + 4)
+#define CONSTRAINT_SIZE (16 + 16 + TRANSFORM_SIZE + COVARIANCE_SIZE + 2)
+#define POSE_SIZE (16 + TRANSFORM_SIZE)
+
+DeltaEncoder::DeltaEncoder(DeltaPayload payload, ScalarType resolution)
+ : mPayload(payload), mResolution(resolution)
+{
+}
+
+uint16_t DeltaEncoder::getString(const std::string& s)
+{
+	for(size_t i = 0; i < mStrings.size(); i++)
+	{
+		if(mStrings[i] == s)
+			return i;
+	}
+	if(mStrings.size() >= 0xFFFF)
+	{
+		throw SerializationError("Too many different names in delta!");
+	}
+	mStrings.push_back(s);
+	return mStrings.size() - 1;
+}
+
+uint16_t DeltaEncoder::getFrame(const Measurement& m)
+{
+	Frame frame;
+	frame.robot = getString(m.getRobotName());
+	frame.sensor = getString(m.getSensorName());
+	frame.pose = m.getSensorPose();
+	for(size_t i = 0; i < mFrames.size(); i++)
+	{
+		if(mFrames[i].robot == frame.robot && mFrames[i].sensor == frame.sensor
+		   && mFrames[i].pose.matrix() == frame.pose.matrix())
+			return i;
+	}
+	if(mFrames.size() >= 0xFFFF)
+	{
+		throw SerializationError("Too many different sensor poses in delta!");
+	}
+	mFrames.push_back(frame);
+	return mFrames.size() - 1;
+}
+
+size_t DeltaEncoder::getPayloadSize(const Measurement& m) const
+{
+	if(!m.hasPayload())
+		return 0;
+	switch(mPayload)
+	{
+	case DELTA_RAW_PAYLOAD:
+		return m.getPayloadSize();
+	case DELTA_COMPRESSED_PAYLOAD:
+		return m.getCompressedPayloadSize(mResolution);
+	default:
+		return 0;
+	}
+}
+
+void DeltaEncoder::buildTables(const GraphDelta& delta)
+{
+	mStrings.clear();
+	mFrames.clear();
+	mReadingFrames.clear();
+	for(ExternalReadingList::const_iterator r = delta.readings.begin(); r != delta.readings.end(); ++r)
+	{
+		mReadingFrames.push_back(getFrame(*r->measurement));
+		getString(r->sensor);
+	}
+	for(ExternalConstraintList::const_iterator c = delta.constraints.begin(); c != delta.constraints.end(); ++c)
+	{
+		getString(c->sensor);
+	}
+}
+
+size_t DeltaEncoder::getEncodedSize(const GraphDelta& delta)
+{
+	buildTables(delta);
+	size_t size = HEADER_SIZE + 2 + 2 + mFrames.size() * FRAME_SIZE;
+	for(std::vector<std::string>::const_iterator s = mStrings.begin(); s != mStrings.end(); ++s)
+	{
+		size += 4 + s->size();
+	}
+	size += 4 + delta.readings.size() * READING_SIZE;
+	for(ExternalReadingList::const_iterator r = delta.readings.begin(); r != delta.readings.end(); ++r)
+	{
+		size += getPayloadSize(*r->measurement);
+	}
+	size += 4 + delta.constraints.size() * CONSTRAINT_SIZE;
+	size += 4 + delta.poses.size() * POSE_SIZE;
+	return size;
+}
+
+size_t DeltaEncoder::encode(const GraphDelta& delta, char* buffer, size_t capacity)
+{
+	buildTables(delta);
+	BinaryWriter writer(buffer, capacity);
+	write(delta, writer);
+	return writer.size();
+}
+
+void DeltaEncoder::encode(const GraphDelta& delta, std::vector<char>& buffer)
+{
+	buffer.clear();
+	buffer.reserve(getEncodedSize(delta));
+	BinaryWriter writer(buffer);
+	write(delta, writer);
+}
+
+void DeltaEncoder::write(const GraphDelta& delta, BinaryWriter& writer)
+{
+	writer.writeBytes(DELTA_MAGIC, 4);
+	writer.write<uint16_t>(DELTA_VERSION);
+	writer.write<uint8_t>(mPayload);
+	writer.write<ScalarType>(mResolution);
+	writer.write<uint32_t>(delta.base_revision);
+	writer.write<uint32_t>(delta.revision);
+	
+	writer.write<uint16_t>(mStrings.size());
+	for(std::vector<std::string>::const_iterator s = mStrings.begin(); s != mStrings.end(); ++s)
+	{
+		writer.writeString(*s);
+	}
+	writer.write<uint16_t>(mFrames.size());
+	for(std::vector<Frame, Eigen::aligned_allocator<Frame> >::const_iterator f = mFrames.begin(); f != mFrames.end(); ++f)
+	{
+		writer.write<uint16_t>(f->robot);
+		writer.write<uint16_t>(f->sensor);
+		writer.writeTransform(f->pose);
+	}
+	
+	writer.write<uint32_t>(delta.readings.size());
+	for(size_t i = 0; i < delta.readings.size(); i++)
+	{
+		const ExternalReading& r = delta.readings[i];
+		const Measurement& m = *r.measurement;
+		timeval stamp = m.getTimestamp();
+		writer.writeUuid(m.getUniqueId());
+		writer.write<uint16_t>(mReadingFrames[i]);
+		writer.write<int64_t>((int64_t)stamp.tv_sec * 1000000 + stamp.tv_usec);
+		writer.writeUuid(r.source);
+		writer.writeTransform(r.transform);
+		writer.writeCovariance(r.covariance);
+		writer.write<uint16_t>(getString(r.sensor));
+		
+		size_t size = getPayloadSize(m);
+		writer.write<uint32_t>(size);
+		if(size == 0)
+			continue;
+		if(mPayload == DELTA_COMPRESSED_PAYLOAD)
+			m.writeCompressedPayload(writer.reserve(size), mResolution);
+		else
+			m.writePayload(writer.reserve(size));
+	}
+	
+	writer.write<uint32_t>(delta.constraints.size());
+	for(ExternalConstraintList::const_iterator c = delta.constraints.begin(); c != delta.constraints.end(); ++c)
+	{
+		writer.writeUuid(c->source);
+		writer.writeUuid(c->target);
+		writer.writeTransform(c->transform);
+		writer.writeCovariance(c->covariance);
+		writer.write<uint16_t>(getString(c->sensor));
+	}
+	
+	writer.write<uint32_t>(delta.poses.size());
+	for(UuidPoseVector::const_iterator p = delta.poses.begin(); p != delta.poses.end(); ++p)
+	{
+		writer.writeUuid(p->first);
+		writer.writeTransform(p->second);
+	}
+}
+
+void DeltaDecoder::registerSensor(Sensor* s)
+{
+	mSensors[s->getName()] = s;
+}
+
+static const std::string& getString(const std::vector<std::string>& strings, uint16_t index)
+{
+	if(index >= strings.size())
+	{
+		throw SerializationError("Invalid name in delta!");
+	}
+	return strings[index];
+}
+
+void DeltaDecoder::decode(const char* buffer, size_t size, GraphDelta& delta) const
+{
+	BinaryReader reader(buffer, size);
+	if(memcmp(reader.skip(4), DELTA_MAGIC, 4) != 0)
+	{
+		throw SerializationError("Buffer does not contain a graph delta!");
+	}
+	uint16_t version = reader.read<uint16_t>();
+	if(version != DELTA_VERSION)
+	{
+		throw SerializationError((boost::format("Unsupported delta version %1%!") % version).str());
+	}
+	uint8_t payload = reader.read<uint8_t>();
+	ScalarType resolution = reader.read<ScalarType>();
+	delta.base_revision = reader.read<uint32_t>();
+	delta.revision = reader.read<uint32_t>();
+	
+	std::vector<std::string> strings(reader.read<uint16_t>());
+	for(std::vector<std::string>::iterator s = strings.begin(); s != strings.end(); ++s)
+	{
+		*s = reader.readString();
+	}
+	uint16_t frame_count = reader.read<uint16_t>();
+	std::vector<uint16_t> robots(frame_count);
+	std::vector<uint16_t> sensors(frame_count);
+	std::vector<Transform, Eigen::aligned_allocator<Transform> > poses(frame_count);
+	for(uint16_t f = 0; f < frame_count; f++)
+	{
+		robots[f] = reader.read<uint16_t>();
+		sensors[f] = reader.read<uint16_t>();
+		poses[f] = reader.readTransform();
+		if(robots[f] >= strings.size() || sensors[f] >= strings.size())
+		{
+			throw SerializationError("Invalid name in delta!");
+		}
+	}
+	
+	uint32_t count = reader.read<uint32_t>();
+	delta.readings.clear();
+	delta.readings.reserve(std::min<size_t>(count, reader.remaining() / READING_SIZE));
+	for(uint32_t i = 0; i < count; i++)
+	{
+		boost::uuids::uuid id = reader.readUuid();
+		uint16_t frame = reader.read<uint16_t>();
+		if(frame >= frame_count)
+		{
+			throw SerializationError("Invalid sensor pose in delta!");
+		}
+		int64_t microseconds = reader.read<int64_t>();
+		timeval stamp;
+		stamp.tv_sec = microseconds / 1000000;
+		stamp.tv_usec = microseconds % 1000000;
+		
+		ExternalReading r;
+		r.source = reader.readUuid();
+		r.transform = reader.readTransform();
+		r.covariance = reader.readCovariance();
+		r.sensor = getString(strings, reader.read<uint16_t>());
+		uint32_t payload_size = reader.read<uint32_t>();
+		const char* data = reader.skip(payload_size);
+		
+		const std::string& robot = getString(strings, robots[frame]);
+		const std::string& sensor_name = getString(strings, sensors[frame]);
+		SensorList::const_iterator s = mSensors.find(sensor_name);
+		if(s == mSensors.end())
+		{
+			r.measurement.reset(new Measurement(robot, sensor_name, poses[frame], id, stamp));
+			delta.readings.push_back(r);
+			continue;
+		}
+		r.measurement = s->second->createMeasurement(robot, id, stamp, poses[frame]);
+		try
+		{
+			if(payload_size > 0 && payload == DELTA_COMPRESSED_PAYLOAD)
+				r.measurement->readCompressedPayload(data, payload_size, resolution);
+			else if(payload_size > 0)
+				r.measurement->readPayload(data, payload_size);
+		}catch(BadMeasurementType &e)
+		{
+			throw SerializationError((boost::format("Invalid sensor data of measurement from '%1%'!") % sensor_name).str());
+		}
+		delta.readings.push_back(r);
+	}
+	
+	count = reader.read<uint32_t>();
+	delta.constraints.clear();
+	delta.constraints.reserve(std::min<size_t>(count, reader.remaining() / CONSTRAINT_SIZE));
+	for(uint32_t i = 0; i < count; i++)
+	{
+		ExternalConstraint c;
+		c.source = reader.readUuid();
+		c.target = reader.readUuid();
+		c.transform = reader.readTransform();
+		c.covariance = reader.readCovariance();
+		c.sensor = getString(strings, reader.read<uint16_t>());
+		delta.constraints.push_back(c);
+	}
+	
+	count = reader.read<uint32_t>();
+	delta.poses.clear();
+	delta.poses.reserve(std::min<size_t>(count, reader.remaining() / POSE_SIZE));
+	for(uint32_t i = 0; i < count; i++)
+	{
+		boost::uuids::uuid id = reader.readUuid();
+		delta.poses.push_back(UuidPose(id, reader.readTransform()));
+	}
+}
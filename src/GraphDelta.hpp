@@ -0,0 +1,164 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_GRAPHDELTA_HPP
+#define SLAM_GRAPHDELTA_HPP
+
+#include "GraphMapper.hpp"
+#include "Serialization.hpp"
+
+namespace slam3d
+{
+	/**
+	 * @struct GraphDelta
+	 * @brief Changes of a map to be shared with another robot.
+	 * @details The readings and constraints are usually filled by
+	 * GraphMapper::exportSince and applied on the receiving side with
+	 * GraphMapper::addExternalReadings and GraphMapper::addExternalConstraints.
+	 * Pose updates can be applied with GraphMapper::updatePoses.
+	 */
+	struct GraphDelta
+	{
+		GraphDelta() : base_revision(0), revision(0) {}
+		
+		/** @brief Revision of the sender's map the changes are based on */
+		uint32_t base_revision;
+		
+		/** @brief Revision of the sender's map including the changes */
+		uint32_t revision;
+		
+		ExternalReadingList readings;
+		ExternalConstraintList constraints;
+		UuidPoseVector poses;
+	};
+	
+	/**
+	 * @brief How the sensor data of the measurements in a delta is encoded.
+	 */
+	enum DeltaPayload
+	{
+		DELTA_NO_PAYLOAD = 0,
+		DELTA_RAW_PAYLOAD = 1,
+		DELTA_COMPRESSED_PAYLOAD = 2
+	};
+	
+	/**
+	 * @class DeltaEncoder
+	 * @brief Writes a GraphDelta in a compact, versioned binary format.
+	 * @details Robot and sensor names as well as sensor poses are written
+	 * once per delta into tables that are referenced by the measurements.
+	 * Values are written in the byte order of the host.
+	 */
+	class DeltaEncoder
+	{
+	public:
+		/**
+		 * @brief Constructor.
+		 * @param payload encoding of the sensor data
+		 * @param resolution maximum error of compressed sensor data
+		 */
+		DeltaEncoder(DeltaPayload payload = DELTA_COMPRESSED_PAYLOAD, ScalarType resolution = 0.005);
+		
+		/**
+		 * @brief Get the exact number of bytes needed to encode the delta.
+		 * @param delta
+		 */
+		size_t getEncodedSize(const GraphDelta& delta);
+		
+		/**
+		 * @brief Encode the delta into a preallocated buffer.
+		 * @param delta
+		 * @param buffer memory of at least getEncodedSize() bytes
+		 * @param capacity size of the buffer in bytes
+		 * @return number of bytes written
+		 * @throw SerializationError if the buffer is too small
+		 */
+		size_t encode(const GraphDelta& delta, char* buffer, size_t capacity);
+		
+		/**
+		 * @brief Encode the delta into the given vector, which is resized as needed.
+		 * @param delta
+		 * @param buffer receives the encoded delta
+		 */
+		void encode(const GraphDelta& delta, std::vector<char>& buffer);
+		
+	protected:
+		/**
+		 * @brief Collect the names and sensor poses of the delta.
+		 */
+		void buildTables(const GraphDelta& delta);
+		
+		uint16_t getString(const std::string& s);
+		uint16_t getFrame(const Measurement& m);
+		size_t getPayloadSize(const Measurement& m) const;
+		void write(const GraphDelta& delta, BinaryWriter& writer);
+		
+	protected:
+		struct Frame
+		{
+			uint16_t robot;
+			uint16_t sensor;
+			Transform pose;
+		};
+		
+		DeltaPayload mPayload;
+		ScalarType mResolution;
+		std::vector<std::string> mStrings;
+		std::vector<Frame, Eigen::aligned_allocator<Frame> > mFrames;
+		std::vector<uint16_t> mReadingFrames;
+	};
+	
+	/**
+	 * @class DeltaDecoder
+	 * @brief Reads a GraphDelta written by a DeltaEncoder.
+	 * @details Measurements are created by the registered sensor of the same
+	 * name, so their sensor data can be restored. Measurements of unknown
+	 * sensors are created without sensor data.
+	 */
+	class DeltaDecoder
+	{
+	public:
+		/**
+		 * @brief Register a sensor to create its measurements.
+		 * @param s
+		 */
+		void registerSensor(Sensor* s);
+		
+		/**
+		 * @brief Decode a delta from the given buffer.
+		 * @details The lists within the delta are replaced.
+		 * @param buffer encoded delta
+		 * @param size size of the buffer in bytes
+		 * @param delta receives the decoded delta
+		 * @throw SerializationError if the buffer does not contain a valid delta
+		 */
+		void decode(const char* buffer, size_t size, GraphDelta& delta) const;
+		
+	protected:
+		SensorList mSensors;
+	};
+}
+
+#endif
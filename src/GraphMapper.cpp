@@ -27,6 +27,8 @@
 
 #include <boost/format.hpp>
 
+#include <sys/time.h>
+
 using namespace slam3d;
 
 // Re-orthogonalize the rotation-matrix
@@ -43,15 +45,32 @@ GraphMapper::GraphMapper(Logger* log)
 {
 	mOdometry = NULL;
 	mSolver = NULL;
+	mPatchSolver = NULL;
+	mMeasurementStorage = NULL;
+	mJournal = NULL;
+	mMetrics = NULL;
 	mLogger = log;
 	
 	mNeighborRadius = 1.0;
+	mSearchSigma = 0;
+	mMaxSearchRadius = 10.0;
+	mMinOverlapProbability = 0.05;
 	mMinTranslation = 0.5;
 	mMinRotation = 0.1;
 	mAddOdometryEdges = false;
+	mPatchBuildingRange = 0;
 	mUseOdometryHeading = false;
 	mCurrentPose = Transform::Identity();
 	mOptimized = false;
+	
+	PosePublication publication;
+	publication.pose = Transform::Identity();
+	publication.stamp.tv_sec = 0;
+	publication.stamp.tv_usec = 0;
+	publication.anchor = Transform::Identity();
+	publication.anchor_odometry = Transform::Identity();
+	publication.anchor_stamp = publication.stamp;
+	mPublishedPose.store(publication);
 }
 
 GraphMapper::~GraphMapper()
@@ -61,6 +80,8 @@ GraphMapper::~GraphMapper()
 void GraphMapper::setSolver(Solver* solver)
 {
 	mSolver = solver;
+	if(mMetrics)
+		mSolver->setMetrics(mMetrics);
 	mSolver->addNode(0, Transform::Identity());
 	mSolver->setFixed(0);
 }
@@ -68,6 +89,8 @@ void GraphMapper::setSolver(Solver* solver)
 void GraphMapper::setPatchSolver(Solver* solver)
 {
 	mPatchSolver = solver;
+	if(mMetrics)
+		mPatchSolver->setMetrics(mMetrics);
 }
 
 void GraphMapper::setOdometry(Odometry* odom, bool add_edges)
@@ -76,15 +99,61 @@ void GraphMapper::setOdometry(Odometry* odom, bool add_edges)
 	mAddOdometryEdges = add_edges;
 }
 
+void GraphMapper::setMeasurementStorage(MeasurementStorage* storage)
+{
+	mMeasurementStorage = storage;
+}
+
+void GraphMapper::setJournal(Journal* journal)
+{
+	mJournal = journal;
+}
+
+void GraphMapper::setMetrics(Metrics* metrics)
+{
+	mMetrics = metrics;
+	if(mSolver)
+		mSolver->setMetrics(metrics);
+	if(mPatchSolver)
+		mPatchSolver->setMetrics(metrics);
+	for(SensorList::iterator s = mSensors.begin(); s != mSensors.end(); ++s)
+		s->second->setMetrics(metrics);
+}
+
+MemoryStats GraphMapper::getMemoryStats()
+{
+	updateMemoryStats();
+	return mMemoryStats;
+}
+
+void GraphMapper::updateMemoryStats()
+{
+	MemoryUsageMap usage;
+	getMemoryUsage(usage);
+	if(mSolver)
+		usage["solver"] = mSolver->getMemoryUsage();
+	if(mPatchSolver)
+		usage["patch_solver"] = mPatchSolver->getMemoryUsage();
+	for(SensorList::iterator s = mSensors.begin(); s != mSensors.end(); ++s)
+	{
+		MemoryUsage u = s->second->getMemoryUsage();
+		if(u.bytes > 0 || u.objects > 0)
+			usage["sensor." + s->first] = u;
+	}
+	mMemoryStats.update(usage);
+}
+
 void GraphMapper::registerSensor(Sensor* s)
 {
 	std::pair<SensorList::iterator, bool> result;
 	result = mSensors.insert(SensorList::value_type(s->getName(), s));
 	if(!result.second)
 	{
-		mLogger->message(ERROR, (boost::format("Sensor with name %1% already exists!") % s->getName()).str());
+		SLAM3D_LOG(mLogger, ERROR, (boost::format("Sensor with name %1% already exists!") % s->getName()).str());
 		return;
 	}
+	if(mMetrics)
+		s->setMetrics(mMetrics);
 }
 
 Transform GraphMapper::getCurrentPose()
@@ -95,18 +164,106 @@ Transform GraphMapper::getCurrentPose()
 void GraphMapper::setCurrentPose(const Transform& pose)
 {
 	mCurrentPose = pose;
+	republishCurrentPose();
+}
+
+Transform GraphMapper::getPublishedPose(timeval& stamp) const
+{
+	PosePublication publication;
+	mPublishedPose.load(publication);
+	stamp = publication.stamp;
+	return publication.pose;
+}
+
+Transform GraphMapper::getPublishedPose() const
+{
+	timeval stamp;
+	return getPublishedPose(stamp);
+}
+
+bool GraphMapper::updatePublishedPose(timeval stamp)
+{
+	if(!mOdometry)
+		return false;
+	
+	// Query the odometry before taking the lock, so the mapper is not delayed
+	Transform odometry;
+	try
+	{
+		odometry = mOdometry->getOdometricPose(stamp);
+	}catch(OdometryException &e)
+	{
+		return false;
+	}
+	
+	std::lock_guard<std::mutex> lock(mPublishMutex);
+	PosePublication publication;
+	mPublishedPose.load(publication);
+	if(!timercmp(&stamp, &publication.stamp, >))
+		return false;
+	publication.pose = publication.anchor * publication.anchor_odometry.inverse() * odometry;
+	publication.stamp = stamp;
+	mPublishedPose.store(publication);
+	return true;
+}
+
+void GraphMapper::publishCurrentPose(const timeval& stamp, const Transform& odometric_pose)
+{
+	std::lock_guard<std::mutex> lock(mPublishMutex);
+	PosePublication last;
+	mPublishedPose.load(last);
+	
+	PosePublication publication;
+	publication.anchor = getCurrentPose();
+	publication.anchor_odometry = odometric_pose;
+	publication.anchor_stamp = stamp;
+	publication.pose = publication.anchor;
+	publication.stamp = stamp;
+	if(mOdometry && timercmp(&last.stamp, &stamp, >))
+	{
+		// Keep the odometric motion that has been published beyond the reading
+		Transform odometry = last.anchor_odometry * last.anchor.inverse() * last.pose;
+		publication.pose = publication.anchor * odometric_pose.inverse() * odometry;
+		publication.stamp = last.stamp;
+	}
+	mPublishedPose.store(publication);
+}
+
+void GraphMapper::republishCurrentPose()
+{
+	PosePublication last;
+	mPublishedPose.load(last);
+	publishCurrentPose(last.anchor_stamp, last.anchor_odometry);
 }
 
 void GraphMapper::writeGraphToFile(const std::string &name)
 {
-	mLogger->message(ERROR, "Graph writing not implemented!");
+	SLAM3D_LOG(mLogger, ERROR, "Graph writing not implemented!");
+}
+
+bool GraphMapper::saveSession(const std::string& filename)
+{
+	SLAM3D_LOG(mLogger, ERROR, "Session saving not implemented!");
+	return false;
+}
+
+bool GraphMapper::loadSession(const std::string& filename)
+{
+	SLAM3D_LOG(mLogger, ERROR, "Session loading not implemented!");
+	return false;
+}
+
+bool GraphMapper::replayJournal(const std::string& filename)
+{
+	SLAM3D_LOG(mLogger, ERROR, "Journal replay not implemented!");
+	return false;
 }
 
 bool GraphMapper::checkMinDistance(const Transform &t)
 {
 	ScalarType rot = Eigen::AngleAxis<ScalarType>(t.rotation()).angle();
 	ScalarType trans = t.translation().norm();
-	mLogger->message(DEBUG, (boost::format("Translation: %1% / Rotation: %2%") % trans % rot).str());
+	SLAM3D_LOG(mLogger, DEBUG, (boost::format("Translation: %1% / Rotation: %2%") % trans % rot).str());
 	if(trans < mMinTranslation && std::abs(rot) < mMinRotation)
 		return false;
 	else
@@ -129,6 +286,31 @@ bool GraphMapper::getSensorForMeasurement(Measurement::Ptr measurement, Sensor*&
 	return false;
 }
 
+void GraphMapper::loadMeasurement(const Measurement::Ptr& measurement) const
+{
+	if(mMeasurementStorage)
+	{
+		mMeasurementStorage->load(measurement);
+	}
+}
+
+bool GraphMapper::pinMeasurement(const Measurement::Ptr& measurement) const
+{
+	if(mMeasurementStorage)
+	{
+		mMeasurementStorage->pin(measurement);
+	}
+	return measurement->hasPayload();
+}
+
+void GraphMapper::unpinMeasurement(const Measurement::Ptr& measurement) const
+{
+	if(mMeasurementStorage)
+	{
+		mMeasurementStorage->unpin(measurement);
+	}
+}
+
 bool GraphMapper::optimized()
 {
 	if(mOptimized)
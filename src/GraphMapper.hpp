@@ -72,8 +72,12 @@ if(!mapper->addReading(m))
 #include "Odometry.hpp"
 #include "Sensor.hpp"
 #include "Solver.hpp"
+#include "MeasurementStorage.hpp"
+#include "Journal.hpp"
+#include "SeqLock.hpp"
 
 #include <map>
+#include <mutex>
 
 namespace slam3d
 {
@@ -135,6 +139,58 @@ namespace slam3d
 			return msg.str().c_str();
 		}
 	};
+
+	/**
+	 * @struct ExternalReading
+	 * @brief Measurement from another robot together with its link to a known measurement.
+	 * @details See GraphMapper::addExternalReading for the meaning of the fields.
+	 */
+	struct ExternalReading
+	{
+		Measurement::Ptr measurement;
+		boost::uuids::uuid source;
+		Transform transform;
+		Covariance covariance;
+		std::string sensor;
+	};
+
+	/**
+	 * @struct ExternalConstraint
+	 * @brief Constraint from another robot between two measurements.
+	 * @details See GraphMapper::addExternalConstraint for the meaning of the fields.
+	 */
+	struct ExternalConstraint
+	{
+		boost::uuids::uuid source;
+		boost::uuids::uuid target;
+		Transform transform;
+		Covariance covariance;
+		std::string sensor;
+	};
+
+	typedef std::vector<ExternalReading> ExternalReadingList;
+	typedef std::vector<ExternalConstraint> ExternalConstraintList;
+	
+	typedef std::pair<boost::uuids::uuid, Transform> UuidPose;
+	typedef std::vector<UuidPose> UuidPoseVector;
+
+	/**
+	 * @struct ImportResult
+	 * @brief Outcome of adding a batch of external readings or constraints.
+	 */
+	struct ImportResult
+	{
+		ImportResult() : added(0), duplicates(0), unresolved(0) {}
+		
+		/** @brief Number of elements added to the graph */
+		unsigned added;
+		
+		/** @brief Number of elements skipped, because they already exist */
+		unsigned duplicates;
+		
+		/** @brief Number of elements skipped, because they refer to unknown measurements */
+		unsigned unresolved;
+	};
 	/**
 	 * @class GraphMapper
 	 * @brief Holds measurements from different sensors in a graph.
@@ -190,6 +246,65 @@ namespace slam3d
 		 */
 		void setOdometry(Odometry* odom, bool add_edges = false);
 
+		/**
+		 * @brief Sets a storage that keeps the measurements within a memory budget.
+		 * @details Without a storage all measurements are kept in memory. The
+		 * storage has to be set before the first measurement is added.
+		 * @param storage measurement storage to be used
+		 */
+		void setMeasurementStorage(MeasurementStorage* storage);
+
+		/**
+		 * @brief Keeps the data of a measurement in memory until it is unpinned.
+		 * @details Measurements that are used outside of the mapping thread,
+		 * e.g. for matching in the background, have to be pinned, so their
+		 * data is not released by the measurement storage. This has to be
+		 * called on the mapping thread.
+		 * @param measurement
+		 * @return false if the data of the measurement is not available
+		 */
+		bool pinMeasurement(const Measurement::Ptr& measurement) const;
+
+		/**
+		 * @brief Releases a measurement pinned with pinMeasurement.
+		 * @details This has to be called on the mapping thread.
+		 * @param measurement
+		 */
+		void unpinMeasurement(const Measurement::Ptr& measurement) const;
+
+		/**
+		 * @brief Sets a journal that records all changes to the graph.
+		 * @details After a crash, the map can be restored by calling
+		 * replayJournal with the journal's file.
+		 * @param journal journal to write changes to
+		 */
+		void setJournal(Journal* journal);
+
+		/**
+		 * @brief Sets a collector for timings of the mapping pipeline.
+		 * @details The metrics are passed on to the solvers and all sensors,
+		 * including those registered later. Nothing is measured if metrics
+		 * are not set or disabled.
+		 * @param metrics collector for timings, NULL to disable
+		 */
+		void setMetrics(Metrics* metrics);
+
+		/**
+		 * @brief Get the collector for timings of the mapping pipeline.
+		 * @return metrics set with setMetrics or NULL
+		 */
+		Metrics* getMetrics() const { return mMetrics; }
+
+		/**
+		 * @brief Get the memory used by the mapper, its solvers and sensors.
+		 * @details Categories of the mapper are "measurements", "vertices",
+		 * "edges" and "neighbor_index", followed by "solver", "patch_solver"
+		 * and "sensor.<name>" if they report any usage. The peak values
+		 * are sampled after every added reading and optimization.
+		 * @return current and peak usage per category
+		 */
+		MemoryStats getMemoryStats();
+
 		/**
 		 * @brief Register a sensor, so its data can be added to the graph.
 		 * @details Multiple sensors can be used, but in this case an odometry module
@@ -244,11 +359,67 @@ namespace slam3d
 		                                   const Covariance& covariance,
 		                                   const std::string& sensor) = 0;
 
+		/**
+		 * @brief Add many measurements from other robots at once.
+		 * @details In contrast to calling addExternalReading for each element,
+		 * the readings are passed to the solver in a single step. They are
+		 * inserted in the order of their timestamps and may refer to other
+		 * readings in the same batch. Readings that are already in the graph
+		 * or whose source cannot be found are skipped instead of throwing.
+		 * @param readings measurements with their link to a source measurement
+		 * @return number of added and skipped readings
+		 */
+		virtual ImportResult addExternalReadings(const ExternalReadingList& readings) = 0;
+		
+		/**
+		 * @brief Add many constraints from other robots at once.
+		 * @details Constraints that already exist or that refer to unknown
+		 * measurements are skipped instead of throwing.
+		 * @param constraints constraints between measurements
+		 * @return number of added and skipped constraints
+		 */
+		virtual ImportResult addExternalConstraints(const ExternalConstraintList& constraints) = 0;
+		
+		/**
+		 * @brief Get the revision of the graph.
+		 * @details The revision is increased with every vertex and edge that
+		 * is added to the graph. It can be passed to exportSince to get all
+		 * changes made after this call.
+		 */
+		virtual unsigned getRevision() const = 0;
+		
+		/**
+		 * @brief Export all vertices and edges added after the given revision.
+		 * @details The result can be passed to addExternalReadings and
+		 * addExternalConstraints of another mapper. Each vertex is exported
+		 * as a reading linked to an older vertex or to one exported before it,
+		 * all other edges are exported as constraints. The receiver has to know
+		 * the measurements that are referenced from before the revision.
+		 * Vertices and edges that have been removed in the meantime are not
+		 * exported.
+		 * @param revision revision as returned by getRevision, 0 for the whole graph
+		 * @param readings receives the new vertices
+		 * @param constraints receives the new edges
+		 */
+		virtual void exportSince(unsigned revision, ExternalReadingList& readings, ExternalConstraintList& constraints) const = 0;
+		
+		/**
+		 * @brief Set the poses of measurements, e.g. as optimized by another robot.
+		 * @details The poses are also passed to the solver as its estimate
+		 * for the next optimization. If the solver does not support this, the
+		 * next optimization replaces all poses with the solver's estimate.
+		 * Unknown measurements are ignored.
+		 * @param poses poses in map coordinates by the measurements' uuids
+		 * @return number of updated vertices
+		 */
+		virtual unsigned updatePoses(const UuidPoseVector& poses) = 0;
+
 		/**
 		 * @brief Get the current pose of the robot within the generated map.
 		 * @details The pose is updated at least whenever a new node is added.
 		 * Depending on the available information, it might be updated
-		 * more often. (e.g. when odometry is available)
+		 * more often. (e.g. when odometry is available) It must only be
+		 * called from the mapping thread, use getPublishedPose otherwise.
 		 * @return current robot pose in map coordinates
 		 */
 		virtual Transform getCurrentPose();
@@ -262,6 +433,35 @@ namespace slam3d
 		 */
 		virtual void setCurrentPose(const Transform& pose);
 		
+		/**
+		 * @brief Get the latest published robot pose in map coordinates.
+		 * @details In contrast to getCurrentPose, this can be called from any
+		 * thread at any rate without locking, e.g. from a control loop.
+		 * The mapper publishes the pose of each reading and after each
+		 * optimization, updatePublishedPose moves it with the odometry.
+		 * @param stamp receives the time of the pose
+		 * @return robot pose in map coordinates
+		 */
+		Transform getPublishedPose(timeval& stamp) const;
+		
+		/**
+		 * @brief Get the latest published robot pose in map coordinates.
+		 * @return robot pose in map coordinates
+		 */
+		Transform getPublishedPose() const;
+		
+		/**
+		 * @brief Move the published pose with the odometry between readings.
+		 * @details Intended to be called from the thread that drives the
+		 * odometry whenever it has new data. It must only be called from
+		 * one thread, and the registered Odometry must support queries that
+		 * run concurrently to the mapper, like the BufferedOdometry.
+		 * @param stamp time of the new pose
+		 * @return false if the odometry is not available at the given time,
+		 * or a newer pose has already been published
+		 */
+		bool updatePublishedPose(timeval stamp);
+		
 		/**
 		 * @brief Start the backend optimization process.
 		 * @details Requires that a Solver has been set with setSolver.
@@ -269,10 +469,43 @@ namespace slam3d
 		 */
 		virtual bool optimize() = 0;
 		
+		/**
+		 * @brief Start the backend optimization with limited iterations and duration.
+		 * @details This bounds the time spent in the solver, the result might
+		 * not be fully converged.
+		 * @param budget maximum iterations and duration of the optimization
+		 * @return true if optimization was successful
+		 */
+		virtual bool optimize(const OptimizationBudget& budget) = 0;
+		
 		/**
 		 * @brief Returns whether optimize() has been called since the last call to this.
 		 */
 		bool optimized();
+		
+		/**
+		 * @brief Remove a vertex and replace its edges with an approximation.
+		 * @details The information of all edges of the vertex is kept by new
+		 * edges between its former neighbors, so the remaining graph stays
+		 * as constrained as before. The measurement of the vertex is dropped.
+		 * The root vertex and the last added vertex cannot be removed.
+		 * @param id identifier of the vertex
+		 * @return true if the vertex has been removed
+		 * @throw std::out_of_range
+		 */
+		virtual bool marginalizeVertex(IdType id) = 0;
+		
+		/**
+		 * @brief Reduce the map to one vertex per area.
+		 * @details Every vertex of the sensor that is within the radius of an
+		 * older vertex that is kept, is removed with marginalizeVertex. When
+		 * called regularly, the size of the graph is bounded by the explored
+		 * area instead of growing with the duration of the mission.
+		 * @param sensor name of the sensor whose vertices are reduced
+		 * @param radius minimum distance between the remaining vertices
+		 * @return number of removed vertices
+		 */
+		virtual unsigned sparsify(const std::string& sensor, float radius) = 0;
 
 		/**
 		 * @brief Get the last vertex, that was locally added to the graph.
@@ -288,6 +521,31 @@ namespace slam3d
 		 */
 		virtual void writeGraphToFile(const std::string &name);
 
+		/**
+		 * @brief Save the complete map including all measurements to a binary file.
+		 * @details In contrast to writeGraphToFile, the written session can be
+		 * restored with loadSession, e.g. after a restart of the robot.
+		 * @param filename name of the session file
+		 * @return true if the session was written successfully
+		 */
+		virtual bool saveSession(const std::string& filename);
+
+		/**
+		 * @brief Restore a map from a file written by saveSession.
+		 * @param filename name of the session file
+		 * @return true if the session was loaded successfully
+		 */
+		virtual bool loadSession(const std::string& filename);
+
+		/**
+		 * @brief Restore all changes that have been recorded in a journal.
+		 * @details This can also be used after loadSession to restore the
+		 * changes made after the session has been written.
+		 * @param filename name of the journal file
+		 * @return true if the journal was replayed successfully
+		 */
+		virtual bool replayJournal(const std::string& filename);
+
 		/**
 		 * @brief Sets neighbor radius for matching
 		 * @details New nodes are matched against nodes of the same sensor
@@ -297,6 +555,27 @@ namespace slam3d
 		 */
 		void setNeighborRadius(float r, int l){ mNeighborRadius = r; mMaxNeighorLinks = l; }
 
+		/**
+		 * @brief Adapt the neighbor search to the uncertainty of the new pose.
+		 * @details The search radius is enlarged by sigma times the standard
+		 * deviation of the new pose's position along its most uncertain axis.
+		 * Each candidate is ranked by the probability that its relative
+		 * position to the new node lies within the neighbor radius, which
+		 * is estimated from the solver's relative covariance. Candidates
+		 * below the minimum probability are not matched. This requires a
+		 * solver that supports covariance queries, otherwise all candidates
+		 * within the neighbor radius are used as before.
+		 * @param sigma factor of the standard deviation, 0 to disable
+		 * @param max_radius upper limit of the enlarged search radius
+		 * @param min_probability minimum probability of a candidate to be matched
+		 */
+		void setAdaptiveNeighborSearch(float sigma, float max_radius, float min_probability)
+		{
+			mSearchSigma = sigma;
+			mMaxSearchRadius = max_radius;
+			mMinOverlapProbability = min_probability;
+		}
+
 		/**
 		 * @brief Set minimal change in pose between adjacent nodes.
 		 * @param t Minimum translation between nodes (in meter).
@@ -364,6 +643,33 @@ namespace slam3d
 		virtual EdgeObjectList getEdgeObjectsFromSensor(const std::string& sensor) const = 0;
 
 	protected:
+		/**
+		 * @struct PosePublication
+		 * @brief Published robot pose and the reading it was derived from.
+		 */
+		struct PosePublication
+		{
+			Transform pose;
+			timeval stamp;
+			Transform anchor;
+			Transform anchor_odometry;
+			timeval anchor_stamp;
+		};
+		
+		/**
+		 * @brief Publish getCurrentPose() as the pose at the time of a reading.
+		 * @details A newer pose from updatePublishedPose is kept and moved
+		 * along with the new reading's pose.
+		 * @param stamp time of the reading
+		 * @param odometric_pose odometric pose at the time of the reading
+		 */
+		void publishCurrentPose(const timeval& stamp, const Transform& odometric_pose);
+		
+		/**
+		 * @brief Publish getCurrentPose() again, e.g. after an optimization.
+		 */
+		void republishCurrentPose();
+		
 		static Transform orthogonalize(const Transform& t);
 		bool checkMinDistance(const Transform &t);
 
@@ -379,20 +685,48 @@ namespace slam3d
 		 * @returns true if a sensor for the given measurement is registered
 		 */
 		bool getSensorForMeasurement(Measurement::Ptr measurement, Sensor*& sensor);
+
+		/**
+		 * @brief Makes sure the data of the measurement is in memory.
+		 * @details This has to be called before a measurement from the graph
+		 * is passed to a sensor or returned to the user.
+		 * @param measurement
+		 */
+		void loadMeasurement(const Measurement::Ptr& measurement) const;
+
+		/**
+		 * @brief Adds the memory used by the graph structures to the map.
+		 * @param usage map of categories to be filled
+		 */
+		virtual void getMemoryUsage(MemoryUsageMap& usage) const {}
+
+		/**
+		 * @brief Samples the current memory usage to keep track of the peak.
+		 */
+		void updateMemoryStats();
 		
 	protected:
 		Solver* mSolver;
 		Solver* mPatchSolver;
 		Logger* mLogger;
 		Odometry* mOdometry;
+		MeasurementStorage* mMeasurementStorage;
+		Journal* mJournal;
+		Metrics* mMetrics;
+		MemoryStats mMemoryStats;
 		SensorList mSensors;
 
 		Transform mCurrentPose;
 		Transform mLastOdometricPose;
+		SeqLock<PosePublication> mPublishedPose;
+		std::mutex mPublishMutex;
 
 		// Parameters
 		int mMaxNeighorLinks;
 		float mNeighborRadius;
+		float mSearchSigma;
+		float mMaxSearchRadius;
+		float mMinOverlapProbability;
 		float mMinTranslation;
 		float mMinRotation;
 		bool mAddOdometryEdges;
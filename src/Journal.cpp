@@ -0,0 +1,362 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "Journal.hpp"
+#include "Serialization.hpp"
+
+#include <boost/format.hpp>
+#include <boost/crc.hpp>
+
+#include <chrono>
+#include <stdexcept>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+using namespace slam3d;
+
+#define JOURNAL_MAGIC "SLAM3DJL"
+#define JOURNAL_VERSION 1
+#define JOURNAL_HEADER_SIZE 12
+
+// Wake up the writer early when this many bytes are pending
+#define JOURNAL_COMMIT_SIZE (4 * 1024 * 1024)
+
+// Each record is framed as [uint32 size][uint8 type][content][uint32 crc],
+// where size is the size of the content and the crc covers type and content.
+#define RECORD_PREFIX_SIZE 5
+#define RECORD_SUFFIX_SIZE 4
+
+typedef std::chrono::steady_clock StopClock;
+
+static uint32_t checksum(const char* data, size_t size)
+{
+	boost::crc_32_type crc;
+	crc.process_bytes(data, size);
+	return crc.checksum();
+}
+
+Journal::Journal(Logger* logger, const std::string& filename, unsigned interval)
+ : mLogger(logger), mInterval(interval), mWritePayloads(false),
+   mRecorded(0), mWritten(0), mCommitRequested(false), mRunning(true), mFailed(false),
+   mWrittenSize(0), mCommits(0), mRecordingTime(0)
+{
+	mFileDescriptor = open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if(mFileDescriptor < 0)
+	{
+		throw std::runtime_error((boost::format("Could not open journal '%1%': %2%") % filename % strerror(errno)).str());
+	}
+	
+	// Cut off an incomplete record left by a crash, because everything
+	// appended behind it would be unreachable during replay.
+	off_t size = lseek(mFileDescriptor, 0, SEEK_END);
+	off_t valid = 0;
+	if(size >= JOURNAL_HEADER_SIZE)
+	{
+		try
+		{
+			JournalReader reader(filename);
+			JournalRecordType type;
+			const char* data;
+			size_t length;
+			while(reader.next(type, data, length)) {}
+			valid = reader.getPosition();
+		}catch(std::exception& e)
+		{
+			close(mFileDescriptor);
+			throw std::runtime_error((boost::format("Could not append to journal '%1%': %2%") % filename % e.what()).str());
+		}
+	}
+	if(valid < size)
+	{
+		SLAM3D_LOG(mLogger, WARNING, (boost::format("Discarding %1% bytes of incomplete records at the end of journal '%2%'.") % (size - valid) % filename).str());
+		if(ftruncate(mFileDescriptor, valid) != 0)
+		{
+			close(mFileDescriptor);
+			throw std::runtime_error((boost::format("Could not truncate journal '%1%': %2%") % filename % strerror(errno)).str());
+		}
+	}
+	
+	// Start a new journal with a header
+	if(valid == 0)
+	{
+		BinaryWriter writer(mPending);
+		writer.writeBytes(JOURNAL_MAGIC, 8);
+		writer.write<uint32_t>(JOURNAL_VERSION);
+	}
+	mThread = std::thread(&Journal::run, this);
+}
+
+Journal::~Journal()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mRunning = false;
+	}
+	mCondition.notify_one();
+	mThread.join();
+	close(mFileDescriptor);
+}
+
+size_t Journal::beginRecord(JournalRecordType type)
+{
+	size_t start = mPending.size();
+	BinaryWriter writer(mPending);
+	writer.write<uint32_t>(0);
+	writer.write<uint8_t>(type);
+	return start;
+}
+
+void Journal::finishRecord(size_t start)
+{
+	uint32_t size = mPending.size() - start - RECORD_PREFIX_SIZE;
+	memcpy(&mPending[start], &size, sizeof(size));
+	uint32_t crc = checksum(&mPending[start + 4], size + 1);
+	BinaryWriter writer(mPending);
+	writer.write<uint32_t>(crc);
+	mRecorded++;
+}
+
+void Journal::addVertex(const VertexObject& v)
+{
+	StopClock::time_point start_time = StopClock::now();
+	bool wake;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		size_t start = beginRecord(JOURNAL_VERTEX);
+		BinaryWriter writer(mPending);
+		writer.write<uint32_t>(v.index);
+		writer.writeString(v.label);
+		writer.writeUuid(v.measurement->getUniqueId());
+		writer.writeString(v.measurement->getRobotName());
+		writer.writeString(v.measurement->getSensorName());
+		writer.writeTimestamp(v.measurement->getTimestamp());
+		writer.writeTransform(v.measurement->getSensorPose());
+		writer.writeTransform(v.corrected_pose);
+		if(mWritePayloads && v.measurement->hasPayload())
+		{
+			uint64_t size = v.measurement->getPayloadSize();
+			writer.write<uint64_t>(size);
+			if(size > 0)
+				v.measurement->writePayload(writer.reserve(size));
+		}else
+		{
+			writer.write<uint64_t>(0);
+		}
+		finishRecord(start);
+		wake = mPending.size() > JOURNAL_COMMIT_SIZE;
+	}
+	if(wake)
+		mCondition.notify_one();
+	mRecordingTime += std::chrono::duration<double, std::micro>(StopClock::now() - start_time).count();
+}
+
+void Journal::addEdge(const EdgeObject& e)
+{
+	StopClock::time_point start_time = StopClock::now();
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		size_t start = beginRecord(JOURNAL_EDGE);
+		BinaryWriter writer(mPending);
+		writer.write<uint32_t>(e.source);
+		writer.write<uint32_t>(e.target);
+		writer.writeTransform(e.transform);
+		writer.writeCovariance(e.covariance);
+		writer.writeString(e.sensor);
+		writer.writeString(e.label);
+		finishRecord(start);
+	}
+	mRecordingTime += std::chrono::duration<double, std::micro>(StopClock::now() - start_time).count();
+}
+
+void Journal::addPoses(const IdPoseVector& poses)
+{
+	StopClock::time_point start_time = StopClock::now();
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		size_t start = beginRecord(JOURNAL_POSES);
+		BinaryWriter writer(mPending);
+		writer.write<uint32_t>(poses.size());
+		for(IdPoseVector::const_iterator it = poses.begin(); it != poses.end(); ++it)
+		{
+			writer.write<uint32_t>(it->first);
+			writer.writeTransform(it->second);
+		}
+		finishRecord(start);
+	}
+	mRecordingTime += std::chrono::duration<double, std::micro>(StopClock::now() - start_time).count();
+}
+
+void Journal::removeVertex(IdType id)
+{
+	StopClock::time_point start_time = StopClock::now();
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		size_t start = beginRecord(JOURNAL_REMOVAL);
+		BinaryWriter writer(mPending);
+		writer.write<uint32_t>(id);
+		finishRecord(start);
+	}
+	mRecordingTime += std::chrono::duration<double, std::micro>(StopClock::now() - start_time).count();
+}
+
+void Journal::addState(IdType last_vertex, const Transform& odometric_pose)
+{
+	StopClock::time_point start_time = StopClock::now();
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		size_t start = beginRecord(JOURNAL_STATE);
+		BinaryWriter writer(mPending);
+		writer.write<uint32_t>(last_vertex);
+		writer.writeTransform(odometric_pose);
+		finishRecord(start);
+	}
+	mRecordingTime += std::chrono::duration<double, std::micro>(StopClock::now() - start_time).count();
+}
+
+bool Journal::commit()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	uint64_t target = mRecorded;
+	mCommitRequested = true;
+	mCondition.notify_one();
+	mCommitted.wait(lock, [&]{ return mFailed || mWritten >= target; });
+	return mWritten >= target;
+}
+
+void Journal::run()
+{
+	std::vector<char> buffer;
+	std::unique_lock<std::mutex> lock(mMutex);
+	while(true)
+	{
+		mCondition.wait_for(lock, std::chrono::milliseconds(mInterval), [&]{
+			return !mRunning || mCommitRequested || mPending.size() > JOURNAL_COMMIT_SIZE; });
+		mCommitRequested = false;
+		
+		// After a failed write the file ends with a partial record, so
+		// nothing appended afterwards could be replayed.
+		if(mFailed)
+			mPending.clear();
+		
+		if(mPending.empty())
+		{
+			mCommitted.notify_all();
+			if(!mRunning)
+				break;
+			continue;
+		}
+		
+		// Take all pending records and write them without holding the lock
+		buffer.swap(mPending);
+		uint64_t recorded = mRecorded;
+		lock.unlock();
+		
+		size_t written = 0;
+		bool failed = false;
+		while(written < buffer.size())
+		{
+			ssize_t result = write(mFileDescriptor, &buffer[written], buffer.size() - written);
+			if(result < 0)
+			{
+				if(errno == EINTR)
+					continue;
+				SLAM3D_LOG(mLogger, FATAL, (boost::format("Failed to write journal: %1%") % strerror(errno)).str());
+				failed = true;
+				break;
+			}
+			written += result;
+		}
+		if(!failed && fdatasync(mFileDescriptor) != 0)
+		{
+			SLAM3D_LOG(mLogger, FATAL, (boost::format("Failed to synchronize journal: %1%") % strerror(errno)).str());
+			failed = true;
+		}
+		buffer.clear();
+		
+		lock.lock();
+		if(failed)
+		{
+			mFailed = true;
+		}else
+		{
+			mWritten = recorded;
+			mCommits++;
+		}
+		mWrittenSize += written;
+		mCommitted.notify_all();
+	}
+}
+
+JournalReader::JournalReader(const std::string& filename)
+ : mFile(filename, false), mPosition(JOURNAL_HEADER_SIZE), mTruncated(false)
+{
+	if(mFile.size() < JOURNAL_HEADER_SIZE || memcmp(mFile.data(), JOURNAL_MAGIC, 8) != 0)
+	{
+		throw SerializationError("File is not a journal!");
+	}
+	uint32_t version;
+	memcpy(&version, mFile.data() + 8, sizeof(version));
+	if(version != JOURNAL_VERSION)
+	{
+		throw SerializationError((boost::format("Unsupported journal version %1%!") % version).str());
+	}
+}
+
+bool JournalReader::next(JournalRecordType& type, const char*& data, size_t& size)
+{
+	if(mPosition == mFile.size())
+		return false;
+	
+	// Check that the record is complete and not damaged
+	uint32_t content_size;
+	if(mFile.size() - mPosition < RECORD_PREFIX_SIZE + RECORD_SUFFIX_SIZE)
+	{
+		mTruncated = true;
+		return false;
+	}
+	const char* record = mFile.data() + mPosition;
+	memcpy(&content_size, record, sizeof(content_size));
+	size_t record_size = RECORD_PREFIX_SIZE + content_size + RECORD_SUFFIX_SIZE;
+	if(mFile.size() - mPosition < record_size)
+	{
+		mTruncated = true;
+		return false;
+	}
+	uint32_t crc;
+	memcpy(&crc, record + RECORD_PREFIX_SIZE + content_size, sizeof(crc));
+	if(crc != checksum(record + 4, content_size + 1))
+	{
+		mTruncated = true;
+		return false;
+	}
+	
+	type = (JournalRecordType)record[4];
+	data = record + RECORD_PREFIX_SIZE;
+	size = content_size;
+	mPosition += record_size;
+	return true;
+}
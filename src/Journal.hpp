@@ -0,0 +1,219 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_JOURNAL_HPP
+#define SLAM_JOURNAL_HPP
+
+#include "Types.hpp"
+#include "Logger.hpp"
+#include "Solver.hpp"
+#include "MappedFile.hpp"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace slam3d
+{
+	/**
+	 * @brief Types of the records within a journal.
+	 */
+	enum JournalRecordType
+	{
+		JOURNAL_VERTEX = 1,
+		JOURNAL_EDGE = 2,
+		JOURNAL_POSES = 3,
+		JOURNAL_STATE = 4,
+		JOURNAL_REMOVAL = 5
+	};
+	
+	/**
+	 * @class Journal
+	 * @brief Append-only log of all changes to the pose graph.
+	 * @details The mapper writes every added vertex and edge as well as the
+	 * results of each optimization to the journal, so the map can be restored
+	 * with GraphMapper::replayJournal after a crash. Records are encoded on the
+	 * calling thread into a memory buffer, while a background thread writes
+	 * them to disk. All records collected during one commit interval are
+	 * written and synchronized together (group commit), so the mapping thread
+	 * never waits for the disk.
+	 * 
+	 * Each record is framed by its length and a checksum, so an incomplete
+	 * record at the end of the file (e.g. from a crash during writing) is
+	 * detected and ignored during replay.
+	 */
+	class Journal
+	{
+	public:
+		/**
+		 * @brief Constructor, opens the journal file for appending.
+		 * @details An incomplete record at the end of an existing journal is
+		 * removed before new records are appended.
+		 * @param logger
+		 * @param filename name of the journal file
+		 * @param interval time between two commits in milliseconds
+		 * @throw std::runtime_error if the file cannot be opened or is not a journal
+		 */
+		Journal(Logger* logger, const std::string& filename, unsigned interval = 20);
+		
+		/**
+		 * @brief Destructor, commits all pending records.
+		 */
+		~Journal();
+		
+		/**
+		 * @brief Whether to include the sensor data of each measurement.
+		 * @details Without the payloads, the journal is much smaller and faster,
+		 * but replay only restores the graph structure and measurement meta
+		 * information. The sensor data can then be loaded from a session.
+		 * @param write write payloads into the journal
+		 */
+		void setWritePayloads(bool write) { mWritePayloads = write; }
+		
+		/**
+		 * @brief Record a new vertex.
+		 * @param v the vertex that was added to the graph
+		 */
+		void addVertex(const VertexObject& v);
+		
+		/**
+		 * @brief Record a new edge.
+		 * @param e the edge that was added to the graph
+		 */
+		void addEdge(const EdgeObject& e);
+		
+		/**
+		 * @brief Record the removal of a vertex and all its edges.
+		 * @param id the vertex that was removed from the graph
+		 */
+		void removeVertex(IdType id);
+		
+		/**
+		 * @brief Record the new vertex poses after an optimization.
+		 * @param poses list of updated poses
+		 */
+		void addPoses(const IdPoseVector& poses);
+		
+		/**
+		 * @brief Record the state of the mapper after adding a reading.
+		 * @param last_vertex id of the last vertex added by the robot
+		 * @param odometric_pose odometric pose of the last vertex
+		 */
+		void addState(IdType last_vertex, const Transform& odometric_pose);
+		
+		/**
+		 * @brief Block until all recorded changes have been written to disk.
+		 * @details After a failed write or synchronization, the journal stops
+		 * writing and all following commits fail.
+		 * @return false if the changes could not be written
+		 */
+		bool commit();
+		
+		/**
+		 * @brief Get the number of bytes written to the journal so far.
+		 */
+		size_t getWrittenSize() const { return mWrittenSize; }
+		
+		/**
+		 * @brief Get the number of commits to disk so far.
+		 */
+		size_t getNumberOfCommits() const { return mCommits; }
+		
+		/**
+		 * @brief Get the accumulated time spent in the calling thread in microseconds.
+		 * @details This is the overhead of journaling on the mapping thread,
+		 * which is only the encoding of the records into memory.
+		 */
+		double getRecordingTime() const { return mRecordingTime; }
+		
+	protected:
+		size_t beginRecord(JournalRecordType type);
+		void finishRecord(size_t start);
+		void run();
+		
+	protected:
+		Logger* mLogger;
+		int mFileDescriptor;
+		unsigned mInterval;
+		bool mWritePayloads;
+		
+		std::thread mThread;
+		std::mutex mMutex;
+		std::condition_variable mCondition;
+		std::condition_variable mCommitted;
+		std::vector<char> mPending;
+		uint64_t mRecorded;
+		uint64_t mWritten;
+		bool mCommitRequested;
+		bool mRunning;
+		bool mFailed;
+		
+		size_t mWrittenSize;
+		size_t mCommits;
+		double mRecordingTime;
+	};
+	
+	/**
+	 * @class JournalReader
+	 * @brief Iterates over the valid records of a journal file.
+	 */
+	class JournalReader
+	{
+	public:
+		/**
+		 * @brief Opens a journal file for reading.
+		 * @param filename
+		 * @throw FileMappingError
+		 * @throw SerializationError
+		 */
+		JournalReader(const std::string& filename);
+		
+		/**
+		 * @brief Advance to the next record.
+		 * @param type type of the record
+		 * @param data pointer to the record's content
+		 * @param size size of the record's content
+		 * @return false at the end of the journal or at an incomplete record
+		 */
+		bool next(JournalRecordType& type, const char*& data, size_t& size);
+		
+		/**
+		 * @brief Whether the journal ended with a damaged or incomplete record.
+		 */
+		bool isTruncated() const { return mTruncated; }
+		
+		/**
+		 * @brief Get the file offset behind the last valid record read so far.
+		 */
+		size_t getPosition() const { return mPosition; }
+		
+	protected:
+		MappedFile mFile;
+		size_t mPosition;
+		bool mTruncated;
+	};
+}
+
+#endif
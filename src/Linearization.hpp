@@ -0,0 +1,169 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_LINEARIZATION_HPP
+#define SLAM_LINEARIZATION_HPP
+
+#include "Types.hpp"
+
+namespace slam3d
+{
+	typedef Eigen::Matrix<ScalarType,6,1> Vector6;
+	typedef Eigen::Matrix<ScalarType,6,6> Matrix6;
+	
+	/**
+	 * @brief Get the skew-symmetric matrix, so that skew(v) * w = v x w.
+	 */
+	inline Eigen::Matrix<ScalarType,3,3> skew(const Vector3& v)
+	{
+		Eigen::Matrix<ScalarType,3,3> m;
+		m <<     0, -v(2),  v(1),
+		      v(2),     0, -v(0),
+		     -v(1),  v(0),     0;
+		return m;
+	}
+	
+	/**
+	 * @brief Get the adjoint of a transform for increments (translation, rotation).
+	 * @details For an increment d applied from the right, it holds that
+	 * tf * exp(d) = exp(adjoint(tf) * d) * tf.
+	 */
+	inline Matrix6 adjoint(const Transform& tf)
+	{
+		Matrix6 adj = Matrix6::Zero();
+		adj.topLeftCorner<3,3>() = tf.linear();
+		adj.topRightCorner<3,3>() = skew(tf.translation()) * tf.linear();
+		adj.bottomRightCorner<3,3>() = tf.linear();
+		return adj;
+	}
+	
+	/**
+	 * @brief Get the scaling from increments (translation, rotation vector)
+	 * to the residual (translation, imaginary part of quaternion) near the identity.
+	 */
+	inline Vector6 errorScale()
+	{
+		return (Vector6() << 1, 1, 1, 0.5, 0.5, 0.5).finished();
+	}
+	
+	/**
+	 * @brief Get the covariance of the relative pose source^-1 * target.
+	 * @details All covariances are given for increments applied from the right.
+	 * @param source pose of the source node
+	 * @param target pose of the target node
+	 * @param source_cov marginal covariance of the source node
+	 * @param target_cov marginal covariance of the target node
+	 * @param cross correlation with the source's increment in the rows and the target's in the columns
+	 */
+	inline Matrix6 relativeCovariance(const Transform& source, const Transform& target,
+	                                  const Matrix6& source_cov, const Matrix6& target_cov,
+	                                  const Matrix6& cross)
+	{
+		// The relative increment is d_t - adjoint(target^-1 * source) * d_s
+		Matrix6 A = adjoint(target.inverse() * source);
+		Matrix6 relative = target_cov + A * source_cov * A.transpose() - A * cross - cross.transpose() * A.transpose();
+		return 0.5 * (relative + relative.transpose());
+	}
+	
+	/**
+	 * @brief Apply an increment (translation, rotation vector) from the right.
+	 */
+	inline Transform applyIncrement(const Transform& tf, const Vector6& d)
+	{
+		Vector3 rotation = d.tail<3>();
+		ScalarType angle = rotation.norm();
+		Transform increment = Transform::Identity();
+		if(angle > 0)
+		{
+			increment.linear() = Eigen::AngleAxis<ScalarType>(angle, rotation / angle).toRotationMatrix();
+		}
+		increment.translation() = d.head<3>();
+		return tf * increment;
+	}
+	
+	/**
+	 * @brief Compute the residual of a relative pose constraint.
+	 * @details The residual is the translation and the imaginary part of the
+	 * quaternion of E = Z^-1 * Xi^-1 * Xj, which is the same as in g2o's
+	 * EdgeSE3. Therefore the covariances of the constraints are expected in
+	 * these coordinates.
+	 * @param inverse_measurement inverse of the measured transform Z
+	 * @param source pose Xi of the source node
+	 * @param target pose Xj of the target node
+	 * @param error the residual
+	 */
+	inline void computePoseError(const Transform& inverse_measurement,
+	                             const Transform& source,
+	                             const Transform& target,
+	                             Vector6& error)
+	{
+		Transform delta = inverse_measurement * source.inverse() * target;
+		Eigen::Quaternion<ScalarType> q(delta.linear());
+		if(q.w() < 0)
+			q.coeffs() *= -1;
+		error.head<3>() = delta.translation();
+		error.tail<3>() = q.vec();
+	}
+	
+	/**
+	 * @brief Compute residual and Jacobians of a relative pose constraint.
+	 * @details The Jacobians are taken with respect to increments that are
+	 * applied from the right with applyIncrement.
+	 * @param inverse_measurement inverse of the measured transform Z
+	 * @param source pose Xi of the source node
+	 * @param target pose Xj of the target node
+	 * @param error the residual
+	 * @param Ji Jacobian with respect to the source node
+	 * @param Jj Jacobian with respect to the target node
+	 */
+	inline void linearizePoseError(const Transform& inverse_measurement,
+	                               const Transform& source,
+	                               const Transform& target,
+	                               Vector6& error, Matrix6& Ji, Matrix6& Jj)
+	{
+		Transform relative = source.inverse() * target;
+		Transform delta = inverse_measurement * relative;
+		Eigen::Quaternion<ScalarType> q(delta.linear());
+		if(q.w() < 0)
+			q.coeffs() *= -1;
+		error.head<3>() = delta.translation();
+		error.tail<3>() = q.vec();
+		
+		// Derivative of the quaternion's imaginary part after a rotation from the right
+		Eigen::Matrix<ScalarType,3,3> dq = 0.5 * (q.w() * Eigen::Matrix<ScalarType,3,3>::Identity() + skew(q.vec()));
+		const Eigen::Matrix<ScalarType,3,3>& Rz = inverse_measurement.linear();
+		
+		Jj.setZero();
+		Jj.topLeftCorner<3,3>() = delta.linear();
+		Jj.bottomRightCorner<3,3>() = dq;
+		
+		Ji.setZero();
+		Ji.topLeftCorner<3,3>() = -Rz;
+		Ji.topRightCorner<3,3>() = Rz * skew(relative.translation());
+		Ji.bottomRightCorner<3,3>() = -dq * relative.linear().transpose();
+	}
+}
+
+#endif
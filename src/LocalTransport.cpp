@@ -0,0 +1,86 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "LocalTransport.hpp"
+
+#include <boost/format.hpp>
+
+#include <chrono>
+
+using namespace slam3d;
+
+size_t LocalNetwork::getSentBytes()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	return mSentBytes;
+}
+
+LocalTransport::LocalTransport(LocalNetwork& network, int agent)
+ : mNetwork(network), mAgent(agent)
+{
+	std::unique_lock<std::mutex> lock(mNetwork.mMutex);
+	if(!mNetwork.mMailboxes.insert(std::make_pair(agent, std::deque<TransportMessage>())).second)
+	{
+		throw TransportError((boost::format("Agent %1% is already connected!") % agent).str());
+	}
+}
+
+LocalTransport::~LocalTransport()
+{
+	std::unique_lock<std::mutex> lock(mNetwork.mMutex);
+	mNetwork.mMailboxes.erase(mAgent);
+}
+
+bool LocalTransport::send(int agent, const std::vector<char>& payload)
+{
+	std::unique_lock<std::mutex> lock(mNetwork.mMutex);
+	std::map<int, std::deque<TransportMessage> >::iterator mailbox = mNetwork.mMailboxes.find(agent);
+	if(mailbox == mNetwork.mMailboxes.end())
+	{
+		return false;
+	}
+	mailbox->second.push_back(TransportMessage());
+	mailbox->second.back().sender = mAgent;
+	mailbox->second.back().payload = payload;
+	mNetwork.mSentBytes += payload.size();
+	mNetwork.mDelivered.notify_all();
+	return true;
+}
+
+bool LocalTransport::receive(TransportMessage& message, double timeout)
+{
+	std::unique_lock<std::mutex> lock(mNetwork.mMutex);
+	std::deque<TransportMessage>& mailbox = mNetwork.mMailboxes[mAgent];
+	if(!mNetwork.mDelivered.wait_for(lock, std::chrono::duration<double>(timeout), [&mailbox]{ return !mailbox.empty(); }))
+	{
+		return false;
+	}
+	
+	// Hand over the buffer instead of copying it
+	message.sender = mailbox.front().sender;
+	message.payload.swap(mailbox.front().payload);
+	mailbox.pop_front();
+	return true;
+}
@@ -0,0 +1,94 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_LOCALTRANSPORT_HPP
+#define SLAM_LOCALTRANSPORT_HPP
+
+#include "Transport.hpp"
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+
+namespace slam3d
+{
+	/**
+	 * @class LocalNetwork
+	 * @brief Mailboxes of all agents that run within the same process.
+	 * @details This stands in for a real network in tests and simulations.
+	 * Messages are moved between threads through shared memory, so they are
+	 * neither limited in size nor lost while the receiver is connected.
+	 */
+	class LocalNetwork
+	{
+	public:
+		LocalNetwork() : mSentBytes(0) {}
+		
+		/**
+		 * @brief Get the number of bytes that have been sent through the network.
+		 */
+		size_t getSentBytes();
+		
+	protected:
+		friend class LocalTransport;
+		
+		std::mutex mMutex;
+		std::condition_variable mDelivered;
+		std::map<int, std::deque<TransportMessage> > mMailboxes;
+		size_t mSentBytes;
+	};
+	
+	/**
+	 * @class LocalTransport
+	 * @brief Exchanges messages between agents connected to the same LocalNetwork.
+	 */
+	class LocalTransport : public Transport
+	{
+	public:
+		/**
+		 * @brief Connect an agent to the network.
+		 * @param network network shared by all agents, has to outlive the transport
+		 * @param agent id of this agent
+		 * @throw TransportError if the id is already connected
+		 */
+		LocalTransport(LocalNetwork& network, int agent);
+		
+		/**
+		 * @brief Disconnect the agent, undelivered messages are dropped.
+		 */
+		~LocalTransport();
+		
+		int getAgentId() const { return mAgent; }
+		bool send(int agent, const std::vector<char>& payload);
+		bool receive(TransportMessage& message, double timeout);
+		
+	protected:
+		LocalNetwork& mNetwork;
+		int mAgent;
+	};
+}
+
+#endif
@@ -42,6 +42,24 @@
 
 #define USEC std::setw(6)<<std::left<<std::setfill('0')
 
+// Messages below this level are removed at compile time (0 = DEBUG, 4 = FATAL)
+#ifndef SLAM3D_MIN_LOG_LEVEL
+#define SLAM3D_MIN_LOG_LEVEL 0
+#endif
+
+/**
+ * @brief Log a message only if its level is enabled.
+ * @details In contrast to calling Logger::message directly, the message
+ * expression is only evaluated after the level check, so formatting costs
+ * nothing for disabled levels. Levels below SLAM3D_MIN_LOG_LEVEL are
+ * eliminated by the compiler.
+ */
+#define SLAM3D_LOG(logger, lvl, msg) \
+	do { \
+		if((lvl) >= SLAM3D_MIN_LOG_LEVEL && (logger)->isEnabled(lvl)) \
+			(logger)->message((lvl), (msg)); \
+	} while(0)
+
 namespace slam3d
 {
 	enum LOG_LEVEL{DEBUG, INFO, WARNING, ERROR, FATAL};
@@ -67,6 +85,12 @@ namespace slam3d
 		 */
 		virtual void setLogLevel(LOG_LEVEL lvl){mLogLevel = lvl;}
 		
+		/**
+		 * @brief Check if messages of the given level would be printed.
+		 * @param lvl log-level to check
+		 */
+		bool isEnabled(LOG_LEVEL lvl) const { return lvl >= mLogLevel; }
+		
 		/**
 		 * @brief Prints a message, showing log-level and timestamp.
 		 * @param lvl the message's log-level
@@ -0,0 +1,247 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "MapMerger.hpp"
+
+#include <boost/format.hpp>
+#include <boost/functional/hash.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <thread>
+#include <tuple>
+#include <unordered_set>
+
+using namespace slam3d;
+
+typedef std::tuple<int, int, int> Cell;
+typedef std::map<Cell, std::vector<size_t> > CellGrid;
+
+static Cell getCell(const Vector3& position, double size)
+{
+	return Cell((int)std::floor(position(0) / size), (int)std::floor(position(1) / size), (int)std::floor(position(2) / size));
+}
+
+// Pin the measurement of a keyframe once, the state is cached in 'available'
+static bool pinKeyframe(const GraphMapper& mapper, const VertexObjectList& keyframes, size_t index,
+	std::vector<char>& available, std::vector<Measurement::Ptr>& pinned, size_t& missing)
+{
+	if(available[index] < 0)
+	{
+		available[index] = mapper.pinMeasurement(keyframes[index].measurement);
+		pinned.push_back(keyframes[index].measurement);
+		if(!available[index])
+			missing++;
+	}
+	return available[index];
+}
+
+MapMerger::MapMerger(Logger* logger, Sensor* sensor, const MapMergerConfiguration& config)
+ : mLogger(logger), mMetrics(NULL), mSensor(sensor), mConfig(config), mPinnedBy(NULL)
+{
+	if(mConfig.search_radius <= 0)
+		mConfig.search_radius = 1;
+}
+
+MapMerger::~MapMerger()
+{
+	unpinAll();
+}
+
+void MapMerger::unpinAll()
+{
+	for(std::vector<Measurement::Ptr>::iterator m = mPinned.begin(); m != mPinned.end(); ++m)
+		mPinnedBy->unpinMeasurement(*m);
+	mPinned.clear();
+	mPinnedBy = NULL;
+}
+
+size_t MapMerger::prepare(const GraphMapper& mapper, const std::vector<boost::uuids::uuid>& incoming)
+{
+	ScopedTimer timer(mMetrics, "merger.prepare");
+	unpinAll();
+	mCandidates.clear();
+	mConstraints.clear();
+	mPinnedBy = &mapper;
+	
+	// Index the incoming keyframes in a grid with the search radius as cell size
+	VertexObjectList keyframes = mapper.getVertexObjectsFromSensor(mSensor->getName());
+	std::unordered_set<boost::uuids::uuid, boost::hash<boost::uuids::uuid> > incoming_ids(incoming.begin(), incoming.end());
+	std::vector<size_t> local;
+	std::vector<size_t> indexed;
+	CellGrid grid;
+	for(size_t i = 0; i < keyframes.size(); i++)
+	{
+		if(incoming_ids.find(keyframes[i].measurement->getUniqueId()) == incoming_ids.end())
+		{
+			local.push_back(i);
+			continue;
+		}
+		grid[getCell(keyframes[i].corrected_pose.translation(), mConfig.search_radius)].push_back(indexed.size());
+		indexed.push_back(i);
+	}
+	
+	// Search the neighboring cells around each keyframe from another robot
+	std::vector<std::vector<std::pair<double, size_t> > > neighbors(indexed.size());
+	for(std::vector<size_t>::iterator l = local.begin(); l != local.end(); ++l)
+	{
+		const VertexObject& source = keyframes[*l];
+		Vector3 position = source.corrected_pose.translation();
+		Cell cell = getCell(position, mConfig.search_radius);
+		for(int dx = -1; dx <= 1; dx++)
+		for(int dy = -1; dy <= 1; dy++)
+		for(int dz = -1; dz <= 1; dz++)
+		{
+			CellGrid::iterator c = grid.find(Cell(std::get<0>(cell) + dx, std::get<1>(cell) + dy, std::get<2>(cell) + dz));
+			if(c == grid.end())
+				continue;
+			for(std::vector<size_t>::iterator n = c->second.begin(); n != c->second.end(); ++n)
+			{
+				const VertexObject& target = keyframes[indexed[*n]];
+				if(target.measurement->getRobotName() == source.measurement->getRobotName())
+					continue;
+				double distance = (target.corrected_pose.translation() - position).norm();
+				if(distance <= mConfig.search_radius)
+					neighbors[*n].push_back(std::make_pair(distance, *l));
+			}
+		}
+	}
+	
+	// Keep the nearest candidates of each incoming keyframe, the data of
+	// both measurements is pinned so it stays in memory during evaluate()
+	std::vector<char> available(keyframes.size(), -1);
+	size_t missing = 0;
+	for(size_t n = 0; n < neighbors.size(); n++)
+	{
+		std::vector<std::pair<double, size_t> >& list = neighbors[n];
+		size_t count = std::min<size_t>(list.size(), mConfig.max_candidates);
+		std::partial_sort(list.begin(), list.begin() + count, list.end());
+		if(count > 0 && !pinKeyframe(mapper, keyframes, indexed[n], available, mPinned, missing))
+			continue;
+		const VertexObject& target = keyframes[indexed[n]];
+		for(size_t i = 0; i < count; i++)
+		{
+			if(!pinKeyframe(mapper, keyframes, list[i].second, available, mPinned, missing))
+				continue;
+			const VertexObject& source = keyframes[list[i].second];
+			Candidate candidate;
+			candidate.source = source.measurement;
+			candidate.target = target.measurement;
+			candidate.guess = source.corrected_pose.inverse() * target.corrected_pose;
+			candidate.distance = list[i].first;
+			mCandidates.push_back(candidate);
+		}
+	}
+	if(missing > 0)
+	{
+		SLAM3D_LOG(mLogger, ERROR, (boost::format("Dropped merge candidates of %1% keyframes without measurement data.") % missing).str());
+		if(mMetrics)
+			mMetrics->increment("merger.missing_payloads", missing);
+	}
+	SLAM3D_LOG(mLogger, INFO, (boost::format("Found %1% merge candidates for %2% incoming keyframes.")
+		% mCandidates.size() % indexed.size()).str());
+	return mCandidates.size();
+}
+
+bool MapMerger::match(size_t candidate)
+{
+	Candidate& c = mCandidates[candidate];
+	try
+	{
+		TransformWithCovariance coarse = mSensor->calculateTransform(c.source, c.target, c.guess, true);
+		c.result = mSensor->calculateTransform(c.source, c.target, coarse.transform);
+		return true;
+	}catch(NoMatch &e)
+	{
+		return false;
+	}catch(BadMeasurementType &e)
+	{
+		return false;
+	}
+}
+
+size_t MapMerger::evaluate()
+{
+	ScopedTimer timer(mMetrics, "merger.evaluate");
+	mConstraints.clear();
+	std::vector<char> matched(mCandidates.size(), 0);
+	size_t num_threads = std::min<size_t>(std::max(mConfig.threads, 1u), mCandidates.size());
+	if(num_threads < 2)
+	{
+		for(size_t i = 0; i < mCandidates.size(); i++)
+			matched[i] = match(i);
+	}else
+	{
+		// Candidates are independent, each worker takes the next unmatched one
+		std::atomic<size_t> next(0);
+		std::vector<std::thread> workers;
+		for(size_t t = 0; t < num_threads; t++)
+		{
+			workers.push_back(std::thread([this, &matched, &next]()
+			{
+				for(size_t i = next++; i < mCandidates.size(); i = next++)
+					matched[i] = match(i);
+			}));
+		}
+		for(std::vector<std::thread>::iterator w = workers.begin(); w != workers.end(); ++w)
+			w->join();
+	}
+	
+	for(size_t i = 0; i < mCandidates.size(); i++)
+	{
+		if(!matched[i])
+			continue;
+		ExternalConstraint constraint;
+		constraint.source = mCandidates[i].source->getUniqueId();
+		constraint.target = mCandidates[i].target->getUniqueId();
+		constraint.transform = mCandidates[i].result.transform;
+		constraint.covariance = mCandidates[i].result.covariance;
+		constraint.sensor = mSensor->getName();
+		mConstraints.push_back(constraint);
+	}
+	if(mMetrics)
+		mMetrics->increment("merger.match_failures", mCandidates.size() - mConstraints.size());
+	SLAM3D_LOG(mLogger, INFO, (boost::format("Verified %1% of %2% merge candidates with %3% threads.")
+		% mConstraints.size() % mCandidates.size() % num_threads).str());
+	return mConstraints.size();
+}
+
+ImportResult MapMerger::commit(GraphMapper& mapper)
+{
+	ScopedTimer timer(mMetrics, "merger.commit");
+	ImportResult result = mapper.addExternalConstraints(mConstraints);
+	mCandidates.clear();
+	unpinAll();
+	return result;
+}
+
+ImportResult MapMerger::merge(GraphMapper& mapper, const std::vector<boost::uuids::uuid>& incoming)
+{
+	prepare(mapper, incoming);
+	evaluate();
+	return commit(mapper);
+}
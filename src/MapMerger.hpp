@@ -0,0 +1,153 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_MAPMERGER_HPP
+#define SLAM_MAPMERGER_HPP
+
+#include "GraphMapper.hpp"
+#include "MapMergerConfiguration.hpp"
+
+namespace slam3d
+{
+	/**
+	 * @class MapMerger
+	 * @brief Finds loop closures between the keyframes of different robots.
+	 * @details External readings are only linked to the measurement given as
+	 * their source, so the overlap with the maps of other robots is not found
+	 * by the mapper. The merger indexes incoming keyframes spatially, matches
+	 * them with nearby keyframes of other robots and adds the verified
+	 * constraints to the mapper in one batch.
+	 * 
+	 * A merge is split in three steps, so the expensive matching does not stall
+	 * the mapping thread: prepare() takes a snapshot of the candidates from the
+	 * mapper, evaluate() matches them in parallel and can run on a background
+	 * thread, while the mapper keeps adding readings. Finally, commit() adds
+	 * the constraints to the mapper. The sensor's calculateTransform is called
+	 * concurrently, so it has to be thread-safe, and the logger has to accept
+	 * messages from several threads. The measurements of the candidates are
+	 * pinned in the mapper's MeasurementStorage from prepare() until commit(),
+	 * so their data is not released while they are matched.
+	 */
+	class MapMerger
+	{
+	public:
+		/**
+		 * @brief Constructor.
+		 * @param logger
+		 * @param sensor sensor whose keyframes are matched
+		 * @param config
+		 */
+		MapMerger(Logger* logger, Sensor* sensor, const MapMergerConfiguration& config = MapMergerConfiguration());
+		
+		/**
+		 * @brief Destructor, unpins the measurements of remaining candidates.
+		 * @details Like prepare() and commit(), this has to be called on the
+		 * mapping thread if candidates are left.
+		 */
+		~MapMerger();
+		
+		/**
+		 * @brief Set the metrics to record timings of the merge.
+		 * @param metrics collector for timings, NULL to disable
+		 */
+		void setMetrics(Metrics* metrics) { mMetrics = metrics; }
+		
+		/**
+		 * @brief Collect the candidates between incoming keyframes and keyframes of other robots.
+		 * @details Only keyframes of the merger's sensor are considered, the
+		 * incoming keyframes must already be in the mapper (e.g. added with
+		 * GraphMapper::addExternalReadings). This has to be called on the
+		 * mapping thread and replaces all previous candidates. Candidates
+		 * whose measurement data is not available are dropped and logged as
+		 * an error.
+		 * @param mapper
+		 * @param incoming uuids of the incoming keyframes
+		 * @return number of candidates
+		 */
+		size_t prepare(const GraphMapper& mapper, const std::vector<boost::uuids::uuid>& incoming);
+		
+		/**
+		 * @brief Match all candidates in parallel.
+		 * @details This does not access the mapper and can run on any thread.
+		 * @return number of verified constraints
+		 */
+		size_t evaluate();
+		
+		/**
+		 * @brief Add the verified constraints to the mapper.
+		 * @details Constraints between keyframes that have been removed in the
+		 * meantime are skipped by the mapper.
+		 * @param mapper
+		 * @return number of added and skipped constraints
+		 */
+		ImportResult commit(GraphMapper& mapper);
+		
+		/**
+		 * @brief Run prepare(), evaluate() and commit() on the calling thread.
+		 * @param mapper
+		 * @param incoming uuids of the incoming keyframes
+		 * @return number of added and skipped constraints
+		 */
+		ImportResult merge(GraphMapper& mapper, const std::vector<boost::uuids::uuid>& incoming);
+		
+		/**
+		 * @brief Get the constraints verified by the last evaluate().
+		 */
+		const ExternalConstraintList& getConstraints() const { return mConstraints; }
+		
+	protected:
+		/**
+		 * @brief Match a single candidate.
+		 * @return false if the sensor could not match the measurements
+		 */
+		bool match(size_t candidate);
+		
+		/**
+		 * @brief Unpin all measurements pinned by prepare().
+		 */
+		void unpinAll();
+		
+	protected:
+		struct Candidate
+		{
+			Measurement::Ptr source;
+			Measurement::Ptr target;
+			Transform guess;
+			double distance;
+			TransformWithCovariance result;
+		};
+		
+		Logger* mLogger;
+		Metrics* mMetrics;
+		Sensor* mSensor;
+		MapMergerConfiguration mConfig;
+		std::vector<Candidate> mCandidates;
+		std::vector<Measurement::Ptr> mPinned;
+		const GraphMapper* mPinnedBy;
+		ExternalConstraintList mConstraints;
+	};
+}
+
+#endif
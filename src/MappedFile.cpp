@@ -0,0 +1,154 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "MappedFile.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+#include <boost/format.hpp>
+
+using namespace slam3d;
+
+static size_t pageAlign(size_t offset)
+{
+	static const size_t page = sysconf(_SC_PAGESIZE);
+	return offset - (offset % page);
+}
+
+MappedFile::MappedFile(const std::string& filename, bool writable)
+ : mFilename(filename), mWritable(writable), mData(NULL), mSize(0)
+{
+	int flags = writable ? (O_RDWR | O_CREAT) : O_RDONLY;
+	mFileDescriptor = open(filename.c_str(), flags, 0644);
+	if(mFileDescriptor < 0)
+	{
+		throw FileMappingError((boost::format("Could not open '%1%': %2%") % filename % strerror(errno)).str());
+	}
+	
+	struct stat info;
+	if(fstat(mFileDescriptor, &info) != 0)
+	{
+		close(mFileDescriptor);
+		throw FileMappingError((boost::format("Could not stat '%1%': %2%") % filename % strerror(errno)).str());
+	}
+	mSize = info.st_size;
+	
+	try
+	{
+		map();
+	}catch(FileMappingError &e)
+	{
+		close(mFileDescriptor);
+		throw;
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	unmap();
+	close(mFileDescriptor);
+}
+
+void MappedFile::map()
+{
+	if(mSize == 0)
+	{
+		mData = NULL;
+		return;
+	}
+	
+	int prot = mWritable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+	void* addr = mmap(NULL, mSize, prot, MAP_SHARED, mFileDescriptor, 0);
+	if(addr == MAP_FAILED)
+	{
+		mData = NULL;
+		throw FileMappingError((boost::format("Could not map '%1%': %2%") % mFilename % strerror(errno)).str());
+	}
+	mData = static_cast<char*>(addr);
+}
+
+void MappedFile::unmap()
+{
+	if(mData)
+	{
+		munmap(mData, mSize);
+		mData = NULL;
+	}
+}
+
+void MappedFile::resize(size_t size)
+{
+	if(!mWritable)
+	{
+		throw FileMappingError((boost::format("Cannot resize read-only mapping of '%1%'.") % mFilename).str());
+	}
+	
+	unmap();
+	if(ftruncate(mFileDescriptor, size) != 0)
+	{
+		map();
+		throw FileMappingError((boost::format("Could not resize '%1%': %2%") % mFilename % strerror(errno)).str());
+	}
+	mSize = size;
+	map();
+}
+
+void MappedFile::sync(bool async)
+{
+	if(mData && mWritable)
+	{
+		msync(mData, mSize, async ? MS_ASYNC : MS_SYNC);
+	}
+}
+
+void MappedFile::prefetch(size_t offset, size_t length) const
+{
+	if(!mData || offset >= mSize)
+		return;
+	size_t start = pageAlign(offset);
+	size_t end = std::min(offset + length, mSize);
+	madvise(mData + start, end - start, MADV_WILLNEED);
+}
+
+void MappedFile::release(size_t offset, size_t length)
+{
+	if(!mData || offset >= mSize)
+		return;
+	size_t start = pageAlign(offset);
+	size_t end = std::min(offset + length, mSize);
+	if(mWritable)
+	{
+		// Only start the write-back, the mapping is shared, so dropping the
+		// pages does not lose their content.
+		msync(mData + start, end - start, MS_ASYNC);
+	}
+	madvise(mData + start, end - start, MADV_DONTNEED);
+}
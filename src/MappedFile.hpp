@@ -0,0 +1,136 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_MAPPEDFILE_HPP
+#define SLAM_MAPPEDFILE_HPP
+
+#include <string>
+#include <exception>
+#include <cstddef>
+
+namespace slam3d
+{
+	/**
+	 * @class FileMappingError
+	 * @brief Exception thrown when a file could not be opened or mapped into memory.
+	 */
+	class FileMappingError: public std::exception
+	{
+	public:
+		FileMappingError(const std::string& msg):message(msg){}
+		virtual ~FileMappingError() throw() {}
+		virtual const char* what() const throw()
+		{
+			return message.c_str();
+		}
+		
+		std::string message;
+	};
+	
+	/**
+	 * @class MappedFile
+	 * @brief A file on disk that is mapped into the address space of the process.
+	 * @details The operating system pages the content in and out as required,
+	 * so the file can be much larger than the available main memory. A writable
+	 * file can be grown with resize(), which invalidates all pointers into
+	 * the previous mapping.
+	 */
+	class MappedFile
+	{
+	public:
+		/**
+		 * @brief Opens (and if writable creates) the given file and maps it.
+		 * @param filename path of the file to be mapped
+		 * @param writable whether the mapping can be modified and resized
+		 * @throw FileMappingError
+		 */
+		MappedFile(const std::string& filename, bool writable);
+		~MappedFile();
+		
+		/**
+		 * @brief Get the current size of the mapping in bytes.
+		 */
+		size_t size() const { return mSize; }
+		
+		/**
+		 * @brief Pointer to the beginning of the mapped data.
+		 * @details This is NULL as long as the file is empty.
+		 */
+		char* data() { return mData; }
+		const char* data() const { return mData; }
+		
+		/**
+		 * @brief Get the name of the mapped file.
+		 */
+		const std::string& getFilename() const { return mFilename; }
+		
+		/**
+		 * @brief Change the size of the underlying file and remap it.
+		 * @param size new size in bytes
+		 * @throw FileMappingError
+		 */
+		void resize(size_t size);
+		
+		/**
+		 * @brief Write modified pages back to disk.
+		 * @param async only schedule the write instead of waiting for it
+		 */
+		void sync(bool async = false);
+		
+		/**
+		 * @brief Tell the kernel that the given range will be accessed soon.
+		 * @param offset start of the range in bytes
+		 * @param length length of the range in bytes
+		 */
+		void prefetch(size_t offset, size_t length) const;
+		
+		/**
+		 * @brief Tell the kernel that the given range is not needed anymore.
+		 * @details Pages are dropped from the mapping and read again from
+		 * the file on the next access. Modified pages of a writable file stay
+		 * in the page cache until the kernel writes them back, this does not
+		 * wait for the data to be on disk.
+		 * @param offset start of the range in bytes
+		 * @param length length of the range in bytes
+		 */
+		void release(size_t offset, size_t length);
+		
+	private:
+		MappedFile(const MappedFile& other);
+		MappedFile& operator=(const MappedFile& other);
+		
+		void map();
+		void unmap();
+		
+	private:
+		std::string mFilename;
+		int mFileDescriptor;
+		bool mWritable;
+		char* mData;
+		size_t mSize;
+	};
+}
+
+#endif
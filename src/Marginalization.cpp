@@ -0,0 +1,247 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "Marginalization.hpp"
+
+#include <Eigen/Cholesky>
+
+#include <algorithm>
+#include <limits>
+
+using namespace slam3d;
+
+static const Vector6 ERROR_SCALE = errorScale();
+
+// Gauss-Newton iterations on the local problem around the removed node
+static const int MAX_ITERATIONS = 10;
+static const double STEP_THRESHOLD = 1e-10;
+
+static bool logDeterminant(const Eigen::MatrixXd& cov, double& log_det)
+{
+	Eigen::LLT<Eigen::MatrixXd> llt(cov);
+	if(llt.info() != Eigen::Success)
+		return false;
+	log_det = 2 * llt.matrixLLT().diagonal().array().log().sum();
+	return true;
+}
+
+Marginalization::Marginalization(const Transform& pose)
+ : mPose(pose)
+{
+}
+
+void Marginalization::addConstraint(IdType neighbor, const Transform& neighbor_pose,
+                                    const Transform& tf, const Covariance& cov, bool from_neighbor)
+{
+	std::map<IdType, size_t>::iterator n = mNeighborIndex.find(neighbor);
+	size_t index;
+	if(n == mNeighborIndex.end())
+	{
+		index = mNeighbors.size();
+		mNeighborIndex.insert(std::make_pair(neighbor, index));
+		mNeighbors.push_back(neighbor);
+		mNeighborPoses.push_back(neighbor_pose);
+	}else
+	{
+		index = n->second;
+	}
+	
+	Factor factor;
+	factor.neighbor = index;
+	factor.from_neighbor = from_neighbor;
+	factor.inverse_measurement = tf.inverse();
+	factor.information = cov.inverse();
+	mFactors.push_back(factor);
+}
+
+bool Marginalization::computeChowLiuTree(MarginalConstraintList& constraints) const
+{
+	constraints.clear();
+	
+	// A single neighbor only receives information about the gauge
+	size_t k = mNeighbors.size();
+	if(k < 2)
+		return true;
+	
+	// Neighbors are ordered by id, so the first one has the smallest id
+	std::vector<size_t> position(k);
+	std::vector<IdType> ids;
+	std::vector<Transform, Eigen::aligned_allocator<Transform> > poses;
+	for(std::map<IdType, size_t>::const_iterator n = mNeighborIndex.begin(); n != mNeighborIndex.end(); ++n)
+	{
+		position[n->second] = ids.size();
+		ids.push_back(n->first);
+		poses.push_back(mNeighborPoses[n->second]);
+	}
+	
+	// The constraints are generally not consistent with the current poses,
+	// so the local problem with the first neighbor held fixed is solved
+	// first and the marginal is taken at its optimum.
+	Transform pose = mPose;
+	size_t m = k - 1;
+	Eigen::MatrixXd cov;
+	for(int iteration = 0; ; iteration++)
+	{
+		// Information and gradient over the removed node (block 0) and its neighbors
+		Eigen::MatrixXd H = Eigen::MatrixXd::Zero(6 * (k + 1), 6 * (k + 1));
+		Eigen::VectorXd b = Eigen::VectorXd::Zero(6 * (k + 1));
+		Vector6 error;
+		Matrix6 Jn, Jx;
+		for(size_t f = 0; f < mFactors.size(); f++)
+		{
+			const Factor& factor = mFactors[f];
+			size_t neighbor = position[factor.neighbor];
+			if(factor.from_neighbor)
+			{
+				linearizePoseError(factor.inverse_measurement, poses[neighbor], pose, error, Jn, Jx);
+			}else
+			{
+				linearizePoseError(factor.inverse_measurement, pose, poses[neighbor], error, Jx, Jn);
+			}
+			Matrix6 OJx = factor.information * Jx;
+			Matrix6 OJn = factor.information * Jn;
+			size_t n = 6 * (neighbor + 1);
+			H.block<6,6>(0, 0) += Jx.transpose() * OJx;
+			H.block<6,6>(n, n) += Jn.transpose() * OJn;
+			H.block<6,6>(0, n) += Jx.transpose() * OJn;
+			H.block<6,6>(n, 0) += Jn.transpose() * OJx;
+			b.segment<6>(0) += OJx.transpose() * error;
+			b.segment<6>(n) += OJn.transpose() * error;
+		}
+		
+		// Eliminate the removed node with the Schur complement
+		Eigen::LLT<Matrix6> node(H.block<6,6>(0, 0));
+		if(node.info() != Eigen::Success)
+			return false;
+		Eigen::MatrixXd Hnx = H.block(6, 0, 6 * k, 6);
+		Eigen::MatrixXd marginal = H.block(6, 6, 6 * k, 6 * k) - Hnx * node.solve(Hnx.transpose());
+		Eigen::VectorXd gradient = b.tail(6 * k) - Hnx * node.solve(b.head<6>());
+		
+		// The marginal only constrains relative poses, so it is expressed
+		// relative to the first neighbor by holding it fixed. Increments of the
+		// other neighbors are then increments of their pose relative to it.
+		Eigen::LLT<Eigen::MatrixXd> relative(marginal.bottomRightCorner(6 * m, 6 * m));
+		if(relative.info() != Eigen::Success)
+			return false;
+		cov = relative.solve(Eigen::MatrixXd::Identity(6 * m, 6 * m));
+		cov = 0.5 * (cov + cov.transpose()).eval();
+		
+		Eigen::VectorXd step = Eigen::VectorXd::Zero(6 * k);
+		step.tail(6 * m) = -cov * gradient.tail(6 * m);
+		if(iteration >= MAX_ITERATIONS || step.lpNorm<Eigen::Infinity>() < STEP_THRESHOLD)
+			break;
+		
+		// Back substitution for the removed node
+		Vector6 step_x = -node.solve(b.head<6>() + Hnx.transpose() * step);
+		pose = applyIncrement(pose, step_x);
+		for(size_t i = 0; i < m; i++)
+		{
+			poses[i + 1] = applyIncrement(poses[i + 1], step.segment<6>(6 * (i + 1)));
+		}
+	}
+	
+	// Mutual information between all pairs of relative poses
+	std::vector<double> log_det(m);
+	for(size_t i = 0; i < m; i++)
+	{
+		if(!logDeterminant(cov.block(6 * i, 6 * i, 6, 6), log_det[i]))
+			return false;
+	}
+	Eigen::MatrixXd information = Eigen::MatrixXd::Zero(m, m);
+	for(size_t i = 0; i < m; i++)
+	{
+		for(size_t j = i + 1; j < m; j++)
+		{
+			Eigen::MatrixXd joint(12, 12);
+			joint << cov.block(6 * i, 6 * i, 6, 6), cov.block(6 * i, 6 * j, 6, 6),
+			         cov.block(6 * j, 6 * i, 6, 6), cov.block(6 * j, 6 * j, 6, 6);
+			double joint_log_det;
+			if(!logDeterminant(joint, joint_log_det))
+				return false;
+			information(i, j) = information(j, i) = 0.5 * (log_det[i] + log_det[j] - joint_log_det);
+		}
+	}
+	
+	// The tree starts at the pose that is best known relative to the first neighbor
+	size_t root = 0;
+	for(size_t i = 1; i < m; i++)
+	{
+		if(log_det[i] < log_det[root])
+			root = i;
+	}
+	
+	MarginalConstraint constraint;
+	constraint.source = ids[0];
+	constraint.target = ids[root + 1];
+	constraint.transform = poses[0].inverse() * poses[root + 1];
+	constraint.covariance = ERROR_SCALE.asDiagonal() * cov.block(6 * root, 6 * root, 6, 6) * ERROR_SCALE.asDiagonal();
+	constraints.push_back(constraint);
+	
+	// Maximum spanning tree with Prim's algorithm
+	std::vector<bool> in_tree(m, false);
+	std::vector<double> best(m, -std::numeric_limits<double>::infinity());
+	std::vector<size_t> parent(m, root);
+	in_tree[root] = true;
+	for(size_t i = 0; i < m; i++)
+		best[i] = information(root, i);
+	
+	for(size_t added = 1; added < m; added++)
+	{
+		size_t next = m;
+		for(size_t i = 0; i < m; i++)
+		{
+			if(!in_tree[i] && (next == m || best[i] > best[next]))
+				next = i;
+		}
+		in_tree[next] = true;
+		for(size_t i = 0; i < m; i++)
+		{
+			if(!in_tree[i] && information(next, i) > best[i])
+			{
+				best[i] = information(next, i);
+				parent[i] = next;
+			}
+		}
+		
+		// Covariance of the relative pose from p to c with the smaller id
+		// first, its increments are d_pc = d_c - Ad(T_pc^-1) * d_p
+		size_t p = std::min(parent[next], next);
+		size_t c = std::max(parent[next], next);
+		Transform tf = poses[p + 1].inverse() * poses[c + 1];
+		Eigen::Matrix<double, 6, 12> A;
+		A << -adjoint(tf.inverse()), Matrix6::Identity();
+		Eigen::MatrixXd joint(12, 12);
+		joint << cov.block(6 * p, 6 * p, 6, 6), cov.block(6 * p, 6 * c, 6, 6),
+		         cov.block(6 * c, 6 * p, 6, 6), cov.block(6 * c, 6 * c, 6, 6);
+		Matrix6 relative_cov = A * joint * A.transpose();
+		
+		constraint.source = ids[p + 1];
+		constraint.target = ids[c + 1];
+		constraint.transform = tf;
+		constraint.covariance = ERROR_SCALE.asDiagonal() * (0.5 * (relative_cov + relative_cov.transpose())) * ERROR_SCALE.asDiagonal();
+		constraints.push_back(constraint);
+	}
+	return true;
+}
@@ -0,0 +1,124 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_MARGINALIZATION_HPP
+#define SLAM_MARGINALIZATION_HPP
+
+#include "Types.hpp"
+#include "Linearization.hpp"
+
+#include <Eigen/StdVector>
+#include <map>
+
+namespace slam3d
+{
+	/**
+	 * @struct MarginalConstraint
+	 * @brief Relative pose constraint that replaces the constraints of a removed node.
+	 */
+	struct MarginalConstraint
+	{
+		IdType source;
+		IdType target;
+		Transform transform;
+		Covariance covariance;
+		
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	};
+	
+	typedef std::vector<MarginalConstraint, Eigen::aligned_allocator<MarginalConstraint> > MarginalConstraintList;
+	
+	/**
+	 * @class Marginalization
+	 * @brief Removes a node from a pose graph while keeping its information.
+	 * @details All constraints of the node are linearized at the current
+	 * poses and the node is eliminated with the Schur complement, which
+	 * results in a dense Gaussian over all neighbors. This dense factor is
+	 * approximated by its Chow-Liu tree, the tree of pairwise marginals
+	 * with the largest mutual information, where every tree edge becomes a
+	 * relative pose constraint with the marginal covariance of that relative
+	 * pose. The approximation is exact for nodes with up to two neighbors,
+	 * e.g. within a chain of odometry, and the number of new constraints is
+	 * always one less than the number of neighbors.
+	 * 
+	 * See: H. Kretzschmar and C. Stachniss, "Information-theoretic compression
+	 * of pose graphs for laser-based SLAM", IJRR 2012.
+	 */
+	class Marginalization
+	{
+	public:
+		/**
+		 * @brief Constructor
+		 * @param pose current pose of the node to be removed
+		 */
+		Marginalization(const Transform& pose);
+		
+		/**
+		 * @brief Add a constraint between the removed node and one of its neighbors.
+		 * @param neighbor id of the neighbor
+		 * @param neighbor_pose current pose of the neighbor
+		 * @param tf measured transform between the nodes
+		 * @param cov covariance of the transform
+		 * @param from_neighbor true if tf goes from the neighbor to the removed node
+		 */
+		void addConstraint(IdType neighbor, const Transform& neighbor_pose,
+		                   const Transform& tf, const Covariance& cov, bool from_neighbor);
+		
+		/**
+		 * @brief Get the number of distinct neighbors of the removed node.
+		 */
+		size_t getNumberOfNeighbors() const { return mNeighbors.size(); }
+		
+		/**
+		 * @brief Compute the sparse approximation of the marginal.
+		 * @details The local problem around the removed node is solved first,
+		 * so the new constraints reflect the optimum of the removed edges
+		 * rather than the current poses. Like the edges in the mapper, the new
+		 * constraints are directed from the smaller to the larger id.
+		 * @param constraints the new constraints between the neighbors
+		 * @return false if the marginal is degenerated, e.g. due to invalid covariances
+		 */
+		bool computeChowLiuTree(MarginalConstraintList& constraints) const;
+		
+	protected:
+		struct Factor
+		{
+			size_t neighbor;
+			bool from_neighbor;
+			Transform inverse_measurement;
+			Covariance information;
+			
+			EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+		};
+		
+		Transform mPose;
+		std::vector<IdType> mNeighbors;
+		std::vector<Transform, Eigen::aligned_allocator<Transform> > mNeighborPoses;
+		std::map<IdType, size_t> mNeighborIndex;
+		std::vector<Factor, Eigen::aligned_allocator<Factor> > mFactors;
+	};
+}
+
+#endif
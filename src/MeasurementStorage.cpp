@@ -0,0 +1,260 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "MeasurementStorage.hpp"
+
+#include <boost/format.hpp>
+#include <boost/uuid/uuid_io.hpp>
+
+using namespace slam3d;
+
+// Grow the arena in steps of at least this size to avoid remapping too often.
+#define ARENA_CHUNK_SIZE (64 * 1024 * 1024)
+
+MeasurementStorage::MeasurementStorage(Logger* logger, const std::string& arena, size_t budget)
+ : mLogger(logger), mArena(arena, true), mPolicy(EVICT_LEAST_RECENTLY_USED),
+   mBudget(budget), mResidentSize(0), mStoredSize(0), mLastPosition(0,0,0)
+{
+	// Content from a previous run cannot be used, as the measurements are gone.
+	mArena.resize(0);
+}
+
+MeasurementStorage::~MeasurementStorage()
+{
+}
+
+void MeasurementStorage::add(Measurement::Ptr m, const Vector3& position)
+{
+	size_t size = m->getPayloadSize();
+	if(size == 0)
+		return;
+
+	std::pair<EntryMap::iterator, bool> result = mEntries.insert(EntryMap::value_type(m->getUniqueId(), Entry()));
+	if(!result.second)
+	{
+		SLAM3D_LOG(mLogger, WARNING, (boost::format("Measurement %1% has already been added to the storage.") % m->getUniqueId()).str());
+		return;
+	}
+	
+	Entry& entry = result.first->second;
+	entry.measurement = m;
+	entry.position = position;
+	entry.size = size;
+	entry.offset = 0;
+	entry.file = &mArena;
+	entry.stored = false;
+	entry.resident = true;
+	entry.removed = false;
+	entry.pins = 1;
+	entry.usage = mUsage.insert(mUsage.begin(), m->getUniqueId());
+	mResidentSize += size;
+	
+	enforceBudget(mLastPosition);
+	entry.pins = 0;
+}
+
+void MeasurementStorage::addMapped(Measurement::Ptr m, const Vector3& position,
+                                   boost::shared_ptr<MappedFile> file, size_t offset, size_t size)
+{
+	if(size == 0)
+		return;
+	
+	std::pair<EntryMap::iterator, bool> result = mEntries.insert(EntryMap::value_type(m->getUniqueId(), Entry()));
+	if(!result.second)
+	{
+		SLAM3D_LOG(mLogger, WARNING, (boost::format("Measurement %1% has already been added to the storage.") % m->getUniqueId()).str());
+		return;
+	}
+	
+	if(mMappedFiles.empty() || mMappedFiles.back() != file)
+	{
+		mMappedFiles.push_back(file);
+	}
+	
+	Entry& entry = result.first->second;
+	entry.measurement = m;
+	entry.position = position;
+	entry.size = size;
+	entry.offset = offset;
+	entry.file = file.get();
+	entry.stored = true;
+	entry.resident = false;
+	entry.removed = false;
+	entry.pins = 0;
+}
+
+void MeasurementStorage::setPosition(const Measurement::Ptr& m, const Vector3& position)
+{
+	EntryMap::iterator it = mEntries.find(m->getUniqueId());
+	if(it != mEntries.end())
+	{
+		it->second.position = position;
+	}
+}
+
+void MeasurementStorage::remove(const Measurement::Ptr& m)
+{
+	EntryMap::iterator it = mEntries.find(m->getUniqueId());
+	if(it == mEntries.end())
+		return;
+	
+	// A pinned payload may still be read by another thread
+	Entry& entry = it->second;
+	if(entry.pins > 0)
+	{
+		entry.removed = true;
+		return;
+	}
+	if(entry.resident)
+	{
+		mUsage.erase(entry.usage);
+		mResidentSize -= entry.size;
+	}
+	entry.measurement->releasePayload();
+	mEntries.erase(it);
+}
+
+void MeasurementStorage::load(const Measurement::Ptr& m)
+{
+	EntryMap::iterator it = mEntries.find(m->getUniqueId());
+	if(it == mEntries.end())
+		return;
+	
+	Entry& entry = it->second;
+	if(entry.resident)
+	{
+		mUsage.splice(mUsage.begin(), mUsage, entry.usage);
+		return;
+	}
+	
+	entry.measurement->readPayload(entry.file->data() + entry.offset, entry.size);
+	entry.file->release(entry.offset, entry.size);
+	entry.resident = true;
+	entry.usage = mUsage.insert(mUsage.begin(), it->first);
+	mResidentSize += entry.size;
+	SLAM3D_LOG(mLogger, DEBUG, (boost::format("Loaded measurement %1% (%2% bytes) from disk.") % it->first % entry.size).str());
+}
+
+bool MeasurementStorage::pin(const Measurement::Ptr& m)
+{
+	EntryMap::iterator it = mEntries.find(m->getUniqueId());
+	if(it == mEntries.end() || it->second.removed)
+		return false;
+	load(m);
+	it->second.pins++;
+	return true;
+}
+
+void MeasurementStorage::unpin(const Measurement::Ptr& m)
+{
+	EntryMap::iterator it = mEntries.find(m->getUniqueId());
+	if(it == mEntries.end())
+		return;
+	if(it->second.pins == 0)
+	{
+		SLAM3D_LOG(mLogger, WARNING, (boost::format("Measurement %1% is not pinned.") % m->getUniqueId()).str());
+		return;
+	}
+	it->second.pins--;
+	if(it->second.pins == 0 && it->second.removed)
+	{
+		remove(m);
+	}
+}
+
+void MeasurementStorage::enforceBudget(const Vector3& position)
+{
+	mLastPosition = position;
+	while(mResidentSize > mBudget && mUsage.size() > 1)
+	{
+		Entry* victim = selectVictim(position);
+		if(!victim)
+			break;
+		evict(*victim);
+	}
+}
+
+MeasurementStorage::Entry* MeasurementStorage::selectVictim(const Vector3& position)
+{
+	// The most recently used and pinned measurements are never evicted.
+	if(mPolicy == EVICT_LEAST_RECENTLY_USED)
+	{
+		for(UsageList::reverse_iterator it = mUsage.rbegin(); it != mUsage.rend(); ++it)
+		{
+			if(*it == mUsage.front())
+				break;
+			Entry& entry = mEntries.at(*it);
+			if(entry.pins == 0)
+				return &entry;
+		}
+		return NULL;
+	}
+	
+	Entry* victim = NULL;
+	ScalarType max_distance = -1;
+	UsageList::iterator it = mUsage.begin();
+	for(++it; it != mUsage.end(); ++it)
+	{
+		Entry& entry = mEntries.at(*it);
+		if(entry.pins > 0)
+			continue;
+		ScalarType distance = (entry.position - position).squaredNorm();
+		if(distance > max_distance)
+		{
+			max_distance = distance;
+			victim = &entry;
+		}
+	}
+	return victim;
+}
+
+void MeasurementStorage::store(Entry& entry)
+{
+	size_t required = mStoredSize + entry.size;
+	if(required > mArena.size())
+	{
+		size_t grow = std::max(entry.size, (size_t)ARENA_CHUNK_SIZE);
+		mArena.resize(mArena.size() + grow);
+	}
+	entry.offset = mStoredSize;
+	entry.file = &mArena;
+	entry.measurement->writePayload(mArena.data() + entry.offset);
+	entry.stored = true;
+	mStoredSize += entry.size;
+}
+
+void MeasurementStorage::evict(Entry& entry)
+{
+	if(!entry.stored)
+	{
+		store(entry);
+	}
+	entry.file->release(entry.offset, entry.size);
+	entry.measurement->releasePayload();
+	entry.resident = false;
+	mUsage.erase(entry.usage);
+	mResidentSize -= entry.size;
+	SLAM3D_LOG(mLogger, DEBUG, (boost::format("Evicted measurement %1% (%2% bytes) to disk.") % entry.measurement->getUniqueId() % entry.size).str());
+}
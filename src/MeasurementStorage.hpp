@@ -0,0 +1,219 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_MEASUREMENTSTORAGE_HPP
+#define SLAM_MEASUREMENTSTORAGE_HPP
+
+#include "Types.hpp"
+#include "Logger.hpp"
+#include "MappedFile.hpp"
+
+#include <list>
+
+namespace slam3d
+{
+	/**
+	 * @brief Strategy to select measurements whose data is moved to disk.
+	 */
+	enum EvictionPolicy
+	{
+		EVICT_LEAST_RECENTLY_USED,
+		EVICT_MOST_DISTANT
+	};
+	
+	/**
+	 * @class MeasurementStorage
+	 * @brief Keeps the sensor data of all measurements within a memory budget.
+	 * @details Measurements are registered with their position in the map.
+	 * Whenever the size of all payloads held in memory exceeds the budget,
+	 * payloads are written to a memory-mapped arena on disk and released
+	 * from the measurement. Only the payload is moved, the Measurement object
+	 * with its meta information as well as the pose graph stay in memory.
+	 * A payload is written to the arena only once, as measurements do not
+	 * change after they have been added to the graph.
+	 * 
+	 * The mapper calls load() before a measurement's data is used, so that
+	 * paging is transparent for the sensors. Eviction is only done within
+	 * add() and enforceBudget(), so measurements loaded for an ongoing
+	 * operation (e.g. building a patch) are never evicted while in use.
+	 * Data that is used beyond the current operation, e.g. by a background
+	 * thread, has to be pinned, as pinned measurements are never evicted.
+	 * The storage itself is not thread-safe, pin() and unpin() have to be
+	 * called from the thread that adds the measurements.
+	 */
+	class MeasurementStorage
+	{
+	public:
+		/**
+		 * @brief Constructor
+		 * @param logger
+		 * @param arena file to store evicted payloads (will be truncated)
+		 * @param budget maximum number of payload bytes kept in memory
+		 * @throw FileMappingError
+		 */
+		MeasurementStorage(Logger* logger, const std::string& arena, size_t budget);
+		~MeasurementStorage();
+		
+		/**
+		 * @brief Sets the maximum number of payload bytes held in memory.
+		 * @param budget size in bytes
+		 */
+		void setMemoryBudget(size_t budget) { mBudget = budget; }
+		
+		/**
+		 * @brief Sets the strategy used to select measurements for eviction.
+		 * @param policy
+		 */
+		void setEvictionPolicy(EvictionPolicy policy) { mPolicy = policy; }
+		
+		/**
+		 * @brief Registers a new measurement with the storage.
+		 * @details Measurements without a payload are ignored. Other payloads
+		 * may be evicted to meet the budget, but not the new one.
+		 * @param m the new measurement
+		 * @param position location of the measurement in map coordinates
+		 */
+		void add(Measurement::Ptr m, const Vector3& position);
+		
+		/**
+		 * @brief Registers a measurement whose payload is located in a mapped file.
+		 * @details The payload is not read until the measurement is loaded,
+		 * so large maps can be opened without reading all sensor data.
+		 * The storage keeps a reference to the file.
+		 * @param m measurement without payload
+		 * @param position location of the measurement in map coordinates
+		 * @param file mapped file that contains the payload
+		 * @param offset position of the payload within the file
+		 * @param size size of the payload in bytes
+		 */
+		void addMapped(Measurement::Ptr m, const Vector3& position,
+		               boost::shared_ptr<MappedFile> file, size_t offset, size_t size);
+		
+		/**
+		 * @brief Updates the location of a measurement, e.g. after optimization.
+		 * @param m a registered measurement
+		 * @param position new location in map coordinates
+		 */
+		void setPosition(const Measurement::Ptr& m, const Vector3& position);
+		
+		/**
+		 * @brief Removes a measurement from the storage and releases its payload.
+		 * @details The space of a stored payload in the arena is not reused.
+		 * Unknown measurements are ignored. A pinned measurement is removed
+		 * when its last pin is released, it cannot be pinned again.
+		 * @param m a registered measurement
+		 */
+		void remove(const Measurement::Ptr& m);
+		
+		/**
+		 * @brief Makes sure that the payload of the measurement is in memory.
+		 * @details It also marks the measurement as recently used.
+		 * Unknown measurements are ignored.
+		 * @param m a registered measurement
+		 */
+		void load(const Measurement::Ptr& m);
+		
+		/**
+		 * @brief Loads the payload and keeps it in memory until unpin() is called.
+		 * @details Pins are counted, so every call has to be matched by a
+		 * call to unpin().
+		 * @param m a registered measurement
+		 * @return false if the measurement is not registered or removed
+		 */
+		bool pin(const Measurement::Ptr& m);
+		
+		/**
+		 * @brief Releases a pin, so the payload can be evicted again.
+		 * @details Unknown measurements are ignored.
+		 * @param m a pinned measurement
+		 */
+		void unpin(const Measurement::Ptr& m);
+		
+		/**
+		 * @brief Evicts payloads until the memory budget is met.
+		 * @details Pinned measurements and the most recently used one are
+		 * never evicted, so the budget may be exceeded.
+		 * @param position current location of the robot in map coordinates
+		 */
+		void enforceBudget(const Vector3& position);
+		
+		/**
+		 * @brief Get the number of payload bytes currently held in memory.
+		 */
+		size_t getResidentSize() const { return mResidentSize; }
+		
+		/**
+		 * @brief Get the number of bytes that have been written to disk.
+		 */
+		size_t getStoredSize() const { return mStoredSize; }
+		
+		/**
+		 * @brief Get the number of registered measurements.
+		 */
+		size_t getNumberOfMeasurements() const { return mEntries.size(); }
+		
+		/**
+		 * @brief Get the number of measurements whose payload is in memory.
+		 */
+		size_t getNumberOfResidentMeasurements() const { return mUsage.size(); }
+		
+	protected:
+		typedef std::list<boost::uuids::uuid> UsageList;
+		
+		struct Entry
+		{
+			Measurement::Ptr measurement;
+			Vector3 position;
+			size_t size;
+			size_t offset;
+			MappedFile* file;
+			bool stored;
+			bool resident;
+			bool removed;
+			unsigned pins;
+			UsageList::iterator usage;
+		};
+		
+		typedef std::map<boost::uuids::uuid, Entry> EntryMap;
+		
+		void evict(Entry& entry);
+		void store(Entry& entry);
+		Entry* selectVictim(const Vector3& position);
+		
+	protected:
+		Logger* mLogger;
+		MappedFile mArena;
+		EntryMap mEntries;
+		UsageList mUsage;
+		std::vector< boost::shared_ptr<MappedFile> > mMappedFiles;
+		EvictionPolicy mPolicy;
+		size_t mBudget;
+		size_t mResidentSize;
+		size_t mStoredSize;
+		Vector3 mLastPosition;
+	};
+}
+
+#endif
@@ -0,0 +1,121 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_MEMORYSTATS_HPP
+#define SLAM_MEMORYSTATS_HPP
+
+#include <string>
+#include <map>
+
+namespace slam3d
+{
+	/**
+	 * @struct MemoryUsage
+	 * @brief Memory used by one category of objects.
+	 * @details Byte counts are estimates based on the size of the objects and
+	 * their payload, overhead of the allocator is not included.
+	 */
+	struct MemoryUsage
+	{
+		MemoryUsage() : bytes(0), objects(0) {}
+		MemoryUsage(size_t b, size_t o) : bytes(b), objects(o) {}
+		size_t bytes;
+		size_t objects;
+	};
+	
+	typedef std::map<std::string, MemoryUsage> MemoryUsageMap;
+	
+	/**
+	 * @class MemoryStats
+	 * @brief Current and peak memory usage per category.
+	 */
+	class MemoryStats
+	{
+	public:
+		MemoryStats() : mTotal(0), mPeakTotal(0) {}
+		
+		/**
+		 * @brief Replace the current usage and raise the peak values.
+		 * @param usage memory usage of all categories
+		 */
+		void update(const MemoryUsageMap& usage)
+		{
+			mCurrent = usage;
+			mTotal = 0;
+			for(MemoryUsageMap::const_iterator u = usage.begin(); u != usage.end(); ++u)
+			{
+				mTotal += u->second.bytes;
+				MemoryUsage& peak = mPeak[u->first];
+				if(u->second.bytes > peak.bytes)
+					peak.bytes = u->second.bytes;
+				if(u->second.objects > peak.objects)
+					peak.objects = u->second.objects;
+			}
+			if(mTotal > mPeakTotal)
+				mPeakTotal = mTotal;
+		}
+		
+		/**
+		 * @brief Get the current usage of a category.
+		 */
+		MemoryUsage getUsage(const std::string& category) const
+		{
+			MemoryUsageMap::const_iterator u = mCurrent.find(category);
+			return u == mCurrent.end() ? MemoryUsage() : u->second;
+		}
+		
+		/**
+		 * @brief Get the highest usage of a category seen so far.
+		 */
+		MemoryUsage getPeakUsage(const std::string& category) const
+		{
+			MemoryUsageMap::const_iterator u = mPeak.find(category);
+			return u == mPeak.end() ? MemoryUsage() : u->second;
+		}
+		
+		/**
+		 * @brief Get the current usage of all categories.
+		 */
+		const MemoryUsageMap& getCategories() const { return mCurrent; }
+		
+		/**
+		 * @brief Get the sum of bytes in all categories.
+		 */
+		size_t getTotalBytes() const { return mTotal; }
+		
+		/**
+		 * @brief Get the highest sum of bytes seen so far.
+		 */
+		size_t getPeakTotalBytes() const { return mPeakTotal; }
+		
+	protected:
+		MemoryUsageMap mCurrent;
+		MemoryUsageMap mPeak;
+		size_t mTotal;
+		size_t mPeakTotal;
+	};
+}
+
+#endif
@@ -0,0 +1,198 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "Metrics.hpp"
+
+#include <fstream>
+#include <thread>
+#include <functional>
+#include <cmath>
+#include <limits>
+
+#define HISTOGRAM_MIN 1e-6
+#define HISTOGRAM_GROWTH 1.05
+#define HISTOGRAM_BUCKETS 800
+
+using namespace slam3d;
+
+Histogram::Histogram()
+ : mBuckets(HISTOGRAM_BUCKETS, 0), mCount(0), mSum(0),
+   mMin(std::numeric_limits<double>::max()), mMax(-std::numeric_limits<double>::max())
+{
+}
+
+void Histogram::add(double value)
+{
+	int bucket = 0;
+	if(value > HISTOGRAM_MIN)
+	{
+		bucket = (int)(std::log(value / HISTOGRAM_MIN) / std::log(HISTOGRAM_GROWTH)) + 1;
+		if(bucket >= HISTOGRAM_BUCKETS)
+			bucket = HISTOGRAM_BUCKETS - 1;
+	}
+	mBuckets[bucket]++;
+	mCount++;
+	mSum += value;
+	if(value < mMin) mMin = value;
+	if(value > mMax) mMax = value;
+}
+
+double Histogram::getPercentile(double p) const
+{
+	if(mCount == 0)
+		return 0;
+	uint64_t rank = (uint64_t)std::ceil(mCount * p / 100.0);
+	if(rank == 0) rank = 1;
+	uint64_t seen = 0;
+	for(int i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		seen += mBuckets[i];
+		if(seen >= rank)
+		{
+			// Upper bound of the bucket, clamped to the observed range
+			double upper = (i == 0) ? HISTOGRAM_MIN : HISTOGRAM_MIN * std::pow(HISTOGRAM_GROWTH, i);
+			if(upper > mMax) upper = mMax;
+			if(upper < mMin) upper = mMin;
+			return upper;
+		}
+	}
+	return mMax;
+}
+
+Metrics::Metrics(Clock* clock)
+ : mClock(clock), mEnabled(false), mTracing(false), mMaxEvents(0), mDroppedEvents(0)
+{
+	mStart = mClock->monotonic();
+}
+
+void Metrics::setTracing(bool enabled, size_t max_events)
+{
+	std::lock_guard<std::mutex> guard(mMutex);
+	mTracing = enabled;
+	mMaxEvents = max_events;
+}
+
+void Metrics::recordDuration(const char* name, int64_t start, int64_t end,
+                             const std::vector<std::pair<const char*, double> >& args)
+{
+	std::lock_guard<std::mutex> guard(mMutex);
+	mHistograms[name].add((end - start) / 1e6);
+	if(!mTracing)
+		return;
+	if(mEvents.size() >= mMaxEvents)
+	{
+		mDroppedEvents++;
+		return;
+	}
+	TraceEvent event;
+	event.name = name;
+	event.start = start;
+	event.duration = end - start;
+	event.thread = std::hash<std::thread::id>()(std::this_thread::get_id());
+	event.args = args;
+	mEvents.push_back(event);
+}
+
+void Metrics::recordValue(const std::string& name, double value)
+{
+	if(!mEnabled)
+		return;
+	std::lock_guard<std::mutex> guard(mMutex);
+	mHistograms[name].add(value);
+}
+
+void Metrics::increment(const std::string& name, double amount)
+{
+	if(!mEnabled)
+		return;
+	std::lock_guard<std::mutex> guard(mMutex);
+	mCounters[name] += amount;
+}
+
+HistogramMap Metrics::getHistograms() const
+{
+	std::lock_guard<std::mutex> guard(mMutex);
+	return mHistograms;
+}
+
+Histogram Metrics::getHistogram(const std::string& name) const
+{
+	std::lock_guard<std::mutex> guard(mMutex);
+	HistogramMap::const_iterator h = mHistograms.find(name);
+	if(h == mHistograms.end())
+		return Histogram();
+	return h->second;
+}
+
+CounterMap Metrics::getCounters() const
+{
+	std::lock_guard<std::mutex> guard(mMutex);
+	return mCounters;
+}
+
+void Metrics::reset()
+{
+	std::lock_guard<std::mutex> guard(mMutex);
+	mHistograms.clear();
+	mCounters.clear();
+	mEvents.clear();
+	mDroppedEvents = 0;
+	mStart = mClock->monotonic();
+}
+
+bool Metrics::writeChromeTrace(const std::string& filename) const
+{
+	std::ofstream file(filename.c_str());
+	if(!file.good())
+		return false;
+
+	std::lock_guard<std::mutex> guard(mMutex);
+	std::map<size_t, int> threads;
+	file << "{\"traceEvents\":[";
+	for(std::vector<TraceEvent>::const_iterator ev = mEvents.begin(); ev != mEvents.end(); ++ev)
+	{
+		std::map<size_t, int>::iterator t = threads.find(ev->thread);
+		if(t == threads.end())
+			t = threads.insert(std::make_pair(ev->thread, (int)threads.size())).first;
+
+		if(ev != mEvents.begin())
+			file << ",";
+		file << "\n{\"name\":\"" << ev->name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << t->second
+		     << ",\"ts\":" << (ev->start - mStart) / 1000.0 << ",\"dur\":" << ev->duration / 1000.0;
+		if(!ev->args.empty())
+		{
+			file << ",\"args\":{";
+			for(size_t i = 0; i < ev->args.size(); i++)
+			{
+				if(i > 0) file << ",";
+				file << "\"" << ev->args[i].first << "\":" << ev->args[i].second;
+			}
+			file << "}";
+		}
+		file << "}";
+	}
+	file << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":" << mDroppedEvents << "}}\n";
+	return file.good();
+}
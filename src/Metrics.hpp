@@ -0,0 +1,223 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_METRICS_HPP
+#define SLAM_METRICS_HPP
+
+#include "Clock.hpp"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+
+namespace slam3d
+{
+	/**
+	 * @class Histogram
+	 * @brief Distribution of recorded values with logarithmic buckets.
+	 * @details Memory is constant, percentiles are accurate to about 5%.
+	 */
+	class Histogram
+	{
+	public:
+		Histogram();
+		
+		/**
+		 * @brief Add a new value to the distribution.
+		 */
+		void add(double value);
+		
+		size_t getCount() const { return mCount; }
+		double getSum() const { return mSum; }
+		double getMin() const { return mMin; }
+		double getMax() const { return mMax; }
+		double getMean() const { return mCount ? mSum / mCount : 0; }
+		
+		/**
+		 * @brief Get the value below which the given percentage of values lies.
+		 * @param p percentage between 0 and 100
+		 */
+		double getPercentile(double p) const;
+		
+	protected:
+		std::vector<uint64_t> mBuckets;
+		size_t mCount;
+		double mSum;
+		double mMin;
+		double mMax;
+	};
+	
+	typedef std::map<std::string, Histogram> HistogramMap;
+	typedef std::map<std::string, double> CounterMap;
+	
+	/**
+	 * @class Metrics
+	 * @brief Collects timings and counters from the mapping pipeline.
+	 * @details Durations are recorded in milliseconds into a histogram for
+	 * each name. Optionally, each timed section is also kept as a trace event,
+	 * so the complete timeline can be inspected in chrome://tracing. Metrics
+	 * are disabled after construction, in which case ScopedTimer only costs
+	 * a single check.
+	 */
+	class Metrics
+	{
+	public:
+		/**
+		 * @brief Constructor
+		 * @param clock clock used for all time measurements
+		 */
+		Metrics(Clock* clock);
+		
+		/**
+		 * @brief Enable or disable the collection of metrics.
+		 */
+		void setEnabled(bool enabled) { mEnabled = enabled; }
+		bool isEnabled() const { return mEnabled; }
+		
+		/**
+		 * @brief Enable or disable recording of trace events.
+		 * @param enabled whether to record events
+		 * @param max_events maximum number of events to be kept
+		 */
+		void setTracing(bool enabled, size_t max_events = 1000000);
+		
+		/**
+		 * @brief Get the current time of the metrics' clock in nanoseconds.
+		 */
+		int64_t now() const { return mClock->monotonic(); }
+		
+		/**
+		 * @brief Record a timed section.
+		 * @param name name of the section
+		 * @param start start of the section in nanoseconds
+		 * @param end end of the section in nanoseconds
+		 * @param args additional values to be shown in the trace
+		 */
+		void recordDuration(const char* name, int64_t start, int64_t end,
+		                    const std::vector<std::pair<const char*, double> >& args = std::vector<std::pair<const char*, double> >());
+		
+		/**
+		 * @brief Add a value to the histogram with the given name.
+		 */
+		void recordValue(const std::string& name, double value);
+		
+		/**
+		 * @brief Increment the counter with the given name.
+		 */
+		void increment(const std::string& name, double amount = 1);
+		
+		/**
+		 * @brief Get a copy of all histograms.
+		 */
+		HistogramMap getHistograms() const;
+		
+		/**
+		 * @brief Get the histogram with the given name (empty if unknown).
+		 */
+		Histogram getHistogram(const std::string& name) const;
+		
+		/**
+		 * @brief Get a copy of all counters.
+		 */
+		CounterMap getCounters() const;
+		
+		/**
+		 * @brief Remove all recorded values, counters and events.
+		 */
+		void reset();
+		
+		/**
+		 * @brief Write all recorded events in the Chrome trace-event format.
+		 * @param filename name of the JSON file
+		 * @return true if the file was written
+		 */
+		bool writeChromeTrace(const std::string& filename) const;
+		
+	protected:
+		struct TraceEvent
+		{
+			const char* name;
+			int64_t start;
+			int64_t duration;
+			size_t thread;
+			std::vector<std::pair<const char*, double> > args;
+		};
+		
+		Clock* mClock;
+		bool mEnabled;
+		bool mTracing;
+		size_t mMaxEvents;
+		
+		mutable std::mutex mMutex;
+		HistogramMap mHistograms;
+		CounterMap mCounters;
+		std::vector<TraceEvent> mEvents;
+		size_t mDroppedEvents;
+		int64_t mStart;
+	};
+	
+	/**
+	 * @class ScopedTimer
+	 * @brief Measures the time until it goes out of scope.
+	 * @details Nothing is measured if the metrics are NULL or disabled.
+	 */
+	class ScopedTimer
+	{
+	public:
+		ScopedTimer(Metrics* metrics, const char* name)
+		 : mMetrics((metrics && metrics->isEnabled()) ? metrics : NULL), mName(name), mStart(0)
+		{
+			if(mMetrics)
+				mStart = mMetrics->now();
+		}
+		
+		~ScopedTimer()
+		{
+			if(mMetrics)
+				mMetrics->recordDuration(mName, mStart, mMetrics->now(), mArgs);
+		}
+		
+		/**
+		 * @brief Attach a value to the trace event, it is also recorded as
+		 * a histogram named "<timer>.<name>".
+		 */
+		void addValue(const char* name, double value)
+		{
+			if(!mMetrics)
+				return;
+			mArgs.push_back(std::make_pair(name, value));
+			mMetrics->recordValue(std::string(mName) + "." + name, value);
+		}
+		
+	private:
+		Metrics* mMetrics;
+		const char* mName;
+		int64_t mStart;
+		std::vector<std::pair<const char*, double> > mArgs;
+	};
+}
+
+#endif
@@ -0,0 +1,629 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "NativeSolver.hpp"
+
+#include <boost/format.hpp>
+
+#include <algorithm>
+#include <fstream>
+
+using namespace slam3d;
+
+NativeSolver::NativeSolver(Logger* logger, int max_iterations, double gain_threshold)
+ : Solver(logger), mFactorNonZeros(0), mStructureChanged(true), mLinearized(false),
+   mCovarianceFactorized(false), mMaxIterations(max_iterations), mGainThreshold(gain_threshold), mLambda(0), mLastIterations(0)
+{
+}
+
+NativeSolver::~NativeSolver()
+{
+}
+
+void NativeSolver::addNode(unsigned id, Transform pose)
+{
+	if(mNodeIndex.find(id) != mNodeIndex.end())
+	{
+		throw DuplicateVertex(id);
+	}
+	
+	Node node;
+	node.pose = pose;
+	node.reported = pose;
+	node.id = id;
+	node.fixed = false;
+	node.variable = -1;
+	mNodeIndex[id] = mNodes.size();
+	mNodes.push_back(node);
+	mStructureChanged = true;
+}
+
+void NativeSolver::addConstraint(unsigned source, unsigned target, Transform tf, Covariance cov)
+{
+	std::unordered_map<unsigned, size_t>::iterator s = mNodeIndex.find(source);
+	std::unordered_map<unsigned, size_t>::iterator t = mNodeIndex.find(target);
+	if(s == mNodeIndex.end() || t == mNodeIndex.end())
+	{
+		throw BadEdge(source, target);
+	}
+	
+	Constraint constraint;
+	constraint.inverse_measurement = tf.inverse();
+	constraint.information = cov.inverse();
+	constraint.source = s->second;
+	constraint.target = t->second;
+	constraint.offdiagonal = -1;
+	mConstraints.push_back(constraint);
+	mStructureChanged = true;
+}
+
+void NativeSolver::setFixed(unsigned id)
+{
+	std::unordered_map<unsigned, size_t>::iterator n = mNodeIndex.find(id);
+	if(n == mNodeIndex.end())
+	{
+		SLAM3D_LOG(mLogger, ERROR, (boost::format("Could not fix node with ID %1%!") % id).str());
+		throw UnknownVertex(id);
+	}
+	if(!mNodes[n->second].fixed)
+	{
+		mNodes[n->second].fixed = true;
+		mStructureChanged = true;
+	}
+}
+
+void NativeSolver::unsetFixed(unsigned id)
+{
+	std::unordered_map<unsigned, size_t>::iterator n = mNodeIndex.find(id);
+	if(n == mNodeIndex.end())
+	{
+		throw UnknownVertex(id);
+	}
+	if(mNodes[n->second].fixed)
+	{
+		mNodes[n->second].fixed = false;
+		mStructureChanged = true;
+	}
+}
+
+void NativeSolver::removeNode(unsigned id)
+{
+	std::unordered_map<unsigned, size_t>::iterator n = mNodeIndex.find(id);
+	if(n == mNodeIndex.end())
+	{
+		throw UnknownVertex(id);
+	}
+	size_t index = n->second;
+	size_t last = mNodes.size() - 1;
+	mNodeIndex.erase(n);
+	
+	// Remove the connected constraints
+	ConstraintList::iterator end = std::remove_if(mConstraints.begin(), mConstraints.end(),
+		[index](const Constraint& c){ return c.source == index || c.target == index; });
+	mConstraints.erase(end, mConstraints.end());
+	
+	// Move the last node into the gap
+	if(index != last)
+	{
+		mNodes[index] = mNodes[last];
+		mNodeIndex[mNodes[index].id] = index;
+		for(ConstraintList::iterator c = mConstraints.begin(); c != mConstraints.end(); ++c)
+		{
+			if(c->source == last) c->source = index;
+			if(c->target == last) c->target = index;
+		}
+	}
+	mNodes.pop_back();
+	mStructureChanged = true;
+}
+
+void NativeSolver::setPose(unsigned id, const Transform& pose)
+{
+	std::unordered_map<unsigned, size_t>::iterator n = mNodeIndex.find(id);
+	if(n == mNodeIndex.end())
+	{
+		throw UnknownVertex(id);
+	}
+	mNodes[n->second].pose = pose;
+	mNodes[n->second].reported = pose;
+	mLinearized = false;
+	mCovarianceFactorized = false;
+	mMarginalCache.clear();
+	mRelativeCache.clear();
+}
+
+void NativeSolver::buildStructure()
+{
+	// Only free nodes are variables of the linear system
+	mVariableNodes.clear();
+	for(size_t i = 0; i < mNodes.size(); i++)
+	{
+		if(mNodes[i].fixed)
+		{
+			mNodes[i].variable = -1;
+		}else
+		{
+			mNodes[i].variable = mVariableNodes.size();
+			mVariableNodes.push_back(i);
+		}
+	}
+	
+	// Collect the off-diagonal blocks of the lower triangle per block column
+	size_t n = mVariableNodes.size();
+	std::vector<std::vector<int> > neighbors(n);
+	for(ConstraintList::iterator c = mConstraints.begin(); c != mConstraints.end(); ++c)
+	{
+		int s = mNodes[c->source].variable;
+		int t = mNodes[c->target].variable;
+		if(s >= 0 && t >= 0 && s != t)
+		{
+			neighbors[std::min(s, t)].push_back(std::max(s, t));
+		}
+	}
+	size_t nnz = 0;
+	for(size_t v = 0; v < n; v++)
+	{
+		std::sort(neighbors[v].begin(), neighbors[v].end());
+		neighbors[v].erase(std::unique(neighbors[v].begin(), neighbors[v].end()), neighbors[v].end());
+		nnz += 36 * (1 + neighbors[v].size());
+	}
+	
+	// All six columns of a block column share the same row pattern,
+	// so each 6x6 block can be accessed with a fixed outer stride
+	mHessian.resize(6 * n, 6 * n);
+	mHessian.resizeNonZeros(nnz);
+	int* outer = mHessian.outerIndexPtr();
+	int* inner = mHessian.innerIndexPtr();
+	mBlockStart.resize(n);
+	mBlockStride.resize(n);
+	int pos = 0;
+	for(size_t v = 0; v < n; v++)
+	{
+		mBlockStart[v] = pos;
+		mBlockStride[v] = 6 * (1 + neighbors[v].size());
+		for(int k = 0; k < 6; k++)
+		{
+			outer[6 * v + k] = pos;
+			for(int r = 0; r < 6; r++)
+				inner[pos++] = 6 * v + r;
+			for(std::vector<int>::iterator nb = neighbors[v].begin(); nb != neighbors[v].end(); ++nb)
+				for(int r = 0; r < 6; r++)
+					inner[pos++] = 6 * (*nb) + r;
+		}
+	}
+	outer[6 * n] = pos;
+	
+	// Remember where each constraint writes its off-diagonal block
+	for(ConstraintList::iterator c = mConstraints.begin(); c != mConstraints.end(); ++c)
+	{
+		int s = mNodes[c->source].variable;
+		int t = mNodes[c->target].variable;
+		if(s >= 0 && t >= 0 && s != t)
+		{
+			int col = std::min(s, t);
+			std::vector<int>::iterator slot = std::lower_bound(neighbors[col].begin(), neighbors[col].end(), std::max(s, t));
+			c->offdiagonal = mBlockStart[col] + 6 * (1 + (slot - neighbors[col].begin()));
+		}else
+		{
+			c->offdiagonal = -1;
+		}
+	}
+	
+	mGradient.resize(6 * n);
+	if(n > 0)
+	{
+		mCholesky.analyzePattern(mHessian);
+	}
+	mStructureChanged = false;
+}
+
+NativeSolver::BlockMap NativeSolver::diagonalBlock(int variable)
+{
+	return BlockMap(mHessian.valuePtr() + mBlockStart[variable], Eigen::OuterStride<>(mBlockStride[variable]));
+}
+
+double NativeSolver::buildSystem()
+{
+	std::fill(mHessian.valuePtr(), mHessian.valuePtr() + mHessian.nonZeros(), 0.0);
+	mGradient.setZero();
+	
+	double chi2 = 0;
+	Vector6 error;
+	Matrix6 Ji, Jj;
+	for(ConstraintList::iterator c = mConstraints.begin(); c != mConstraints.end(); ++c)
+	{
+		linearizePoseError(c->inverse_measurement, mNodes[c->source].pose, mNodes[c->target].pose, error, Ji, Jj);
+		Vector6 weighted = c->information * error;
+		chi2 += error.dot(weighted);
+		
+		int s = mNodes[c->source].variable;
+		int t = mNodes[c->target].variable;
+		if(s >= 0 && s == t)
+		{
+			Matrix6 J = Ji + Jj;
+			diagonalBlock(s).noalias() += J.transpose() * c->information * J;
+			mGradient.segment<6>(6 * s).noalias() += J.transpose() * weighted;
+			continue;
+		}
+		
+		Matrix6 OJi = c->information * Ji;
+		Matrix6 OJj = c->information * Jj;
+		if(s >= 0)
+		{
+			diagonalBlock(s).noalias() += Ji.transpose() * OJi;
+			mGradient.segment<6>(6 * s).noalias() += Ji.transpose() * weighted;
+		}
+		if(t >= 0)
+		{
+			diagonalBlock(t).noalias() += Jj.transpose() * OJj;
+			mGradient.segment<6>(6 * t).noalias() += Jj.transpose() * weighted;
+		}
+		if(c->offdiagonal >= 0)
+		{
+			// Only the block below the diagonal is stored
+			if(s < t)
+			{
+				BlockMap block(mHessian.valuePtr() + c->offdiagonal, Eigen::OuterStride<>(mBlockStride[s]));
+				block.noalias() += Jj.transpose() * OJi;
+			}else
+			{
+				BlockMap block(mHessian.valuePtr() + c->offdiagonal, Eigen::OuterStride<>(mBlockStride[t]));
+				block.noalias() += Ji.transpose() * OJj;
+			}
+		}
+	}
+	return chi2;
+}
+
+void NativeSolver::applyIncrement(const Eigen::VectorXd& dx)
+{
+	for(size_t v = 0; v < mVariableNodes.size(); v++)
+	{
+		Transform& pose = mNodes[mVariableNodes[v]].pose;
+		pose = slam3d::applyIncrement(pose, dx.segment<6>(6 * v));
+	}
+}
+
+double NativeSolver::getChi2() const
+{
+	double chi2 = 0;
+	Vector6 error;
+	for(ConstraintList::const_iterator c = mConstraints.begin(); c != mConstraints.end(); ++c)
+	{
+		computePoseError(c->inverse_measurement, mNodes[c->source].pose, mNodes[c->target].pose, error);
+		chi2 += error.dot(c->information * error);
+	}
+	return chi2;
+}
+
+bool NativeSolver::compute()
+{
+	return compute(OptimizationBudget());
+}
+
+bool NativeSolver::compute(const OptimizationBudget& budget)
+{
+	mLastIterations = 0;
+	mChangedPoses.clear();
+	mLinearized = false;
+	mCovarianceFactorized = false;
+	mMarginalCache.clear();
+	mRelativeCache.clear();
+	
+	// need to do something?
+	if(mNodes.size() < 2 || mConstraints.empty())
+		return true;
+	
+	if(mStructureChanged)
+	{
+		ScopedTimer timer(mMetrics, "solver.initialize");
+		buildStructure();
+		timer.addValue("nonzeros", mHessian.nonZeros());
+	}
+	if(mVariableNodes.empty())
+		return true;
+	
+	int64_t deadline = budget.max_duration > 0 ? mClock.monotonic() + (int64_t)(budget.max_duration * 1e9) : 0;
+	int iterations = budget.max_iterations > 0 ? budget.max_iterations : mMaxIterations;
+	
+	ScopedTimer timer(mMetrics, "solver.optimize");
+	double chi2 = buildSystem();
+	
+	// Initial damping relative to the largest diagonal entry
+	double max_diagonal = 0;
+	for(size_t v = 0; v < mVariableNodes.size(); v++)
+		max_diagonal = std::max(max_diagonal, diagonalBlock(v).diagonal().maxCoeff());
+	mLambda = 1e-5 * max_diagonal;
+	
+	Eigen::VectorXd dx;
+	bool failed = false;
+	int iter = 0;
+	while(iter < iterations && chi2 > 0)
+	{
+		iter++;
+		bool accepted = false;
+		double new_chi2 = chi2;
+		for(int attempt = 0; attempt < 10 && !accepted; attempt++)
+		{
+			for(size_t v = 0; v < mVariableNodes.size(); v++)
+				diagonalBlock(v).diagonal().array() += mLambda;
+			mCholesky.factorize(mHessian);
+			for(size_t v = 0; v < mVariableNodes.size(); v++)
+				diagonalBlock(v).diagonal().array() -= mLambda;
+			
+			if(mCholesky.info() != Eigen::Success)
+			{
+				mLambda *= 10;
+				continue;
+			}
+			mFactorNonZeros = mCholesky.matrixL().nestedExpression().nonZeros();
+			dx = mCholesky.solve(-mGradient);
+			
+			// Try the step and revert it if the error increases
+			mBackup.resize(mVariableNodes.size());
+			for(size_t v = 0; v < mVariableNodes.size(); v++)
+				mBackup[v] = mNodes[mVariableNodes[v]].pose;
+			applyIncrement(dx);
+			new_chi2 = getChi2();
+			if(new_chi2 < chi2)
+			{
+				accepted = true;
+				mLambda = std::max(mLambda / 3, 1e-12);
+			}else
+			{
+				for(size_t v = 0; v < mVariableNodes.size(); v++)
+					mNodes[mVariableNodes[v]].pose = mBackup[v];
+				mLambda *= 10;
+			}
+		}
+		
+		if(!accepted)
+		{
+			// No decrease is possible anymore, unless the system could not be solved at all
+			failed = (iter == 1 && mCholesky.info() != Eigen::Success);
+			break;
+		}
+		
+		double gain = (chi2 - new_chi2) / chi2;
+		chi2 = buildSystem();
+		if(gain < mGainThreshold)
+			break;
+		if(deadline > 0 && mClock.monotonic() >= deadline)
+			break;
+	}
+	timer.addValue("iterations", iter);
+	timer.addValue("chi2", chi2);
+	mLastIterations = iter;
+	
+	if(failed)
+	{
+		SLAM3D_LOG(mLogger, ERROR, "Optimization failed!");
+		return false;
+	}
+	SLAM3D_LOG(mLogger, INFO ,(boost::format("Optimization finished after %1% iterations.") % iter).str());
+	mLinearized = true;
+	
+	// Collect the nodes that moved beyond the tolerance
+	for(size_t v = 0; v < mVariableNodes.size(); v++)
+	{
+		Node& node = mNodes[mVariableNodes[v]];
+		Transform diff = node.reported.inverse() * node.pose;
+		if(diff.translation().norm() > mTranslationTolerance ||
+		   Eigen::AngleAxis<ScalarType>(diff.linear()).angle() > mRotationTolerance)
+		{
+			node.reported = node.pose;
+			mChangedPoses.push_back(IdPose(node.id, node.pose));
+		}
+	}
+	return true;
+}
+
+void NativeSolver::clear()
+{
+	mNodes.clear();
+	mConstraints.clear();
+	mNodeIndex.clear();
+	mVariableNodes.clear();
+	mBlockStart.clear();
+	mBlockStride.clear();
+	mBackup.clear();
+	mChangedPoses.clear();
+	mHessian.resize(0, 0);
+	mHessian.data().squeeze();
+	mFactorNonZeros = 0;
+	mStructureChanged = true;
+	mLinearized = false;
+	mCovarianceFactorized = false;
+	mMarginalCache.clear();
+	mRelativeCache.clear();
+}
+
+IdPoseVector NativeSolver::getCorrections()
+{
+	IdPoseVector corrections;
+	corrections.reserve(mNodes.size());
+	for(NodeList::iterator n = mNodes.begin(); n != mNodes.end(); ++n)
+	{
+		corrections.push_back(IdPose(n->id, n->pose));
+	}
+	return corrections;
+}
+
+const IdPoseVector& NativeSolver::getChangedPoses()
+{
+	return mChangedPoses;
+}
+
+const NativeSolver::Node& NativeSolver::getNode(unsigned id) const
+{
+	std::unordered_map<unsigned, size_t>::const_iterator n = mNodeIndex.find(id);
+	if(n == mNodeIndex.end())
+	{
+		throw UnknownVertex(id);
+	}
+	return mNodes[n->second];
+}
+
+bool NativeSolver::solveCovarianceColumns(int variable, Eigen::MatrixXd& columns)
+{
+	if(!mLinearized)
+		return false;
+	
+	// The last factorization contains the damping of Levenberg-Marquardt
+	if(!mCovarianceFactorized)
+	{
+		ScopedTimer timer(mMetrics, "solver.covariance_factorization");
+		mCholesky.factorize(mHessian);
+		if(mCholesky.info() != Eigen::Success)
+		{
+			SLAM3D_LOG(mLogger, ERROR, "Factorization for covariance queries failed!");
+			mLinearized = false;
+			return false;
+		}
+		mCovarianceFactorized = true;
+	}
+	
+	Eigen::MatrixXd unit = Eigen::MatrixXd::Zero(mHessian.rows(), 6);
+	unit.block<6,6>(6 * variable, 0).setIdentity();
+	columns = mCholesky.solve(unit);
+	return true;
+}
+
+bool NativeSolver::getIncrementCovariance(const Node& node, Matrix6& cov)
+{
+	if(node.fixed)
+	{
+		cov.setZero();
+		return true;
+	}
+	if(node.variable < 0)
+		return false;
+	
+	CovarianceCache<unsigned>::Type::iterator cached = mMarginalCache.find(node.id);
+	if(cached != mMarginalCache.end())
+	{
+		cov = cached->second;
+		return true;
+	}
+	
+	Eigen::MatrixXd columns;
+	if(!solveCovarianceColumns(node.variable, columns))
+		return false;
+	cov = columns.block<6,6>(6 * node.variable, 0);
+	cov = 0.5 * (cov + cov.transpose()).eval();
+	mMarginalCache.insert(CovarianceCache<unsigned>::Type::value_type(node.id, cov));
+	return true;
+}
+
+bool NativeSolver::getMarginalCovariance(unsigned id, Covariance& cov)
+{
+	Matrix6 increment_cov;
+	if(!getIncrementCovariance(getNode(id), increment_cov))
+		return false;
+	cov = errorScale().asDiagonal() * increment_cov * errorScale().asDiagonal();
+	return true;
+}
+
+bool NativeSolver::getRelativeCovariance(unsigned source, unsigned target, Covariance& cov)
+{
+	const Node& s = getNode(source);
+	const Node& t = getNode(target);
+	uint64_t key = ((uint64_t)source << 32) | target;
+	CovarianceCache<uint64_t>::Type::iterator cached = mRelativeCache.find(key);
+	if(cached != mRelativeCache.end())
+	{
+		cov = cached->second;
+		return true;
+	}
+	
+	Matrix6 source_cov, target_cov;
+	if(!getIncrementCovariance(s, source_cov) || !getIncrementCovariance(t, target_cov))
+		return false;
+	
+	// Correlation between both nodes, which is zero if one of them is fixed
+	Matrix6 cross = Matrix6::Zero();
+	if(!s.fixed && !t.fixed)
+	{
+		Eigen::MatrixXd columns;
+		if(!solveCovarianceColumns(t.variable, columns))
+			return false;
+		cross = columns.block<6,6>(6 * s.variable, 0);
+	}
+	
+	Matrix6 relative = relativeCovariance(s.pose, t.pose, source_cov, target_cov, cross);
+	cov = errorScale().asDiagonal() * relative * errorScale().asDiagonal();
+	mRelativeCache.insert(CovarianceCache<uint64_t>::Type::value_type(key, cov));
+	return true;
+}
+
+MemoryUsage NativeSolver::getMemoryUsage() const
+{
+	MemoryUsage usage;
+	usage.objects = mNodes.size() + mConstraints.size();
+	usage.bytes = mNodes.capacity() * sizeof(Node) + mConstraints.capacity() * sizeof(Constraint);
+	usage.bytes += mNodeIndex.size() * (sizeof(unsigned) + sizeof(size_t) + 2 * sizeof(void*));
+	usage.bytes += mHessian.nonZeros() * (sizeof(double) + sizeof(int)) + mHessian.outerSize() * sizeof(int);
+	usage.bytes += mFactorNonZeros * (sizeof(double) + sizeof(int));
+	usage.bytes += mGradient.size() * sizeof(double) * 2;
+	usage.bytes += mBackup.capacity() * sizeof(Transform);
+	usage.bytes += mChangedPoses.capacity() * sizeof(IdPose);
+	usage.bytes += (mMarginalCache.size() + mRelativeCache.size()) * (sizeof(Matrix6) + sizeof(uint64_t) + 2 * sizeof(void*));
+	return usage;
+}
+
+void NativeSolver::saveGraph(std::string filename)
+{
+	std::ofstream file(filename.c_str());
+	if(!file.good())
+	{
+		SLAM3D_LOG(mLogger, ERROR, (boost::format("Could not save %1%.") % filename).str());
+		return;
+	}
+	
+	file.precision(12);
+	for(NodeList::iterator n = mNodes.begin(); n != mNodes.end(); ++n)
+	{
+		Eigen::Quaterniond q(n->pose.linear());
+		Eigen::Vector3d t = n->pose.translation();
+		file << "VERTEX_SE3:QUAT " << n->id << " " << t(0) << " " << t(1) << " " << t(2) << " "
+		     << q.x() << " " << q.y() << " " << q.z() << " " << q.w() << std::endl;
+		if(n->fixed)
+			file << "FIX " << n->id << std::endl;
+	}
+	for(ConstraintList::iterator c = mConstraints.begin(); c != mConstraints.end(); ++c)
+	{
+		Transform measurement = c->inverse_measurement.inverse();
+		Eigen::Quaterniond q(measurement.linear());
+		Eigen::Vector3d t = measurement.translation();
+		file << "EDGE_SE3:QUAT " << mNodes[c->source].id << " " << mNodes[c->target].id << " "
+		     << t(0) << " " << t(1) << " " << t(2) << " "
+		     << q.x() << " " << q.y() << " " << q.z() << " " << q.w();
+		for(int i = 0; i < 6; i++)
+			for(int j = i; j < 6; j++)
+				file << " " << c->information(i, j);
+		file << std::endl;
+	}
+	SLAM3D_LOG(mLogger, INFO, (boost::format("Saved current graph in %1%.") % filename).str());
+}
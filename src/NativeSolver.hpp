@@ -0,0 +1,234 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_NATIVE_SOLVER_HPP
+#define SLAM_NATIVE_SOLVER_HPP
+
+#include "Solver.hpp"
+#include "Clock.hpp"
+#include "Linearization.hpp"
+
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+#include <Eigen/StdVector>
+
+#include <cstdint>
+#include <unordered_map>
+
+namespace slam3d
+{
+	/**
+	 * @class NativeSolver
+	 * @brief A lightweight pose-graph solver without external backend.
+	 * @details The solver minimizes the same error as g2o's EdgeSE3, the
+	 * translation and the imaginary part of the quaternion of the residual
+	 * transform, with Levenberg-Marquardt. All Jacobians and Hessian blocks
+	 * are fixed-size 6x6 matrices. The Hessian is stored as one contiguous
+	 * sparse matrix, whose pattern and fill-reducing ordering are computed
+	 * only when nodes or constraints are added or removed, so repeated
+	 * calls to compute() only refill the values and refactorize.
+	 */
+	class NativeSolver : public Solver
+	{
+	public:
+		/**
+		 * @brief Constructor
+		 * @param logger pointer to the logger used by the solver
+		 * @param max_iterations default number of iterations for compute()
+		 * @param gain_threshold stop when the relative decrease of chi² is below
+		 */
+		NativeSolver(Logger* logger, int max_iterations = 100, double gain_threshold = 1e-6);
+		~NativeSolver();
+		
+		void addNode(unsigned id, Transform pose);
+		void addConstraint(unsigned source, unsigned target, Transform tf, Covariance cov);
+		void setFixed(unsigned id);
+		void unsetFixed(unsigned id);
+		void removeNode(unsigned id);
+		
+		/**
+		 * @brief Move a node to the given pose.
+		 * @details Covariances of the last compute() are discarded, as they
+		 * refer to the previous pose.
+		 * @param id
+		 * @param pose new pose of the node
+		 * @throw UnknownVertex
+		 */
+		void setPose(unsigned id, const Transform& pose);
+		bool compute();
+		
+		/**
+		 * @brief Start optimization with limited iterations and duration.
+		 * @param budget maximum iterations and duration of the optimization
+		 */
+		bool compute(const OptimizationBudget& budget);
+		
+		void clear();
+		
+		/**
+		 * @brief Save the graph in g2o's text format (VERTEX_SE3:QUAT, EDGE_SE3:QUAT).
+		 */
+		void saveGraph(std::string filename);
+		
+		IdPoseVector getCorrections();
+		const IdPoseVector& getChangedPoses();
+		
+		/**
+		 * @brief Get the marginal covariance of a node.
+		 * @details The Hessian of the last compute() is factorized again
+		 * without damping on the first query, each node then needs one
+		 * solve with six right-hand sides.
+		 * @throw UnknownVertex
+		 */
+		bool getMarginalCovariance(unsigned id, Covariance& cov);
+		
+		/**
+		 * @brief Get the covariance of the relative pose from source to target.
+		 * @throw UnknownVertex
+		 */
+		bool getRelativeCovariance(unsigned source, unsigned target, Covariance& cov);
+		
+		/**
+		 * @brief Get the number of iterations done by the last compute().
+		 */
+		int getLastIterations() const { return mLastIterations; }
+		
+		/**
+		 * @brief Get the summed squared error weighted with the information matrices.
+		 */
+		double getChi2() const;
+		
+		/**
+		 * @brief Get the memory used by nodes, constraints and the Hessian.
+		 */
+		MemoryUsage getMemoryUsage() const;
+		
+	protected:
+		typedef Eigen::Map<Matrix6, Eigen::Unaligned, Eigen::OuterStride<> > BlockMap;
+		typedef Eigen::SparseMatrix<double> SparseMatrix;
+		
+		struct Node
+		{
+			Transform pose;
+			Transform reported;
+			unsigned id;
+			bool fixed;
+			
+			// Position of the node in the linear system, -1 when fixed
+			int variable;
+		};
+		
+		struct Constraint
+		{
+			Transform inverse_measurement;
+			Matrix6 information;
+			size_t source;
+			size_t target;
+			
+			// Offset of the off-diagonal Hessian block in the value array,
+			// -1 when one of the nodes is fixed
+			int offdiagonal;
+		};
+		
+		typedef std::vector<Node, Eigen::aligned_allocator<Node> > NodeList;
+		typedef std::vector<Constraint, Eigen::aligned_allocator<Constraint> > ConstraintList;
+		
+		template<class Key>
+		struct CovarianceCache
+		{
+			typedef std::unordered_map<Key, Matrix6, std::hash<Key>, std::equal_to<Key>,
+				Eigen::aligned_allocator<std::pair<const Key, Matrix6> > > Type;
+		};
+		
+		/**
+		 * @brief Create the sparsity pattern of the Hessian and analyze it.
+		 */
+		void buildStructure();
+		
+		/**
+		 * @brief Fill the Hessian and the gradient at the current poses.
+		 * @return chi² at the current poses
+		 */
+		double buildSystem();
+		
+		/**
+		 * @brief Get the Hessian block of a variable on the diagonal.
+		 */
+		BlockMap diagonalBlock(int variable);
+		
+		/**
+		 * @brief Apply the solution of the linear system to all free nodes.
+		 */
+		void applyIncrement(const Eigen::VectorXd& dx);
+		
+		/**
+		 * @brief Get the node with the given id or throw UnknownVertex.
+		 */
+		const Node& getNode(unsigned id) const;
+		
+		/**
+		 * @brief Solve for the columns of the covariance that belong to a variable.
+		 * @return false if the Hessian of the last compute() is not available
+		 */
+		bool solveCovarianceColumns(int variable, Eigen::MatrixXd& columns);
+		
+		/**
+		 * @brief Get the marginal covariance of a node for increments (translation, rotation).
+		 */
+		bool getIncrementCovariance(const Node& node, Matrix6& cov);
+		
+		NodeList mNodes;
+		ConstraintList mConstraints;
+		std::unordered_map<unsigned, size_t> mNodeIndex;
+		
+		// Linear system, the pattern is rebuilt when mStructureChanged is set
+		SparseMatrix mHessian;
+		Eigen::VectorXd mGradient;
+		Eigen::SimplicialLDLT<SparseMatrix, Eigen::Lower> mCholesky;
+		std::vector<int> mBlockStart;
+		std::vector<int> mBlockStride;
+		std::vector<size_t> mVariableNodes;
+		size_t mFactorNonZeros;
+		bool mStructureChanged;
+		
+		// The Hessian has been built at the current poses by the last compute()
+		// and is factorized without damping for covariance queries
+		bool mLinearized;
+		bool mCovarianceFactorized;
+		CovarianceCache<unsigned>::Type mMarginalCache;
+		CovarianceCache<uint64_t>::Type mRelativeCache;
+		
+		// Backup of the poses to revert rejected steps
+		std::vector<Transform, Eigen::aligned_allocator<Transform> > mBackup;
+		
+		int mMaxIterations;
+		double mGainThreshold;
+		double mLambda;
+		int mLastIterations;
+		Clock mClock;
+	};
+}
+
+#endif
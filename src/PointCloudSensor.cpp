@@ -32,9 +32,227 @@
 
 #include <boost/format.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
 using namespace slam3d;
 
-typedef pcl::GeneralizedIterativeClosestPoint<PointType, PointType> GICP;
+// Exposes the number of iterations used by the last alignment
+class GICP : public pcl::GeneralizedIterativeClosestPoint<PointType, PointType>
+{
+public:
+	int getIterations() const { return nr_iterations_; }
+};
+
+// Layout of a serialized point cloud, followed by the raw points
+struct CloudPayloadHeader
+{
+	uint32_t width;
+	uint32_t height;
+	uint32_t dense;
+	uint32_t points;
+};
+
+size_t PointCloudMeasurement::getPayloadSize() const
+{
+	if(!mPointCloud)
+		return 0;
+	return sizeof(CloudPayloadHeader) + mPointCloud->points.size() * sizeof(PointType);
+}
+
+void PointCloudMeasurement::writePayload(char* buffer) const
+{
+	CloudPayloadHeader header;
+	header.width = mPointCloud->width;
+	header.height = mPointCloud->height;
+	header.dense = mPointCloud->is_dense;
+	header.points = mPointCloud->points.size();
+	memcpy(buffer, &header, sizeof(header));
+	memcpy(buffer + sizeof(header), mPointCloud->points.data(), header.points * sizeof(PointType));
+}
+
+// Organized clouds are indexed by width and height, which have to match the
+// number of points, otherwise the cloud is treated as unorganized.
+static void setDimensions(PointCloud& cloud, uint32_t width, uint32_t height)
+{
+	if((uint64_t)width * height == cloud.points.size())
+	{
+		cloud.width = width;
+		cloud.height = height;
+	}else
+	{
+		cloud.width = cloud.points.size();
+		cloud.height = 1;
+	}
+}
+
+void PointCloudMeasurement::readPayload(const char* buffer, size_t size)
+{
+	CloudPayloadHeader header;
+	if(size < sizeof(header))
+	{
+		throw BadMeasurementType();
+	}
+	memcpy(&header, buffer, sizeof(header));
+	if(size < sizeof(header) + header.points * sizeof(PointType))
+	{
+		throw BadMeasurementType();
+	}
+	
+	PointCloud::Ptr cloud(new PointCloud);
+	cloud->points.resize(header.points);
+	memcpy(cloud->points.data(), buffer + sizeof(header), header.points * sizeof(PointType));
+	setDimensions(*cloud, header.width, header.height);
+	cloud->is_dense = header.dense;
+	cloud->header.stamp = (uint64_t)mStamp.tv_sec * 1000000 + mStamp.tv_usec;
+	mPointCloud = cloud;
+}
+
+// Layout of a quantized point cloud, followed by the quantized coordinates
+struct CompressedCloudHeader
+{
+	uint32_t width;
+	uint32_t height;
+	uint32_t dense;
+	uint32_t points;
+	float origin[3];
+	float step;
+};
+
+// Quantized coordinates per point, invalid coordinates are marked by the largest step
+#ifdef PCL_WITH_VIEWPOINT
+#define COMPRESSED_VALUES 6
+#else
+#define COMPRESSED_VALUES 3
+#endif
+#define INVALID_STEP 0xFFFF
+
+static void getCoordinates(const PointType& p, float* values)
+{
+	values[0] = p.x;
+	values[1] = p.y;
+	values[2] = p.z;
+#ifdef PCL_WITH_VIEWPOINT
+	values[3] = p.vp_x;
+	values[4] = p.vp_y;
+	values[5] = p.vp_z;
+#endif
+}
+
+static void setCoordinates(PointType& p, const float* values)
+{
+	p.x = values[0];
+	p.y = values[1];
+	p.z = values[2];
+#ifdef PCL_WITH_VIEWPOINT
+	p.vp_x = values[3];
+	p.vp_y = values[4];
+	p.vp_z = values[5];
+#endif
+}
+
+size_t PointCloudMeasurement::getCompressedPayloadSize(ScalarType resolution) const
+{
+	if(!mPointCloud)
+		return 0;
+	return sizeof(CompressedCloudHeader) + mPointCloud->points.size() * COMPRESSED_VALUES * sizeof(uint16_t);
+}
+
+void PointCloudMeasurement::writeCompressedPayload(char* buffer, ScalarType resolution) const
+{
+	CompressedCloudHeader header;
+	header.width = mPointCloud->width;
+	header.height = mPointCloud->height;
+	header.dense = mPointCloud->is_dense;
+	header.points = mPointCloud->points.size();
+	
+	// All coordinates are quantized relative to the minimum of the cloud
+	float values[COMPRESSED_VALUES];
+	float maximum[3];
+	for(unsigned i = 0; i < 3; i++)
+	{
+		header.origin[i] = std::numeric_limits<float>::max();
+		maximum[i] = -std::numeric_limits<float>::max();
+	}
+	for(size_t n = 0; n < header.points; n++)
+	{
+		getCoordinates(mPointCloud->points[n], values);
+		for(unsigned i = 0; i < COMPRESSED_VALUES; i++)
+		{
+			if(!std::isfinite(values[i]))
+				continue;
+			header.origin[i % 3] = std::min(header.origin[i % 3], values[i]);
+			maximum[i % 3] = std::max(maximum[i % 3], values[i]);
+		}
+	}
+	
+	// Rounding to steps of twice the resolution keeps the error within the
+	// resolution, larger clouds get larger steps so all coordinates fit
+	double step = 2 * resolution;
+	for(unsigned i = 0; i < 3; i++)
+	{
+		if(maximum[i] >= header.origin[i])
+			step = std::max<double>(step, ((double)maximum[i] - header.origin[i]) / (INVALID_STEP - 1));
+	}
+	header.step = step;
+	memcpy(buffer, &header, sizeof(header));
+	
+	uint16_t steps[COMPRESSED_VALUES];
+	char* out = buffer + sizeof(header);
+	for(size_t n = 0; n < header.points; n++)
+	{
+		getCoordinates(mPointCloud->points[n], values);
+		for(unsigned i = 0; i < COMPRESSED_VALUES; i++)
+		{
+			if(std::isfinite(values[i]))
+				steps[i] = std::min<double>(std::round((values[i] - header.origin[i % 3]) / header.step), INVALID_STEP - 1);
+			else
+				steps[i] = INVALID_STEP;
+		}
+		memcpy(out, steps, sizeof(steps));
+		out += sizeof(steps);
+	}
+}
+
+void PointCloudMeasurement::readCompressedPayload(const char* buffer, size_t size, ScalarType resolution)
+{
+	CompressedCloudHeader header;
+	if(size < sizeof(header))
+	{
+		throw BadMeasurementType();
+	}
+	memcpy(&header, buffer, sizeof(header));
+	if(size < sizeof(header) + header.points * COMPRESSED_VALUES * sizeof(uint16_t) || !(header.step > 0))
+	{
+		throw BadMeasurementType();
+	}
+	
+	PointCloud::Ptr cloud(new PointCloud);
+	cloud->points.resize(header.points);
+	double step = header.step;
+	uint16_t steps[COMPRESSED_VALUES];
+	float values[COMPRESSED_VALUES];
+	const char* in = buffer + sizeof(header);
+	for(size_t n = 0; n < header.points; n++)
+	{
+		memcpy(steps, in, sizeof(steps));
+		in += sizeof(steps);
+		for(unsigned i = 0; i < COMPRESSED_VALUES; i++)
+		{
+			if(steps[i] == INVALID_STEP)
+				values[i] = std::numeric_limits<float>::quiet_NaN();
+			else
+				values[i] = header.origin[i % 3] + steps[i] * step;
+		}
+		setCoordinates(cloud->points[n], values);
+	}
+	setDimensions(*cloud, header.width, header.height);
+	cloud->is_dense = header.dense;
+	cloud->header.stamp = (uint64_t)mStamp.tv_sec * 1000000 + mStamp.tv_usec;
+	mPointCloud = cloud;
+}
 
 PointCloudSensor::PointCloudSensor(const std::string& n, Logger* l, const Transform& p)
  : Sensor(n, l, p)
@@ -49,6 +267,7 @@ PointCloudSensor::~PointCloudSensor()
 
 PointCloud::Ptr PointCloudSensor::downsample(PointCloud::ConstPtr in, double leaf_size) const
 {
+	ScopedTimer timer(mMetrics, "sensor.downsample");
 	PointCloud::Ptr out(new PointCloud);
 	pcl::VoxelGrid<PointType> grid;
 	grid.setLeafSize (leaf_size, leaf_size, leaf_size);
@@ -59,6 +278,7 @@ PointCloud::Ptr PointCloudSensor::downsample(PointCloud::ConstPtr in, double lea
 
 PointCloud::Ptr PointCloudSensor::removeOutliers(PointCloud::ConstPtr in, double radius, unsigned min_neighbors) const
 {
+	ScopedTimer timer(mMetrics, "sensor.remove_outliers");
 	PointCloud::Ptr out(new PointCloud);
 	pcl::RadiusOutlierRemoval<PointType> out_removal;
 	out_removal.setInputCloud(in);
@@ -78,7 +298,7 @@ TransformWithCovariance PointCloudSensor::calculateTransform(Measurement::Ptr so
 	PointCloudMeasurement::Ptr targetCloud = boost::dynamic_pointer_cast<PointCloudMeasurement>(target);
 	if(!sourceCloud || !targetCloud)
 	{
-		mLogger->message(ERROR, "Measurement given to calculateTransform() is not a PointCloud!");
+		SLAM3D_LOG(mLogger, ERROR, "Measurement given to calculateTransform() is not a PointCloud!");
 		throw BadMeasurementType();
 	}
 	
@@ -124,12 +344,19 @@ TransformWithCovariance PointCloudSensor::calculateTransform(Measurement::Ptr so
 	icp.setInputSource(shifted_target);
 	icp.setInputTarget(filtered_source);
 	PointCloud result;
-	icp.align(result);
+	double fitness;
+	{
+		ScopedTimer timer(mMetrics, "sensor.gicp");
+		icp.align(result);
+		fitness = icp.getFitnessScore();
+		timer.addValue("iterations", icp.getIterations());
+		timer.addValue("fitness", fitness);
+	}
 
 	// Check if ICP was successful (kind of...)
-	if(!icp.hasConverged() || icp.getFitnessScore() > config.max_fitness_score)
+	if(!icp.hasConverged() || fitness > config.max_fitness_score)
 	{
-		throw NoMatch((boost::format("ICP failed with Fitness-Score %1% > %2%") % icp.getFitnessScore() % config.max_fitness_score).str());
+		throw NoMatch((boost::format("ICP failed with Fitness-Score %1% > %2%") % fitness % config.max_fitness_score).str());
 	}
 	
 	// Get estimated transform
@@ -145,6 +372,7 @@ TransformWithCovariance PointCloudSensor::calculateTransform(Measurement::Ptr so
 
 PointCloud::Ptr PointCloudSensor::transform(PointCloud::ConstPtr source, const Transform tf) const
 {
+	ScopedTimer timer(mMetrics, "sensor.transform");
 	PointCloud::Ptr transformedCloud(new PointCloud);
 	pcl::transformPointCloud(*source, *transformedCloud, tf.matrix());
 	return transformedCloud;
@@ -158,7 +386,7 @@ PointCloud::Ptr PointCloudSensor::getAccumulatedCloud(const VertexObjectList& ve
 		PointCloudMeasurement::Ptr pcl = boost::dynamic_pointer_cast<PointCloudMeasurement>(it->measurement);
 		if(!pcl)
 		{
-			mLogger->message(ERROR, "Measurement in getAccumulatedCloud() is not a point cloud!");
+			SLAM3D_LOG(mLogger, ERROR, "Measurement in getAccumulatedCloud() is not a point cloud!");
 			throw BadMeasurementType();
 		}
 		
@@ -168,8 +396,15 @@ PointCloud::Ptr PointCloudSensor::getAccumulatedCloud(const VertexObjectList& ve
 	return accu;
 }
 
+Measurement::Ptr PointCloudSensor::createMeasurement(const std::string& robot, const boost::uuids::uuid& id,
+                                                     const timeval& stamp, const Transform& pose) const
+{
+	return Measurement::Ptr(new PointCloudMeasurement(robot, mName, pose, id, stamp));
+}
+
 Measurement::Ptr PointCloudSensor::createCombinedMeasurement(const VertexObjectList& vertices, Transform pose) const
 {
+	ScopedTimer timer(mMetrics, "sensor.combine");
 	PointCloud::Ptr cloud = getAccumulatedCloud(vertices);
 	PointCloud::Ptr shifted(new PointCloud);
 	pcl::transformPointCloud(*cloud, *shifted, pose.inverse().matrix());
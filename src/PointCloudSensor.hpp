@@ -79,12 +79,79 @@ namespace slam3d
 			mStamp.tv_usec = cloud->header.stamp % 1000000;
 		}
 		
+		/**
+		 * @brief Constructor for a measurement without a point cloud.
+		 * @details The point cloud has to be restored with readPayload().
+		 * @param r name of the robot that accquired this measurement
+		 * @param s name of the sensor managing this measurement
+		 * @param tr pose of the sensor in robot coordinates
+		 * @param id unique identifier of this measurement
+		 * @param stamp time when the measurement was recorded
+		 */
+		PointCloudMeasurement(const std::string& r, const std::string& s, const Transform& tr,
+		                      const boost::uuids::uuid& id, const timeval& stamp)
+		 : Measurement(r, s, tr, id, stamp) {}
+		
 		/**
 		 * @brief Gets the point cloud contained within this measurement.
 		 * @return Constant shared pointer to the point cloud
 		 */
 		const PointCloud::Ptr getPointCloud() const {return mPointCloud;}
 		
+		/**
+		 * @brief Get the size of the serialized point cloud in bytes.
+		 */
+		size_t getPayloadSize() const;
+		
+		/**
+		 * @brief Write the points into the given buffer.
+		 * @param buffer memory of at least getPayloadSize() bytes
+		 */
+		void writePayload(char* buffer) const;
+		
+		/**
+		 * @brief Restore the point cloud from the given buffer.
+		 * @param buffer memory previously filled by writePayload()
+		 * @param size size of the buffer in bytes
+		 */
+		void readPayload(const char* buffer, size_t size);
+		
+		/**
+		 * @brief Get the size of the quantized point cloud in bytes.
+		 * @details Each coordinate is stored as a 16 bit step relative to the
+		 * minimum of the cloud. If the extent of the cloud exceeds 131070
+		 * times the resolution, the step is enlarged to fit all points, so
+		 * the error grows beyond the resolution.
+		 * @param resolution maximum error of a coordinate
+		 */
+		size_t getCompressedPayloadSize(ScalarType resolution) const;
+		
+		/**
+		 * @brief Write the quantized points into the given buffer.
+		 * @param buffer memory of at least getCompressedPayloadSize() bytes
+		 * @param resolution maximum error of a coordinate
+		 */
+		void writeCompressedPayload(char* buffer, ScalarType resolution) const;
+		
+		/**
+		 * @brief Restore the point cloud from quantized points.
+		 * @param buffer memory previously filled by writeCompressedPayload()
+		 * @param size size of the buffer in bytes
+		 * @param resolution resolution used for writing, the actual step is
+		 * stored with the points
+		 */
+		void readCompressedPayload(const char* buffer, size_t size, ScalarType resolution);
+		
+		/**
+		 * @brief Release the point cloud held by this measurement.
+		 */
+		void releasePayload() { mPointCloud.reset(); }
+		
+		/**
+		 * @brief Whether the point cloud is currently held in memory.
+		 */
+		bool hasPayload() const { return (bool)mPointCloud; }
+		
 	protected:
 		PointCloud::Ptr mPointCloud;
 	};
@@ -124,6 +191,18 @@ namespace slam3d
 		 */		
 		Measurement::Ptr createCombinedMeasurement(const VertexObjectList& vertices, Transform pose) const;
 		
+		/**
+		 * @brief Create a PointCloudMeasurement without points from meta information.
+		 * @param robot name of the robot that recorded the measurement
+		 * @param id unique identifier of the measurement
+		 * @param stamp time when the measurement was recorded
+		 * @param pose sensor pose in robot coordinates
+		 */
+		Measurement::Ptr createMeasurement(const std::string& robot,
+		                                   const boost::uuids::uuid& id,
+		                                   const timeval& stamp,
+		                                   const Transform& pose) const;
+		
 		/**
 		 * @brief Sets configuration for fine GICP algorithm.
 		 * @param c New configuration paramerters
@@ -0,0 +1,239 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "PoseGraphGenerator.hpp"
+
+#include <boost/format.hpp>
+
+#include <cmath>
+
+using namespace slam3d;
+
+// Number of steps between two intersections in the Manhattan world
+#define BLOCK_LENGTH 10
+
+// Number of earlier poses per cell that are checked for loop closures
+#define MAX_LOOP_CANDIDATES 16
+
+SyntheticSensor::SyntheticSensor(const std::string& n, Logger* l, const GeneratorConfiguration& config)
+ : Sensor(n, l, Transform::Identity()), mConfiguration(config), mRandom(config.seed)
+{
+}
+
+TransformWithCovariance SyntheticSensor::addNoise(const Transform& tf) const
+{
+	std::normal_distribution<double> translation(0, mConfiguration.translation_noise);
+	std::normal_distribution<double> rotation(0, mConfiguration.rotation_noise);
+	
+	TransformWithCovariance twc;
+	twc.transform = tf;
+	twc.transform.translation() += Vector3(translation(mRandom), translation(mRandom), translation(mRandom));
+	twc.transform.rotate(Eigen::AngleAxisd(rotation(mRandom), Vector3::UnitZ())
+	                   * Eigen::AngleAxisd(rotation(mRandom), Vector3::UnitY())
+	                   * Eigen::AngleAxisd(rotation(mRandom), Vector3::UnitX()));
+	
+	// Keep the covariance invertible, even without any noise
+	double t_var = std::max(mConfiguration.translation_noise * mConfiguration.translation_noise, 1e-6);
+	double r_var = std::max(mConfiguration.rotation_noise * mConfiguration.rotation_noise, 1e-6);
+	twc.covariance = Covariance::Identity();
+	twc.covariance.block<3,3>(0,0) *= t_var;
+	twc.covariance.block<3,3>(3,3) *= r_var;
+	return twc;
+}
+
+TransformWithCovariance SyntheticSensor::calculateTransform(Measurement::Ptr source, Measurement::Ptr target, Transform odometry, bool coarse) const
+{
+	SyntheticMeasurement::Ptr s = boost::dynamic_pointer_cast<SyntheticMeasurement>(source);
+	SyntheticMeasurement::Ptr t = boost::dynamic_pointer_cast<SyntheticMeasurement>(target);
+	if(!s || !t)
+	{
+		throw BadMeasurementType();
+	}
+	
+	Transform relative = s->getGroundTruth().inverse() * t->getGroundTruth();
+	size_t distance = s->getSequence() > t->getSequence() ? s->getSequence() - t->getSequence() : t->getSequence() - s->getSequence();
+	if(distance > 1)
+	{
+		std::uniform_real_distribution<double> uniform(0, 1);
+		if(relative.translation().norm() > mConfiguration.loop_range)
+			throw NoMatch("measurements are too far apart");
+		if(uniform(mRandom) > mConfiguration.loop_probability)
+			throw NoMatch("loop closure rejected");
+	}
+	return addNoise(relative);
+}
+
+Measurement::Ptr SyntheticSensor::createCombinedMeasurement(const VertexObjectList& vertices, Transform pose) const
+{
+	// There is no sensor data to combine, so just take the first measurement
+	if(vertices.empty())
+	{
+		throw BadMeasurementType();
+	}
+	return vertices.front().measurement;
+}
+
+PoseGraphGenerator::PoseGraphGenerator(const SyntheticSensor& sensor, const GeneratorConfiguration& config)
+ : mSensor(sensor), mConfiguration(config), mRandom(config.seed), mSequence(0),
+   mPose(Transform::Identity()), mHeading(0), mRadius(2 * config.step), mGrowth(1),
+   mLastId(boost::uuids::nil_uuid()), mLoops(0)
+{
+}
+
+Transform PoseGraphGenerator::nextPose()
+{
+	double step = mConfiguration.step;
+	switch(mConfiguration.trajectory)
+	{
+	case TRAJECTORY_GRID:
+	{
+		// Drive back and forth in rows, then start again at the origin
+		size_t row_length = std::max(1.0, mConfiguration.area / step);
+		size_t k = mSequence % (row_length * row_length);
+		size_t row = k / row_length;
+		size_t col = k % row_length;
+		bool forward = (row % 2 == 0);
+		mPose = Transform::Identity();
+		mPose.translation() = Vector3((forward ? col : row_length - 1 - col) * step, row * step, 0);
+		mHeading = forward ? 0 : M_PI;
+		break;
+	}
+	case TRAJECTORY_MANHATTAN:
+	{
+		// Choose a new direction at each intersection, but stay within the area
+		if(mSequence > 0 && mSequence % BLOCK_LENGTH == 0)
+		{
+			std::uniform_int_distribution<int> turn(-1, 2);
+			int t = turn(mRandom);
+			if(t != 2)
+				mHeading += t * M_PI / 2;
+			
+			Vector3 ahead = mPose.translation() + Vector3(cos(mHeading), sin(mHeading), 0) * step * BLOCK_LENGTH;
+			if(std::abs(ahead[0]) > mConfiguration.area / 2 || std::abs(ahead[1]) > mConfiguration.area / 2)
+				mHeading += M_PI;
+		}
+		if(mSequence > 0)
+		{
+			mPose.translation() += Vector3(round(cos(mHeading)), round(sin(mHeading)), 0) * step;
+		}
+		break;
+	}
+	case TRAJECTORY_SPIRAL:
+	{
+		// Move along the spiral, the radius grows by one step per revolution
+		double angle = step / mRadius;
+		mHeading += angle;
+		mRadius += mGrowth * step * angle / (2 * M_PI);
+		if(mRadius > mConfiguration.area / 2 || mRadius < 2 * step)
+			mGrowth = -mGrowth;
+		mPose = Transform::Identity();
+		mPose.translation() = Vector3(mRadius * cos(mHeading), mRadius * sin(mHeading), 0);
+		mPose.rotate(Eigen::AngleAxisd(mHeading + M_PI / 2, Vector3::UnitZ()));
+		mSequence++;
+		return mPose;
+	}
+	}
+	
+	mPose.linear() = Eigen::AngleAxisd(mHeading, Vector3::UnitZ()).toRotationMatrix();
+	mSequence++;
+	return mPose;
+}
+
+SyntheticMeasurement::Ptr PoseGraphGenerator::nextMeasurement()
+{
+	Transform pose = nextPose();
+	timeval stamp;
+	stamp.tv_sec = mSequence / 10;
+	stamp.tv_usec = (mSequence % 10) * 100000;
+	return SyntheticMeasurement::Ptr(new SyntheticMeasurement("synthetic", mSensor.getName(), stamp, mSequence, pose));
+}
+
+void PoseGraphGenerator::addReadings(GraphMapper& mapper, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+	{
+		mapper.addReading(nextMeasurement(), true);
+	}
+}
+
+std::pair<int, int> PoseGraphGenerator::getCell(const Vector3& position) const
+{
+	return std::make_pair((int)floor(position[0] / mConfiguration.loop_range),
+	                      (int)floor(position[1] / mConfiguration.loop_range));
+}
+
+void PoseGraphGenerator::addExternalReadings(GraphMapper& mapper, size_t count)
+{
+	std::uniform_real_distribution<double> uniform(0, 1);
+	size_t min_loop_distance = 2 * mConfiguration.loop_range / mConfiguration.step + 1;
+	Transform last_pose = mPose;
+	for(size_t i = 0; i < count; i++)
+	{
+		SyntheticMeasurement::Ptr m = nextMeasurement();
+		const Transform& pose = m->getGroundTruth();
+		
+		// Link to the previous measurement (or to the root)
+		TransformWithCovariance twc;
+		if(mLastId.is_nil())
+			twc = mSensor.addNoise(pose);
+		else
+			twc = mSensor.addNoise(last_pose.inverse() * pose);
+		mapper.addExternalReading(m, mLastId, twc.transform, twc.covariance, mSensor.getName());
+		
+		// Search for loop closures in the surrounding cells
+		Place place = {m->getSequence(), m->getUniqueId(), pose};
+		std::pair<int, int> cell = getCell(pose.translation());
+		unsigned links = 0;
+		for(int dx = -1; dx <= 1 && links < mConfiguration.max_loop_links; dx++)
+		{
+			for(int dy = -1; dy <= 1 && links < mConfiguration.max_loop_links; dy++)
+			{
+				PlaceGrid::iterator places = mPlaces.find(std::make_pair(cell.first + dx, cell.second + dy));
+				if(places == mPlaces.end())
+					continue;
+				
+				// Only look at the latest visits, so the cost per pose stays constant
+				unsigned checked = 0;
+				for(PlaceList::reverse_iterator p = places->second.rbegin(); p != places->second.rend()
+				    && links < mConfiguration.max_loop_links && checked < MAX_LOOP_CANDIDATES; ++p)
+				{
+					checked++;
+					if(place.sequence - p->sequence < min_loop_distance)
+						continue;
+					Transform relative = p->pose.inverse() * pose;
+					if(relative.translation().norm() > mConfiguration.loop_range || uniform(mRandom) > mConfiguration.loop_probability)
+						continue;
+					twc = mSensor.addNoise(relative);
+					mapper.addExternalConstraint(p->id, place.id, twc.transform, twc.covariance, mSensor.getName());
+					links++;
+					mLoops++;
+				}
+			}
+		}
+		mPlaces[cell].push_back(place);
+		mLastId = place.id;
+		last_pose = pose;
+	}
+}
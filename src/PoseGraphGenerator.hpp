@@ -0,0 +1,194 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_POSEGRAPHGENERATOR_HPP
+#define SLAM_POSEGRAPHGENERATOR_HPP
+
+#include "GraphMapper.hpp"
+
+#include <random>
+
+namespace slam3d
+{
+	/**
+	 * @brief Shapes of the generated trajectories.
+	 */
+	enum TrajectoryType
+	{
+		TRAJECTORY_GRID,       ///< back and forth in parallel rows, restarting at the origin
+		TRAJECTORY_MANHATTAN,  ///< random walk along the streets of a city block grid
+		TRAJECTORY_SPIRAL      ///< spiral that grows and shrinks again, revisiting old rings
+	};
+	
+	/**
+	 * @struct GeneratorConfiguration
+	 * @brief Parameters for the synthetic pose graph.
+	 */
+	struct GeneratorConfiguration
+	{
+		GeneratorConfiguration()
+		 : trajectory(TRAJECTORY_GRID), step(1.0), area(100.0),
+		   translation_noise(0.01), rotation_noise(0.002),
+		   loop_probability(0.5), loop_range(3.0), max_loop_links(3), seed(42) {}
+		
+		TrajectoryType trajectory;
+		double step;               ///< distance between two consecutive poses
+		double area;               ///< size of the area covered by the trajectory
+		double translation_noise;  ///< standard deviation of the translation error per match
+		double rotation_noise;     ///< standard deviation of the rotation error per match
+		double loop_probability;   ///< probability that a loop closure is found
+		double loop_range;         ///< maximum distance for a loop closure
+		unsigned max_loop_links;   ///< maximum number of loop closures per pose
+		unsigned seed;             ///< seed for the random number generators
+	};
+	
+	/**
+	 * @class SyntheticMeasurement
+	 * @brief Measurement without sensor data that knows its true pose.
+	 */
+	class SyntheticMeasurement : public Measurement
+	{
+	public:
+		typedef boost::shared_ptr<SyntheticMeasurement> Ptr;
+		
+	public:
+		SyntheticMeasurement(const std::string& r, const std::string& s, const timeval& stamp,
+		                     size_t sequence, const Transform& ground_truth)
+		 : Measurement(r, s, Transform::Identity(), boost::uuids::random_generator()(), stamp),
+		   mSequence(sequence), mGroundTruth(ground_truth) {}
+		
+		size_t getSequence() const { return mSequence; }
+		const Transform& getGroundTruth() const { return mGroundTruth; }
+		
+	protected:
+		size_t mSequence;
+		Transform mGroundTruth;
+	};
+	
+	/**
+	 * @class SyntheticSensor
+	 * @brief Sensor that "matches" synthetic measurements by their true poses.
+	 * @details The returned transforms are disturbed by gaussian noise.
+	 * Consecutive measurements are always matched, all others only within
+	 * the loop range and with the configured loop probability. Matching is
+	 * done in constant time, so the cost of the mapper itself can be measured.
+	 */
+	class SyntheticSensor : public Sensor
+	{
+	public:
+		SyntheticSensor(const std::string& n, Logger* l, const GeneratorConfiguration& config);
+		
+		TransformWithCovariance calculateTransform(Measurement::Ptr source, Measurement::Ptr target, Transform odometry, bool coarse = false) const;
+		
+		Measurement::Ptr createCombinedMeasurement(const VertexObjectList& vertices, Transform pose) const;
+		
+		/**
+		 * @brief Disturb a relative transform with the configured noise.
+		 */
+		TransformWithCovariance addNoise(const Transform& tf) const;
+		
+	protected:
+		GeneratorConfiguration mConfiguration;
+		mutable std::mt19937 mRandom;
+	};
+	
+	/**
+	 * @class PoseGraphGenerator
+	 * @brief Creates large pose graphs from synthetic trajectories.
+	 * @details The graph can be created through GraphMapper::addReading,
+	 * which uses the complete mapping pipeline including neighbor search, or
+	 * through addExternalReading and addExternalConstraint, where the loop
+	 * closures are found by the generator itself. The latter scales to
+	 * millions of vertices and measures only the cost of the graph storage.
+	 */
+	class PoseGraphGenerator
+	{
+	public:
+		/**
+		 * @brief Constructor
+		 * @param sensor synthetic sensor that has to be registered in the mapper
+		 * @param config trajectory and noise parameters
+		 */
+		PoseGraphGenerator(const SyntheticSensor& sensor, const GeneratorConfiguration& config);
+		
+		/**
+		 * @brief Get the next true pose of the trajectory.
+		 */
+		Transform nextPose();
+		
+		/**
+		 * @brief Create a measurement at the next pose of the trajectory.
+		 */
+		SyntheticMeasurement::Ptr nextMeasurement();
+		
+		/**
+		 * @brief Add measurements through the complete mapping pipeline.
+		 * @param mapper mapper with the synthetic sensor registered
+		 * @param count number of measurements to add
+		 */
+		void addReadings(GraphMapper& mapper, size_t count);
+		
+		/**
+		 * @brief Add measurements and loop closures as external data.
+		 * @param mapper mapper to add the measurements to
+		 * @param count number of measurements to add
+		 */
+		void addExternalReadings(GraphMapper& mapper, size_t count);
+		
+		/**
+		 * @brief Get the number of loop closures added by addExternalReadings.
+		 */
+		size_t getNumberOfLoops() const { return mLoops; }
+		
+	protected:
+		struct Place
+		{
+			size_t sequence;
+			boost::uuids::uuid id;
+			Transform pose;
+		};
+		typedef std::vector<Place> PlaceList;
+		typedef std::map<std::pair<int, int>, PlaceList> PlaceGrid;
+		
+		std::pair<int, int> getCell(const Vector3& position) const;
+		
+	protected:
+		const SyntheticSensor& mSensor;
+		GeneratorConfiguration mConfiguration;
+		std::mt19937 mRandom;
+		
+		size_t mSequence;
+		Transform mPose;
+		double mHeading;
+		double mRadius;
+		double mGrowth;
+		
+		boost::uuids::uuid mLastId;
+		PlaceGrid mPlaces;
+		size_t mLoops;
+	};
+}
+
+#endif
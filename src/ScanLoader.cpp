@@ -0,0 +1,275 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "ScanLoader.hpp"
+
+#include <boost/format.hpp>
+
+#include <algorithm>
+#include <sstream>
+#include <cstdlib>
+#include <dirent.h>
+#include <stdint.h>
+
+using namespace slam3d;
+
+// Layout of a KITTI scan: x, y, z, reflectance
+#define KITTI_STRIDE (4 * sizeof(float))
+
+static bool endsWith(const std::string& str, const std::string& ending)
+{
+	return str.size() >= ending.size() && str.compare(str.size() - ending.size(), ending.size(), ending) == 0;
+}
+
+ScanView::ScanView(boost::shared_ptr<MappedFile> file, size_t offset, size_t points,
+                   size_t stride, size_t x, size_t y, size_t z)
+ : mFile(file), mData(file->data() + offset), mPoints(points), mStride(stride),
+   mOffsetX(x), mOffsetY(y), mOffsetZ(z)
+{
+}
+
+const float* ScanView::floats() const
+{
+	if(mStride == KITTI_STRIDE && mOffsetX == 0 && mOffsetY == 4 && mOffsetZ == 8
+	   && (uintptr_t)mData % sizeof(float) == 0)
+	{
+		return (const float*)mData;
+	}
+	return NULL;
+}
+
+void ScanView::copyTo(PointCloud& cloud) const
+{
+	cloud.resize(mPoints);
+	cloud.width = mPoints;
+	cloud.height = 1;
+	cloud.is_dense = true;
+	
+	const float* data = floats();
+	if(data)
+	{
+		// Tight loop without function calls, so the compiler can vectorize it
+		PointType* out = &cloud.points[0];
+		for(size_t i = 0; i < mPoints; i++)
+		{
+			out[i].x = data[4*i];
+			out[i].y = data[4*i+1];
+			out[i].z = data[4*i+2];
+		}
+	}else
+	{
+		for(size_t i = 0; i < mPoints; i++)
+		{
+			cloud.points[i].x = x(i);
+			cloud.points[i].y = y(i);
+			cloud.points[i].z = z(i);
+		}
+	}
+}
+
+static ScanView mapPCD(boost::shared_ptr<MappedFile> file)
+{
+	// Parse the ASCII header up to the DATA line
+	const char* data = file->data();
+	size_t size = file->size();
+	size_t position = 0;
+	std::vector<std::string> fields, sizes, types, counts;
+	size_t points = 0;
+	bool binary = false;
+	while(position < size)
+	{
+		const char* end = (const char*)memchr(data + position, '\n', size - position);
+		if(!end)
+			break;
+		std::istringstream line(std::string(data + position, end));
+		position = end - data + 1;
+		
+		std::string key, value;
+		line >> key;
+		std::vector<std::string> values;
+		while(line >> value)
+			values.push_back(value);
+		
+		if(key == "FIELDS")      fields = values;
+		else if(key == "SIZE")   sizes = values;
+		else if(key == "TYPE")   types = values;
+		else if(key == "COUNT")  counts = values;
+		else if(key == "POINTS" && values.size() == 1) points = atol(values[0].c_str());
+		else if(key == "DATA")
+		{
+			binary = (values.size() == 1 && values[0] == "binary");
+			break;
+		}
+	}
+	
+	if(!binary)
+	{
+		throw ScanFormatError((boost::format("'%1%' is not a binary PCD file!") % file->getFilename()).str());
+	}
+	if(sizes.size() != fields.size() || types.size() != fields.size())
+	{
+		throw ScanFormatError((boost::format("'%1%' has an invalid PCD header!") % file->getFilename()).str());
+	}
+	
+	// Find the offsets of the coordinates within a point
+	size_t stride = 0;
+	size_t offset[3] = {0, 0, 0};
+	int found = 0;
+	for(size_t i = 0; i < fields.size(); i++)
+	{
+		size_t field_size = atol(sizes[i].c_str());
+		size_t count = counts.size() == fields.size() ? atol(counts[i].c_str()) : 1;
+		if(fields[i] == "x" || fields[i] == "y" || fields[i] == "z")
+		{
+			if(field_size != sizeof(float) || types[i] != "F" || count != 1)
+			{
+				throw ScanFormatError((boost::format("Coordinates in '%1%' must be float!") % file->getFilename()).str());
+			}
+			offset[fields[i][0] - 'x'] = stride;
+			found++;
+		}
+		stride += field_size * count;
+	}
+	if(found != 3)
+	{
+		throw ScanFormatError((boost::format("'%1%' does not contain x, y and z!") % file->getFilename()).str());
+	}
+	if(points * stride > size - position)
+	{
+		throw ScanFormatError((boost::format("'%1%' is shorter than its header states!") % file->getFilename()).str());
+	}
+	return ScanView(file, position, points, stride, offset[0], offset[1], offset[2]);
+}
+
+ScanView ScanLoader::map(const std::string& filename)
+{
+	boost::shared_ptr<MappedFile> file(new MappedFile(filename, false));
+	if(endsWith(filename, ".pcd"))
+	{
+		return mapPCD(file);
+	}
+	
+	if(file->size() % KITTI_STRIDE != 0)
+	{
+		throw ScanFormatError((boost::format("Size of '%1%' is not a multiple of the point size!") % filename).str());
+	}
+	file->prefetch(0, file->size());
+	return ScanView(file, 0, file->size() / KITTI_STRIDE, KITTI_STRIDE, 0, 4, 8);
+}
+
+PointCloud::Ptr ScanLoader::load(const std::string& filename)
+{
+	PointCloud::Ptr cloud(new PointCloud);
+	map(filename).copyTo(*cloud);
+	return cloud;
+}
+
+DatasetReader::DatasetReader(const std::string& directory, const std::string& ending, unsigned prefetch)
+ : mPrefetch(std::max(prefetch, 1u)), mNextLoad(0), mNextRead(0), mRunning(true)
+{
+	DIR* dir = opendir(directory.c_str());
+	if(!dir)
+	{
+		throw ScanFormatError((boost::format("Could not open directory '%1%'!") % directory).str());
+	}
+	struct dirent* entry;
+	while((entry = readdir(dir)) != NULL)
+	{
+		std::string name(entry->d_name);
+		if(endsWith(name, ending))
+		{
+			mFiles.push_back(directory + "/" + name);
+		}
+	}
+	closedir(dir);
+	std::sort(mFiles.begin(), mFiles.end());
+	
+	mThread = std::thread(&DatasetReader::run, this);
+}
+
+DatasetReader::~DatasetReader()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mRunning = false;
+	}
+	mConsumed.notify_one();
+	mThread.join();
+}
+
+bool DatasetReader::next(PointCloud::Ptr& cloud)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	if(mNextRead >= mFiles.size())
+		return false;
+	
+	mLoaded.wait(lock, [&]{ return !mQueue.empty() || !mError.empty(); });
+	if(mQueue.empty())
+	{
+		throw ScanFormatError(mError);
+	}
+	cloud = mQueue.front();
+	mQueue.pop_front();
+	mNextRead++;
+	mConsumed.notify_one();
+	return true;
+}
+
+void DatasetReader::run()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	while(mNextLoad < mFiles.size())
+	{
+		mConsumed.wait(lock, [&]{ return !mRunning || mQueue.size() < mPrefetch; });
+		if(!mRunning)
+			break;
+		
+		std::string filename = mFiles[mNextLoad];
+		lock.unlock();
+		PointCloud::Ptr cloud;
+		std::string error;
+		try
+		{
+			cloud = ScanLoader::load(filename);
+		}catch(FileMappingError &e)
+		{
+			error = e.what();
+		}catch(ScanFormatError &e)
+		{
+			error = e.what();
+		}
+		lock.lock();
+		
+		if(!cloud)
+		{
+			mError = error;
+			mLoaded.notify_one();
+			break;
+		}
+		mQueue.push_back(cloud);
+		mNextLoad++;
+		mLoaded.notify_one();
+	}
+}
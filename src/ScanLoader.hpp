@@ -0,0 +1,199 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_SCANLOADER_HPP
+#define SLAM_SCANLOADER_HPP
+
+#include "PointCloudSensor.hpp"
+#include "MappedFile.hpp"
+
+#include <deque>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace slam3d
+{
+	/**
+	 * @class ScanFormatError
+	 * @brief Exception thrown when a scan file has an unsupported format.
+	 */
+	class ScanFormatError: public std::exception
+	{
+	public:
+		ScanFormatError(const std::string& msg):message(msg){}
+		virtual ~ScanFormatError() throw() {}
+		virtual const char* what() const throw()
+		{
+			return message.c_str();
+		}
+		
+		std::string message;
+	};
+	
+	/**
+	 * @class ScanView
+	 * @brief Read-only view on the points of a memory-mapped scan file.
+	 * @details The points are not copied, they are read directly from the
+	 * mapped file. The view keeps the file mapped as long as it exists.
+	 */
+	class ScanView
+	{
+	public:
+		ScanView(boost::shared_ptr<MappedFile> file, size_t offset, size_t points,
+		         size_t stride, size_t x, size_t y, size_t z);
+		
+		/**
+		 * @brief Get the number of points in the scan.
+		 */
+		size_t size() const { return mPoints; }
+		
+		/**
+		 * @brief Get the coordinates of the i-th point.
+		 */
+		float x(size_t i) const { return get(i, mOffsetX); }
+		float y(size_t i) const { return get(i, mOffsetY); }
+		float z(size_t i) const { return get(i, mOffsetZ); }
+		
+		/**
+		 * @brief Direct access to the points as consecutive (x,y,z,r) floats.
+		 * @details This is only possible for KITTI-style scans, other
+		 * layouts return NULL and have to be read with x(), y() and z().
+		 */
+		const float* floats() const;
+		
+		/**
+		 * @brief Copy all points into the given cloud.
+		 * @details The cloud is resized once, so no reallocation happens
+		 * during the copy.
+		 * @param cloud point cloud to be filled
+		 */
+		void copyTo(PointCloud& cloud) const;
+		
+	protected:
+		float get(size_t i, size_t offset) const
+		{
+			float value;
+			memcpy(&value, mData + i * mStride + offset, sizeof(float));
+			return value;
+		}
+		
+	protected:
+		boost::shared_ptr<MappedFile> mFile;
+		const char* mData;
+		size_t mPoints;
+		size_t mStride;
+		size_t mOffsetX;
+		size_t mOffsetY;
+		size_t mOffsetZ;
+	};
+	
+	/**
+	 * @class ScanLoader
+	 * @brief Loads scans from KITTI-style binary files or binary PCD files.
+	 * @details KITTI scans (usually *.bin) consist of consecutive (x,y,z,r)
+	 * float values without any header. PCD files must be stored with
+	 * "DATA binary" and contain the fields x, y and z as float.
+	 */
+	class ScanLoader
+	{
+	public:
+		/**
+		 * @brief Map a scan file into memory without copying the points.
+		 * @details The format is selected by the file ending, ".pcd" is
+		 * read as PCD file and all others as KITTI scan.
+		 * @param filename path of the scan file
+		 * @throw FileMappingError
+		 * @throw ScanFormatError
+		 */
+		static ScanView map(const std::string& filename);
+		
+		/**
+		 * @brief Read a scan file into a new point cloud.
+		 * @param filename path of the scan file
+		 * @throw FileMappingError
+		 * @throw ScanFormatError
+		 */
+		static PointCloud::Ptr load(const std::string& filename);
+	};
+	
+	/**
+	 * @class DatasetReader
+	 * @brief Iterates over all scans in a directory in alphabetical order.
+	 * @details A background thread reads ahead the next scans, so the
+	 * reading from disk overlaps with processing the current scan.
+	 */
+	class DatasetReader
+	{
+	public:
+		/**
+		 * @brief Constructor, starts reading the first scans.
+		 * @param directory directory containing the scan files
+		 * @param ending only files with this ending are read
+		 * @param prefetch maximum number of scans to read ahead
+		 * @throw ScanFormatError if the directory cannot be read
+		 */
+		DatasetReader(const std::string& directory, const std::string& ending = ".bin", unsigned prefetch = 4);
+		~DatasetReader();
+		
+		/**
+		 * @brief Get the number of scans in the dataset.
+		 */
+		size_t size() const { return mFiles.size(); }
+		
+		/**
+		 * @brief Get the path of the i-th scan.
+		 */
+		const std::string& getFilename(size_t i) const { return mFiles.at(i); }
+		
+		/**
+		 * @brief Get the next scan of the dataset.
+		 * @param cloud the next scan
+		 * @return false when all scans have been read
+		 * @throw ScanFormatError if the scan could not be read
+		 */
+		bool next(PointCloud::Ptr& cloud);
+		
+	protected:
+		void run();
+		
+	protected:
+		std::vector<std::string> mFiles;
+		unsigned mPrefetch;
+		
+		std::thread mThread;
+		std::mutex mMutex;
+		std::condition_variable mLoaded;
+		std::condition_variable mConsumed;
+		std::deque<PointCloud::Ptr> mQueue;
+		size_t mNextLoad;
+		size_t mNextRead;
+		std::string mError;
+		bool mRunning;
+	};
+}
+
+#endif
@@ -28,6 +28,8 @@
 
 #include "Types.hpp"
 #include "Logger.hpp"
+#include "Metrics.hpp"
+#include "MemoryStats.hpp"
 
 namespace slam3d
 {	
@@ -78,7 +80,7 @@ namespace slam3d
 	{
 	public:
 		Sensor(const std::string& n, Logger* l, const Transform& p)
-		 :mName(n), mLogger(l), mSensorPose(p){}
+		 :mName(n), mLogger(l), mMetrics(NULL), mSensorPose(p){}
 		virtual ~Sensor(){}
 		
 		/**
@@ -114,9 +116,41 @@ namespace slam3d
 		 */
 		virtual Measurement::Ptr createCombinedMeasurement(const VertexObjectList& vertices, Transform pose) const = 0;
 		
+		/**
+		 * @brief Creates an empty measurement of this sensor's type from meta information.
+		 * @details This is used to restore measurements from a stored map. The
+		 * sensor data has to be restored afterwards with Measurement::readPayload.
+		 * The default implementation creates a generic measurement that cannot
+		 * hold any sensor data.
+		 * @param robot name of the robot that recorded the measurement
+		 * @param id unique identifier of the measurement
+		 * @param stamp time when the measurement was recorded
+		 * @param pose sensor pose in robot coordinates
+		 */
+		virtual Measurement::Ptr createMeasurement(const std::string& robot,
+		                                           const boost::uuids::uuid& id,
+		                                           const timeval& stamp,
+		                                           const Transform& pose) const
+		{
+			return Measurement::Ptr(new Measurement(robot, mName, pose, id, stamp));
+		}
+		
+		/**
+		 * @brief Set the metrics to record timings of the sensor's operations.
+		 * @param metrics collector for timings, NULL to disable
+		 */
+		void setMetrics(Metrics* metrics) { mMetrics = metrics; }
+		
+		/**
+		 * @brief Get the memory held by the sensor itself, e.g. for caches.
+		 * @details Memory of the sensor's measurements is reported by the mapper.
+		 */
+		virtual MemoryUsage getMemoryUsage() const { return MemoryUsage(); }
+		
 	protected:
 		std::string mName;
 		Logger* mLogger;
+		Metrics* mMetrics;
 		Transform mSensorPose;
 	};
 	
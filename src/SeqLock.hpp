@@ -0,0 +1,112 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_SEQLOCK_HPP
+#define SLAM_SEQLOCK_HPP
+
+#include <atomic>
+#include <stddef.h>
+
+namespace slam3d
+{
+	/**
+	 * @class SeqLock
+	 * @brief Value that is published by one writer and read without locks.
+	 * @details The writer stores each value into the next of a few slots,
+	 * each guarded by a sequence number. Readers copy the newest complete
+	 * slot and check its sequence afterwards, so they never wait for a
+	 * write in progress. A reader only retries when the writer has
+	 * published as many values as there are slots while it was copying.
+	 * The value type must be copyable without side effects, as readers may
+	 * copy a slot that is being overwritten and discard the result.
+	 */
+	template <typename T, unsigned Slots = 4>
+	class SeqLock
+	{
+	public:
+		SeqLock() : mHead(0)
+		{
+			for(unsigned i = 0; i < Slots; i++)
+			{
+				mSlots[i].sequence.store(0, std::memory_order_relaxed);
+			}
+		}
+		
+		/**
+		 * @brief Publish a new value, must not be called concurrently.
+		 * @param value
+		 */
+		void store(const T& value)
+		{
+			size_t position = mHead.load(std::memory_order_relaxed);
+			Slot& slot = mSlots[position % Slots];
+			slot.sequence.store(2 * position + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			slot.value = value;
+			slot.sequence.store(2 * position + 2, std::memory_order_release);
+			mHead.store(position + 1, std::memory_order_release);
+		}
+		
+		/**
+		 * @brief Get the most recently published value.
+		 * @param value receives the value
+		 * @return false if no value has been published yet
+		 */
+		bool load(T& value) const
+		{
+			while(true)
+			{
+				size_t head = mHead.load(std::memory_order_acquire);
+				if(head == 0)
+					return false;
+				const Slot& slot = mSlots[(head - 1) % Slots];
+				size_t sequence = slot.sequence.load(std::memory_order_acquire);
+				if(sequence != 2 * head)
+					continue;
+				value = slot.value;
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if(slot.sequence.load(std::memory_order_relaxed) == sequence)
+					return true;
+			}
+		}
+		
+		/**
+		 * @brief Get the number of values published so far.
+		 */
+		size_t getRevision() const { return mHead.load(std::memory_order_acquire); }
+		
+	protected:
+		struct Slot
+		{
+			std::atomic<size_t> sequence;
+			T value;
+		};
+		
+		Slot mSlots[Slots];
+		std::atomic<size_t> mHead;
+	};
+}
+
+#endif
@@ -0,0 +1,287 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_SERIALIZATION_HPP
+#define SLAM_SERIALIZATION_HPP
+
+#include "Types.hpp"
+
+#include <cstring>
+#include <stdint.h>
+
+namespace slam3d
+{
+	/**
+	 * @class SerializationError
+	 * @brief Exception thrown when binary data cannot be written or read.
+	 */
+	class SerializationError: public std::exception
+	{
+	public:
+		SerializationError(const std::string& msg):message(msg){}
+		virtual ~SerializationError() throw() {}
+		virtual const char* what() const throw()
+		{
+			return message.c_str();
+		}
+		
+		std::string message;
+	};
+	
+	/**
+	 * @class BinaryWriter
+	 * @brief Writes values in a compact binary representation to a buffer.
+	 * @details The writer either appends to a growing vector or fills a
+	 * preallocated buffer of fixed size. Values are written in the byte
+	 * order of the host, transforms are stored as the upper 3x4 part of
+	 * the matrix and covariances as their upper triangle.
+	 */
+	class BinaryWriter
+	{
+	public:
+		/**
+		 * @brief Create a writer that appends to the given vector.
+		 * @param buffer
+		 */
+		BinaryWriter(std::vector<char>& buffer)
+		 : mVector(&buffer), mBuffer(NULL), mCapacity(0), mPosition(buffer.size()) {}
+		
+		/**
+		 * @brief Create a writer that fills the given buffer.
+		 * @param buffer preallocated memory
+		 * @param capacity size of the buffer in bytes
+		 */
+		BinaryWriter(char* buffer, size_t capacity)
+		 : mVector(NULL), mBuffer(buffer), mCapacity(capacity), mPosition(0) {}
+		
+		/**
+		 * @brief Get the number of bytes in the buffer.
+		 */
+		size_t size() const { return mPosition; }
+		
+		/**
+		 * @brief Provide space for the given number of bytes.
+		 * @details The returned pointer is invalidated by the next write
+		 * when appending to a vector.
+		 * @param size number of bytes
+		 * @return pointer to the reserved memory
+		 * @throw SerializationError
+		 */
+		char* reserve(size_t size)
+		{
+			size_t position = mPosition;
+			if(mVector)
+			{
+				mVector->resize(mPosition + size);
+				mPosition += size;
+				return &(*mVector)[position];
+			}
+			if(mPosition + size > mCapacity)
+			{
+				throw SerializationError("Buffer is too small!");
+			}
+			mPosition += size;
+			return mBuffer + position;
+		}
+		
+		void writeBytes(const void* data, size_t size)
+		{
+			if(size > 0)
+				memcpy(reserve(size), data, size);
+		}
+		
+		/**
+		 * @brief Write a value of plain type (e.g. integer or float).
+		 */
+		template<typename T>
+		void write(const T& value)
+		{
+			writeBytes(&value, sizeof(T));
+		}
+		
+		void writeString(const std::string& s)
+		{
+			write<uint32_t>(s.size());
+			writeBytes(s.data(), s.size());
+		}
+		
+		void writeUuid(const boost::uuids::uuid& id)
+		{
+			writeBytes(id.data, id.size());
+		}
+		
+		void writeTimestamp(const timeval& stamp)
+		{
+			write<int64_t>(stamp.tv_sec);
+			write<int64_t>(stamp.tv_usec);
+		}
+		
+		void writeTransform(const Transform& tf)
+		{
+			ScalarType data[12];
+			for(unsigned r = 0; r < 3; r++)
+				for(unsigned c = 0; c < 4; c++)
+					data[r*4+c] = tf.matrix()(r,c);
+			writeBytes(data, sizeof(data));
+		}
+		
+		void writeCovariance(const Covariance& cov)
+		{
+			ScalarType data[21];
+			unsigned i = 0;
+			for(unsigned r = 0; r < 6; r++)
+				for(unsigned c = r; c < 6; c++, i++)
+					data[i] = cov(r,c);
+			writeBytes(data, sizeof(data));
+		}
+		
+	private:
+		std::vector<char>* mVector;
+		char* mBuffer;
+		size_t mCapacity;
+		size_t mPosition;
+	};
+	
+	/**
+	 * @class BinaryReader
+	 * @brief Reads values written by a BinaryWriter from a buffer.
+	 * @details All reads are checked against the size of the buffer.
+	 */
+	class BinaryReader
+	{
+	public:
+		BinaryReader(const char* buffer, size_t size)
+		 : mBuffer(buffer), mSize(size), mPosition(0) {}
+		
+		/**
+		 * @brief Get the current read position in bytes.
+		 */
+		size_t position() const { return mPosition; }
+		
+		/**
+		 * @brief Get the number of bytes that have not been read yet.
+		 */
+		size_t remaining() const { return mSize - mPosition; }
+		
+		/**
+		 * @brief Set the read position.
+		 * @param position offset from the beginning of the buffer
+		 * @throw SerializationError
+		 */
+		void seek(size_t position)
+		{
+			if(position > mSize)
+				throw SerializationError("Seek beyond end of buffer!");
+			mPosition = position;
+		}
+		
+		/**
+		 * @brief Skip the given number of bytes.
+		 * @param size number of bytes
+		 * @return pointer to the skipped bytes
+		 * @throw SerializationError
+		 */
+		const char* skip(size_t size)
+		{
+			if(size > mSize - mPosition)
+				throw SerializationError("Unexpected end of buffer!");
+			const char* data = mBuffer + mPosition;
+			mPosition += size;
+			return data;
+		}
+		
+		void readBytes(void* data, size_t size)
+		{
+			if(size > 0)
+				memcpy(data, skip(size), size);
+		}
+		
+		/**
+		 * @brief Read a value of plain type (e.g. integer or float).
+		 */
+		template<typename T>
+		T read()
+		{
+			T value;
+			readBytes(&value, sizeof(T));
+			return value;
+		}
+		
+		std::string readString()
+		{
+			uint32_t size = read<uint32_t>();
+			const char* data = skip(size);
+			return std::string(data, size);
+		}
+		
+		boost::uuids::uuid readUuid()
+		{
+			boost::uuids::uuid id;
+			readBytes(id.data, id.size());
+			return id;
+		}
+		
+		timeval readTimestamp()
+		{
+			timeval stamp;
+			stamp.tv_sec = read<int64_t>();
+			stamp.tv_usec = read<int64_t>();
+			return stamp;
+		}
+		
+		Transform readTransform()
+		{
+			ScalarType data[12];
+			readBytes(data, sizeof(data));
+			Transform tf = Transform::Identity();
+			for(unsigned r = 0; r < 3; r++)
+				for(unsigned c = 0; c < 4; c++)
+					tf.matrix()(r,c) = data[r*4+c];
+			return tf;
+		}
+		
+		Covariance readCovariance()
+		{
+			ScalarType data[21];
+			readBytes(data, sizeof(data));
+			Covariance cov;
+			unsigned i = 0;
+			for(unsigned r = 0; r < 6; r++)
+				for(unsigned c = r; c < 6; c++, i++)
+				{
+					cov(r,c) = data[i];
+					cov(c,r) = data[i];
+				}
+			return cov;
+		}
+		
+	private:
+		const char* mBuffer;
+		size_t mSize;
+		size_t mPosition;
+	};
+}
+
+#endif
@@ -28,6 +28,8 @@
 
 #include "Types.hpp"
 #include "Logger.hpp"
+#include "Metrics.hpp"
+#include "MemoryStats.hpp"
 
 #include <vector>
 
@@ -36,6 +38,25 @@ namespace slam3d
 	typedef std::pair<int, Transform> IdPose;
 	typedef std::vector<IdPose> IdPoseVector;
 	
+	/**
+	 * @struct OptimizationBudget
+	 * @brief Limits for a single optimization.
+	 * @details The optimization stops when either limit is reached. A running
+	 * iteration is always completed, so the duration can be exceeded by the
+	 * time of one iteration.
+	 */
+	struct OptimizationBudget
+	{
+		OptimizationBudget() : max_iterations(0), max_duration(0) {}
+		OptimizationBudget(int iterations, double duration) : max_iterations(iterations), max_duration(duration) {}
+		
+		/** @brief Maximum number of iterations, 0 to use the solver's default */
+		int max_iterations;
+		
+		/** @brief Maximum duration of the optimization in seconds, 0 for no limit */
+		double max_duration;
+	};
+	
 	/**
 	 * @class Solver
 	 * @brief Abstact base class for generic graph optimization solutions.
@@ -98,12 +119,32 @@ namespace slam3d
 			int target;
 		};
 
+		/**
+		 * @class UnsupportedOperation
+		 * @brief Exception thrown when a solver does not implement an optional operation.
+		 */
+		class UnsupportedOperation: public std::exception
+		{
+		public:
+			UnsupportedOperation(const std::string& op)
+			 : operation(op), message("The solver does not support " + op + "!"){}
+			virtual ~UnsupportedOperation() throw() {}
+			virtual const char* what() const throw()
+			{
+				return message.c_str();
+			}
+			
+			std::string operation;
+			std::string message;
+		};
+
 	public:
 		/**
 		 * @brief Constructor setting the used logging device.
 		 * @param logger pointer to the logger used by the solver
 		 */
-		Solver(Logger* logger):mLogger(logger){}
+		Solver(Logger* logger)
+		 : mLogger(logger), mMetrics(NULL), mTranslationTolerance(1e-4), mRotationTolerance(1e-4){}
 		
 		/**
 		 * @brief Virtual Destructor.
@@ -134,10 +175,51 @@ namespace slam3d
 		 */
 		virtual void setFixed(unsigned id) = 0;
 		
+		/**
+		 * @brief Release a node that has been fixed with setFixed, so it is optimized again.
+		 * @details The default implementation does not support this.
+		 * @param id
+		 * @throw UnknownVertex
+		 * @throw UnsupportedOperation
+		 */
+		virtual void unsetFixed(unsigned id) { throw UnsupportedOperation("unsetFixed"); }
+		
+		/**
+		 * @brief Remove a node and all constraints connected to it.
+		 * @details This allows to keep a solver alive for a sliding window
+		 * of nodes, instead of clearing and rebuilding it. The default
+		 * implementation does not support this.
+		 * @param id
+		 * @throw UnknownVertex
+		 * @throw UnsupportedOperation
+		 */
+		virtual void removeNode(unsigned id) { throw UnsupportedOperation("removeNode"); }
+		
+		/**
+		 * @brief Replace the current estimate of a node.
+		 * @details This is used when the pose has been determined outside of
+		 * the solver, e.g. by the optimization of another robot. The pose is
+		 * the initial estimate for the next compute() and counts as reported,
+		 * so it is not returned by getChangedPoses() unless the node moves
+		 * again. The default implementation does not support this.
+		 * @param id
+		 * @param pose new pose of the node
+		 * @throw UnknownVertex
+		 * @throw UnsupportedOperation
+		 */
+		virtual void setPose(unsigned id, const Transform& pose) { throw UnsupportedOperation("setPose"); }
+		
 		/**
 		 * @brief Start optimization of the defined graph.
 		 */
 		virtual bool compute() = 0;
+		
+		/**
+		 * @brief Start optimization of the defined graph within the given limits.
+		 * @details Solvers that do not support limits ignore the budget.
+		 * @param budget maximum iterations and duration of the optimization
+		 */
+		virtual bool compute(const OptimizationBudget& budget) { return compute(); }
 	
 		/**
 		 * @brief Clear internal graph structure by removing all nodes and constraints.
@@ -159,14 +241,91 @@ namespace slam3d
 		 */
 		virtual IdPoseVector getCorrections() = 0;
 		
+		/**
+		 * @brief Get the poses that changed since they were last reported.
+		 * @details Only nodes that moved more than the change tolerance since
+		 * the last compute() are contained. The returned buffer is owned by
+		 * the solver and valid until the next call to compute(). The default
+		 * implementation reports all corrections.
+		 */
+		virtual const IdPoseVector& getChangedPoses()
+		{
+			mChangedPoses = getCorrections();
+			return mChangedPoses;
+		}
+		
+		/**
+		 * @brief Get the marginal covariance of a node.
+		 * @details The covariance is given in the same coordinates as the
+		 * covariance of constraints, for increments applied from the right.
+		 * It is computed from the linearization of the last compute() and
+		 * cached until the next one. Nodes that have been added after the
+		 * last compute() are not known yet. The default implementation does
+		 * not support covariance queries.
+		 * @param id
+		 * @param cov receives the covariance, zero for fixed nodes
+		 * @return false if the covariance is not available
+		 */
+		virtual bool getMarginalCovariance(unsigned id, Covariance& cov) { return false; }
+
+		/**
+		 * @brief Get the covariance of the relative pose from source to target.
+		 * @details In contrast to the sum of both marginals, this contains the
+		 * correlation of both nodes, so it is small for nodes that are close
+		 * in the graph, even when both are far from the fixed nodes.
+		 * @param source
+		 * @param target
+		 * @param cov receives the covariance of source^-1 * target
+		 * @return false if the covariance is not available
+		 */
+		virtual bool getRelativeCovariance(unsigned source, unsigned target, Covariance& cov) { return false; }
+
+		/**
+		 * @brief Announce the relative covariances that will be queried next.
+		 * @details Solvers that compute covariances more efficiently in one
+		 * batch can override this to fill their cache, so the following
+		 * calls of getRelativeCovariance() are answered from it. Unknown
+		 * nodes are ignored. The default implementation does nothing.
+		 * @param pairs pairs of source and target
+		 */
+		virtual void prepareRelativeCovariances(const std::vector<std::pair<unsigned, unsigned> >& pairs) {}
+
+		/**
+		 * @brief Set the minimum change of a pose to be reported by getChangedPoses().
+		 * @param translation distance in meters
+		 * @param rotation angle in radians
+		 */
+		void setChangeTolerance(ScalarType translation, ScalarType rotation)
+		{
+			mTranslationTolerance = translation;
+			mRotationTolerance = rotation;
+		}
+		
 		/**
 		 * @brief Set the Logger to be used by the Solver.
 		 * @param log Specialized logger implementation.
 		 */
 		void setLogger(Logger* log) {mLogger = log;}
 		
+		/**
+		 * @brief Set the metrics to record timings of the solver's phases.
+		 * @param metrics collector for timings, NULL to disable
+		 */
+		void setMetrics(Metrics* metrics) {mMetrics = metrics;}
+		
+		/**
+		 * @brief Get the memory used by the internal graph representation.
+		 * @details The default implementation reports nothing.
+		 */
+		virtual MemoryUsage getMemoryUsage() const { return MemoryUsage(); }
+		
 	protected:
 		Logger* mLogger;
+		Metrics* mMetrics;
+		
+		IdPoseVector mChangedPoses;
+		ScalarType mTranslationTolerance;
+		ScalarType mRotationTolerance;
 	};
 }
 
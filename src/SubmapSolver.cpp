@@ -0,0 +1,605 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "SubmapSolver.hpp"
+
+#include <boost/format.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <set>
+#include <thread>
+
+using namespace slam3d;
+
+SubmapSolver::SubmapSolver(Logger* logger, const SubmapSolverConfiguration& config)
+ : Solver(logger), mConfig(config), mGlobal(logger, config.global_iterations, config.gain_threshold),
+   mGlobalChanged(false)
+{
+	if(mConfig.submap_size < 1)
+		mConfig.submap_size = 1;
+}
+
+SubmapSolver::~SubmapSolver()
+{
+}
+
+SubmapSolver::Node& SubmapSolver::getNode(unsigned id)
+{
+	NodeMap::iterator n = mNodes.find(id);
+	if(n == mNodes.end())
+	{
+		throw UnknownVertex(id);
+	}
+	return n->second;
+}
+
+void SubmapSolver::addNode(unsigned id, Transform pose)
+{
+	if(mNodes.find(id) != mNodes.end())
+	{
+		throw DuplicateVertex(id);
+	}
+	
+	// Start a new submap when the last one is full
+	if(mSubmaps.empty() || mSubmaps.back().members.size() >= mConfig.submap_size)
+	{
+		Submap submap;
+		submap.anchor = id;
+		submap.fixed = 0;
+		submap.dirty = false;
+		submap.moved = false;
+		mSubmaps.push_back(submap);
+		mGlobalChanged = true;
+	}
+	
+	Submap& submap = mSubmaps.back();
+	Node node;
+	node.pose = pose;
+	node.reported = pose;
+	node.submap = mSubmaps.size() - 1;
+	node.fixed = false;
+	if(submap.members.empty())
+	{
+		// The first member of a new or emptied submap becomes its anchor
+		submap.anchor = id;
+		node.local = Transform::Identity();
+		mGlobalChanged = true;
+	}else
+	{
+		node.local = mNodes.at(submap.anchor).pose.inverse() * pose;
+	}
+	submap.members.push_back(id);
+	mNodes.insert(NodeMap::value_type(id, node));
+}
+
+void SubmapSolver::addConstraint(unsigned source, unsigned target, Transform tf, Covariance cov)
+{
+	NodeMap::iterator s = mNodes.find(source);
+	NodeMap::iterator t = mNodes.find(target);
+	if(s == mNodes.end() || t == mNodes.end())
+	{
+		throw BadEdge(source, target);
+	}
+	
+	Constraint constraint;
+	constraint.transform = tf;
+	constraint.covariance = cov;
+	constraint.source = source;
+	constraint.target = target;
+	Submap& source_submap = mSubmaps[s->second.submap];
+	Submap& target_submap = mSubmaps[t->second.submap];
+	if(s->second.submap == t->second.submap)
+	{
+		source_submap.constraints.push_back(constraint);
+	}else
+	{
+		source_submap.links.push_back(constraint);
+		target_submap.links.push_back(constraint);
+		target_submap.dirty = true;
+		mLinks.push_back(constraint);
+	}
+	source_submap.dirty = true;
+	mGlobalChanged = true;
+}
+
+void SubmapSolver::setFixed(unsigned id)
+{
+	NodeMap::iterator n = mNodes.find(id);
+	if(n == mNodes.end())
+	{
+		SLAM3D_LOG(mLogger, ERROR, (boost::format("Could not fix node with ID %1%!") % id).str());
+		throw UnknownVertex(id);
+	}
+	if(n->second.fixed)
+		return;
+	
+	Submap& submap = mSubmaps[n->second.submap];
+	n->second.fixed = true;
+	submap.fixed++;
+	submap.dirty = true;
+	mGlobalChanged = true;
+}
+
+void SubmapSolver::unsetFixed(unsigned id)
+{
+	Node& node = getNode(id);
+	if(!node.fixed)
+		return;
+	
+	Submap& submap = mSubmaps[node.submap];
+	node.fixed = false;
+	submap.fixed--;
+	submap.dirty = true;
+	mGlobalChanged = true;
+}
+
+void SubmapSolver::removeNode(unsigned id)
+{
+	Node& node = getNode(id);
+	Submap& submap = mSubmaps[node.submap];
+	if(node.fixed)
+		submap.fixed--;
+	
+	// Neighboring submaps lose their links to this node
+	for(ConstraintList::iterator c = submap.links.begin(); c != submap.links.end(); ++c)
+	{
+		if(c->source != id && c->target != id)
+			continue;
+		unsigned other = (c->source == id) ? c->target : c->source;
+		Submap& neighbor = mSubmaps[mNodes.at(other).submap];
+		removeConstraints(neighbor.links, id);
+		neighbor.dirty = true;
+	}
+	submap.members.erase(std::find(submap.members.begin(), submap.members.end(), id));
+	removeConstraints(submap.constraints, id);
+	removeConstraints(submap.links, id);
+	removeConstraints(mLinks, id);
+	mNodes.erase(id);
+	
+	// Removing the anchor moves the reference of the submap to the next member,
+	// an emptied submap gets a new anchor with its next member in addNode
+	if(id == submap.anchor && !submap.members.empty())
+	{
+		updateAnchor(submap);
+	}
+	submap.dirty = true;
+	mGlobalChanged = true;
+}
+
+void SubmapSolver::setPose(unsigned id, const Transform& pose)
+{
+	Node& node = getNode(id);
+	node.pose = pose;
+	node.reported = pose;
+	
+	// Moving the anchor changes the local poses of all other members
+	Submap& submap = mSubmaps[node.submap];
+	if(id == submap.anchor)
+		updateAnchor(submap);
+	else
+		node.local = mNodes.at(submap.anchor).pose.inverse() * pose;
+	submap.dirty = true;
+	mGlobalChanged = true;
+}
+
+void SubmapSolver::removeConstraints(ConstraintList& constraints, unsigned id)
+{
+	constraints.erase(std::remove_if(constraints.begin(), constraints.end(),
+		[id](const Constraint& c){ return c.source == id || c.target == id; }), constraints.end());
+}
+
+void SubmapSolver::updateAnchor(Submap& submap)
+{
+	submap.anchor = submap.members.front();
+	Transform anchor_inverse = mNodes.at(submap.anchor).pose.inverse();
+	for(std::vector<unsigned>::iterator m = submap.members.begin(); m != submap.members.end(); ++m)
+	{
+		Node& node = mNodes.at(*m);
+		node.local = anchor_inverse * node.pose;
+	}
+}
+
+bool SubmapSolver::solveSubmap(Submap& submap)
+{
+	if(submap.constraints.empty() && submap.links.empty())
+		return true;
+	
+	NativeSolver solver(mLogger, mConfig.local_iterations, mConfig.gain_threshold);
+	for(std::vector<unsigned>::iterator m = submap.members.begin(); m != submap.members.end(); ++m)
+	{
+		const Node& node = mNodes.at(*m);
+		solver.addNode(*m, node.local);
+		if(node.fixed)
+			solver.setFixed(*m);
+	}
+	solver.setFixed(submap.anchor);
+	for(ConstraintList::iterator c = submap.constraints.begin(); c != submap.constraints.end(); ++c)
+	{
+		solver.addConstraint(c->source, c->target, c->transform, c->covariance);
+	}
+	
+	// Nodes of other submaps are held at their current pose relative to the anchor
+	const Node& anchor_node = mNodes.at(submap.anchor);
+	Transform anchor_inverse = anchor_node.pose.inverse();
+	std::set<unsigned> neighbors;
+	for(ConstraintList::iterator c = submap.links.begin(); c != submap.links.end(); ++c)
+	{
+		unsigned other = (mNodes.at(c->source).submap == anchor_node.submap) ? c->target : c->source;
+		if(neighbors.insert(other).second)
+		{
+			solver.addNode(other, anchor_inverse * mNodes.at(other).pose);
+			solver.setFixed(other);
+		}
+		solver.addConstraint(c->source, c->target, c->transform, c->covariance);
+	}
+	
+	if(!solver.compute())
+		return false;
+	
+	IdPoseVector poses = solver.getCorrections();
+	for(IdPoseVector::const_iterator p = poses.begin(); p != poses.end(); ++p)
+	{
+		if(neighbors.find(p->first) != neighbors.end())
+			continue;
+		Node& node = mNodes.at(p->first);
+		if(hasMoved(node.local, p->second))
+			submap.moved = true;
+		node.local = p->second;
+	}
+	
+	// Later batches need the new poses of the members as neighbors
+	const Transform& anchor = mNodes.at(submap.anchor).pose;
+	for(std::vector<unsigned>::iterator m = submap.members.begin(); m != submap.members.end(); ++m)
+	{
+		Node& node = mNodes.at(*m);
+		node.pose = anchor * node.local;
+	}
+	return true;
+}
+
+bool SubmapSolver::solveSubmaps(const std::vector<size_t>& submaps)
+{
+	std::vector<char> success(submaps.size(), 1);
+	size_t num_threads = std::min<size_t>(std::max(mConfig.threads, 1u), submaps.size());
+	if(num_threads < 2)
+	{
+		for(size_t i = 0; i < submaps.size(); i++)
+			success[i] = solveSubmap(mSubmaps[submaps[i]]);
+	}else
+	{
+		// Each submap only touches its own members, so they can be solved concurrently
+		std::atomic<size_t> next(0);
+		std::vector<std::thread> workers;
+		for(size_t t = 0; t < num_threads; t++)
+		{
+			workers.push_back(std::thread([this, &submaps, &success, &next]()
+			{
+				for(size_t i = next++; i < submaps.size(); i = next++)
+					success[i] = solveSubmap(mSubmaps[submaps[i]]);
+			}));
+		}
+		for(std::vector<std::thread>::iterator w = workers.begin(); w != workers.end(); ++w)
+			w->join();
+	}
+	
+	bool result = true;
+	for(size_t i = 0; i < submaps.size(); i++)
+	{
+		if(!success[i])
+		{
+			SLAM3D_LOG(mLogger, ERROR, (boost::format("Optimization of submap with anchor %1% failed!")
+				% mSubmaps[submaps[i]].anchor).str());
+			result = false;
+		}
+	}
+	return result;
+}
+
+std::vector<std::vector<size_t> > SubmapSolver::createBatches(const std::vector<size_t>& submaps) const
+{
+	// Greedy coloring of the submaps, linked submaps never share a color
+	std::vector<std::vector<size_t> > batches;
+	std::map<size_t, size_t> colors;
+	for(std::vector<size_t>::const_iterator s = submaps.begin(); s != submaps.end(); ++s)
+	{
+		std::set<size_t> used;
+		const ConstraintList& links = mSubmaps[*s].links;
+		for(ConstraintList::const_iterator c = links.begin(); c != links.end(); ++c)
+		{
+			size_t other = mNodes.at(c->source).submap;
+			if(other == *s)
+				other = mNodes.at(c->target).submap;
+			std::map<size_t, size_t>::iterator color = colors.find(other);
+			if(color != colors.end())
+				used.insert(color->second);
+		}
+		size_t color = 0;
+		while(used.find(color) != used.end())
+			color++;
+		colors[*s] = color;
+		if(batches.size() <= color)
+			batches.resize(color + 1);
+		batches[color].push_back(*s);
+	}
+	return batches;
+}
+
+void SubmapSolver::buildGlobalGraph()
+{
+	mGlobal.clear();
+	for(std::vector<Submap>::iterator s = mSubmaps.begin(); s != mSubmaps.end(); ++s)
+	{
+		if(s->members.empty())
+			continue;
+		mGlobal.addNode(s->anchor, mNodes.at(s->anchor).pose);
+		if(s->fixed > 0)
+			mGlobal.setFixed(s->anchor);
+	}
+	
+	// A constraint Z between members i and j with poses Ai*Li and Aj*Lj relates
+	// the anchors by Li*Z*Lj^-1. Its residual is the original one conjugated
+	// with Lj, so the covariance is rotated by the adjoint of Lj.
+	Matrix6 scale = errorScale().asDiagonal();
+	Matrix6 unscale = errorScale().cwiseInverse().asDiagonal();
+	for(ConstraintList::iterator c = mLinks.begin(); c != mLinks.end(); ++c)
+	{
+		const Node& source = mNodes.at(c->source);
+		const Node& target = mNodes.at(c->target);
+		Transform tf = source.local * c->transform * target.local.inverse();
+		Matrix6 rotation = scale * adjoint(target.local) * unscale;
+		Covariance cov = rotation * c->covariance * rotation.transpose();
+		mGlobal.addConstraint(mSubmaps[source.submap].anchor, mSubmaps[target.submap].anchor, tf, 0.5 * (cov + cov.transpose()));
+	}
+}
+
+bool SubmapSolver::compute()
+{
+	return compute(OptimizationBudget());
+}
+
+bool SubmapSolver::compute(const OptimizationBudget& budget)
+{
+	mChangedPoses.clear();
+	std::set<size_t> changed;
+	bool success = true;
+	for(int round = 0; round < mConfig.max_rounds; round++)
+	{
+		// Solve all submaps with new constraints or moved neighbors
+		std::vector<size_t> dirty;
+		for(size_t s = 0; s < mSubmaps.size(); s++)
+		{
+			if(mSubmaps[s].dirty && !mSubmaps[s].members.empty())
+				dirty.push_back(s);
+		}
+		if(dirty.empty() && !mGlobalChanged)
+			break;
+		if(!dirty.empty())
+		{
+			// Linked submaps are solved one after another, so each one sees the
+			// latest poses of its neighbors and the error can only decrease.
+			ScopedTimer timer(mMetrics, "solver.submaps");
+			std::vector<std::vector<size_t> > batches = createBatches(dirty);
+			for(std::vector<std::vector<size_t> >::iterator b = batches.begin(); b != batches.end(); ++b)
+			{
+				for(std::vector<size_t>::iterator s = b->begin(); s != b->end(); ++s)
+					mSubmaps[*s].dirty = false;
+				success = solveSubmaps(*b) && success;
+				for(std::vector<size_t>::iterator s = b->begin(); s != b->end(); ++s)
+				{
+					if(mSubmaps[*s].moved)
+						markNeighbors(mSubmaps[*s]);
+				}
+			}
+			mGlobalChanged = true;
+			timer.addValue("submaps", dirty.size());
+			timer.addValue("batches", batches.size());
+		}
+		
+		// Optimize the anchors with the new relative poses
+		ScopedTimer timer(mMetrics, "solver.anchors");
+		buildGlobalGraph();
+		mGlobalChanged = false;
+		if(!mGlobal.compute(budget))
+		{
+			SLAM3D_LOG(mLogger, ERROR, "Optimization of the submap anchors failed!");
+			return false;
+		}
+		
+		// Submaps next to a moved anchor are solved again in the next round
+		const IdPoseVector& anchors = mGlobal.getChangedPoses();
+		for(IdPoseVector::const_iterator a = anchors.begin(); a != anchors.end(); ++a)
+		{
+			Node& anchor = mNodes.at(a->first);
+			anchor.pose = a->second;
+			Submap& submap = mSubmaps[anchor.submap];
+			submap.moved = true;
+			submap.dirty = true;
+			markNeighbors(submap);
+		}
+		timer.addValue("anchors", anchors.size());
+		
+		// The members of moved submaps are needed as neighbors in the next round
+		propagate(changed);
+	}
+	
+	// Report the members of all submaps that have been moved
+	for(std::set<size_t>::iterator s = changed.begin(); s != changed.end(); ++s)
+	{
+		const std::vector<unsigned>& members = mSubmaps[*s].members;
+		for(std::vector<unsigned>::const_iterator m = members.begin(); m != members.end(); ++m)
+		{
+			Node& node = mNodes.at(*m);
+			if(hasMoved(node.reported, node.pose))
+			{
+				node.reported = node.pose;
+				mChangedPoses.push_back(IdPose(*m, node.pose));
+			}
+		}
+	}
+	return success;
+}
+
+void SubmapSolver::markNeighbors(const Submap& submap)
+{
+	for(ConstraintList::const_iterator c = submap.links.begin(); c != submap.links.end(); ++c)
+	{
+		mSubmaps[mNodes.at(c->source).submap].dirty = true;
+		mSubmaps[mNodes.at(c->target).submap].dirty = true;
+	}
+}
+
+bool SubmapSolver::hasMoved(const Transform& from, const Transform& to) const
+{
+	Transform diff = from.inverse() * to;
+	return diff.translation().norm() > mTranslationTolerance ||
+	       Eigen::AngleAxis<ScalarType>(diff.linear()).angle() > mRotationTolerance;
+}
+
+void SubmapSolver::propagate(std::set<size_t>& changed)
+{
+	ScopedTimer timer(mMetrics, "solver.propagate");
+	size_t propagated = 0;
+	for(std::vector<Submap>::iterator s = mSubmaps.begin(); s != mSubmaps.end(); ++s)
+	{
+		if(!s->moved)
+			continue;
+		s->moved = false;
+		changed.insert(s - mSubmaps.begin());
+		propagated++;
+		
+		const Transform& anchor = mNodes.at(s->anchor).pose;
+		for(std::vector<unsigned>::iterator m = s->members.begin(); m != s->members.end(); ++m)
+		{
+			Node& node = mNodes.at(*m);
+			node.pose = anchor * node.local;
+		}
+	}
+	timer.addValue("submaps", propagated);
+}
+
+void SubmapSolver::clear()
+{
+	mNodes.clear();
+	mSubmaps.clear();
+	mLinks.clear();
+	mGlobal.clear();
+	mChangedPoses.clear();
+	mGlobalChanged = false;
+}
+
+IdPoseVector SubmapSolver::getCorrections()
+{
+	IdPoseVector corrections;
+	corrections.reserve(mNodes.size());
+	for(std::vector<Submap>::iterator s = mSubmaps.begin(); s != mSubmaps.end(); ++s)
+	{
+		for(std::vector<unsigned>::iterator m = s->members.begin(); m != s->members.end(); ++m)
+		{
+			corrections.push_back(IdPose(*m, mNodes.at(*m).pose));
+		}
+	}
+	return corrections;
+}
+
+const IdPoseVector& SubmapSolver::getChangedPoses()
+{
+	return mChangedPoses;
+}
+
+size_t SubmapSolver::getNumberOfSubmaps() const
+{
+	size_t count = 0;
+	for(std::vector<Submap>::const_iterator s = mSubmaps.begin(); s != mSubmaps.end(); ++s)
+	{
+		if(!s->members.empty())
+			count++;
+	}
+	return count;
+}
+
+MemoryUsage SubmapSolver::getMemoryUsage() const
+{
+	MemoryUsage usage = mGlobal.getMemoryUsage();
+	usage.objects += mNodes.size() + mLinks.size();
+	usage.bytes += mNodes.size() * (sizeof(NodeMap::value_type) + 2 * sizeof(void*));
+	usage.bytes += mLinks.capacity() * sizeof(Constraint);
+	usage.bytes += mSubmaps.capacity() * sizeof(Submap);
+	for(std::vector<Submap>::const_iterator s = mSubmaps.begin(); s != mSubmaps.end(); ++s)
+	{
+		usage.bytes += s->members.capacity() * sizeof(unsigned)
+		             + (s->constraints.capacity() + s->links.capacity()) * sizeof(Constraint);
+		usage.objects += s->constraints.size();
+	}
+	usage.bytes += mChangedPoses.capacity() * sizeof(IdPose);
+	return usage;
+}
+
+void SubmapSolver::saveGraph(std::string filename)
+{
+	std::ofstream file(filename.c_str());
+	if(!file.good())
+	{
+		SLAM3D_LOG(mLogger, ERROR, (boost::format("Could not save %1%.") % filename).str());
+		return;
+	}
+	
+	file.precision(12);
+	for(std::vector<Submap>::iterator s = mSubmaps.begin(); s != mSubmaps.end(); ++s)
+	{
+		for(std::vector<unsigned>::iterator m = s->members.begin(); m != s->members.end(); ++m)
+		{
+			const Node& node = mNodes.at(*m);
+			Eigen::Quaterniond q(node.pose.linear());
+			Eigen::Vector3d t = node.pose.translation();
+			file << "VERTEX_SE3:QUAT " << *m << " " << t(0) << " " << t(1) << " " << t(2) << " "
+			     << q.x() << " " << q.y() << " " << q.z() << " " << q.w() << std::endl;
+			if(node.fixed)
+				file << "FIX " << *m << std::endl;
+		}
+	}
+	
+	ConstraintList constraints = mLinks;
+	for(std::vector<Submap>::iterator s = mSubmaps.begin(); s != mSubmaps.end(); ++s)
+	{
+		constraints.insert(constraints.end(), s->constraints.begin(), s->constraints.end());
+	}
+	for(ConstraintList::iterator c = constraints.begin(); c != constraints.end(); ++c)
+	{
+		Eigen::Quaterniond q(c->transform.linear());
+		Eigen::Vector3d t = c->transform.translation();
+		Covariance information = c->covariance.inverse();
+		file << "EDGE_SE3:QUAT " << c->source << " " << c->target << " "
+		     << t(0) << " " << t(1) << " " << t(2) << " "
+		     << q.x() << " " << q.y() << " " << q.z() << " " << q.w();
+		for(int i = 0; i < 6; i++)
+			for(int j = i; j < 6; j++)
+				file << " " << information(i, j);
+		file << std::endl;
+	}
+	SLAM3D_LOG(mLogger, INFO, (boost::format("Saved current graph in %1%.") % filename).str());
+}
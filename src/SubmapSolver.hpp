@@ -0,0 +1,208 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_SUBMAP_SOLVER_HPP
+#define SLAM_SUBMAP_SOLVER_HPP
+
+#include "NativeSolver.hpp"
+#include "SubmapSolverConfiguration.hpp"
+
+#include <set>
+
+namespace slam3d
+{
+	/**
+	 * @class SubmapSolver
+	 * @brief Two-level pose-graph solver for large maps.
+	 * @details Consecutive nodes are grouped into submaps of a fixed size.
+	 * The first node of a submap is its anchor, all other members are
+	 * expressed relative to it. Constraints between submaps are transformed
+	 * into constraints between their anchors, which form a much smaller graph
+	 * that is optimized globally. The members of a submap are optimized
+	 * relative to the anchor, with the nodes of neighboring submaps held at
+	 * their current poses.
+	 *
+	 * Only submaps that received new constraints, or whose neighborhood has
+	 * moved, are solved again, and the global poses of the members are only
+	 * updated when the submap has been solved or its anchor moved. Changed
+	 * submaps are independent of each other and can be solved on several
+	 * threads, in that case the logger has to accept messages from several
+	 * threads, like the AsyncFileLogger does. Alternating between submaps and
+	 * anchors converges to the optimum of the full graph, each call to
+	 * compute() does a limited number of these rounds.
+	 */
+	class SubmapSolver : public Solver
+	{
+	public:
+		/**
+		 * @brief Constructor
+		 * @param logger pointer to the logger used by the solver
+		 * @param config size of the submaps and parameters of the solvers
+		 */
+		SubmapSolver(Logger* logger, const SubmapSolverConfiguration& config = SubmapSolverConfiguration());
+		~SubmapSolver();
+		
+		void addNode(unsigned id, Transform pose);
+		void addConstraint(unsigned source, unsigned target, Transform tf, Covariance cov);
+		void setFixed(unsigned id);
+		void unsetFixed(unsigned id);
+		void removeNode(unsigned id);
+		void setPose(unsigned id, const Transform& pose);
+		bool compute();
+		
+		/**
+		 * @brief Solve the changed submaps and the global graph.
+		 * @details The budget only limits the global optimization, the
+		 * submaps are limited by the configured number of iterations.
+		 * @param budget maximum iterations and duration of the global optimization
+		 */
+		bool compute(const OptimizationBudget& budget);
+		
+		void clear();
+		
+		/**
+		 * @brief Save all nodes and constraints in g2o's text format.
+		 */
+		void saveGraph(std::string filename);
+		
+		IdPoseVector getCorrections();
+		const IdPoseVector& getChangedPoses();
+		
+		/**
+		 * @brief Get the number of submaps that contain at least one node.
+		 */
+		size_t getNumberOfSubmaps() const;
+		
+		/**
+		 * @brief Get the memory used by nodes, constraints and all solvers.
+		 */
+		MemoryUsage getMemoryUsage() const;
+		
+	protected:
+		struct Node
+		{
+			Transform pose;
+			Transform local;
+			Transform reported;
+			size_t submap;
+			bool fixed;
+		};
+		
+		struct Constraint
+		{
+			Transform transform;
+			Covariance covariance;
+			unsigned source;
+			unsigned target;
+		};
+		
+		typedef std::vector<Constraint, Eigen::aligned_allocator<Constraint> > ConstraintList;
+		
+		struct Submap
+		{
+			std::vector<unsigned> members;
+			ConstraintList constraints;
+			
+			// Constraints to members of other submaps
+			ConstraintList links;
+			unsigned anchor;
+			
+			// Number of fixed members, the anchor is fixed globally if there is one
+			unsigned fixed;
+			
+			// The members have to be optimized relative to the anchor
+			bool dirty;
+			
+			// The global poses of the members have to be recomputed
+			bool moved;
+		};
+		
+		typedef std::unordered_map<unsigned, Node, std::hash<unsigned>, std::equal_to<unsigned>,
+			Eigen::aligned_allocator<std::pair<const unsigned, Node> > > NodeMap;
+		
+		/**
+		 * @brief Get a node or throw UnknownVertex.
+		 */
+		Node& getNode(unsigned id);
+		
+		/**
+		 * @brief Make the first member the anchor of a submap.
+		 */
+		void updateAnchor(Submap& submap);
+		
+		/**
+		 * @brief Optimize the members of a submap relative to its anchor.
+		 * @details Nodes of other submaps are only read, so several submaps
+		 * can be solved at the same time.
+		 */
+		bool solveSubmap(Submap& submap);
+		
+		/**
+		 * @brief Solve the given submaps, in parallel if configured.
+		 * @details The submaps must not share any constraints.
+		 */
+		bool solveSubmaps(const std::vector<size_t>& submaps);
+		
+		/**
+		 * @brief Split submaps into batches without constraints between them.
+		 */
+		std::vector<std::vector<size_t> > createBatches(const std::vector<size_t>& submaps) const;
+		
+		/**
+		 * @brief Create the graph of all anchors and the constraints between them.
+		 */
+		void buildGlobalGraph();
+		
+		/**
+		 * @brief Move the members of all submaps that have been marked as moved.
+		 * @param changed receives the indices of the moved submaps
+		 */
+		void propagate(std::set<size_t>& changed);
+		
+		/**
+		 * @brief Mark all submaps that share constraints with a submap as dirty.
+		 */
+		void markNeighbors(const Submap& submap);
+		
+		/**
+		 * @brief Check if a pose changed by more than the change tolerance.
+		 */
+		bool hasMoved(const Transform& from, const Transform& to) const;
+		
+		/**
+		 * @brief Remove all constraints connected to a node from a list.
+		 */
+		static void removeConstraints(ConstraintList& constraints, unsigned id);
+		
+		SubmapSolverConfiguration mConfig;
+		NodeMap mNodes;
+		std::vector<Submap> mSubmaps;
+		ConstraintList mLinks;
+		NativeSolver mGlobal;
+		bool mGlobalChanged;
+	};
+}
+
+#endif
@@ -0,0 +1,61 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_SUBMAPSOLVERCONFIGURATION_HPP
+#define SLAM_SUBMAPSOLVERCONFIGURATION_HPP
+
+namespace slam3d
+{
+	/**
+	 * @class SubmapSolverConfiguration
+	 * @brief Parameters for the SubmapSolver.
+	 */
+	struct SubmapSolverConfiguration
+	{
+		/** @brief Number of consecutive nodes that form one submap */
+		unsigned submap_size;
+		
+		/** @brief Number of threads to solve changed submaps in parallel */
+		unsigned threads;
+		
+		/** @brief Maximum iterations of the solver within a submap */
+		int local_iterations;
+		
+		/** @brief Default maximum iterations of the solver over all anchors */
+		int global_iterations;
+		
+		/** @brief Stop when the relative decrease of chi² is below */
+		double gain_threshold;
+		
+		/** @brief Maximum alternations between submaps and anchors in one compute() */
+		int max_rounds;
+		
+		SubmapSolverConfiguration() : submap_size(50), threads(1),
+		                              local_iterations(20), global_iterations(100),
+		                              gain_threshold(1e-6), max_rounds(5) {};
+	};
+}
+
+#endif
@@ -0,0 +1,99 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_TRANSPORT_HPP
+#define SLAM_TRANSPORT_HPP
+
+#include <string>
+#include <vector>
+#include <exception>
+
+namespace slam3d
+{
+	/**
+	 * @class TransportError
+	 * @brief Exception thrown when messages can not be exchanged.
+	 */
+	class TransportError: public std::exception
+	{
+	public:
+		TransportError(const std::string& msg):message(msg){}
+		virtual ~TransportError() throw() {}
+		virtual const char* what() const throw()
+		{
+			return message.c_str();
+		}
+		
+		std::string message;
+	};
+	
+	/**
+	 * @struct TransportMessage
+	 * @brief A message received from another agent.
+	 */
+	struct TransportMessage
+	{
+		int sender;
+		std::vector<char> payload;
+	};
+	
+	/**
+	 * @class Transport
+	 * @brief Abstract base class to exchange messages between agents.
+	 * @details Each agent is addressed by a unique integer id. Messages are
+	 * delivered as a whole and in order between two agents, but they may be
+	 * lost when the receiver is not running.
+	 */
+	class Transport
+	{
+	public:
+		virtual ~Transport(){}
+		
+		/**
+		 * @brief Get the id of the agent using this transport.
+		 */
+		virtual int getAgentId() const = 0;
+		
+		/**
+		 * @brief Send a message to another agent.
+		 * @param agent id of the receiving agent
+		 * @param payload content of the message
+		 * @return false if the agent can not be reached or the message was dropped
+		 * @throw TransportError
+		 */
+		virtual bool send(int agent, const std::vector<char>& payload) = 0;
+		
+		/**
+		 * @brief Wait for the next message from any agent.
+		 * @param message receives the message
+		 * @param timeout maximum time to wait in seconds
+		 * @return false if no message was received within the timeout
+		 * @throw TransportError
+		 */
+		virtual bool receive(TransportMessage& message, double timeout) = 0;
+	};
+}
+
+#endif
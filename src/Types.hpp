@@ -27,6 +27,7 @@
 #define SLAM_TYPES_HPP
 
 #include <sys/time.h>
+#include <boost/shared_ptr.hpp>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_generators.hpp>
 #include <Eigen/Geometry>
@@ -66,6 +67,8 @@ namespace slam3d
 	public:
 		Indexer():mNextID(0) {}
 		IdType getNext() { return mNextID++; }
+		IdType peekNext() const { return mNextID; }
+		void setNext(IdType next) { mNextID = next; }
 	private:
 		IdType mNextID;
 	};
@@ -84,6 +87,21 @@ namespace slam3d
 		
 	public:
 		Measurement(){}
+		
+		/**
+		 * @brief Constructor from meta information without sensor data.
+		 * @details This is used to restore measurements from a stored map.
+		 * @param r name of the robot that accquired this measurement
+		 * @param s name of the sensor that recorded this measurement
+		 * @param p pose of the sensor in robot coordinates
+		 * @param id unique identifier of this measurement
+		 * @param stamp time when the measurement was recorded
+		 */
+		Measurement(const std::string& r, const std::string& s, const Transform& p,
+		            const boost::uuids::uuid& id, const timeval& stamp)
+		 : mStamp(stamp), mRobotName(r), mSensorName(s), mUniqueId(id),
+		   mSensorPose(p), mInverseSensorPose(p.inverse()) {}
+		
 		virtual ~Measurement(){}
 		
 		timeval getTimestamp() const { return mStamp; }
@@ -93,6 +111,65 @@ namespace slam3d
 		Transform getSensorPose() const { return mSensorPose; }
 		Transform getInverseSensorPose() const { return mInverseSensorPose; }
 		
+		/**
+		 * @brief Get the size of the serialized sensor data in bytes.
+		 * @details The payload is the actual sensor data (e.g. the points of
+		 * a point cloud) without the meta information stored in this base class.
+		 * Measurements that cannot be serialized return 0 and will always be
+		 * kept in memory.
+		 * @return size of the payload in bytes
+		 */
+		virtual size_t getPayloadSize() const { return 0; }
+		
+		/**
+		 * @brief Write the sensor data into the given buffer.
+		 * @param buffer memory of at least getPayloadSize() bytes
+		 */
+		virtual void writePayload(char* buffer) const {}
+		
+		/**
+		 * @brief Restore the sensor data from the given buffer.
+		 * @param buffer memory previously filled by writePayload()
+		 * @param size size of the buffer in bytes
+		 */
+		virtual void readPayload(const char* buffer, size_t size) {}
+		
+		/**
+		 * @brief Get the size of the sensor data in a lossy compact representation.
+		 * @details This is used to exchange measurements over limited bandwidth.
+		 * Measurements without a compact representation use their payload.
+		 * @param resolution maximum error of a quantized value
+		 * @return size of the compressed payload in bytes
+		 */
+		virtual size_t getCompressedPayloadSize(ScalarType resolution) const { return getPayloadSize(); }
+		
+		/**
+		 * @brief Write the sensor data in its compact representation into the given buffer.
+		 * @param buffer memory of at least getCompressedPayloadSize() bytes
+		 * @param resolution maximum error of a quantized value
+		 */
+		virtual void writeCompressedPayload(char* buffer, ScalarType resolution) const { writePayload(buffer); }
+		
+		/**
+		 * @brief Restore the sensor data from its compact representation.
+		 * @param buffer memory previously filled by writeCompressedPayload()
+		 * @param size size of the buffer in bytes
+		 * @param resolution resolution used for writing
+		 */
+		virtual void readCompressedPayload(const char* buffer, size_t size, ScalarType resolution) { readPayload(buffer, size); }
+		
+		/**
+		 * @brief Free the memory used by the sensor data.
+		 * @details The meta information stays valid, the data can be restored
+		 * with readPayload() from a previously written buffer.
+		 */
+		virtual void releasePayload() {}
+		
+		/**
+		 * @brief Whether the sensor data is currently held in memory.
+		 */
+		virtual bool hasPayload() const { return true; }
+		
 	protected:
 		timeval mStamp;
 		std::string mRobotName;
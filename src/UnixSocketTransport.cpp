@@ -0,0 +1,157 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "UnixSocketTransport.hpp"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+
+#include <boost/format.hpp>
+
+using namespace slam3d;
+
+static void setAddress(sockaddr_un& address, const std::string& path)
+{
+	if(path.size() >= sizeof(address.sun_path))
+	{
+		throw TransportError((boost::format("Socket path '%1%' is too long!") % path).str());
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+}
+
+UnixSocketTransport::UnixSocketTransport(const std::string& directory, int agent, size_t max_message_size)
+ : mDirectory(directory), mAgent(agent), mSocket(-1), mBuffer(max_message_size + sizeof(int32_t))
+{
+	sockaddr_un address;
+	std::string path = getSocketPath(agent);
+	setAddress(address, path);
+	
+	mSocket = socket(AF_UNIX, SOCK_DGRAM, 0);
+	if(mSocket < 0)
+	{
+		throw TransportError((boost::format("Could not create socket: %1%") % strerror(errno)).str());
+	}
+	
+	// Large messages need larger buffers than the default
+	int size = mBuffer.size();
+	setsockopt(mSocket, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+	setsockopt(mSocket, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	
+	unlink(path.c_str());
+	if(bind(mSocket, (sockaddr*)&address, sizeof(address)) < 0)
+	{
+		int error = errno;
+		close(mSocket);
+		throw TransportError((boost::format("Could not bind socket '%1%': %2%") % path % strerror(error)).str());
+	}
+}
+
+UnixSocketTransport::~UnixSocketTransport()
+{
+	close(mSocket);
+	unlink(getSocketPath(mAgent).c_str());
+}
+
+std::string UnixSocketTransport::getSocketPath(int agent) const
+{
+	return (boost::format("%1%/agent_%2%.sock") % mDirectory % agent).str();
+}
+
+bool UnixSocketTransport::send(int agent, const std::vector<char>& payload)
+{
+	if(payload.size() + sizeof(int32_t) > mBuffer.size())
+	{
+		throw TransportError((boost::format("Message of %1% bytes exceeds the maximum size!") % payload.size()).str());
+	}
+	sockaddr_un address;
+	setAddress(address, getSocketPath(agent));
+	
+	// The sender is written in front of the payload
+	int32_t sender = mAgent;
+	iovec parts[2];
+	parts[0].iov_base = &sender;
+	parts[0].iov_len = sizeof(sender);
+	parts[1].iov_base = (void*)payload.data();
+	parts[1].iov_len = payload.size();
+	msghdr header;
+	memset(&header, 0, sizeof(header));
+	header.msg_name = &address;
+	header.msg_namelen = sizeof(address);
+	header.msg_iov = parts;
+	header.msg_iovlen = 2;
+	
+	// Never block on a receiver that does not read its messages, a full
+	// queue or a too small receive buffer drops the message instead.
+	while(sendmsg(mSocket, &header, MSG_DONTWAIT) < 0)
+	{
+		if(errno == EINTR)
+			continue;
+		if(errno == ENOENT || errno == ECONNREFUSED)
+			return false;
+		if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EMSGSIZE)
+			return false;
+		throw TransportError((boost::format("Could not send to agent %1%: %2%") % agent % strerror(errno)).str());
+	}
+	return true;
+}
+
+bool UnixSocketTransport::receive(TransportMessage& message, double timeout)
+{
+	pollfd fd;
+	fd.fd = mSocket;
+	fd.events = POLLIN;
+	fd.revents = 0;
+	int result = poll(&fd, 1, timeout > 0 ? (int)(timeout * 1000) : 0);
+	if(result < 0 && errno != EINTR)
+	{
+		throw TransportError((boost::format("Could not wait for messages: %1%") % strerror(errno)).str());
+	}
+	if(result <= 0)
+		return false;
+	
+	ssize_t size = recv(mSocket, mBuffer.data(), mBuffer.size(), MSG_TRUNC);
+	if(size < 0)
+	{
+		if(errno == EINTR || errno == EAGAIN)
+			return false;
+		throw TransportError((boost::format("Could not receive message: %1%") % strerror(errno)).str());
+	}
+	if((size_t)size > mBuffer.size() || (size_t)size < sizeof(int32_t))
+	{
+		throw TransportError((boost::format("Received a malformed message of %1% bytes!") % size).str());
+	}
+	int32_t sender;
+	memcpy(&sender, mBuffer.data(), sizeof(sender));
+	message.sender = sender;
+	message.payload.assign(mBuffer.begin() + sizeof(int32_t), mBuffer.begin() + size);
+	return true;
+}
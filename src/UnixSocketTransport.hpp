@@ -0,0 +1,72 @@
+// slam3d - Frontend for graph-based SLAM
+// Copyright (C) 2017 S. Kasperski
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAM_UNIXSOCKETTRANSPORT_HPP
+#define SLAM_UNIXSOCKETTRANSPORT_HPP
+
+#include "Transport.hpp"
+
+namespace slam3d
+{
+	/**
+	 * @class UnixSocketTransport
+	 * @brief Exchanges messages between processes on the same machine.
+	 * @details Each agent binds a datagram socket named after its id within
+	 * a common directory, so agents can run in separate processes or threads.
+	 * Messages are limited by the size of the socket buffers. Sending never
+	 * blocks, a message is dropped when the receiver's queue is full.
+	 */
+	class UnixSocketTransport : public Transport
+	{
+	public:
+		/**
+		 * @brief Create and bind the socket of the given agent.
+		 * @details A socket left over by a previous run is replaced.
+		 * @param directory directory that holds the sockets of all agents
+		 * @param agent id of this agent
+		 * @param max_message_size maximum size of a message in bytes
+		 * @throw TransportError
+		 */
+		UnixSocketTransport(const std::string& directory, int agent, size_t max_message_size = 1 << 20);
+		~UnixSocketTransport();
+		
+		int getAgentId() const { return mAgent; }
+		bool send(int agent, const std::vector<char>& payload);
+		bool receive(TransportMessage& message, double timeout);
+		
+		/**
+		 * @brief Get the path of the socket of the given agent.
+		 */
+		std::string getSocketPath(int agent) const;
+		
+	protected:
+		std::string mDirectory;
+		int mAgent;
+		int mSocket;
+		std::vector<char> mBuffer;
+	};
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef SLAM_TEST_MEASUREMENT_FIXTURE_HPP
+#define SLAM_TEST_MEASUREMENT_FIXTURE_HPP
+
+#include <PointCloudSensor.hpp>
+
+namespace slam3d
+{
+	/**
+	 * @brief Create a small point cloud measurement for the tests.
+	 * @details The points depend on the offset, which is also used as the
+	 * timestamp in seconds, so different offsets give distinct measurements.
+	 * @param points number of points in the cloud
+	 * @param offset position and timestamp of the cloud
+	 */
+	inline PointCloudMeasurement::Ptr createMeasurement(unsigned points, float offset)
+	{
+		PointCloud::Ptr cloud(new PointCloud);
+		for(unsigned i = 0; i < points; i++)
+		{
+			PointType p;
+			p.x = offset + i;
+			p.y = offset - i;
+			p.z = offset;
+			cloud->push_back(p);
+		}
+		cloud->header.stamp = 1000000 * offset;
+		return PointCloudMeasurement::Ptr(new PointCloudMeasurement(cloud, "r1", "pcl_sensor", Transform::Identity()));
+	}
+}
+
+#endif
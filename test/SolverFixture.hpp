@@ -0,0 +1,159 @@
+#ifndef SLAM_TEST_SOLVER_FIXTURE_HPP
+#define SLAM_TEST_SOLVER_FIXTURE_HPP
+
+#include <Solver.hpp>
+
+#include <cstdlib>
+
+namespace slam3d
+{
+	/**
+	 * @struct TestEdge
+	 * @brief Relative measurement between two nodes of a test problem.
+	 */
+	struct TestEdge
+	{
+		unsigned source;
+		unsigned target;
+		Transform measurement;
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	};
+
+	typedef std::vector<TestEdge, Eigen::aligned_allocator<TestEdge> > TestEdgeList;
+	typedef std::vector<Transform, Eigen::aligned_allocator<Transform> > PoseList;
+
+	/**
+	 * @brief Decides whether a loop closure is added between two nodes.
+	 */
+	typedef bool (*LoopRule)(unsigned source, unsigned target);
+
+	/**
+	 * @brief Loop closure between all nodes that are a multiple of seven apart.
+	 */
+	inline bool everySeventhNode(unsigned source, unsigned target)
+	{
+		return (target - source) % 7 == 0;
+	}
+
+	inline double uniform(double range)
+	{
+		return range * (2.0 * rand() / RAND_MAX - 1.0);
+	}
+
+	inline Transform randomTransform(double translation, double rotation)
+	{
+		Transform tf = Transform::Identity();
+		tf.translation() = Vector3(uniform(translation), uniform(translation), uniform(translation));
+		tf.linear() = (Eigen::AngleAxisd(uniform(rotation), Vector3::UnitX())
+		             * Eigen::AngleAxisd(uniform(rotation), Vector3::UnitY())
+		             * Eigen::AngleAxisd(uniform(rotation), Vector3::UnitZ())).toRotationMatrix();
+		return tf;
+	}
+
+	/**
+	 * @brief Create a winding trajectory with odometry and loop closures.
+	 * @details The random generator is reset, so the same arguments always
+	 * give the same problem.
+	 * @param truth true poses of the nodes
+	 * @param edges measurements with the given noise
+	 * @param nodes number of nodes
+	 * @param noise range of the measurement noise
+	 * @param loop selects the pairs of nodes with a loop closure
+	 */
+	inline void createProblem(PoseList& truth, TestEdgeList& edges, size_t nodes, double noise, LoopRule loop = everySeventhNode)
+	{
+		srand(42);
+		truth.clear();
+		edges.clear();
+		Transform pose = Transform::Identity();
+		for(size_t i = 0; i < nodes; i++)
+		{
+			truth.push_back(pose);
+			Transform step = Transform::Identity();
+			step.translation() = Vector3(1, 0, 0.1);
+			step.linear() = Eigen::AngleAxisd(0.3, Vector3(0.1, 0.2, 1).normalized()).toRotationMatrix();
+			pose = pose * step;
+		}
+		for(unsigned i = 0; i < nodes; i++)
+		{
+			for(unsigned j = i + 1; j < nodes; j++)
+			{
+				if(j == i + 1 || loop(i, j))
+				{
+					TestEdge edge;
+					edge.source = i;
+					edge.target = j;
+					edge.measurement = truth[i].inverse() * truth[j] * randomTransform(noise, noise);
+					edges.push_back(edge);
+				}
+			}
+		}
+	}
+
+	/**
+	 * @brief Initial guess from the noisy odometry only.
+	 */
+	inline PoseList getOdometryGuess(const TestEdgeList& edges)
+	{
+		PoseList guess(1, Transform::Identity());
+		for(TestEdgeList::const_iterator e = edges.begin(); e != edges.end(); ++e)
+		{
+			if(e->target == e->source + 1)
+				guess.push_back(guess.back() * e->measurement);
+		}
+		return guess;
+	}
+
+	/**
+	 * @brief Add all nodes at the odometry guess and all edges to the solver.
+	 */
+	inline void fillSolver(Solver& solver, const TestEdgeList& edges, size_t nodes)
+	{
+		PoseList guess = getOdometryGuess(edges);
+		for(unsigned n = 0; n < guess.size(); n++)
+		{
+			solver.addNode(n, guess[n]);
+		}
+		for(TestEdgeList::const_iterator e = edges.begin(); e != edges.end(); ++e)
+		{
+			solver.addConstraint(e->source, e->target, e->measurement, Covariance::Identity());
+		}
+		solver.setFixed(0);
+	}
+
+	inline PoseList getPoses(Solver& solver, size_t nodes)
+	{
+		PoseList poses(nodes);
+		IdPoseVector corrections = solver.getCorrections();
+		for(IdPoseVector::iterator c = corrections.begin(); c != corrections.end(); ++c)
+		{
+			poses[c->first] = c->second;
+		}
+		return poses;
+	}
+
+	/**
+	 * @brief Independent implementation of g2o's EdgeSE3 error.
+	 */
+	inline double chi2(const PoseList& poses, const TestEdgeList& edges)
+	{
+		double sum = 0;
+		for(TestEdgeList::const_iterator e = edges.begin(); e != edges.end(); ++e)
+		{
+			Transform delta = e->measurement.inverse() * poses[e->source].inverse() * poses[e->target];
+			Eigen::Quaterniond q(delta.linear());
+			if(q.w() < 0)
+				q.coeffs() *= -1;
+			sum += delta.translation().squaredNorm() + q.vec().squaredNorm();
+		}
+		return sum;
+	}
+
+	inline double distance(const Transform& a, const Transform& b)
+	{
+		Transform diff = a.inverse() * b;
+		return diff.translation().norm() + Eigen::AngleAxisd(diff.linear()).angle();
+	}
+}
+
+#endif
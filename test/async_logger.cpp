@@ -0,0 +1,87 @@
+#define BOOST_TEST_MODULE "AsyncLoggerTest"
+
+#include <AsyncFileLogger.hpp>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/format.hpp>
+#include <fstream>
+#include <thread>
+
+using namespace slam3d;
+
+unsigned countLines(const std::string& filename, const std::string& pattern)
+{
+	std::ifstream file(filename.c_str());
+	std::string line;
+	unsigned count = 0;
+	while(std::getline(file, line))
+	{
+		if(line.find(pattern) != std::string::npos)
+			count++;
+	}
+	return count;
+}
+
+void produce(Logger* logger, unsigned id, unsigned messages)
+{
+	for(unsigned i = 0; i < messages; i++)
+	{
+		SLAM3D_LOG(logger, INFO, (boost::format("thread %1% message %2%") % id % i).str());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(blocking)
+{
+	{
+		Clock clock;
+		AsyncFileLogger logger(clock, "async_blocking.log", 64, OVERFLOW_BLOCK);
+		std::vector<std::thread> threads;
+		for(unsigned t = 0; t < 4; t++)
+			threads.push_back(std::thread(produce, &logger, t, 5000));
+		for(unsigned t = 0; t < 4; t++)
+			threads[t].join();
+		BOOST_CHECK_EQUAL(logger.getDroppedMessages(), 0);
+	}
+	BOOST_CHECK_EQUAL(countLines("async_blocking.log", "thread "), 20000);
+	BOOST_CHECK_EQUAL(countLines("async_blocking.log", "thread 2 message 4999"), 1);
+}
+
+BOOST_AUTO_TEST_CASE(dropping)
+{
+	size_t dropped;
+	{
+		Clock clock;
+		AsyncFileLogger logger(clock, "async_dropping.log", 16, OVERFLOW_DROP);
+		produce(&logger, 0, 10000);
+		dropped = logger.getDroppedMessages();
+	}
+	BOOST_CHECK_EQUAL(countLines("async_dropping.log", "thread ") + dropped, 10000);
+}
+
+BOOST_AUTO_TEST_CASE(flush)
+{
+	Clock clock;
+	AsyncFileLogger logger(clock, "async_flush.log", 1024, OVERFLOW_BLOCK, 100000, 1000000);
+	produce(&logger, 0, 10);
+	logger.flush();
+	BOOST_CHECK_EQUAL(countLines("async_flush.log", "thread "), 10);
+	
+	// Fatal errors are written before message returns
+	logger.message(FATAL, "fatal error");
+	BOOST_CHECK_EQUAL(countLines("async_flush.log", "fatal error"), 1);
+}
+
+BOOST_AUTO_TEST_CASE(fatal_not_dropped)
+{
+	Clock clock;
+	AsyncFileLogger logger(clock, "async_fatal.log", 16, OVERFLOW_DROP, 100000, 1000000);
+	
+	// Keep the buffer full while fatal errors are reported
+	std::thread flood(produce, &logger, 0, 100000);
+	for(unsigned i = 0; i < 20; i++)
+	{
+		logger.message(FATAL, (boost::format("fatal error %1%.") % i).str());
+		BOOST_CHECK_EQUAL(countLines("async_fatal.log", (boost::format("fatal error %1%.") % i).str()), 1);
+	}
+	flood.join();
+}
@@ -0,0 +1,272 @@
+#define BOOST_TEST_MODULE "BufferedOdometryTest"
+
+#include <BufferedOdometry.hpp>
+#include <BoostMapper.hpp>
+#include <PoseGraphGenerator.hpp>
+#include <Linearization.hpp>
+#include <FileLogger.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+
+using namespace slam3d;
+
+static timeval toStamp(int64_t us)
+{
+	timeval stamp;
+	stamp.tv_sec = us / 1000000;
+	stamp.tv_usec = us % 1000000;
+	return stamp;
+}
+
+// Pose after moving with a constant body velocity for the given time
+static Transform screwMotion(double t)
+{
+	Vector3 v(1.0, 0.2, 0.1);
+	Vector3 w(0.1, -0.05, 0.5);
+	double angle = w.norm() * t;
+	Vector3 axis = w.normalized();
+	Eigen::Matrix<ScalarType,3,3> K = skew(axis);
+	Eigen::Matrix<ScalarType,3,3> V = Eigen::Matrix<ScalarType,3,3>::Identity()
+		+ ((1 - std::cos(angle)) / angle) * K + ((angle - std::sin(angle)) / angle) * K * K;
+	Transform pose = Transform::Identity();
+	if(angle == 0)
+	{
+		pose.translation() = v * t;
+		return pose;
+	}
+	pose.linear() = Eigen::AngleAxis<ScalarType>(angle, axis).toRotationMatrix();
+	pose.translation() = V * (v * t);
+	return pose;
+}
+
+BOOST_AUTO_TEST_CASE(interpolation)
+{
+	Clock clock;
+	FileLogger logger(clock, "buffered_odometry.log");
+	BufferedOdometry odometry(&logger);
+	BOOST_CHECK_THROW(odometry.getOdometricPose(toStamp(0)), OdometryException);
+	
+	// 100 Hz samples on a helix, interpolated at 1 kHz
+	for(int64_t us = 1000000; us <= 3000000; us += 10000)
+	{
+		BOOST_CHECK(odometry.addSample(toStamp(us), screwMotion(us * 1e-6)));
+	}
+	BOOST_CHECK_EQUAL(odometry.getSize(), 201);
+	for(int64_t us = 1000000; us <= 3000000; us += 1000)
+	{
+		Transform pose = odometry.getOdometricPose(toStamp(us));
+		BOOST_CHECK(pose.isApprox(screwMotion(us * 1e-6), 1e-9));
+	}
+	BOOST_CHECK_THROW(odometry.getOdometricPose(toStamp(999999)), OdometryException);
+	BOOST_CHECK_THROW(odometry.getOdometricPose(toStamp(3000001)), OdometryException);
+	
+	// Samples must be added in chronological order
+	BOOST_CHECK(!odometry.addSample(toStamp(3000000), Transform::Identity()));
+	BOOST_CHECK(!odometry.addSample(toStamp(2000000), Transform::Identity()));
+	BOOST_CHECK_EQUAL(odometry.getSize(), 201);
+	
+	TransformWithCovariance forward = odometry.getRelativePose(toStamp(1500500), toStamp(2700300));
+	TransformWithCovariance backward = odometry.getRelativePose(toStamp(2700300), toStamp(1500500));
+	BOOST_CHECK(forward.transform.isApprox(screwMotion(1.5005).inverse() * screwMotion(2.7003), 1e-9));
+	BOOST_CHECK(backward.transform.isApprox(forward.transform.inverse(), 1e-9));
+}
+
+BOOST_AUTO_TEST_CASE(covariance_from_samples)
+{
+	Clock clock;
+	FileLogger logger(clock, "buffered_odometry.log");
+	BufferedOdometry odometry(&logger);
+	
+	// Noise differs per sample, e.g. while the wheels are slipping
+	std::vector<Transform, Eigen::aligned_allocator<Transform> > poses;
+	std::vector<Covariance, Eigen::aligned_allocator<Covariance> > noise;
+	std::mt19937 random(7);
+	std::uniform_real_distribution<double> variance(1e-6, 1e-4);
+	for(int i = 0; i <= 1000; i++)
+	{
+		Covariance cov = Covariance::Zero();
+		for(int d = 0; d < 6; d++)
+			cov(d, d) = variance(random);
+		poses.push_back(screwMotion(i * 0.005));
+		noise.push_back(cov);
+		odometry.addSample(toStamp(i * 5000), poses.back(), cov);
+	}
+	
+	// Propagate the noise of the samples between the two stamps explicitly
+	Vector6 inverse_scale = errorScale().cwiseInverse();
+	Matrix6 expected = Matrix6::Zero();
+	for(int i = 201; i <= 800; i++)
+	{
+		Matrix6 adj = adjoint((poses[i - 1].inverse() * poses[i]).inverse());
+		expected = adj * expected * adj.transpose()
+			+ inverse_scale.asDiagonal() * noise[i] * inverse_scale.asDiagonal();
+	}
+	expected = errorScale().asDiagonal() * expected * errorScale().asDiagonal();
+	TransformWithCovariance twc = odometry.getRelativePose(toStamp(200 * 5000), toStamp(800 * 5000));
+	BOOST_CHECK_SMALL((twc.covariance - expected).norm() / expected.norm(), 1e-9);
+	
+	// The uncertainty grows with the time between both stamps
+	TransformWithCovariance shorter = odometry.getRelativePose(toStamp(200 * 5000), toStamp(400 * 5000 + 2500));
+	BOOST_CHECK_LT(shorter.covariance.trace(), twc.covariance.trace());
+	TransformWithCovariance none = odometry.getRelativePose(toStamp(300 * 5000), toStamp(300 * 5000));
+	BOOST_CHECK_SMALL(none.covariance.norm(), 1e-12);
+	
+	// Covariance of the inverse transform
+	TransformWithCovariance backward = odometry.getRelativePose(toStamp(800 * 5000), toStamp(200 * 5000));
+	Matrix6 adj = errorScale().asDiagonal() * adjoint(twc.transform) * inverse_scale.asDiagonal();
+	BOOST_CHECK_SMALL((backward.covariance - adj * twc.covariance * adj.transpose()).norm() / expected.norm(), 1e-9);
+}
+
+BOOST_AUTO_TEST_CASE(long_running)
+{
+	Clock clock;
+	FileLogger logger(clock, "buffered_odometry.log");
+	BufferedOdometry odometry(&logger);
+	
+	// Large noise over a long drive, followed by a few precise samples
+	for(int i = 0; i <= 4000; i++)
+	{
+		Covariance noise = Covariance::Identity() * (i < 3990 ? 1e-2 : 1e-10);
+		odometry.addSample(toStamp(i * 10000), screwMotion(i * 0.01), noise);
+	}
+	
+	// The relative covariance is not lost in the accumulated uncertainty
+	Covariance expected = Covariance::Identity() * 1e-10;
+	TransformWithCovariance twc = odometry.getRelativePose(toStamp(3995 * 10000), toStamp(3996 * 10000));
+	BOOST_CHECK_SMALL((twc.covariance - expected).norm() / expected.norm(), 1e-6);
+	twc = odometry.getRelativePose(toStamp(3995 * 10000), toStamp(3995 * 10000 + 2500));
+	BOOST_CHECK_SMALL((twc.covariance - 0.25 * expected).norm() / expected.norm(), 1e-6);
+}
+
+BOOST_AUTO_TEST_CASE(wrap_around)
+{
+	Clock clock;
+	FileLogger logger(clock, "buffered_odometry.log");
+	BufferedOdometryConfiguration config;
+	config.capacity = 20;
+	BufferedOdometry odometry(&logger, config);
+	BOOST_CHECK_EQUAL(odometry.getCapacity(), 31);
+	
+	for(int i = 0; i < 100; i++)
+	{
+		odometry.addSample(toStamp(i * 1000), screwMotion(i * 0.001));
+	}
+	BOOST_CHECK_EQUAL(odometry.getSize(), 31);
+	BOOST_CHECK_THROW(odometry.getOdometricPose(toStamp(68500)), OdometryException);
+	BOOST_CHECK(odometry.getOdometricPose(toStamp(69000)).isApprox(screwMotion(0.069), 1e-9));
+	BOOST_CHECK(odometry.getOdometricPose(toStamp(98500)).isApprox(screwMotion(0.0985), 1e-9));
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_readers)
+{
+	Clock clock;
+	FileLogger logger(clock, "buffered_odometry.log");
+	BufferedOdometryConfiguration config;
+	config.capacity = 256;
+	BufferedOdometry odometry(&logger, config);
+	
+	// The producer adds 1 kHz samples as fast as possible, so it
+	// frequently overwrites samples while they are being read.
+	const int64_t samples = 200000;
+	std::atomic<int64_t> latest(0);
+	std::atomic<bool> running(true);
+	std::atomic<size_t> queries(0);
+	std::atomic<size_t> misses(0);
+	std::atomic<size_t> errors(0);
+	odometry.addSample(toStamp(0), screwMotion(0));
+	
+	std::vector<std::thread> readers;
+	for(int r = 0; r < 3; r++)
+	{
+		readers.push_back(std::thread([&, r]()
+		{
+			std::mt19937 random(r);
+			std::uniform_int_distribution<int64_t> age(0, 300 * 1000);
+			while(running.load())
+			{
+				int64_t time = latest.load() - age(random);
+				if(time < 0)
+					continue;
+				try
+				{
+					if(!odometry.getOdometricPose(toStamp(time)).isApprox(screwMotion(time * 1e-6), 1e-9))
+						errors++;
+				}catch(OdometryException& e)
+				{
+					misses++;
+				}
+				queries++;
+			}
+		}));
+	}
+	
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for(int64_t i = 1; i <= samples; i++)
+	{
+		odometry.addSample(toStamp(i * 1000), screwMotion(i * 1e-3));
+		latest.store(i * 1000);
+	}
+	double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	running.store(false);
+	for(std::vector<std::thread>::iterator t = readers.begin(); t != readers.end(); ++t)
+		t->join();
+	
+	BOOST_TEST_MESSAGE("Added " << samples << " samples in " << duration * 1000 << " ms while answering "
+		<< queries.load() << " queries, " << misses.load() << " of them too old");
+	BOOST_CHECK_GT(queries.load(), 0);
+	BOOST_CHECK_LT(misses.load(), queries.load());
+	BOOST_CHECK_EQUAL(errors.load(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(mapper_odometry_edges)
+{
+	Clock clock;
+	FileLogger logger(clock, "buffered_odometry.log");
+	BufferedOdometry odometry(&logger);
+	SyntheticSensor sensor("synthetic", &logger, GeneratorConfiguration());
+	BoostMapper mapper(&logger);
+	mapper.registerSensor(&sensor);
+	mapper.setOdometry(&odometry, true);
+	
+	// Odometry is much noisier during the second half
+	for(int i = 0; i <= 4000; i++)
+	{
+		Covariance noise = Covariance::Identity() * (i < 2000 ? 1e-6 : 1e-4);
+		odometry.addSample(toStamp(i * 1000), screwMotion(i * 1e-3), noise);
+	}
+	for(int i = 0; i <= 4; i++)
+	{
+		timeval stamp = toStamp(i * 1000000);
+		BOOST_CHECK(mapper.addReading(Measurement::Ptr(
+			new SyntheticMeasurement("robot", "synthetic", stamp, i, screwMotion(i))), true));
+	}
+	
+	EdgeObjectList edges = mapper.getEdgeObjectsFromSensor("Odometry");
+	size_t odometry_edges = 0;
+	double largest = 0;
+	for(EdgeObjectList::iterator e = edges.begin(); e != edges.end(); ++e)
+	{
+		if(e->sensor != "Odometry")
+			continue;
+		odometry_edges++;
+		
+		// Each edge's covariance comes from the samples between its vertices
+		bool found = false;
+		for(int i = 0; i < 4; i++)
+		{
+			TransformWithCovariance twc = odometry.getRelativePose(toStamp(i * 1000000), toStamp((i + 1) * 1000000));
+			found = found || e->covariance.isApprox(twc.covariance);
+		}
+		BOOST_CHECK(found);
+		largest = std::max(largest, e->covariance.trace());
+	}
+	BOOST_CHECK_GT(odometry_edges, 0);
+	TransformWithCovariance first = odometry.getRelativePose(toStamp(0), toStamp(1000000));
+	BOOST_CHECK_GT(largest, first.covariance.trace() * 50);
+}
@@ -0,0 +1,211 @@
+#define BOOST_TEST_MODULE "CovarianceTest"
+
+#include <NativeSolver.hpp>
+#include <G2oSolver.hpp>
+#include <BoostMapper.hpp>
+#include <PoseGraphGenerator.hpp>
+#include <FileLogger.hpp>
+
+#include <boost/test/unit_test.hpp>
+#include <Eigen/Eigenvalues>
+
+using namespace slam3d;
+
+static Transform step()
+{
+	Transform tf = Transform::Identity();
+	tf.translation() = Vector3(1, 0.2, 0.1);
+	tf.linear() = Eigen::AngleAxisd(0.3, Vector3(0.1, 0.2, 1).normalized()).toRotationMatrix();
+	return tf;
+}
+
+static Covariance edgeCovariance()
+{
+	Vector6 sigma;
+	sigma << 0.1, 0.2, 0.05, 0.01, 0.02, 0.03;
+	return sigma.cwiseAbs2().asDiagonal();
+}
+
+// Compound the covariance of two relative poses given in error coordinates
+static Covariance compound(const Transform& first, const Covariance& first_cov, const Covariance& second_cov)
+{
+	Vector6 inverse_scale = errorScale().cwiseInverse();
+	Matrix6 adj = adjoint(first.inverse());
+	Matrix6 cov = adj * inverse_scale.asDiagonal() * first_cov * inverse_scale.asDiagonal() * adj.transpose()
+		+ inverse_scale.asDiagonal() * second_cov * inverse_scale.asDiagonal();
+	return errorScale().asDiagonal() * cov * errorScale().asDiagonal();
+}
+
+// A noise free chain 0 -> 1 -> 2 with node 0 fixed
+static void createChain(Solver& solver)
+{
+	solver.addNode(0, Transform::Identity());
+	solver.addNode(1, step());
+	solver.addNode(2, step() * step());
+	solver.addConstraint(0, 1, step(), edgeCovariance());
+	solver.addConstraint(1, 2, step(), edgeCovariance());
+	solver.setFixed(0);
+}
+
+// Check the covariances of the chain after an optimization
+static void checkChain(Solver& solver)
+{
+	Covariance cov;
+	BOOST_REQUIRE(solver.getMarginalCovariance(0, cov));
+	BOOST_CHECK_SMALL(cov.norm(), 1e-12);
+	
+	BOOST_REQUIRE(solver.getMarginalCovariance(1, cov));
+	BOOST_CHECK_SMALL((cov - edgeCovariance()).norm(), 1e-9);
+	
+	BOOST_REQUIRE(solver.getMarginalCovariance(2, cov));
+	Covariance expected = compound(step(), edgeCovariance(), edgeCovariance());
+	BOOST_CHECK_SMALL((cov - expected).norm(), 1e-9);
+	
+	// Both nodes are fully correlated up to node 1
+	BOOST_REQUIRE(solver.getRelativeCovariance(1, 2, cov));
+	BOOST_CHECK_SMALL((cov - edgeCovariance()).norm(), 1e-9);
+	BOOST_REQUIRE(solver.getRelativeCovariance(0, 2, cov));
+	BOOST_CHECK_SMALL((cov - expected).norm(), 1e-9);
+	BOOST_REQUIRE(solver.getRelativeCovariance(2, 2, cov));
+	BOOST_CHECK_SMALL(cov.norm(), 1e-9);
+}
+
+BOOST_AUTO_TEST_CASE(chain)
+{
+	Clock clock;
+	FileLogger logger(clock, "covariance.log");
+	NativeSolver solver(&logger);
+	createChain(solver);
+	BOOST_REQUIRE(solver.compute());
+	checkChain(solver);
+}
+
+BOOST_AUTO_TEST_CASE(g2o_chain)
+{
+	Clock clock;
+	FileLogger logger(clock, "covariance.log");
+	G2oSolver solver(&logger);
+	createChain(solver);
+	BOOST_REQUIRE(solver.compute());
+	checkChain(solver);
+	
+	// Prepared blocks give the same results
+	std::vector<std::pair<unsigned, unsigned> > pairs;
+	pairs.push_back(std::make_pair(1, 2));
+	pairs.push_back(std::make_pair(0, 2));
+	pairs.push_back(std::make_pair(7, 2));
+	BOOST_REQUIRE(solver.compute());
+	solver.prepareRelativeCovariances(pairs);
+	checkChain(solver);
+}
+
+BOOST_AUTO_TEST_CASE(g2o_incremental_chain)
+{
+	Clock clock;
+	FileLogger logger(clock, "covariance.log");
+	G2oSolver solver(&logger);
+	solver.setIncremental(true, 5, 0);
+	
+	// The first compute is a batch, the second only optimizes the region around node 2
+	solver.addNode(0, Transform::Identity());
+	solver.addNode(1, step());
+	solver.addConstraint(0, 1, step(), edgeCovariance());
+	solver.setFixed(0);
+	BOOST_REQUIRE(solver.compute());
+	solver.addNode(2, step() * step());
+	solver.addConstraint(1, 2, step(), edgeCovariance());
+	BOOST_REQUIRE(solver.compute());
+	checkChain(solver);
+}
+
+BOOST_AUTO_TEST_CASE(loop_closure)
+{
+	Clock clock;
+	FileLogger logger(clock, "covariance.log");
+	NativeSolver solver(&logger);
+	createChain(solver);
+	BOOST_REQUIRE(solver.compute());
+	
+	Covariance chain_cov;
+	BOOST_REQUIRE(solver.getMarginalCovariance(2, chain_cov));
+	
+	// The cached result is dropped by the next compute
+	solver.addConstraint(0, 2, step() * step(), edgeCovariance());
+	Covariance cov;
+	BOOST_REQUIRE(solver.getMarginalCovariance(2, cov));
+	BOOST_CHECK_SMALL((cov - chain_cov).norm(), 1e-12);
+	BOOST_REQUIRE(solver.compute());
+	BOOST_REQUIRE(solver.getMarginalCovariance(2, cov));
+	BOOST_CHECK_LT(cov.trace(), edgeCovariance().trace());
+	BOOST_CHECK_LT(cov.trace(), chain_cov.trace());
+	
+	// The posterior must not exceed any single path in any direction
+	Eigen::SelfAdjointEigenSolver<Covariance> eigen(chain_cov - cov);
+	BOOST_CHECK_GT(eigen.eigenvalues().minCoeff(), -1e-12);
+}
+
+BOOST_AUTO_TEST_CASE(availability)
+{
+	Clock clock;
+	FileLogger logger(clock, "covariance.log");
+	NativeSolver solver(&logger);
+	createChain(solver);
+	
+	Covariance cov;
+	BOOST_CHECK(!solver.getMarginalCovariance(1, cov));
+	BOOST_CHECK_THROW(solver.getMarginalCovariance(3, cov), Solver::UnknownVertex);
+	BOOST_CHECK_THROW(solver.getRelativeCovariance(1, 3, cov), Solver::UnknownVertex);
+	
+	BOOST_REQUIRE(solver.compute());
+	BOOST_CHECK(solver.getMarginalCovariance(1, cov));
+	
+	// Nodes added after the optimization are not known yet
+	solver.addNode(3, step() * step() * step());
+	solver.addConstraint(2, 3, step(), edgeCovariance());
+	BOOST_CHECK(!solver.getMarginalCovariance(3, cov));
+	BOOST_CHECK(!solver.getRelativeCovariance(2, 3, cov));
+	BOOST_CHECK(solver.getRelativeCovariance(1, 2, cov));
+	
+	BOOST_REQUIRE(solver.compute());
+	BOOST_CHECK(solver.getMarginalCovariance(3, cov));
+	
+	solver.clear();
+	solver.addNode(0, Transform::Identity());
+	BOOST_CHECK(!solver.getMarginalCovariance(0, cov));
+}
+
+BOOST_AUTO_TEST_CASE(adaptive_neighbor_search)
+{
+	Clock clock;
+	FileLogger logger(clock, "covariance.log");
+	logger.setLogLevel(ERROR);
+	Metrics metrics(&clock);
+	metrics.setEnabled(true);
+	
+	GeneratorConfiguration config;
+	config.trajectory = TRAJECTORY_MANHATTAN;
+	config.area = 10;
+	SyntheticSensor sensor("synthetic", &logger, config);
+	PoseGraphGenerator generator(sensor, config);
+	
+	BoostMapper mapper(&logger);
+	NativeSolver solver(&logger);
+	mapper.registerSensor(&sensor);
+	mapper.setSolver(&solver);
+	mapper.setMetrics(&metrics);
+	mapper.setNeighborRadius(config.loop_range, config.max_loop_links);
+	mapper.setAdaptiveNeighborSearch(3.0, 2 * config.loop_range, 0.1);
+	
+	for(int i = 0; i < 20; i++)
+	{
+		generator.addReadings(mapper, 10);
+		BOOST_REQUIRE(mapper.optimize());
+	}
+	BOOST_CHECK(metrics.getHistogram("mapper.overlap_candidates").getCount() > 0);
+	BOOST_CHECK(metrics.getHistogram("mapper.overlap_candidates.radius").getMax() <= 2 * config.loop_range);
+	
+	// Loops are still closed besides the sequential edges
+	size_t vertices = mapper.getVertexObjectsFromSensor("synthetic").size();
+	size_t edges = mapper.getEdgeObjectsFromSensor("synthetic").size();
+	BOOST_CHECK(edges > 2 * vertices);
+}
@@ -0,0 +1,248 @@
+#define BOOST_TEST_MODULE "DistributedSolverTest"
+
+#include <DistributedSolver.hpp>
+#include <UnixSocketTransport.hpp>
+#include <FileLogger.hpp>
+
+#include "SolverFixture.hpp"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/format.hpp>
+
+#include <chrono>
+#include <set>
+#include <thread>
+
+using namespace slam3d;
+
+// Each agent owns a contiguous range of nodes and keeps copies of the connected nodes of others
+static void fillSolver(DistributedSolver& solver, int agent, const PoseList& guess, const TestEdgeList& edges, unsigned part)
+{
+	std::set<unsigned> remote;
+	for(unsigned n = 0; n < guess.size(); n++)
+	{
+		if(n / part == (unsigned)agent)
+			solver.addNode(n, guess[n]);
+	}
+	for(TestEdgeList::const_iterator e = edges.begin(); e != edges.end(); ++e)
+	{
+		bool own_source = e->source / part == (unsigned)agent;
+		bool own_target = e->target / part == (unsigned)agent;
+		if(!own_source && !own_target)
+			continue;
+		unsigned other = own_source ? e->target : e->source;
+		if(other / part != (unsigned)agent && remote.insert(other).second)
+			solver.addRemoteNode(other, other / part, guess[other]);
+		solver.addConstraint(e->source, e->target, e->measurement, Covariance::Identity());
+	}
+	if(agent == 0)
+		solver.setFixed(0);
+}
+
+BOOST_AUTO_TEST_CASE(unix_socket_transport)
+{
+	UnixSocketTransport first(".", 1);
+	UnixSocketTransport second(".", 2, 1024);
+	BOOST_CHECK_EQUAL(first.getAgentId(), 1);
+	
+	std::vector<char> payload(100, 'x');
+	BOOST_CHECK(first.send(2, payload));
+	BOOST_CHECK(first.send(2, std::vector<char>()));
+	TransportMessage message;
+	BOOST_REQUIRE(second.receive(message, 1.0));
+	BOOST_CHECK_EQUAL(message.sender, 1);
+	BOOST_CHECK(message.payload == payload);
+	BOOST_REQUIRE(second.receive(message, 1.0));
+	BOOST_CHECK(message.payload.empty());
+	BOOST_CHECK(!second.receive(message, 0.01));
+	
+	// Unknown agents and oversized messages
+	BOOST_CHECK(!first.send(3, payload));
+	BOOST_CHECK_THROW(second.send(1, std::vector<char>(2048)), TransportError);
+	BOOST_CHECK_THROW(UnixSocketTransport(std::string(200, 'x'), 1), TransportError);
+}
+
+BOOST_AUTO_TEST_CASE(single_agent)
+{
+	Clock clock;
+	FileLogger logger(clock, "distributed_solver.log");
+	UnixSocketTransport transport(".", 0);
+	PoseList truth;
+	TestEdgeList edges;
+	createProblem(truth, edges, 30, 0.05);
+	PoseList guess = getOdometryGuess(edges);
+	
+	DistributedSolver distributed(&logger, &transport);
+	NativeSolver native(&logger);
+	fillSolver(distributed, 0, guess, edges, guess.size());
+	fillSolver(native, edges, guess.size());
+	
+	BOOST_REQUIRE(distributed.compute());
+	BOOST_REQUIRE(native.compute());
+	BOOST_CHECK_EQUAL(distributed.getLastRounds(), 1);
+	IdPoseVector corrections = distributed.getCorrections();
+	IdPoseVector expected = native.getCorrections();
+	BOOST_REQUIRE_EQUAL(corrections.size(), expected.size());
+	for(size_t i = 0; i < corrections.size(); i++)
+		BOOST_CHECK_SMALL(distance(corrections[i].second, expected[i].second), 1e-9);
+}
+
+static void runAgent(DistributedSolver* solver, bool* result)
+{
+	*result = solver->compute();
+}
+
+BOOST_AUTO_TEST_CASE(converges_to_full_solution)
+{
+	Clock clock;
+	FileLogger logger(clock, "distributed_solver.log");
+	PoseList truth;
+	TestEdgeList edges;
+	const unsigned nodes = 60, agents = 3;
+	createProblem(truth, edges, nodes, 0.05);
+	PoseList guess = getOdometryGuess(edges);
+	
+	NativeSolver native(&logger);
+	fillSolver(native, edges, nodes);
+	BOOST_REQUIRE(native.compute());
+	PoseList optimum = getPoses(native, nodes);
+	
+	DistributedSolverConfiguration config;
+	config.max_rounds = 200;
+	config.translation_tolerance = 1e-6;
+	config.rotation_tolerance = 1e-6;
+	std::vector<FileLogger*> loggers;
+	std::vector<UnixSocketTransport*> transports;
+	std::vector<DistributedSolver*> solvers;
+	for(unsigned a = 0; a < agents; a++)
+	{
+		loggers.push_back(new FileLogger(clock, (boost::format("distributed_agent_%1%.log") % a).str()));
+		transports.push_back(new UnixSocketTransport(".", a));
+		solvers.push_back(new DistributedSolver(loggers[a], transports[a], config));
+		fillSolver(*solvers[a], a, guess, edges, nodes / agents);
+	}
+	
+	bool results[agents];
+	std::vector<std::thread> threads;
+	for(unsigned a = 0; a < agents; a++)
+		threads.push_back(std::thread(runAgent, solvers[a], &results[a]));
+	for(unsigned a = 0; a < agents; a++)
+		threads[a].join();
+	
+	double max_error = 0;
+	size_t changed = 0;
+	for(unsigned a = 0; a < agents; a++)
+	{
+		BOOST_CHECK(results[a]);
+		BOOST_CHECK(solvers[a]->getLastRounds() > 1);
+		BOOST_CHECK(solvers[a]->getLastRounds() < config.max_rounds);
+		IdPoseVector poses = solvers[a]->getCorrections();
+		BOOST_CHECK_EQUAL(poses.size(), nodes / agents);
+		for(IdPoseVector::iterator p = poses.begin(); p != poses.end(); ++p)
+		{
+			BOOST_CHECK_EQUAL(p->first / (nodes / agents), a);
+			max_error = std::max(max_error, distance(p->second, optimum[p->first]));
+		}
+		changed += solvers[a]->getChangedPoses().size();
+	}
+	BOOST_CHECK_SMALL(max_error, 1e-3);
+	BOOST_CHECK(changed > nodes / 2);
+	
+	// A second call continues from the reached state
+	threads.clear();
+	for(unsigned a = 0; a < agents; a++)
+		threads.push_back(std::thread(runAgent, solvers[a], &results[a]));
+	for(unsigned a = 0; a < agents; a++)
+		threads[a].join();
+	for(unsigned a = 0; a < agents; a++)
+	{
+		BOOST_CHECK(results[a]);
+		BOOST_CHECK(solvers[a]->getLastRounds() <= 3);
+		delete solvers[a];
+		delete transports[a];
+		delete loggers[a];
+	}
+}
+
+BOOST_AUTO_TEST_CASE(missing_peer)
+{
+	Clock clock;
+	FileLogger logger(clock, "distributed_solver.log");
+	PoseList truth;
+	TestEdgeList edges;
+	createProblem(truth, edges, 20, 0.05);
+	PoseList guess = getOdometryGuess(edges);
+	
+	// The peer's socket exists, but nobody answers
+	UnixSocketTransport peer(".", 1);
+	UnixSocketTransport transport(".", 0);
+	DistributedSolverConfiguration config;
+	config.round_timeout = 0.1;
+	DistributedSolver solver(&logger, &transport, config);
+	fillSolver(solver, 0, guess, edges, 10);
+	
+	int64_t start = clock.monotonic();
+	BOOST_CHECK(solver.compute());
+	BOOST_CHECK((clock.monotonic() - start) / 1e9 < 1.0);
+	BOOST_CHECK_EQUAL(solver.getCorrections().size(), 10);
+	
+	// The peer received the poses of the separator nodes
+	TransportMessage message;
+	BOOST_CHECK(peer.receive(message, 0));
+	BOOST_CHECK_EQUAL(message.sender, 0);
+}
+
+BOOST_AUTO_TEST_CASE(diverged_sessions)
+{
+	Clock clock;
+	FileLogger logger(clock, "distributed_solver.log");
+	PoseList truth;
+	TestEdgeList edges;
+	const unsigned nodes = 40, agents = 2;
+	createProblem(truth, edges, nodes, 0.05);
+	PoseList guess = getOdometryGuess(edges);
+	
+	NativeSolver native(&logger);
+	fillSolver(native, edges, nodes);
+	BOOST_REQUIRE(native.compute());
+	PoseList optimum = getPoses(native, nodes);
+	
+	DistributedSolverConfiguration config;
+	config.max_rounds = 200;
+	config.round_timeout = 0.5;
+	config.translation_tolerance = 1e-6;
+	config.rotation_tolerance = 1e-6;
+	UnixSocketTransport transport_a(".", 0);
+	UnixSocketTransport transport_b(".", 1);
+	FileLogger logger_a(clock, "distributed_agent_0.log");
+	FileLogger logger_b(clock, "distributed_agent_1.log");
+	DistributedSolver a(&logger_a, &transport_a, config);
+	DistributedSolver b(&logger_b, &transport_b, config);
+	fillSolver(a, 0, guess, edges, nodes / agents);
+	fillSolver(b, 1, guess, edges, nodes / agents);
+	
+	// Agent 0 optimizes once alone, so it is one session ahead of agent 1
+	BOOST_CHECK(a.compute());
+	
+	// Agent 1 starts later and finds the messages of both sessions queued
+	bool results[agents];
+	std::thread thread_a(runAgent, &a, &results[0]);
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	std::thread thread_b(runAgent, &b, &results[1]);
+	thread_a.join();
+	thread_b.join();
+	BOOST_CHECK(results[0]);
+	BOOST_CHECK(results[1]);
+	BOOST_CHECK(a.getLastRounds() < config.max_rounds);
+	BOOST_CHECK(b.getLastRounds() < config.max_rounds);
+	
+	double max_error = 0;
+	DistributedSolver* solvers[agents] = {&a, &b};
+	for(unsigned s = 0; s < agents; s++)
+	{
+		IdPoseVector poses = solvers[s]->getCorrections();
+		for(IdPoseVector::iterator p = poses.begin(); p != poses.end(); ++p)
+			max_error = std::max(max_error, distance(p->second, optimum[p->first]));
+	}
+	BOOST_CHECK_SMALL(max_error, 1e-3);
+}
@@ -0,0 +1,257 @@
+#define BOOST_TEST_MODULE "ExternalBatchTest"
+
+#include <BoostMapper.hpp>
+#include <NativeSolver.hpp>
+#include <PoseGraphGenerator.hpp>
+#include <FileLogger.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+using namespace slam3d;
+
+static Measurement::Ptr createMeasurement(size_t sequence)
+{
+	timeval stamp;
+	stamp.tv_sec = sequence / 10;
+	stamp.tv_usec = (sequence % 10) * 100000;
+	Transform pose(Eigen::Translation<double, 3>(sequence, 0, 0));
+	return Measurement::Ptr(new SyntheticMeasurement("r2", "synthetic", stamp, sequence, pose));
+}
+
+// A chain starting at the root with a loop constraint every ten readings
+static void createMap(size_t size, ExternalReadingList& readings, ExternalConstraintList& constraints)
+{
+	Transform step(Eigen::Translation<double, 3>(1, 0, 0));
+	boost::uuids::uuid source = boost::uuids::nil_uuid();
+	for(size_t i = 0; i < size; i++)
+	{
+		ExternalReading r;
+		r.measurement = createMeasurement(i);
+		r.source = source;
+		r.transform = step;
+		r.covariance = Covariance::Identity();
+		r.sensor = "odom";
+		readings.push_back(r);
+		source = r.measurement->getUniqueId();
+
+		if(i >= 10 && i % 10 == 0)
+		{
+			ExternalConstraint c;
+			c.source = readings[i - 10].measurement->getUniqueId();
+			c.target = source;
+			c.transform = Transform(Eigen::Translation<double, 3>(10.1, 0, 0));
+			c.covariance = Covariance::Identity() * 2;
+			c.sensor = "loop";
+			constraints.push_back(c);
+		}
+	}
+}
+
+// Solver that can not take poses from the mapper
+class EstimateKeepingSolver : public NativeSolver
+{
+public:
+	EstimateKeepingSolver(Logger* logger) : NativeSolver(logger) {}
+	void setPose(unsigned id, const Transform& pose) { throw UnsupportedOperation("setPose"); }
+};
+
+static void checkEqualMaps(const BoostMapper& a, const BoostMapper& b)
+{
+	VertexObjectList va = a.getVertexObjectsFromSensor("synthetic");
+	VertexObjectList vb = b.getVertexObjectsFromSensor("synthetic");
+	BOOST_REQUIRE_EQUAL(va.size(), vb.size());
+	for(VertexObjectList::iterator v = va.begin(); v != va.end(); ++v)
+	{
+		const VertexObject& other = b.getVertex(v->measurement->getUniqueId());
+		BOOST_CHECK(other.corrected_pose.isApprox(v->corrected_pose));
+	}
+	BOOST_CHECK_EQUAL(a.getEdgeObjectsFromSensor("odom").size(), b.getEdgeObjectsFromSensor("odom").size());
+	BOOST_CHECK_EQUAL(a.getEdgeObjectsFromSensor("loop").size(), b.getEdgeObjectsFromSensor("loop").size());
+}
+
+BOOST_AUTO_TEST_CASE(batch_matches_single)
+{
+	Clock clock;
+	FileLogger logger(clock, "external_batch.log");
+	ExternalReadingList readings;
+	ExternalConstraintList constraints;
+	createMap(50, readings, constraints);
+
+	BoostMapper single(&logger);
+	for(ExternalReadingList::iterator r = readings.begin(); r != readings.end(); ++r)
+		single.addExternalReading(r->measurement, r->source, r->transform, r->covariance, r->sensor);
+	for(ExternalConstraintList::iterator c = constraints.begin(); c != constraints.end(); ++c)
+		single.addExternalConstraint(c->source, c->target, c->transform, c->covariance, c->sensor);
+
+	// Sources must be resolved within the batch, regardless of the order
+	std::mt19937 random(42);
+	std::shuffle(readings.begin(), readings.end(), random);
+	BoostMapper batch(&logger);
+	NativeSolver solver(&logger);
+	batch.setSolver(&solver);
+	ImportResult result = batch.addExternalReadings(readings);
+	BOOST_CHECK_EQUAL(result.added, 50);
+	BOOST_CHECK_EQUAL(result.duplicates, 0);
+	BOOST_CHECK_EQUAL(result.unresolved, 0);
+	result = batch.addExternalConstraints(constraints);
+	BOOST_CHECK_EQUAL(result.added, constraints.size());
+	checkEqualMaps(single, batch);
+	BOOST_CHECK(batch.optimize());
+}
+
+BOOST_AUTO_TEST_CASE(duplicates_and_unresolved)
+{
+	Clock clock;
+	FileLogger logger(clock, "external_batch.log");
+	ExternalReadingList readings;
+	ExternalConstraintList constraints;
+	createMap(20, readings, constraints);
+
+	BoostMapper mapper(&logger);
+	ExternalReadingList first(readings.begin(), readings.begin() + 10);
+	BOOST_CHECK_EQUAL(mapper.addExternalReadings(first).added, 10);
+
+	// Two readings that only refer to each other, one with an unknown source
+	ExternalReadingList batch(readings.begin() + 5, readings.end());
+	batch.push_back(readings[15]);
+	ExternalReading a = readings[0];
+	ExternalReading b = readings[0];
+	a.measurement = createMeasurement(100);
+	b.measurement = createMeasurement(101);
+	a.source = b.measurement->getUniqueId();
+	b.source = a.measurement->getUniqueId();
+	ExternalReading c = readings[0];
+	c.measurement = createMeasurement(102);
+	c.source = boost::uuids::random_generator()();
+	batch.push_back(a);
+	batch.push_back(b);
+	batch.push_back(c);
+
+	ImportResult result = mapper.addExternalReadings(batch);
+	BOOST_CHECK_EQUAL(result.added, 10);
+	BOOST_CHECK_EQUAL(result.duplicates, 6);
+	BOOST_CHECK_EQUAL(result.unresolved, 3);
+	BOOST_CHECK_EQUAL(mapper.getVertexObjectsFromSensor("synthetic").size(), 20);
+
+	constraints.push_back(constraints[0]);
+	constraints.push_back(constraints[0]);
+	constraints.back().target = c.measurement->getUniqueId();
+	result = mapper.addExternalConstraints(constraints);
+	BOOST_CHECK_EQUAL(result.added, 1);
+	BOOST_CHECK_EQUAL(result.duplicates, 1);
+	BOOST_CHECK_EQUAL(result.unresolved, 1);
+	BOOST_CHECK_THROW(mapper.addExternalConstraint(constraints[0].source, constraints[0].target,
+		constraints[0].transform, constraints[0].covariance, "loop"), DuplicateEdge);
+}
+
+BOOST_AUTO_TEST_CASE(export_since_revision)
+{
+	Clock clock;
+	FileLogger logger(clock, "external_batch.log");
+	ExternalReadingList readings;
+	ExternalConstraintList constraints;
+	createMap(40, readings, constraints);
+
+	BoostMapper original(&logger);
+	original.addExternalReadings(ExternalReadingList(readings.begin(), readings.begin() + 20));
+	original.addExternalConstraints(ExternalConstraintList(constraints.begin(), constraints.begin() + 1));
+
+	BoostMapper peer(&logger);
+	ExternalReadingList exported_readings;
+	ExternalConstraintList exported_constraints;
+	original.exportSince(0, exported_readings, exported_constraints);
+	BOOST_CHECK_EQUAL(exported_readings.size(), 20);
+	BOOST_CHECK_EQUAL(exported_constraints.size(), 1);
+	BOOST_CHECK_EQUAL(peer.addExternalReadings(exported_readings).added, 20);
+	BOOST_CHECK_EQUAL(peer.addExternalConstraints(exported_constraints).added, 1);
+	checkEqualMaps(original, peer);
+
+	// Only the changes after the revision are exported
+	unsigned revision = original.getRevision();
+	original.exportSince(revision, exported_readings, exported_constraints);
+	BOOST_CHECK(exported_readings.empty());
+	BOOST_CHECK(exported_constraints.empty());
+	original.addExternalReadings(ExternalReadingList(readings.begin() + 20, readings.end()));
+	original.addExternalConstraints(ExternalConstraintList(constraints.begin() + 1, constraints.end()));
+	original.exportSince(revision, exported_readings, exported_constraints);
+	BOOST_CHECK_EQUAL(exported_readings.size(), 20);
+	BOOST_CHECK_EQUAL(exported_constraints.size(), constraints.size() - 1);
+	BOOST_CHECK_EQUAL(peer.addExternalReadings(exported_readings).added, 20);
+	BOOST_CHECK_EQUAL(peer.addExternalConstraints(exported_constraints).added, constraints.size() - 1);
+	checkEqualMaps(original, peer);
+
+	// Exporting the same changes again only yields duplicates
+	original.exportSince(0, exported_readings, exported_constraints);
+	BOOST_CHECK_EQUAL(peer.addExternalReadings(exported_readings).duplicates, 40);
+	BOOST_CHECK_EQUAL(peer.addExternalConstraints(exported_constraints).duplicates, constraints.size());
+}
+
+BOOST_AUTO_TEST_CASE(sync_thousand_keyframes)
+{
+	Clock clock;
+	FileLogger logger(clock, "external_batch.log");
+	logger.setLogLevel(WARNING);
+	ExternalReadingList readings;
+	ExternalConstraintList constraints;
+	createMap(1000, readings, constraints);
+
+	BoostMapper original(&logger);
+	NativeSolver original_solver(&logger);
+	original.setSolver(&original_solver);
+	original.addExternalReadings(readings);
+	original.addExternalConstraints(constraints);
+
+	BoostMapper peer(&logger);
+	NativeSolver peer_solver(&logger);
+	peer.setSolver(&peer_solver);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	ExternalReadingList exported_readings;
+	ExternalConstraintList exported_constraints;
+	original.exportSince(0, exported_readings, exported_constraints);
+	peer.addExternalReadings(exported_readings);
+	peer.addExternalConstraints(exported_constraints);
+	double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	BOOST_TEST_MESSAGE("Synchronized 1000 keyframes in " << duration * 1000 << " ms");
+	BOOST_CHECK_EQUAL(peer.getVertexObjectsFromSensor("synthetic").size(), 1000);
+	BOOST_CHECK_LT(duration, 0.5);
+}
+
+static void checkUpdatedPoseIsOptimized(Logger* logger, Solver& solver)
+{
+	ExternalReadingList readings;
+	ExternalConstraintList constraints;
+	createMap(20, readings, constraints);
+	BoostMapper mapper(logger);
+	mapper.setSolver(&solver);
+	mapper.addExternalReadings(readings);
+	BOOST_REQUIRE(mapper.optimize());
+
+	// The last reading only has its odometry, so the optimization moves it back
+	boost::uuids::uuid last = readings.back().measurement->getUniqueId();
+	Transform optimized = mapper.getVertex(last).corrected_pose;
+	UuidPoseVector poses;
+	poses.push_back(UuidPose(last, Transform(Eigen::Translation<double, 3>(0, 1, 0)) * optimized));
+	BOOST_CHECK_EQUAL(mapper.updatePoses(poses), 1);
+	BOOST_REQUIRE(mapper.optimize());
+	Transform diff = optimized.inverse() * mapper.getVertex(last).corrected_pose;
+	BOOST_CHECK_SMALL(diff.translation().norm(), 1e-6);
+}
+
+BOOST_AUTO_TEST_CASE(update_poses)
+{
+	Clock clock;
+	FileLogger logger(clock, "external_batch.log");
+
+	// The solver continues from the updated pose
+	NativeSolver solver(&logger);
+	checkUpdatedPoseIsOptimized(&logger, solver);
+
+	// Without support, the mapper takes all poses from the solver
+	EstimateKeepingSolver keeping(&logger);
+	checkUpdatedPoseIsOptimized(&logger, keeping);
+}
@@ -0,0 +1,279 @@
+#define BOOST_TEST_MODULE "GraphDeltaTest"
+
+#include <GraphDelta.hpp>
+#include <LocalTransport.hpp>
+#include <BoostMapper.hpp>
+#include <PointCloudSensor.hpp>
+#include <FileLogger.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <random>
+
+using namespace slam3d;
+
+static PointCloudMeasurement::Ptr createMeasurement(unsigned points, unsigned sequence, std::mt19937& random)
+{
+	std::uniform_real_distribution<float> coordinate(-20, 20);
+	PointCloud::Ptr cloud(new PointCloud);
+	for(unsigned i = 0; i < points; i++)
+	{
+		PointType p;
+		p.x = coordinate(random);
+		p.y = coordinate(random);
+		p.z = coordinate(random) / 10;
+		cloud->push_back(p);
+	}
+	cloud->header.stamp = 100000 * (uint64_t)sequence;
+	return PointCloudMeasurement::Ptr(new PointCloudMeasurement(cloud, "r1", "pcl_sensor", Transform::Identity()));
+}
+
+// Extends a chain of readings that starts at the root
+static void addReadings(BoostMapper& mapper, unsigned count, unsigned points, std::mt19937& random)
+{
+	Transform step(Eigen::Translation<double, 3>(1, 0, 0));
+	VertexObjectList vertices = mapper.getVertexObjectsFromSensor("pcl_sensor");
+	boost::uuids::uuid source = boost::uuids::nil_uuid();
+	if(!vertices.empty())
+		source = vertices.back().measurement->getUniqueId();
+	ExternalReadingList readings;
+	for(unsigned i = 0; i < count; i++)
+	{
+		ExternalReading r;
+		r.measurement = createMeasurement(points, vertices.size() + i, random);
+		r.source = source;
+		r.transform = step;
+		r.covariance = Covariance::Identity() * 0.01;
+		r.sensor = "odom";
+		readings.push_back(r);
+		source = r.measurement->getUniqueId();
+	}
+	mapper.addExternalReadings(readings);
+}
+
+BOOST_AUTO_TEST_CASE(point_cloud_compression)
+{
+	std::mt19937 random(1);
+	PointCloudMeasurement::Ptr m = createMeasurement(1000, 0, random);
+	m->getPointCloud()->points[10].x = std::numeric_limits<float>::quiet_NaN();
+
+	double resolution = 0.005;
+	size_t size = m->getCompressedPayloadSize(resolution);
+	BOOST_CHECK_LT(size, m->getPayloadSize() / 2);
+	std::vector<char> buffer(size);
+	m->writeCompressedPayload(&buffer[0], resolution);
+
+	PointCloudMeasurement restored("r1", "pcl_sensor", Transform::Identity(), m->getUniqueId(), m->getTimestamp());
+	restored.readCompressedPayload(&buffer[0], size, resolution);
+	BOOST_REQUIRE(restored.getPointCloud());
+	const PointCloud& original = *m->getPointCloud();
+	const PointCloud& cloud = *restored.getPointCloud();
+	BOOST_REQUIRE_EQUAL(cloud.size(), original.size());
+	BOOST_CHECK(std::isnan(cloud.points[10].x));
+	for(unsigned i = 0; i < cloud.size(); i++)
+	{
+		if(i == 10)
+			continue;
+		BOOST_CHECK_SMALL(cloud.points[i].x - original.points[i].x, 1.01f * (float)resolution);
+		BOOST_CHECK_SMALL(cloud.points[i].y - original.points[i].y, 1.01f * (float)resolution);
+		BOOST_CHECK_SMALL(cloud.points[i].z - original.points[i].z, 1.01f * (float)resolution);
+	}
+	BOOST_CHECK_THROW(restored.readCompressedPayload(&buffer[0], size - 1, resolution), BadMeasurementType);
+}
+
+BOOST_AUTO_TEST_CASE(large_cloud_compression)
+{
+	// The extent exceeds 65534 steps of twice the resolution
+	std::mt19937 random(2);
+	PointCloudMeasurement::Ptr m = createMeasurement(100, 0, random);
+	m->getPointCloud()->points[0].x = 1000;
+
+	double resolution = 0.005;
+	size_t size = m->getCompressedPayloadSize(resolution);
+	std::vector<char> buffer(size);
+	m->writeCompressedPayload(&buffer[0], resolution);
+
+	PointCloudMeasurement restored("r1", "pcl_sensor", Transform::Identity(), m->getUniqueId(), m->getTimestamp());
+	restored.readCompressedPayload(&buffer[0], size, resolution);
+	BOOST_REQUIRE(restored.getPointCloud());
+	const PointCloud& original = *m->getPointCloud();
+	const PointCloud& cloud = *restored.getPointCloud();
+	BOOST_REQUIRE_EQUAL(cloud.size(), original.size());
+
+	// The step grows to fit the extent instead of clamping the far point
+	float error = 0.51f * 1020.0f / 65534;
+	for(unsigned i = 0; i < cloud.size(); i++)
+	{
+		BOOST_CHECK_SMALL(cloud.points[i].x - original.points[i].x, error);
+		BOOST_CHECK_SMALL(cloud.points[i].y - original.points[i].y, error);
+		BOOST_CHECK_SMALL(cloud.points[i].z - original.points[i].z, error);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(encode_and_decode)
+{
+	Clock clock;
+	FileLogger logger(clock, "graph_delta.log");
+	PointCloudSensor sensor("pcl_sensor", &logger, Transform::Identity());
+	std::mt19937 random(2);
+
+	GraphDelta delta;
+	delta.base_revision = 3;
+	delta.revision = 12;
+	for(unsigned i = 0; i < 5; i++)
+	{
+		ExternalReading r;
+		r.measurement = createMeasurement(100, i, random);
+		r.source = i ? delta.readings.back().measurement->getUniqueId() : boost::uuids::nil_uuid();
+		r.transform = Transform(Eigen::Translation<double, 3>(1, 0.1 * i, 0) * Eigen::AngleAxisd(0.1, Vector3::UnitZ()));
+		r.covariance = Covariance::Identity() * (i + 1);
+		r.covariance(0, 5) = r.covariance(5, 0) = 0.1;
+		r.sensor = "odom";
+		delta.readings.push_back(r);
+	}
+	ExternalConstraint c;
+	c.source = delta.readings[0].measurement->getUniqueId();
+	c.target = delta.readings[4].measurement->getUniqueId();
+	c.transform = Transform(Eigen::Translation<double, 3>(4, 0, 0));
+	c.covariance = Covariance::Identity() * 2;
+	c.sensor = "loop";
+	delta.constraints.push_back(c);
+	delta.poses.push_back(UuidPose(c.target, c.transform));
+
+	// Encode into a preallocated buffer of the exact size
+	DeltaEncoder encoder(DELTA_RAW_PAYLOAD);
+	size_t size = encoder.getEncodedSize(delta);
+	std::vector<char> buffer(size);
+	BOOST_CHECK_EQUAL(encoder.encode(delta, &buffer[0], buffer.size()), size);
+	BOOST_CHECK_THROW(encoder.encode(delta, &buffer[0], size - 1), SerializationError);
+	std::vector<char> appended;
+	encoder.encode(delta, appended);
+	BOOST_CHECK(appended == buffer);
+
+	DeltaDecoder decoder;
+	decoder.registerSensor(&sensor);
+	GraphDelta decoded;
+	decoder.decode(&buffer[0], buffer.size(), decoded);
+	BOOST_CHECK_EQUAL(decoded.base_revision, 3);
+	BOOST_CHECK_EQUAL(decoded.revision, 12);
+	BOOST_REQUIRE_EQUAL(decoded.readings.size(), 5);
+	for(unsigned i = 0; i < 5; i++)
+	{
+		const ExternalReading& a = delta.readings[i];
+		const ExternalReading& b = decoded.readings[i];
+		BOOST_CHECK(a.measurement->getUniqueId() == b.measurement->getUniqueId());
+		BOOST_CHECK_EQUAL(b.measurement->getRobotName(), "r1");
+		BOOST_CHECK_EQUAL(b.measurement->getSensorName(), "pcl_sensor");
+		BOOST_CHECK_EQUAL(b.measurement->getTimestamp().tv_sec, a.measurement->getTimestamp().tv_sec);
+		BOOST_CHECK_EQUAL(b.measurement->getTimestamp().tv_usec, a.measurement->getTimestamp().tv_usec);
+		BOOST_CHECK(a.source == b.source);
+		BOOST_CHECK(a.transform.isApprox(b.transform));
+		BOOST_CHECK(a.covariance.isApprox(b.covariance));
+		BOOST_CHECK_EQUAL(b.sensor, "odom");
+
+		PointCloudMeasurement::Ptr cloud = boost::dynamic_pointer_cast<PointCloudMeasurement>(b.measurement);
+		BOOST_REQUIRE(cloud && cloud->getPointCloud());
+		BOOST_CHECK_EQUAL(cloud->getPayloadSize(), a.measurement->getPayloadSize());
+	}
+	BOOST_REQUIRE_EQUAL(decoded.constraints.size(), 1);
+	BOOST_CHECK(decoded.constraints[0].target == c.target);
+	BOOST_CHECK_EQUAL(decoded.constraints[0].sensor, "loop");
+	BOOST_REQUIRE_EQUAL(decoded.poses.size(), 1);
+	BOOST_CHECK(decoded.poses[0].second.isApprox(c.transform));
+
+	// Without the sensor, the measurements have no point clouds
+	DeltaDecoder generic;
+	generic.decode(&buffer[0], buffer.size(), decoded);
+	BOOST_CHECK(!boost::dynamic_pointer_cast<PointCloudMeasurement>(decoded.readings[0].measurement));
+
+	// Corrupted buffers are detected
+	BOOST_CHECK_THROW(decoder.decode(&buffer[0], buffer.size() - 1, decoded), SerializationError);
+	buffer[0] = 'X';
+	BOOST_CHECK_THROW(decoder.decode(&buffer[0], buffer.size(), decoded), SerializationError);
+}
+
+// Sends the changes of the sender since the last sync and applies them at the receiver
+static double synchronize(BoostMapper& sender, BoostMapper& receiver, uint32_t& revision,
+                          DeltaEncoder& encoder, const DeltaDecoder& decoder,
+                          LocalTransport& out, LocalTransport& in, std::vector<char>& buffer)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	GraphDelta delta;
+	delta.base_revision = revision;
+	delta.revision = sender.getRevision();
+	sender.exportSince(revision, delta.readings, delta.constraints);
+	for(ExternalReadingList::iterator r = delta.readings.begin(); r != delta.readings.end(); ++r)
+	{
+		boost::uuids::uuid id = r->measurement->getUniqueId();
+		delta.poses.push_back(UuidPose(id, sender.getVertex(id).corrected_pose));
+	}
+
+	// The buffer is only grown, so it is reused between synchronizations
+	size_t size = encoder.getEncodedSize(delta);
+	if(buffer.size() < size)
+		buffer.resize(size);
+	size = encoder.encode(delta, &buffer[0], buffer.size());
+	BOOST_REQUIRE(out.send(in.getAgentId(), std::vector<char>(buffer.begin(), buffer.begin() + size)));
+
+	TransportMessage message;
+	BOOST_REQUIRE(in.receive(message, 1.0));
+	GraphDelta received;
+	decoder.decode(&message.payload[0], message.payload.size(), received);
+	BOOST_CHECK_EQUAL(received.base_revision, revision);
+	ImportResult result = receiver.addExternalReadings(received.readings);
+	BOOST_CHECK_EQUAL(result.added, delta.readings.size());
+	BOOST_CHECK_EQUAL(receiver.addExternalConstraints(received.constraints).unresolved, 0);
+	BOOST_CHECK_EQUAL(receiver.updatePoses(received.poses), received.poses.size());
+	revision = received.revision;
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+BOOST_AUTO_TEST_CASE(sync_over_local_transport)
+{
+	Clock clock;
+	FileLogger logger(clock, "graph_delta.log");
+	logger.setLogLevel(WARNING);
+	PointCloudSensor sensor("pcl_sensor", &logger, Transform::Identity());
+	DeltaDecoder decoder;
+	decoder.registerSensor(&sensor);
+	std::mt19937 random(3);
+
+	const unsigned keyframes = 100;
+	const unsigned points = 5000;
+	DeltaPayload modes[2] = {DELTA_RAW_PAYLOAD, DELTA_COMPRESSED_PAYLOAD};
+	size_t bytes[2];
+	for(unsigned i = 0; i < 2; i++)
+	{
+		LocalNetwork network;
+		LocalTransport transport_a(network, 1);
+		LocalTransport transport_b(network, 2);
+		BoostMapper robot_a(&logger);
+		BoostMapper robot_b(&logger);
+		DeltaEncoder encoder(modes[i]);
+		std::vector<char> buffer;
+		uint32_t revision = 0;
+
+		// Synchronize in two steps, the second only contains the new keyframes
+		addReadings(robot_a, keyframes / 2, points, random);
+		double duration = synchronize(robot_a, robot_b, revision, encoder, decoder, transport_a, transport_b, buffer);
+		addReadings(robot_a, keyframes / 2, points, random);
+		duration += synchronize(robot_a, robot_b, revision, encoder, decoder, transport_a, transport_b, buffer);
+		bytes[i] = network.getSentBytes();
+
+		BOOST_TEST_MESSAGE((i ? "Compressed" : "Raw") << " sync: " << bytes[i] / keyframes << " bytes and "
+			<< duration * 1e6 / keyframes << " us per keyframe with " << points << " points");
+
+		VertexObjectList vertices = robot_a.getVertexObjectsFromSensor("pcl_sensor");
+		BOOST_REQUIRE_EQUAL(robot_b.getVertexObjectsFromSensor("pcl_sensor").size(), keyframes);
+		for(VertexObjectList::iterator v = vertices.begin(); v != vertices.end(); ++v)
+		{
+			const VertexObject& synced = robot_b.getVertex(v->measurement->getUniqueId());
+			BOOST_CHECK(synced.corrected_pose.isApprox(v->corrected_pose));
+			BOOST_CHECK_EQUAL(synced.measurement->getPayloadSize(), v->measurement->getPayloadSize());
+		}
+	}
+	BOOST_CHECK_LT(bytes[1], bytes[0] / 2);
+}
@@ -0,0 +1,177 @@
+#define BOOST_TEST_MODULE "JournalTest"
+
+#include <BoostMapper.hpp>
+#include <PointCloudSensor.hpp>
+#include <FileLogger.hpp>
+#include "MeasurementFixture.hpp"
+
+#include <boost/test/unit_test.hpp>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+
+using namespace slam3d;
+
+std::vector<boost::uuids::uuid> buildMap(BoostMapper& mapper, unsigned first, unsigned size, boost::uuids::uuid source)
+{
+	Transform step(Eigen::Translation<double, 3>(1,0,0));
+	Covariance cov = Covariance::Identity();
+	std::vector<boost::uuids::uuid> ids;
+	for(unsigned i = first; i < first + size; i++)
+	{
+		PointCloudMeasurement::Ptr m = createMeasurement(100 + i, i);
+		mapper.addExternalReading(m, source, step, cov, "odom");
+		source = m->getUniqueId();
+		ids.push_back(source);
+	}
+	return ids;
+}
+
+BOOST_AUTO_TEST_CASE(record_and_replay)
+{
+	Clock clock;
+	FileLogger logger(clock, "journal.log");
+	logger.setLogLevel(DEBUG);
+	std::remove("test.journal");
+	
+	PointCloudSensor sensor("pcl_sensor", &logger, Transform::Identity());
+	BoostMapper original(&logger);
+	original.registerSensor(&sensor);
+	{
+		Journal journal(&logger, "test.journal");
+		journal.setWritePayloads(true);
+		original.setJournal(&journal);
+		std::vector<boost::uuids::uuid> ids = buildMap(original, 0, 20, boost::uuids::nil_uuid());
+		original.addExternalConstraint(ids[0], ids[19], Transform(Eigen::Translation<double, 3>(19,0,0)), Covariance::Identity(), "loop");
+		BOOST_CHECK(journal.commit());
+		BOOST_CHECK(journal.getWrittenSize() > 0);
+		BOOST_TEST_MESSAGE("Recording took " << journal.getRecordingTime() / 41 << " us per record, "
+			<< journal.getNumberOfCommits() << " commits with " << journal.getWrittenSize() << " bytes.");
+		original.setJournal(NULL);
+	}
+	
+	BoostMapper restored(&logger);
+	restored.registerSensor(&sensor);
+	BOOST_REQUIRE(restored.replayJournal("test.journal"));
+	
+	VertexObjectList v1 = original.getVertexObjectsFromSensor("pcl_sensor");
+	VertexObjectList v2 = restored.getVertexObjectsFromSensor("pcl_sensor");
+	BOOST_REQUIRE_EQUAL(v2.size(), v1.size());
+	for(unsigned i = 0; i < v1.size(); i++)
+	{
+		const VertexObject& v = restored.getVertex(v1[i].index);
+		BOOST_CHECK(v.measurement->getUniqueId() == v1[i].measurement->getUniqueId());
+		BOOST_CHECK(v.corrected_pose.isApprox(v1[i].corrected_pose));
+		PointCloudMeasurement::Ptr cloud = boost::dynamic_pointer_cast<PointCloudMeasurement>(v.measurement);
+		BOOST_REQUIRE(cloud && cloud->getPointCloud());
+		BOOST_CHECK_EQUAL(cloud->getPointCloud()->size(), 100 + i);
+	}
+	BOOST_CHECK_EQUAL(restored.getEdgeObjectsFromSensor("").size(), original.getEdgeObjectsFromSensor("").size());
+	
+	// Replaying again must not duplicate anything
+	BOOST_REQUIRE(restored.replayJournal("test.journal"));
+	BOOST_CHECK_EQUAL(restored.getVertexObjectsFromSensor("pcl_sensor").size(), v1.size());
+	BOOST_CHECK_EQUAL(restored.getEdgeObjectsFromSensor("").size(), original.getEdgeObjectsFromSensor("").size());
+}
+
+BOOST_AUTO_TEST_CASE(truncated_journal)
+{
+	Clock clock;
+	FileLogger logger(clock, "journal.log");
+	std::remove("truncated.journal");
+	
+	PointCloudSensor sensor("pcl_sensor", &logger, Transform::Identity());
+	BoostMapper original(&logger);
+	original.registerSensor(&sensor);
+	{
+		Journal journal(&logger, "truncated.journal");
+		original.setJournal(&journal);
+		buildMap(original, 0, 5, boost::uuids::nil_uuid());
+		original.setJournal(NULL);
+	}
+	
+	// Cut the last record in half, as if writing was interrupted
+	std::ifstream in("truncated.journal", std::ios::binary);
+	std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	in.close();
+	std::ofstream out("truncated.journal", std::ios::binary | std::ios::trunc);
+	out.write(content.data(), content.size() - 20);
+	out.close();
+	
+	BoostMapper restored(&logger);
+	restored.registerSensor(&sensor);
+	BOOST_REQUIRE(restored.replayJournal("truncated.journal"));
+	BOOST_CHECK_EQUAL(restored.getVertexObjectsFromSensor("pcl_sensor").size(), 5);
+	BOOST_CHECK_EQUAL(restored.getEdgeObjectsFromSensor("odom").size(), 8);
+}
+
+BOOST_AUTO_TEST_CASE(append_after_truncation)
+{
+	Clock clock;
+	FileLogger logger(clock, "journal.log");
+	std::remove("append.journal");
+	{
+		Journal journal(&logger, "append.journal");
+		journal.removeVertex(1);
+		journal.removeVertex(2);
+		BOOST_CHECK(journal.commit());
+	}
+	
+	// Cut the last record, then append to the damaged journal
+	std::ifstream in("append.journal", std::ios::binary);
+	std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	in.close();
+	std::ofstream out("append.journal", std::ios::binary | std::ios::trunc);
+	out.write(content.data(), content.size() - 2);
+	out.close();
+	{
+		Journal journal(&logger, "append.journal");
+		journal.removeVertex(3);
+		BOOST_CHECK(journal.commit());
+	}
+	
+	JournalReader reader("append.journal");
+	std::vector<uint32_t> removed;
+	JournalRecordType type;
+	const char* data;
+	size_t size;
+	while(reader.next(type, data, size))
+	{
+		BOOST_REQUIRE_EQUAL(type, JOURNAL_REMOVAL);
+		BOOST_REQUIRE_EQUAL(size, sizeof(uint32_t));
+		uint32_t id;
+		memcpy(&id, data, sizeof(id));
+		removed.push_back(id);
+	}
+	BOOST_CHECK(!reader.isTruncated());
+	BOOST_REQUIRE_EQUAL(removed.size(), 2);
+	BOOST_CHECK_EQUAL(removed[0], 1);
+	BOOST_CHECK_EQUAL(removed[1], 3);
+}
+
+BOOST_AUTO_TEST_CASE(replay_after_session)
+{
+	Clock clock;
+	FileLogger logger(clock, "journal.log");
+	std::remove("session.journal");
+	
+	PointCloudSensor sensor("pcl_sensor", &logger, Transform::Identity());
+	BoostMapper original(&logger);
+	original.registerSensor(&sensor);
+	Journal* journal = new Journal(&logger, "session.journal");
+	journal->setWritePayloads(true);
+	original.setJournal(journal);
+	std::vector<boost::uuids::uuid> ids = buildMap(original, 0, 5, boost::uuids::nil_uuid());
+	BOOST_REQUIRE(original.saveSession("journal.session"));
+	buildMap(original, 5, 5, ids.back());
+	original.setJournal(NULL);
+	delete journal;
+	
+	BoostMapper restored(&logger);
+	restored.registerSensor(&sensor);
+	BOOST_REQUIRE(restored.loadSession("journal.session"));
+	BOOST_CHECK_EQUAL(restored.getVertexObjectsFromSensor("pcl_sensor").size(), 5);
+	BOOST_REQUIRE(restored.replayJournal("session.journal"));
+	BOOST_CHECK_EQUAL(restored.getVertexObjectsFromSensor("pcl_sensor").size(), 10);
+	BOOST_CHECK_EQUAL(restored.getEdgeObjectsFromSensor("").size(), original.getEdgeObjectsFromSensor("").size());
+}
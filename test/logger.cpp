@@ -0,0 +1,42 @@
+#define BOOST_TEST_MODULE "LoggerTest"
+
+#include <Logger.hpp>
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+
+using namespace slam3d;
+
+class RecordingLogger : public Logger
+{
+public:
+	RecordingLogger() : Logger(Clock()) {}
+	void message(LOG_LEVEL lvl, const std::string& message) { messages.push_back(message); }
+	std::vector<std::string> messages;
+};
+
+static unsigned evaluated = 0;
+
+std::string expensiveMessage()
+{
+	evaluated++;
+	return "expensive";
+}
+
+BOOST_AUTO_TEST_CASE(lazy_formatting)
+{
+	RecordingLogger logger;
+	logger.setLogLevel(WARNING);
+	BOOST_CHECK(!logger.isEnabled(INFO));
+	BOOST_CHECK(logger.isEnabled(ERROR));
+	
+	SLAM3D_LOG(&logger, DEBUG, expensiveMessage());
+	SLAM3D_LOG(&logger, INFO, expensiveMessage());
+	BOOST_CHECK_EQUAL(evaluated, 0);
+	BOOST_CHECK(logger.messages.empty());
+	
+	SLAM3D_LOG(&logger, WARNING, expensiveMessage());
+	BOOST_CHECK_EQUAL(evaluated, 1);
+	BOOST_REQUIRE_EQUAL(logger.messages.size(), 1);
+	BOOST_CHECK_EQUAL(logger.messages[0], "expensive");
+}
@@ -0,0 +1,214 @@
+#define BOOST_TEST_MODULE "MapMergerTest"
+
+#include <MapMerger.hpp>
+#include <BoostMapper.hpp>
+#include <NativeSolver.hpp>
+#include <PoseGraphGenerator.hpp>
+#include <AsyncFileLogger.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <set>
+#include <thread>
+
+using namespace slam3d;
+
+// Matches synthetic measurements within a range, each match takes some time
+class OverlapSensor : public Sensor
+{
+public:
+	OverlapSensor(Logger* l, double range, unsigned delay)
+	 : Sensor("synthetic", l, Transform::Identity()), mRange(range), mDelay(delay) {}
+
+	TransformWithCovariance calculateTransform(Measurement::Ptr source, Measurement::Ptr target, Transform odometry, bool coarse) const
+	{
+		SyntheticMeasurement::Ptr s = boost::dynamic_pointer_cast<SyntheticMeasurement>(source);
+		SyntheticMeasurement::Ptr t = boost::dynamic_pointer_cast<SyntheticMeasurement>(target);
+		if(!s || !t)
+			throw BadMeasurementType();
+		std::this_thread::sleep_for(std::chrono::microseconds(mDelay));
+
+		TransformWithCovariance twc;
+		twc.transform = s->getGroundTruth().inverse() * t->getGroundTruth();
+		twc.covariance = Covariance::Identity() * 0.01;
+		if(twc.transform.translation().norm() > mRange)
+			throw NoMatch("measurements do not overlap");
+		return twc;
+	}
+
+	Measurement::Ptr createCombinedMeasurement(const VertexObjectList& vertices, Transform pose) const
+	{
+		throw BadMeasurementType();
+	}
+
+protected:
+	double mRange;
+	unsigned mDelay;
+};
+
+// Synthetic measurement whose data has been released
+class ReleasedMeasurement : public SyntheticMeasurement
+{
+public:
+	ReleasedMeasurement(const std::string& r, const timeval& stamp, size_t sequence, const Transform& pose)
+	 : SyntheticMeasurement(r, "synthetic", stamp, sequence, pose) {}
+
+	bool hasPayload() const { return false; }
+};
+
+// Adds a straight trajectory of a robot starting at the given pose, linked to the root
+static std::vector<boost::uuids::uuid> addTrajectory(GraphMapper& mapper, const std::string& robot,
+                                                     const Transform& start, unsigned count, unsigned& sequence)
+{
+	ExternalReadingList readings;
+	std::vector<boost::uuids::uuid> ids;
+	Transform step(Eigen::Translation<double, 3>(1, 0, 0));
+	Transform pose = start;
+	boost::uuids::uuid source = boost::uuids::nil_uuid();
+	for(unsigned i = 0; i < count; i++, sequence++)
+	{
+		timeval stamp;
+		stamp.tv_sec = sequence;
+		stamp.tv_usec = 0;
+		ExternalReading r;
+		r.measurement.reset(new SyntheticMeasurement(robot, "synthetic", stamp, sequence, pose));
+		r.source = source;
+		r.transform = i ? step : start;
+		r.covariance = Covariance::Identity() * 0.01;
+		r.sensor = "odom";
+		readings.push_back(r);
+		source = r.measurement->getUniqueId();
+		ids.push_back(source);
+		pose = pose * step;
+	}
+	mapper.addExternalReadings(readings);
+	return ids;
+}
+
+BOOST_AUTO_TEST_CASE(merge_two_robots)
+{
+	Clock clock;
+	AsyncFileLogger logger(clock, "map_merger.log");
+	OverlapSensor sensor(&logger, 2.5, 0);
+	BoostMapper mapper(&logger);
+	NativeSolver solver(&logger);
+	mapper.setSolver(&solver);
+	mapper.registerSensor(&sensor);
+
+	// Robot b drives parallel to robot a with an offset of two meters
+	unsigned sequence = 0;
+	std::vector<boost::uuids::uuid> a = addTrajectory(mapper, "a", Transform::Identity(), 20, sequence);
+	std::vector<boost::uuids::uuid> b = addTrajectory(mapper, "b", Transform(Eigen::Translation<double, 3>(5, 2, 0)), 20, sequence);
+
+	MapMergerConfiguration config;
+	config.search_radius = 3;
+	config.max_candidates = 2;
+	MapMerger merger(&logger, &sensor, config);
+
+	// The last keyframes of robot b have fewer candidates, as robot a ends before
+	BOOST_CHECK_EQUAL(merger.prepare(mapper, b), 33);
+	BOOST_CHECK_EQUAL(merger.evaluate(), 31);
+	std::set<boost::uuids::uuid> ids_a(a.begin(), a.end());
+	std::set<boost::uuids::uuid> ids_b(b.begin(), b.end());
+	const ExternalConstraintList& constraints = merger.getConstraints();
+	for(ExternalConstraintList::const_iterator c = constraints.begin(); c != constraints.end(); ++c)
+	{
+		BOOST_CHECK(ids_a.count(c->source));
+		BOOST_CHECK(ids_b.count(c->target));
+		const VertexObject& source = mapper.getVertex(c->source);
+		const VertexObject& target = mapper.getVertex(c->target);
+		BOOST_CHECK(c->transform.isApprox(source.corrected_pose.inverse() * target.corrected_pose));
+	}
+	ImportResult result = merger.commit(mapper);
+	BOOST_CHECK_EQUAL(result.added, 31);
+	BOOST_CHECK(mapper.optimize());
+
+	// A second merge of the same keyframes only finds the existing constraints
+	result = merger.merge(mapper, b);
+	BOOST_CHECK_EQUAL(result.added, 0);
+	BOOST_CHECK_EQUAL(result.duplicates, 31);
+}
+
+BOOST_AUTO_TEST_CASE(merge_in_background)
+{
+	Clock clock;
+	AsyncFileLogger logger(clock, "map_merger.log");
+	OverlapSensor sensor(&logger, 4, 2000);
+	BoostMapper mapper(&logger);
+	mapper.registerSensor(&sensor);
+
+	unsigned sequence = 0;
+	addTrajectory(mapper, "a", Transform::Identity(), 50, sequence);
+	std::vector<boost::uuids::uuid> b = addTrajectory(mapper, "b", Transform(Eigen::Translation<double, 3>(0, 1, 0)), 50, sequence);
+
+	// Single-threaded reference
+	MapMergerConfiguration config;
+	config.threads = 1;
+	MapMerger serial(&logger, &sensor, config);
+	size_t candidates = serial.prepare(mapper, b);
+	BOOST_REQUIRE_EQUAL(candidates, 150);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t verified = serial.evaluate();
+	double serial_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	// Match on a background thread, while the robot keeps mapping
+	config.threads = 4;
+	MapMerger parallel(&logger, &sensor, config);
+	BOOST_REQUIRE_EQUAL(parallel.prepare(mapper, b), candidates);
+	start = std::chrono::steady_clock::now();
+	std::thread background([&parallel](){ parallel.evaluate(); });
+	addTrajectory(mapper, "c", Transform(Eigen::Translation<double, 3>(0, -1, 0)), 50, sequence);
+	double mapping_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	background.join();
+	double parallel_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	BOOST_TEST_MESSAGE("Matched " << candidates << " candidates in " << serial_time * 1000 << " ms with 1 thread and "
+		<< parallel_time * 1000 << " ms with 4 threads, mapping took " << mapping_time * 1000 << " ms");
+	BOOST_CHECK_EQUAL(parallel.getConstraints().size(), verified);
+	BOOST_CHECK_LT(parallel_time, serial_time / 2);
+	BOOST_CHECK_LT(mapping_time, serial_time / 10);
+	BOOST_CHECK_EQUAL(parallel.commit(mapper).added, verified);
+}
+
+BOOST_AUTO_TEST_CASE(missing_payload)
+{
+	Clock clock;
+	AsyncFileLogger logger(clock, "map_merger.log");
+	OverlapSensor sensor(&logger, 2.5, 0);
+	BoostMapper mapper(&logger);
+	mapper.registerSensor(&sensor);
+
+	unsigned sequence = 0;
+	addTrajectory(mapper, "a", Transform::Identity(), 10, sequence);
+	std::vector<boost::uuids::uuid> b = addTrajectory(mapper, "b", Transform(Eigen::Translation<double, 3>(0, 1, 0)), 5, sequence);
+
+	// A keyframe of robot b without data must not become a candidate
+	timeval stamp;
+	stamp.tv_sec = sequence;
+	stamp.tv_usec = 0;
+	ExternalReadingList readings;
+	ExternalReading r;
+	r.measurement.reset(new ReleasedMeasurement("b", stamp, sequence, Transform(Eigen::Translation<double, 3>(5, 1, 0))));
+	r.source = b.back();
+	r.transform = Transform(Eigen::Translation<double, 3>(1, 0, 0));
+	r.covariance = Covariance::Identity() * 0.01;
+	r.sensor = "odom";
+	readings.push_back(r);
+	mapper.addExternalReadings(readings);
+
+	Metrics metrics(&clock);
+	metrics.setEnabled(true);
+	MapMergerConfiguration config;
+	config.search_radius = 3;
+	config.max_candidates = 2;
+	MapMerger merger(&logger, &sensor, config);
+	merger.setMetrics(&metrics);
+	std::vector<boost::uuids::uuid> incoming(1, r.measurement->getUniqueId());
+	BOOST_CHECK_EQUAL(merger.prepare(mapper, incoming), 0);
+	BOOST_CHECK_EQUAL(metrics.getCounters()["merger.missing_payloads"], 1);
+	
+	b.push_back(r.measurement->getUniqueId());
+	BOOST_CHECK_EQUAL(merger.prepare(mapper, b), 10);
+	BOOST_CHECK_EQUAL(merger.evaluate(), 10);
+}
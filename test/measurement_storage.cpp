@@ -0,0 +1,143 @@
+#define BOOST_TEST_MODULE "MeasurementStorageTest"
+
+#include <MeasurementStorage.hpp>
+#include <PointCloudSensor.hpp>
+#include <FileLogger.hpp>
+#include "MeasurementFixture.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace slam3d;
+
+BOOST_AUTO_TEST_CASE(eviction)
+{
+	Clock clock;
+	FileLogger logger(clock, "measurement_storage.log");
+	logger.setLogLevel(DEBUG);
+	
+	std::vector<PointCloudMeasurement::Ptr> measurements;
+	for(unsigned i = 0; i < 10; i++)
+	{
+		measurements.push_back(createMeasurement(1000, i));
+	}
+	size_t size = measurements[0]->getPayloadSize();
+	BOOST_CHECK(size >= 1000 * sizeof(PointType));
+	
+	// Keep only three measurements in memory
+	MeasurementStorage storage(&logger, "measurement_storage.arena", 3 * size);
+	for(unsigned i = 0; i < measurements.size(); i++)
+	{
+		storage.add(measurements[i], Vector3(i, 0, 0));
+	}
+	BOOST_CHECK_EQUAL(storage.getNumberOfMeasurements(), 10);
+	BOOST_CHECK_EQUAL(storage.getNumberOfResidentMeasurements(), 3);
+	BOOST_CHECK(storage.getResidentSize() <= 3 * size);
+	BOOST_CHECK_EQUAL(storage.getStoredSize(), 7 * size);
+	
+	// Oldest measurements have been evicted
+	BOOST_CHECK(!measurements[0]->hasPayload());
+	BOOST_CHECK(measurements[9]->hasPayload());
+	BOOST_CHECK(!measurements[0]->getPointCloud());
+	
+	// Loading restores the original points
+	storage.load(measurements[0]);
+	BOOST_REQUIRE(measurements[0]->hasPayload());
+	PointCloud::Ptr cloud = measurements[0]->getPointCloud();
+	BOOST_CHECK_EQUAL(cloud->size(), 1000);
+	BOOST_CHECK_EQUAL(cloud->points[10].x, 10);
+	BOOST_CHECK_EQUAL(cloud->points[10].y, -10);
+	
+	// Least recently used measurement is evicted
+	storage.enforceBudget(Vector3(0, 0, 0));
+	BOOST_CHECK_EQUAL(storage.getStoredSize(), 8 * size);
+	BOOST_CHECK(measurements[0]->hasPayload());
+	BOOST_CHECK(!measurements[7]->hasPayload());
+	
+	// Evict the measurements far away from the current position
+	storage.setEvictionPolicy(EVICT_MOST_DISTANT);
+	storage.load(measurements[8]);
+	storage.load(measurements[1]);
+	storage.enforceBudget(Vector3(0, 0, 0));
+	BOOST_CHECK_EQUAL(storage.getNumberOfResidentMeasurements(), 3);
+	BOOST_CHECK(measurements[0]->hasPayload());
+	BOOST_CHECK(measurements[1]->hasPayload());
+	BOOST_CHECK(!measurements[9]->hasPayload());
+	BOOST_CHECK_EQUAL(storage.getStoredSize(), 9 * size);
+	
+	// Payloads are written to disk only once
+	storage.setEvictionPolicy(EVICT_LEAST_RECENTLY_USED);
+	storage.load(measurements[9]);
+	storage.enforceBudget(Vector3(0, 0, 0));
+	BOOST_CHECK(!measurements[0]->hasPayload());
+	BOOST_CHECK_EQUAL(storage.getStoredSize(), 9 * size);
+}
+
+BOOST_AUTO_TEST_CASE(pinning)
+{
+	Clock clock;
+	FileLogger logger(clock, "measurement_storage.log");
+	
+	std::vector<PointCloudMeasurement::Ptr> measurements;
+	for(unsigned i = 0; i < 6; i++)
+	{
+		measurements.push_back(createMeasurement(1000, i));
+	}
+	size_t size = measurements[0]->getPayloadSize();
+	MeasurementStorage storage(&logger, "measurement_storage.arena", 2 * size);
+	
+	// Pinned measurements survive adding new ones
+	storage.add(measurements[0], Vector3(0, 0, 0));
+	BOOST_CHECK(storage.pin(measurements[0]));
+	for(unsigned i = 1; i < measurements.size(); i++)
+	{
+		storage.add(measurements[i], Vector3(i, 0, 0));
+		BOOST_CHECK(measurements[i]->hasPayload());
+	}
+	BOOST_CHECK(measurements[0]->hasPayload());
+	BOOST_CHECK(!measurements[1]->hasPayload());
+	
+	// Pinning loads evicted payloads, even beyond the budget
+	BOOST_CHECK(storage.pin(measurements[1]));
+	BOOST_CHECK(storage.pin(measurements[2]));
+	storage.enforceBudget(Vector3(0, 0, 0));
+	BOOST_CHECK(measurements[1]->hasPayload());
+	BOOST_CHECK(measurements[2]->hasPayload());
+	BOOST_CHECK_EQUAL(storage.getResidentSize(), 3 * size);
+	
+	// Pins are counted
+	BOOST_CHECK(storage.pin(measurements[0]));
+	storage.unpin(measurements[0]);
+	storage.unpin(measurements[1]);
+	storage.unpin(measurements[2]);
+	storage.enforceBudget(Vector3(0, 0, 0));
+	BOOST_CHECK(measurements[0]->hasPayload());
+	storage.unpin(measurements[0]);
+	storage.load(measurements[5]);
+	storage.load(measurements[2]);
+	storage.enforceBudget(Vector3(0, 0, 0));
+	BOOST_CHECK(!measurements[0]->hasPayload());
+	BOOST_CHECK(storage.getResidentSize() <= 2 * size);
+	
+	// Unknown measurements cannot be pinned
+	BOOST_CHECK(!storage.pin(createMeasurement(10, 0)));
+	
+	// A pinned measurement keeps its payload until the last pin is released
+	BOOST_CHECK(storage.pin(measurements[3]));
+	storage.remove(measurements[3]);
+	BOOST_CHECK(measurements[3]->hasPayload());
+	BOOST_CHECK(!storage.pin(measurements[3]));
+	storage.unpin(measurements[3]);
+	BOOST_CHECK(!measurements[3]->hasPayload());
+	BOOST_CHECK_EQUAL(storage.getNumberOfMeasurements(), 5);
+}
+
+BOOST_AUTO_TEST_CASE(short_payload)
+{
+	PointCloudMeasurement::Ptr m = createMeasurement(100, 0);
+	std::vector<char> buffer(m->getPayloadSize());
+	m->writePayload(buffer.data());
+	BOOST_CHECK_THROW(m->readPayload(buffer.data(), 4), BadMeasurementType);
+	BOOST_CHECK_THROW(m->readPayload(buffer.data(), buffer.size() - 1), BadMeasurementType);
+	m->readPayload(buffer.data(), buffer.size());
+	BOOST_CHECK_EQUAL(m->getPointCloud()->size(), 100);
+}
@@ -0,0 +1,62 @@
+#define BOOST_TEST_MODULE "MemoryStatsTest"
+
+#include <BoostMapper.hpp>
+#include <PoseGraphGenerator.hpp>
+#include <FileLogger.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace slam3d;
+
+BOOST_AUTO_TEST_CASE(peak_tracking)
+{
+	MemoryStats stats;
+	MemoryUsageMap usage;
+	usage["a"] = MemoryUsage(100, 2);
+	usage["b"] = MemoryUsage(50, 1);
+	stats.update(usage);
+	BOOST_CHECK_EQUAL(stats.getTotalBytes(), 150);
+	
+	usage["a"] = MemoryUsage(20, 1);
+	usage["b"] = MemoryUsage(80, 4);
+	stats.update(usage);
+	BOOST_CHECK_EQUAL(stats.getTotalBytes(), 100);
+	BOOST_CHECK_EQUAL(stats.getPeakTotalBytes(), 150);
+	BOOST_CHECK_EQUAL(stats.getUsage("a").bytes, 20);
+	BOOST_CHECK_EQUAL(stats.getPeakUsage("a").bytes, 100);
+	BOOST_CHECK_EQUAL(stats.getPeakUsage("b").bytes, 80);
+	BOOST_CHECK_EQUAL(stats.getPeakUsage("b").objects, 4);
+	BOOST_CHECK_EQUAL(stats.getUsage("c").bytes, 0);
+}
+
+BOOST_AUTO_TEST_CASE(mapper_usage)
+{
+	Clock clock;
+	FileLogger logger(clock, "memory_stats.log");
+	logger.setLogLevel(ERROR);
+	
+	GeneratorConfiguration config;
+	SyntheticSensor sensor("synthetic", &logger, config);
+	PoseGraphGenerator generator(sensor, config);
+	BoostMapper mapper(&logger);
+	mapper.registerSensor(&sensor);
+	
+	generator.addReadings(mapper, 30);
+	MemoryStats stats = mapper.getMemoryStats();
+	BOOST_CHECK_EQUAL(stats.getUsage("vertices").objects, 31);
+	BOOST_CHECK(stats.getUsage("edges").objects >= 60);
+	BOOST_CHECK_EQUAL(stats.getUsage("neighbor_index").objects, 30);
+	BOOST_CHECK(stats.getUsage("vertices").bytes >= 31 * sizeof(VertexObject));
+	BOOST_CHECK_EQUAL(stats.getCategories().count("solver"), 0);
+	
+	size_t total = 0;
+	for(MemoryUsageMap::const_iterator u = stats.getCategories().begin(); u != stats.getCategories().end(); ++u)
+		total += u->second.bytes;
+	BOOST_CHECK_EQUAL(stats.getTotalBytes(), total);
+	BOOST_CHECK_EQUAL(stats.getPeakTotalBytes(), total);
+	
+	generator.addReadings(mapper, 10);
+	MemoryStats grown = mapper.getMemoryStats();
+	BOOST_CHECK(grown.getTotalBytes() > stats.getTotalBytes());
+	BOOST_CHECK_EQUAL(grown.getPeakUsage("vertices").objects, 41);
+}
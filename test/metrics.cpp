@@ -0,0 +1,123 @@
+#define BOOST_TEST_MODULE "MetricsTest"
+
+#include <Metrics.hpp>
+#include <BoostMapper.hpp>
+#include <PoseGraphGenerator.hpp>
+#include <FileLogger.hpp>
+
+#include <boost/test/unit_test.hpp>
+#include <fstream>
+#include <sstream>
+
+using namespace slam3d;
+
+class ManualClock : public Clock
+{
+public:
+	ManualClock() : time(0) {}
+	int64_t monotonic() { return time; }
+	int64_t time;
+};
+
+BOOST_AUTO_TEST_CASE(histogram)
+{
+	Histogram h;
+	BOOST_CHECK_EQUAL(h.getCount(), 0);
+	BOOST_CHECK_EQUAL(h.getPercentile(50), 0);
+	
+	for(int i = 1; i <= 1000; i++)
+		h.add(i);
+	BOOST_CHECK_EQUAL(h.getCount(), 1000);
+	BOOST_CHECK_EQUAL(h.getMin(), 1);
+	BOOST_CHECK_EQUAL(h.getMax(), 1000);
+	BOOST_CHECK_CLOSE(h.getMean(), 500.5, 1e-6);
+	BOOST_CHECK_CLOSE(h.getPercentile(50), 500, 5);
+	BOOST_CHECK_CLOSE(h.getPercentile(99), 990, 5);
+	BOOST_CHECK_EQUAL(h.getPercentile(100), 1000);
+}
+
+BOOST_AUTO_TEST_CASE(scoped_timer)
+{
+	ManualClock clock;
+	Metrics metrics(&clock);
+	
+	// Nothing is recorded while disabled
+	{
+		ScopedTimer timer(&metrics, "section");
+		clock.time += 1000000;
+	}
+	{
+		ScopedTimer timer(NULL, "section");
+		timer.addValue("value", 1);
+	}
+	metrics.increment("counter");
+	BOOST_CHECK(metrics.getHistograms().empty());
+	BOOST_CHECK(metrics.getCounters().empty());
+	
+	metrics.setEnabled(true);
+	for(int i = 1; i <= 3; i++)
+	{
+		ScopedTimer timer(&metrics, "section");
+		clock.time += i * 1000000;
+		timer.addValue("value", i);
+	}
+	metrics.increment("counter", 2);
+	
+	Histogram h = metrics.getHistogram("section");
+	BOOST_CHECK_EQUAL(h.getCount(), 3);
+	BOOST_CHECK_CLOSE(h.getSum(), 6, 1e-6);
+	BOOST_CHECK_CLOSE(h.getMax(), 3, 1e-6);
+	BOOST_CHECK_EQUAL(metrics.getHistogram("section.value").getCount(), 3);
+	BOOST_CHECK_EQUAL(metrics.getCounters()["counter"], 2);
+	BOOST_CHECK_EQUAL(metrics.getHistogram("unknown").getCount(), 0);
+	
+	metrics.reset();
+	BOOST_CHECK(metrics.getHistograms().empty());
+}
+
+BOOST_AUTO_TEST_CASE(chrome_trace)
+{
+	ManualClock clock;
+	Metrics metrics(&clock);
+	metrics.setEnabled(true);
+	metrics.setTracing(true, 2);
+	for(int i = 0; i < 3; i++)
+	{
+		ScopedTimer timer(&metrics, "traced");
+		timer.addValue("iterations", 7);
+		clock.time += 2000;
+	}
+	BOOST_REQUIRE(metrics.writeChromeTrace("metrics_trace.json"));
+	
+	std::ifstream file("metrics_trace.json");
+	std::stringstream content;
+	content << file.rdbuf();
+	std::string json = content.str();
+	BOOST_CHECK(json.find("\"name\":\"traced\",\"ph\":\"X\",\"pid\":1,\"tid\":0,\"ts\":0,\"dur\":2") != std::string::npos);
+	BOOST_CHECK(json.find("\"ts\":2,\"dur\":2,\"args\":{\"iterations\":7}") != std::string::npos);
+	BOOST_CHECK(json.find("\"ts\":4") == std::string::npos);
+	BOOST_CHECK(json.find("\"dropped_events\":1") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(mapper_metrics)
+{
+	Clock clock;
+	FileLogger logger(clock, "metrics.log");
+	logger.setLogLevel(ERROR);
+	Metrics metrics(&clock);
+	metrics.setEnabled(true);
+	
+	GeneratorConfiguration config;
+	SyntheticSensor sensor("synthetic", &logger, config);
+	PoseGraphGenerator generator(sensor, config);
+	BoostMapper mapper(&logger);
+	mapper.setMetrics(&metrics);
+	mapper.registerSensor(&sensor);
+	BOOST_CHECK_EQUAL(mapper.getMetrics(), &metrics);
+	
+	generator.addReadings(mapper, 20);
+	BOOST_CHECK_EQUAL(metrics.getHistogram("mapper.add_reading").getCount(), 20);
+	BOOST_CHECK_EQUAL(metrics.getHistogram("mapper.insert_vertex").getCount(), 20);
+	BOOST_CHECK(metrics.getHistogram("mapper.insert_edge").getCount() >= 19);
+	BOOST_CHECK(metrics.getHistogram("mapper.neighbor_search").getCount() > 0);
+}
@@ -0,0 +1,149 @@
+#define BOOST_TEST_MODULE "NativeSolverTest"
+
+#include <NativeSolver.hpp>
+#include <G2oSolver.hpp>
+#include <FileLogger.hpp>
+
+#include "SolverFixture.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace slam3d;
+
+BOOST_AUTO_TEST_CASE(interface)
+{
+	Clock clock;
+	FileLogger logger(clock, "native_solver.log");
+	NativeSolver native(&logger);
+	Solver& solver = native;
+	
+	Transform pose = Transform::Identity();
+	solver.addNode(1, pose);
+	solver.addNode(2, pose);
+	solver.addNode(3, pose);
+	BOOST_CHECK_THROW(solver.addNode(3, pose), Solver::DuplicateVertex);
+	
+	solver.addConstraint(1, 2, Transform(Eigen::Translation<double, 3>(1,0,0)));
+	solver.addConstraint(2, 3, Transform(Eigen::Translation<double, 3>(0,1,0)));
+	BOOST_CHECK_THROW(solver.addConstraint(1, 4, pose), Solver::BadEdge);
+	BOOST_CHECK_THROW(solver.setFixed(4), Solver::UnknownVertex);
+	BOOST_CHECK_THROW(solver.unsetFixed(4), Solver::UnknownVertex);
+	BOOST_CHECK_THROW(solver.removeNode(4), Solver::UnknownVertex);
+	
+	solver.setFixed(1);
+	BOOST_CHECK(solver.compute());
+	BOOST_CHECK_EQUAL(solver.getCorrections().size(), 3);
+	BOOST_CHECK_EQUAL(solver.getChangedPoses().size(), 2);
+	PoseList poses = getPoses(solver, 4);
+	BOOST_CHECK_SMALL((poses[3].translation() - Vector3(1,1,0)).norm(), 1e-6);
+	
+	// Nothing changes without new information
+	BOOST_CHECK(solver.compute());
+	BOOST_CHECK_EQUAL(solver.getChangedPoses().size(), 0);
+	
+	// Removing the middle node leaves node 3 unconstrained
+	solver.removeNode(2);
+	BOOST_CHECK_EQUAL(solver.getCorrections().size(), 2);
+	solver.addConstraint(1, 3, Transform(Eigen::Translation<double, 3>(0,2,0)));
+	BOOST_CHECK(solver.compute());
+	poses = getPoses(solver, 4);
+	BOOST_CHECK_SMALL((poses[3].translation() - Vector3(0,2,0)).norm(), 1e-6);
+	BOOST_CHECK(native.getMemoryUsage().bytes > 0);
+	
+	solver.clear();
+	BOOST_CHECK_EQUAL(solver.getCorrections().size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(consistent_graph)
+{
+	Clock clock;
+	FileLogger logger(clock, "native_solver.log");
+	NativeSolver solver(&logger);
+	
+	// Without noise the ground truth has zero error, even with a bad initial guess
+	PoseList truth;
+	TestEdgeList edges;
+	createProblem(truth, edges, 40, 0);
+	fillSolver(solver, edges, truth.size());
+	IdPoseVector corrections = solver.getCorrections();
+	for(IdPoseVector::iterator c = corrections.begin(); c != corrections.end(); ++c)
+	{
+		if(c->first > 0)
+		{
+			solver.removeNode(c->first);
+			solver.addNode(c->first, c->second * randomTransform(0.5, 0.2));
+		}
+	}
+	for(TestEdgeList::iterator e = edges.begin(); e != edges.end(); ++e)
+	{
+		solver.addConstraint(e->source, e->target, e->measurement, Covariance::Identity());
+	}
+	
+	BOOST_CHECK(solver.compute());
+	BOOST_CHECK_SMALL(solver.getChi2(), 1e-12);
+	PoseList poses = getPoses(solver, truth.size());
+	for(size_t i = 0; i < truth.size(); i++)
+	{
+		BOOST_CHECK_SMALL(distance(poses[i], truth[i]), 1e-6);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(minimum)
+{
+	Clock clock;
+	FileLogger logger(clock, "native_solver.log");
+	NativeSolver solver(&logger, 100, 1e-12);
+	
+	PoseList truth;
+	TestEdgeList edges;
+	createProblem(truth, edges, 40, 0.05);
+	fillSolver(solver, edges, truth.size());
+	BOOST_CHECK(solver.compute());
+	PoseList poses = getPoses(solver, truth.size());
+	double optimum = chi2(poses, edges);
+	BOOST_CHECK_CLOSE(optimum, solver.getChi2(), 1e-6);
+	BOOST_CHECK(optimum < chi2(truth, edges));
+	
+	// The result must be a minimum of the error, no small step may decrease it
+	for(size_t i = 1; i < poses.size(); i++)
+	{
+		for(int k = 0; k < 6; k++)
+		{
+			Eigen::Matrix<double,6,1> d = Eigen::Matrix<double,6,1>::Zero();
+			d(k) = 1e-4;
+			PoseList plus = poses, minus = poses;
+			Transform step = Transform::Identity();
+			step.translation() = d.head<3>();
+			step.linear() = Eigen::AngleAxisd(d.tail<3>().norm(), d.tail<3>().normalized()).toRotationMatrix();
+			plus[i] = poses[i] * step;
+			minus[i] = poses[i] * step.inverse();
+			double gradient = (chi2(plus, edges) - chi2(minus, edges)) / 2e-4;
+			BOOST_CHECK_SMALL(gradient, 1e-5);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(equivalence)
+{
+	Clock clock;
+	FileLogger logger(clock, "native_solver.log");
+	G2oSolverConfiguration config;
+	config.gain_threshold = 1e-12;
+	G2oSolver g2o(&logger, config);
+	NativeSolver native(&logger, 100, 1e-12);
+	
+	PoseList truth;
+	TestEdgeList edges;
+	createProblem(truth, edges, 40, 0.05);
+	fillSolver(g2o, edges, truth.size());
+	fillSolver(native, edges, truth.size());
+	BOOST_CHECK(g2o.compute());
+	BOOST_CHECK(native.compute());
+	
+	PoseList g2o_poses = getPoses(g2o, truth.size());
+	PoseList native_poses = getPoses(native, truth.size());
+	for(size_t i = 0; i < truth.size(); i++)
+	{
+		BOOST_CHECK_SMALL(distance(g2o_poses[i], native_poses[i]), 1e-4);
+	}
+}
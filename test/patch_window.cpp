@@ -0,0 +1,57 @@
+#define BOOST_TEST_MODULE "PatchWindowTest"
+
+#include <BoostMapper.hpp>
+#include <G2oSolver.hpp>
+#include <PoseGraphGenerator.hpp>
+#include <FileLogger.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace slam3d;
+
+class CountingSolver : public G2oSolver
+{
+public:
+	CountingSolver(Logger* l) : G2oSolver(l), nodes(0), added(0), removed(0), constraints(0), clears(0), computes(0) {}
+	void addNode(unsigned id, Transform pose) { G2oSolver::addNode(id, pose); nodes++; added++; }
+	void addConstraint(unsigned s, unsigned t, Transform tf, Covariance cov) { G2oSolver::addConstraint(s, t, tf, cov); constraints++; }
+	void removeNode(unsigned id) { G2oSolver::removeNode(id); nodes--; removed++; }
+	void clear() { G2oSolver::clear(); nodes = 0; clears++; }
+	bool compute() { computes++; return G2oSolver::compute(); }
+	
+	int nodes;
+	int added;
+	int removed;
+	int constraints;
+	int clears;
+	int computes;
+};
+
+BOOST_AUTO_TEST_CASE(sliding_window)
+{
+	Clock clock;
+	FileLogger logger(clock, "patch_window.log");
+	logger.setLogLevel(ERROR);
+	
+	GeneratorConfiguration config;
+	config.trajectory = TRAJECTORY_MANHATTAN;
+	config.area = 10;
+	SyntheticSensor sensor("synthetic", &logger, config);
+	PoseGraphGenerator generator(sensor, config);
+	
+	BoostMapper mapper(&logger);
+	CountingSolver patch_solver(&logger);
+	mapper.registerSensor(&sensor);
+	mapper.setPatchSolver(&patch_solver);
+	mapper.setPatchBuildingRange(2);
+	mapper.setNeighborRadius(config.loop_range, config.max_loop_links);
+	
+	generator.addReadings(mapper, 150);
+	
+	// Each patch has up to 5 nodes, rebuilding the solver would add all of them every time
+	BOOST_REQUIRE(patch_solver.computes > 20);
+	BOOST_CHECK_EQUAL(patch_solver.clears, 1);
+	BOOST_CHECK(patch_solver.added < patch_solver.computes * 3);
+	BOOST_CHECK_EQUAL(patch_solver.added - patch_solver.removed, patch_solver.nodes);
+	BOOST_CHECK(patch_solver.nodes <= 10);
+}
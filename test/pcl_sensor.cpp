@@ -1,6 +1,7 @@
 #define BOOST_TEST_MODULE "PclSensorTest"
 
 #include <PointCloudSensor.hpp>
+#include <ScanLoader.hpp>
 #include <FileLogger.hpp>
 
 #include <iostream>
@@ -11,41 +12,6 @@
 
 using namespace slam3d;
 
-PointCloud::Ptr loadFromFile(const std::string& filename)
-{
-	PointCloud::Ptr cloud(new PointCloud);
-
-
-	// allocate 4 MB buffer (only ~130*4*4 KB are needed) and read in the file
-	int32_t num = 1000000;
-	float* data = new float[num];	
-	
-	// load point cloud
-	FILE *stream = fopen(filename.c_str(),"rb");
-	assert(stream);
-	int32_t points = fread(data,sizeof(float),num,stream)/4;
-	fclose(stream);
-	
-	 // pointers to coordiantes
-	float *px = data+0;
-	float *py = data+1;
-	float *pz = data+2;
-	float *pr = data+3;
-	
-	for(int32_t i = 0; i < points; i++)
-	{
-		PointType point;
-		point.x = *px;
-		point.y = *py;
-		point.z = *pz;
-//		point.intensity = *pr;
-		cloud->push_back(point);
-		px+=4; py+=4; pz+=4; pr+=4;
-	}
-	
-	return cloud;
-}
-
 BOOST_AUTO_TEST_CASE(icp)
 {
 	Clock clock;
@@ -61,10 +27,10 @@ BOOST_AUTO_TEST_CASE(icp)
 	pclSensor.setFineConfiguaration(conf);
 	
 	// How to access these files properly?
-	PointCloud::Ptr cloud1 = loadFromFile("../test/cloud1.bin");
-	PointCloud::Ptr cloud2 = loadFromFile("../test/cloud2.bin");
-	PointCloud::Ptr cloud3 = loadFromFile("../test/cloud3.bin");
-	PointCloud::Ptr cloud4 = loadFromFile("../test/cloud4.bin");
+	PointCloud::Ptr cloud1 = ScanLoader::load("../test/cloud1.bin");
+	PointCloud::Ptr cloud2 = ScanLoader::load("../test/cloud2.bin");
+	PointCloud::Ptr cloud3 = ScanLoader::load("../test/cloud3.bin");
+	PointCloud::Ptr cloud4 = ScanLoader::load("../test/cloud4.bin");
 	
 	PointCloudMeasurement::Ptr m1(new PointCloudMeasurement(cloud1, "r1", "pcl_sensor", sensor_pose));
 	PointCloudMeasurement::Ptr m2(new PointCloudMeasurement(cloud2, "r1", "pcl_sensor", sensor_pose));
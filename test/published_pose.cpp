@@ -0,0 +1,196 @@
+#define BOOST_TEST_MODULE "PublishedPoseTest"
+
+#include <BoostMapper.hpp>
+#include <BufferedOdometry.hpp>
+#include <NativeSolver.hpp>
+#include <PoseGraphGenerator.hpp>
+#include <FileLogger.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace slam3d;
+
+static timeval toStamp(int64_t us)
+{
+	timeval stamp;
+	stamp.tv_sec = us / 1000000;
+	stamp.tv_usec = us % 1000000;
+	return stamp;
+}
+
+// Drives a circle with one meter per second
+static Transform trajectory(int64_t us)
+{
+	double t = us * 1e-6;
+	Transform pose(Eigen::AngleAxis<ScalarType>(t * 0.1, Vector3::UnitZ()));
+	pose.translation() = Vector3(10 * std::sin(t * 0.1), 10 - 10 * std::cos(t * 0.1), 0);
+	return pose;
+}
+
+// The synthetic sensor always matches consecutive sequence numbers
+static Measurement::Ptr createReading(int64_t us, size_t sequence)
+{
+	return Measurement::Ptr(new SyntheticMeasurement("robot", "synthetic", toStamp(us), sequence, trajectory(us)));
+}
+
+BOOST_AUTO_TEST_CASE(publish_readings)
+{
+	Clock clock;
+	FileLogger logger(clock, "published_pose.log");
+	SyntheticSensor sensor("synthetic", &logger, GeneratorConfiguration());
+	BoostMapper mapper(&logger);
+	NativeSolver solver(&logger);
+	mapper.setSolver(&solver);
+	mapper.registerSensor(&sensor);
+	
+	timeval stamp;
+	BOOST_CHECK(mapper.getPublishedPose(stamp).isApprox(Transform::Identity()));
+	BOOST_CHECK_EQUAL(stamp.tv_sec, 0);
+	Transform start(Eigen::Translation<double, 3>(1, 2, 0));
+	mapper.setCurrentPose(start);
+	BOOST_CHECK(mapper.getPublishedPose().isApprox(start));
+	
+	for(int i = 0; i < 10; i++)
+	{
+		BOOST_CHECK(mapper.addReading(createReading(i * 1000000, i), true));
+		BOOST_CHECK(mapper.getPublishedPose(stamp).isApprox(mapper.getCurrentPose()));
+		BOOST_CHECK_EQUAL(stamp.tv_sec, i);
+	}
+	
+	// Readings below the minimum distance are published, but not added
+	BOOST_CHECK(!mapper.addReading(createReading(9100000, 10)));
+	BOOST_CHECK(mapper.getPublishedPose(stamp).isApprox(mapper.getCurrentPose()));
+	BOOST_CHECK_EQUAL(stamp.tv_usec, 100000);
+	
+	// Corrections of the last vertex move the published pose
+	BOOST_CHECK(mapper.optimize());
+	BOOST_CHECK(mapper.getPublishedPose().isApprox(mapper.getCurrentPose()));
+	Transform before = mapper.getPublishedPose();
+	Transform shifted = Eigen::Translation<double, 3>(0, 0, 1) * mapper.getLastVertex().corrected_pose;
+	UuidPoseVector poses(1, UuidPose(mapper.getLastVertex().measurement->getUniqueId(), shifted));
+	BOOST_CHECK_EQUAL(mapper.updatePoses(poses), 1);
+	BOOST_CHECK(mapper.getPublishedPose(stamp).isApprox(Eigen::Translation<double, 3>(0, 0, 1) * before));
+	BOOST_CHECK_EQUAL(stamp.tv_usec, 100000);
+	
+	// Without odometry, there is nothing to update between readings
+	BOOST_CHECK(!mapper.updatePublishedPose(toStamp(9500000)));
+}
+
+BOOST_AUTO_TEST_CASE(update_from_odometry)
+{
+	Clock clock;
+	FileLogger logger(clock, "published_pose.log");
+	SyntheticSensor sensor("synthetic", &logger, GeneratorConfiguration());
+	BufferedOdometry odometry(&logger);
+	BoostMapper mapper(&logger);
+	mapper.registerSensor(&sensor);
+	mapper.setOdometry(&odometry);
+	
+	for(int64_t us = 0; us <= 3000000; us += 1000)
+	{
+		odometry.addSample(toStamp(us), trajectory(us));
+	}
+	BOOST_CHECK(mapper.addReading(createReading(0, 0), true));
+	BOOST_CHECK(mapper.addReading(createReading(1000000, 1), true));
+	Transform keyframe = mapper.getCurrentPose();
+	
+	// Dead reckoning from the last reading
+	timeval stamp;
+	for(int64_t us = 1000000; us <= 2000000; us += 50000)
+	{
+		BOOST_CHECK_EQUAL(mapper.updatePublishedPose(toStamp(us)), us > 1000000);
+		Transform expected = keyframe * trajectory(1000000).inverse() * trajectory(us);
+		BOOST_CHECK(mapper.getPublishedPose(stamp).isApprox(expected));
+	}
+	BOOST_CHECK_EQUAL(stamp.tv_sec, 2);
+	BOOST_CHECK(!mapper.updatePublishedPose(toStamp(1500000)));
+	BOOST_CHECK(!mapper.updatePublishedPose(toStamp(3500000)));
+	
+	// A reading that arrives late keeps the newer published time
+	BOOST_CHECK(mapper.addReading(createReading(1800000, 2), true));
+	Transform expected = mapper.getCurrentPose() * trajectory(1800000).inverse() * trajectory(2000000);
+	BOOST_CHECK(mapper.getPublishedPose(stamp).isApprox(expected));
+	BOOST_CHECK_EQUAL(stamp.tv_sec, 2);
+	BOOST_CHECK_EQUAL(stamp.tv_usec, 0);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_readers)
+{
+	Clock clock;
+	FileLogger logger(clock, "published_pose.log");
+	logger.setLogLevel(WARNING);
+	SyntheticSensor sensor("synthetic", &logger, GeneratorConfiguration());
+	BufferedOdometryConfiguration config;
+	config.capacity = 1 << 16;
+	BufferedOdometry odometry(&logger, config);
+	BoostMapper mapper(&logger);
+	NativeSolver solver(&logger);
+	mapper.setSolver(&solver);
+	mapper.registerSensor(&sensor);
+	mapper.setOdometry(&odometry);
+	odometry.addSample(toStamp(0), trajectory(0));
+	
+	// 1 kHz odometry that updates the published pose with every sample
+	const int64_t duration = 20000000;
+	std::atomic<int64_t> latest(0);
+	std::atomic<size_t> updates(0);
+	std::thread driver([&]()
+	{
+		for(int64_t us = 1000; us <= duration; us += 1000)
+		{
+			odometry.addSample(toStamp(us), trajectory(us));
+			latest.store(us);
+			if(mapper.updatePublishedPose(toStamp(us)))
+				updates++;
+		}
+	});
+	
+	// Control loops that check for valid poses and monotonic time
+	std::atomic<bool> running(true);
+	std::atomic<size_t> reads(0);
+	std::atomic<size_t> errors(0);
+	std::vector<std::thread> readers;
+	for(int r = 0; r < 2; r++)
+	{
+		readers.push_back(std::thread([&]()
+		{
+			timeval last = toStamp(0);
+			while(running.load())
+			{
+				timeval stamp;
+				Transform pose = mapper.getPublishedPose(stamp);
+				if(timercmp(&stamp, &last, <) || !(pose.linear() * pose.linear().transpose()).isIdentity(1e-9))
+					errors++;
+				last = stamp;
+				reads++;
+			}
+		}));
+	}
+	
+	// Readings at 10 Hz, optimized every second
+	for(int64_t us = 0; us <= duration; us += 100000)
+	{
+		while(latest.load() < us)
+			std::this_thread::yield();
+		mapper.addReading(createReading(us, us / 100000), true);
+		if(us % 1000000 == 0)
+			mapper.optimize();
+	}
+	driver.join();
+	running.store(false);
+	for(std::vector<std::thread>::iterator t = readers.begin(); t != readers.end(); ++t)
+		t->join();
+	
+	BOOST_TEST_MESSAGE("Published " << updates.load() << " odometry updates while reading the pose "
+		<< reads.load() << " times");
+	BOOST_CHECK_GT(updates.load(), 0);
+	BOOST_CHECK_GT(reads.load(), 0);
+	BOOST_CHECK_EQUAL(errors.load(), 0);
+	timeval stamp;
+	mapper.getPublishedPose(stamp);
+	BOOST_CHECK_EQUAL(stamp.tv_sec, duration / 1000000);
+}
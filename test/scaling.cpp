@@ -0,0 +1,98 @@
+#define BOOST_TEST_MODULE "ScalingTest"
+
+#include <BoostMapper.hpp>
+#include <PoseGraphGenerator.hpp>
+#include <FileLogger.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace slam3d;
+
+BOOST_AUTO_TEST_CASE(trajectories)
+{
+	Clock clock;
+	FileLogger logger(clock, "scaling.log");
+	logger.setLogLevel(ERROR);
+	
+	TrajectoryType types[] = {TRAJECTORY_GRID, TRAJECTORY_MANHATTAN, TRAJECTORY_SPIRAL};
+	for(unsigned t = 0; t < 3; t++)
+	{
+		GeneratorConfiguration config;
+		config.trajectory = types[t];
+		config.area = 20;
+		SyntheticSensor sensor("synthetic", &logger, config);
+		PoseGraphGenerator generator(sensor, config);
+		BoostMapper mapper(&logger);
+		mapper.registerSensor(&sensor);
+		mapper.setNeighborRadius(config.loop_range, config.max_loop_links);
+		
+		generator.addReadings(mapper, 200);
+		BOOST_CHECK_EQUAL(mapper.getVertexObjectsFromSensor("synthetic").size(), 200);
+		
+		// Consecutive poses are one step apart, and the trajectory revisits old places
+		EdgeObjectList edges = mapper.getEdgeObjectsFromSensor("synthetic");
+		unsigned loops = 0;
+		for(EdgeObjectList::iterator e = edges.begin(); e != edges.end(); ++e)
+		{
+			if(e->source + 1 < e->target)
+				loops++;
+		}
+		BOOST_CHECK_MESSAGE(loops > 0, "No loops closed in trajectory " << t);
+		
+		generator.addExternalReadings(mapper, 200);
+		BOOST_CHECK_EQUAL(mapper.getVertexObjectsFromSensor("synthetic").size(), 400);
+		BOOST_CHECK(generator.getNumberOfLoops() > 0);
+	}
+}
+
+// The work per reading is counted instead of timed, so the test does not
+// depend on the load of the machine. The counter is read from the metrics.
+static double workPerReading(size_t vertices, const std::string& counter)
+{
+	Clock clock;
+	FileLogger logger(clock, "scaling.log");
+	logger.setLogLevel(ERROR);
+	Metrics metrics(&clock);
+	metrics.setEnabled(true);
+	
+	GeneratorConfiguration config;
+	config.trajectory = TRAJECTORY_MANHATTAN;
+	config.area = 30;
+	SyntheticSensor sensor("synthetic", &logger, config);
+	PoseGraphGenerator generator(sensor, config);
+	BoostMapper mapper(&logger);
+	mapper.registerSensor(&sensor);
+	mapper.setMetrics(&metrics);
+	mapper.setNeighborRadius(config.loop_range, config.max_loop_links);
+	
+	// Count only the second half, when the map already has the full size
+	generator.addReadings(mapper, vertices / 2);
+	double before = metrics.getCounters()[counter];
+	generator.addReadings(mapper, vertices / 2);
+	return (metrics.getCounters()[counter] - before) / (vertices / 2);
+}
+
+// Inserting 4 times as many vertices may not cost more than this factor per vertex
+#define MAX_WORK_RATIO 2.0
+
+// The mapper currently rebuilds its neighbor index for every new vertex,
+// so this is known to grow with the map.
+BOOST_AUTO_TEST_CASE_EXPECTED_FAILURES(neighbor_index_scaling, 1)
+BOOST_AUTO_TEST_CASE(neighbor_index_scaling)
+{
+	double small = workPerReading(600, "mapper.indexed_vertices");
+	double large = workPerReading(2400, "mapper.indexed_vertices");
+	BOOST_TEST_MESSAGE("Indexed vertices per reading: " << small << " (600), " << large << " (2400)");
+	BOOST_CHECK_LT(large / small, MAX_WORK_RATIO);
+}
+
+// The mapper currently runs Dijkstra on the whole graph for every loop
+// closure candidate, so this is known to grow with the map.
+BOOST_AUTO_TEST_CASE_EXPECTED_FAILURES(graph_distance_scaling, 1)
+BOOST_AUTO_TEST_CASE(graph_distance_scaling)
+{
+	double small = workPerReading(600, "mapper.graph_distance_vertices");
+	double large = workPerReading(2400, "mapper.graph_distance_vertices");
+	BOOST_TEST_MESSAGE("Graph distance vertices per reading: " << small << " (600), " << large << " (2400)");
+	BOOST_CHECK_LT(large / small, MAX_WORK_RATIO);
+}
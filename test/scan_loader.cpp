@@ -0,0 +1,80 @@
+#define BOOST_TEST_MODULE "ScanLoaderTest"
+
+#include <ScanLoader.hpp>
+
+#include <boost/test/unit_test.hpp>
+#include <fstream>
+#include <cstdio>
+
+using namespace slam3d;
+
+BOOST_AUTO_TEST_CASE(kitti_scan)
+{
+	std::ifstream in("../test/cloud1.bin", std::ios::binary | std::ios::ate);
+	size_t file_size = in.tellg();
+	
+	ScanView view = ScanLoader::map("../test/cloud1.bin");
+	BOOST_CHECK_EQUAL(view.size(), file_size / 16);
+	BOOST_REQUIRE(view.floats());
+	
+	PointCloud::Ptr cloud = ScanLoader::load("../test/cloud1.bin");
+	BOOST_REQUIRE_EQUAL(cloud->size(), view.size());
+	for(size_t i = 0; i < view.size(); i += 997)
+	{
+		BOOST_CHECK_EQUAL(cloud->points[i].x, view.x(i));
+		BOOST_CHECK_EQUAL(cloud->points[i].y, view.floats()[4*i+1]);
+		BOOST_CHECK_EQUAL(cloud->points[i].z, view.z(i));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(pcd_scan)
+{
+	// Write a small binary PCD file with an additional field before x
+	std::ofstream out("scan_loader.pcd", std::ios::binary);
+	out << "# .PCD v0.7 - Point Cloud Data file format\n"
+	    << "VERSION 0.7\nFIELDS intensity x y z\nSIZE 1 4 4 4\nTYPE U F F F\nCOUNT 1 1 1 1\n"
+	    << "WIDTH 10\nHEIGHT 1\nVIEWPOINT 0 0 0 1 0 0 0\nPOINTS 10\nDATA binary\n";
+	for(int i = 0; i < 10; i++)
+	{
+		unsigned char intensity = i;
+		float p[3] = {(float)i, (float)(2*i), (float)(3*i)};
+		out.write((char*)&intensity, 1);
+		out.write((char*)p, sizeof(p));
+	}
+	out.close();
+	
+	ScanView view = ScanLoader::map("scan_loader.pcd");
+	BOOST_REQUIRE_EQUAL(view.size(), 10);
+	BOOST_CHECK(!view.floats());
+	PointCloud::Ptr cloud = ScanLoader::load("scan_loader.pcd");
+	BOOST_REQUIRE_EQUAL(cloud->size(), 10);
+	BOOST_CHECK_EQUAL(cloud->points[7].x, 7);
+	BOOST_CHECK_EQUAL(cloud->points[7].y, 14);
+	BOOST_CHECK_EQUAL(cloud->points[7].z, 21);
+	
+	// Truncate the data
+	std::ofstream broken("scan_loader_broken.pcd", std::ios::binary);
+	broken << "FIELDS x y z\nSIZE 4 4 4\nTYPE F F F\nPOINTS 10\nDATA binary\n";
+	broken.close();
+	BOOST_CHECK_THROW(ScanLoader::map("scan_loader_broken.pcd"), ScanFormatError);
+	BOOST_CHECK_THROW(ScanLoader::map("does_not_exist.bin"), FileMappingError);
+}
+
+BOOST_AUTO_TEST_CASE(dataset)
+{
+	DatasetReader reader("../test", ".bin", 2);
+	BOOST_REQUIRE_EQUAL(reader.size(), 4);
+	BOOST_CHECK_EQUAL(reader.getFilename(0), "../test/cloud1.bin");
+	
+	PointCloud::Ptr cloud;
+	for(size_t i = 0; i < reader.size(); i++)
+	{
+		BOOST_REQUIRE(reader.next(cloud));
+		BOOST_CHECK_EQUAL(cloud->size(), ScanLoader::map(reader.getFilename(i)).size());
+	}
+	BOOST_CHECK(!reader.next(cloud));
+	
+	// Stopping in the middle of the dataset must not block
+	DatasetReader partial("../test", ".bin", 1);
+	BOOST_CHECK(partial.next(cloud));
+}
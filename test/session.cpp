@@ -0,0 +1,86 @@
+#define BOOST_TEST_MODULE "SessionTest"
+
+#include <BoostMapper.hpp>
+#include <PointCloudSensor.hpp>
+#include <FileLogger.hpp>
+#include "MeasurementFixture.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace slam3d;
+
+void buildMap(BoostMapper& mapper, unsigned size)
+{
+	boost::uuids::uuid source = boost::uuids::nil_uuid();
+	Transform step(Eigen::Translation<double, 3>(1,0,0));
+	Covariance cov = Covariance::Identity();
+	std::vector<boost::uuids::uuid> ids;
+	for(unsigned i = 0; i < size; i++)
+	{
+		PointCloudMeasurement::Ptr m = createMeasurement(100 + i, i);
+		mapper.addExternalReading(m, source, step, cov, "odom");
+		source = m->getUniqueId();
+		ids.push_back(source);
+	}
+	mapper.addExternalConstraint(ids[0], ids[size-1], Transform(Eigen::Translation<double, 3>(size-1,0,0)), cov * 2, "loop");
+}
+
+BOOST_AUTO_TEST_CASE(save_and_load)
+{
+	Clock clock;
+	FileLogger logger(clock, "session.log");
+	logger.setLogLevel(DEBUG);
+	
+	PointCloudSensor sensor("pcl_sensor", &logger, Transform::Identity());
+	BoostMapper original(&logger);
+	original.registerSensor(&sensor);
+	buildMap(original, 10);
+	BOOST_REQUIRE(original.saveSession("test.session"));
+	
+	// Restore the map with all point clouds
+	BoostMapper restored(&logger);
+	restored.registerSensor(&sensor);
+	BOOST_REQUIRE(restored.loadSession("test.session"));
+	BOOST_CHECK(!restored.loadSession("test.session"));
+	
+	VertexObjectList v1 = original.getVertexObjectsFromSensor("pcl_sensor");
+	VertexObjectList v2 = restored.getVertexObjectsFromSensor("pcl_sensor");
+	BOOST_REQUIRE_EQUAL(v1.size(), 10);
+	BOOST_REQUIRE_EQUAL(v2.size(), 10);
+	for(unsigned i = 0; i < v1.size(); i++)
+	{
+		const VertexObject& v = restored.getVertex(v1[i].index);
+		BOOST_CHECK_EQUAL(v.label, v1[i].label);
+		BOOST_CHECK(v.measurement->getUniqueId() == v1[i].measurement->getUniqueId());
+		BOOST_CHECK(v.corrected_pose.isApprox(v1[i].corrected_pose));
+		BOOST_CHECK_EQUAL(v.measurement->getTimestamp().tv_sec, v1[i].measurement->getTimestamp().tv_sec);
+		
+		PointCloudMeasurement::Ptr c1 = boost::dynamic_pointer_cast<PointCloudMeasurement>(v1[i].measurement);
+		PointCloudMeasurement::Ptr c2 = boost::dynamic_pointer_cast<PointCloudMeasurement>(v.measurement);
+		BOOST_REQUIRE(c2);
+		BOOST_REQUIRE(c2->getPointCloud());
+		BOOST_CHECK_EQUAL(c2->getPointCloud()->size(), c1->getPointCloud()->size());
+		BOOST_CHECK_EQUAL(c2->getPointCloud()->points[5].y, c1->getPointCloud()->points[5].y);
+	}
+	
+	EdgeObject loop = restored.getEdge(v1[0].index, v1[9].index, "loop");
+	BOOST_CHECK(loop.transform.isApprox(Transform(Eigen::Translation<double, 3>(9,0,0))));
+	BOOST_CHECK(loop.covariance.isApprox(Covariance::Identity() * 2));
+	BOOST_CHECK_EQUAL(restored.getOutEdges(v1[5].index).size(), 2);
+	BOOST_CHECK_EQUAL(restored.getEdgeObjectsFromSensor("").size(), original.getEdgeObjectsFromSensor("").size());
+	
+	// Restore the map but load the point clouds lazily
+	MeasurementStorage storage(&logger, "session.arena", 1000000);
+	BoostMapper lazy(&logger);
+	lazy.registerSensor(&sensor);
+	lazy.setMeasurementStorage(&storage);
+	BOOST_REQUIRE(lazy.loadSession("test.session"));
+	BOOST_CHECK_EQUAL(storage.getNumberOfMeasurements(), 10);
+	BOOST_CHECK_EQUAL(storage.getNumberOfResidentMeasurements(), 0);
+	
+	const VertexObject& v = lazy.getVertex(v1[3].index);
+	BOOST_CHECK_EQUAL(storage.getNumberOfResidentMeasurements(), 1);
+	PointCloudMeasurement::Ptr cloud = boost::dynamic_pointer_cast<PointCloudMeasurement>(v.measurement);
+	BOOST_REQUIRE(cloud->getPointCloud());
+	BOOST_CHECK_EQUAL(cloud->getPointCloud()->size(), 103);
+}
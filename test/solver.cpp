@@ -48,3 +48,160 @@ BOOST_AUTO_TEST_CASE(optimization)
 
 	solver->saveGraph("graph_optimized.g2o");
 }
+
+BOOST_AUTO_TEST_CASE(incremental)
+{
+	slam3d::Clock clock;
+	slam3d::FileLogger logger(clock, "solver.log");
+	slam3d::G2oSolver g2o(&logger);
+	g2o.setIncremental(true, 3, 4);
+	slam3d::Solver& solver = g2o;
+	
+	slam3d::Transform step(Eigen::Translation<double, 3>(1,0,0));
+	slam3d::Transform pose = slam3d::Transform::Identity();
+	for(unsigned i = 0; i < 20; i++)
+	{
+		solver.addNode(i, pose);
+		if(i > 0)
+			solver.addConstraint(i-1, i, step);
+		pose = pose * step;
+	}
+	solver.setFixed(0);
+	
+	// The first optimization is always done on the full graph
+	BOOST_CHECK(solver.compute());
+	BOOST_CHECK_EQUAL(solver.getCorrections().size(), 20);
+	
+	// Only the new node and those within 3 hops of the new edge are optimized
+	solver.addNode(20, pose);
+	solver.addConstraint(19, 20, step);
+	BOOST_CHECK(solver.compute());
+	slam3d::IdPoseVector corr = solver.getCorrections();
+	BOOST_CHECK_EQUAL(corr.size(), 5);
+	for(slam3d::IdPoseVector::iterator c = corr.begin(); c != corr.end(); ++c)
+		BOOST_CHECK(c->first >= 16);
+	
+	// A loop closure extends the region on both ends
+	solver.addConstraint(20, 0, pose.inverse());
+	BOOST_CHECK(solver.compute());
+	BOOST_CHECK_EQUAL(solver.getCorrections().size(), 8);
+	
+	solver.addNode(21, pose);
+	solver.addConstraint(20, 21, step);
+	BOOST_CHECK(solver.compute());
+	
+	// Every fourth call optimizes the full graph again
+	solver.addNode(22, pose);
+	solver.addConstraint(21, 22, step);
+	BOOST_CHECK(solver.compute());
+	BOOST_CHECK_EQUAL(solver.getCorrections().size(), 23);
+}
+
+BOOST_AUTO_TEST_CASE(budget)
+{
+	slam3d::Clock clock;
+	slam3d::FileLogger logger(clock, "solver.log");
+	
+	slam3d::G2oSolverConfiguration config;
+	config.algorithm = slam3d::ALGORITHM_LEVENBERG;
+	config.linear_solver = slam3d::LINEAR_SOLVER_CSPARSE;
+	config.max_iterations = 20;
+	slam3d::G2oSolver g2o(&logger, config);
+	slam3d::Solver& solver = g2o;
+	
+	slam3d::Transform pose = slam3d::Transform::Identity();
+	slam3d::Transform step(Eigen::Translation<double, 3>(1,0,0));
+	for(unsigned i = 0; i < 10; i++)
+	{
+		solver.addNode(i, pose);
+		if(i > 0)
+			solver.addConstraint(i-1, i, step);
+	}
+	solver.setFixed(0);
+	
+	BOOST_CHECK(solver.compute(slam3d::OptimizationBudget(5, 0)));
+	BOOST_CHECK(g2o.getLastIterations() <= 5);
+	
+	BOOST_CHECK(solver.compute());
+	BOOST_CHECK(g2o.getLastIterations() <= 20);
+	
+	// The deadline has passed after the first iteration
+	BOOST_CHECK(solver.compute(slam3d::OptimizationBudget(1000, 1e-9)));
+	BOOST_CHECK_EQUAL(g2o.getLastIterations(), 1);
+	
+	// The stop flag is reset for the next optimization
+	BOOST_CHECK(solver.compute(slam3d::OptimizationBudget(3, 0)));
+	BOOST_CHECK(g2o.getLastIterations() > 0);
+}
+
+BOOST_AUTO_TEST_CASE(changed_poses)
+{
+	slam3d::Clock clock;
+	slam3d::FileLogger logger(clock, "solver.log");
+	slam3d::G2oSolver g2o(&logger);
+	slam3d::Solver& solver = g2o;
+	solver.setChangeTolerance(0.01, 0.01);
+	
+	slam3d::Transform pose = slam3d::Transform::Identity();
+	slam3d::Transform step(Eigen::Translation<double, 3>(1,0,0));
+	for(unsigned i = 0; i < 10; i++)
+	{
+		solver.addNode(i, pose);
+		if(i > 0)
+			solver.addConstraint(i-1, i, step);
+		pose = pose * step;
+	}
+	solver.setFixed(0);
+	
+	// All constraints agree with the initial poses
+	BOOST_CHECK(solver.compute());
+	BOOST_CHECK_EQUAL(solver.getCorrections().size(), 10);
+	BOOST_CHECK(solver.getChangedPoses().empty());
+	
+	// Only the node with the wrong initial pose is moved
+	solver.addNode(10, slam3d::Transform::Identity());
+	solver.addConstraint(9, 10, step);
+	BOOST_CHECK(solver.compute());
+	const slam3d::IdPoseVector& changed = solver.getChangedPoses();
+	BOOST_REQUIRE_EQUAL(changed.size(), 1);
+	BOOST_CHECK_EQUAL(changed[0].first, 10);
+	BOOST_CHECK_SMALL((changed[0].second.translation() - pose.translation()).norm(), 0.01);
+	
+	// Nothing has changed since the last report
+	BOOST_CHECK(solver.compute());
+	BOOST_CHECK(solver.getChangedPoses().empty());
+}
+
+BOOST_AUTO_TEST_CASE(remove_node)
+{
+	slam3d::Clock clock;
+	slam3d::FileLogger logger(clock, "solver.log");
+	slam3d::G2oSolver g2o(&logger);
+	slam3d::Solver& solver = g2o;
+	
+	slam3d::Transform step(Eigen::Translation<double, 3>(1,0,0));
+	for(unsigned i = 0; i < 5; i++)
+	{
+		solver.addNode(i, slam3d::Transform::Identity());
+		if(i > 0)
+			solver.addConstraint(i-1, i, step);
+	}
+	solver.setFixed(0);
+	BOOST_CHECK(solver.compute());
+	BOOST_CHECK_EQUAL(solver.getCorrections().size(), 5);
+	
+	solver.removeNode(0);
+	BOOST_CHECK_THROW(solver.removeNode(0), slam3d::Solver::UnknownVertex);
+	BOOST_CHECK_THROW(solver.unsetFixed(0), slam3d::Solver::UnknownVertex);
+	solver.setFixed(1);
+	BOOST_CHECK(solver.compute());
+	BOOST_CHECK_EQUAL(solver.getCorrections().size(), 4);
+	
+	// The id can be used again
+	solver.addNode(0, slam3d::Transform::Identity());
+	solver.addConstraint(0, 1, step);
+	solver.unsetFixed(1);
+	solver.setFixed(0);
+	BOOST_CHECK(solver.compute());
+	BOOST_CHECK_EQUAL(solver.getCorrections().size(), 5);
+}
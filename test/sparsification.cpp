@@ -0,0 +1,295 @@
+#define BOOST_TEST_MODULE "SparsificationTest"
+
+#include <BoostMapper.hpp>
+#include <NativeSolver.hpp>
+#include <Marginalization.hpp>
+#include <PoseGraphGenerator.hpp>
+#include <Journal.hpp>
+#include <FileLogger.hpp>
+
+#include <cstdio>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace slam3d;
+
+static Transform createTransform(double x, double y, double z, double yaw, double pitch)
+{
+	Transform tf = Transform::Identity();
+	tf.translation() = Vector3(x, y, z);
+	tf.linear() = (Eigen::AngleAxisd(yaw, Vector3::UnitZ()) * Eigen::AngleAxisd(pitch, Vector3::UnitY())).toRotationMatrix();
+	return tf;
+}
+
+static Covariance createCovariance(double translation, double rotation)
+{
+	Covariance cov = Covariance::Zero();
+	cov.topLeftCorner<3,3>() = Eigen::Matrix3d::Identity() * translation;
+	cov.bottomRightCorner<3,3>() = Eigen::Matrix3d::Identity() * rotation;
+	cov(0, 4) = cov(4, 0) = 0.3 * std::sqrt(translation * rotation);
+	return cov;
+}
+
+BOOST_AUTO_TEST_CASE(chain_optimum)
+{
+	Clock clock;
+	FileLogger logger(clock, "sparsification.log");
+	NativeSolver full(&logger, 100, 1e-14);
+	
+	// A chain 0-1-2 closed by an inconsistent constraint 0-2
+	Transform tf_0_1 = createTransform(1, 0.2, 0, 0.4, 0.1);
+	Transform tf_1_2 = createTransform(1, -0.1, 0.1, 0.3, -0.05);
+	Transform tf_0_2 = tf_0_1 * tf_1_2 * createTransform(0.1, 0.05, -0.05, 0.05, 0.02);
+	Covariance cov_0_1 = createCovariance(0.01, 0.001);
+	Covariance cov_1_2 = createCovariance(0.02, 0.002);
+	Covariance cov_0_2 = createCovariance(0.05, 0.004);
+	full.addNode(0, Transform::Identity());
+	full.addNode(1, tf_0_1);
+	full.addNode(2, tf_0_1 * tf_1_2);
+	full.setFixed(0);
+	full.addConstraint(0, 1, tf_0_1, cov_0_1);
+	full.addConstraint(1, 2, tf_1_2, cov_1_2);
+	full.addConstraint(0, 2, tf_0_2, cov_0_2);
+	BOOST_REQUIRE(full.compute());
+	IdPoseVector poses = full.getCorrections();
+	
+	// Remove the middle node at the optimum, the remaining graph must have the same
+	// optimum up to the error of linearizing the marginal
+	Marginalization marginalization(poses[1].second);
+	marginalization.addConstraint(0, poses[0].second, tf_0_1, cov_0_1, true);
+	marginalization.addConstraint(2, poses[2].second, tf_1_2, cov_1_2, false);
+	MarginalConstraintList constraints;
+	BOOST_REQUIRE(marginalization.computeChowLiuTree(constraints));
+	BOOST_REQUIRE_EQUAL(constraints.size(), 1);
+	BOOST_CHECK_EQUAL(constraints[0].source, 0);
+	BOOST_CHECK_EQUAL(constraints[0].target, 2);
+	
+	NativeSolver reduced(&logger, 100, 1e-14);
+	reduced.addNode(0, Transform::Identity());
+	reduced.addNode(2, tf_0_1 * tf_1_2);
+	reduced.setFixed(0);
+	reduced.addConstraint(0, 2, constraints[0].transform, constraints[0].covariance);
+	reduced.addConstraint(0, 2, tf_0_2, cov_0_2);
+	BOOST_REQUIRE(reduced.compute());
+	IdPoseVector result = reduced.getCorrections();
+	Transform diff = poses[2].second.inverse() * result[1].second;
+	BOOST_CHECK_SMALL(diff.translation().norm(), 1e-4);
+	BOOST_CHECK_SMALL(Eigen::AngleAxisd(diff.linear()).angle(), 1e-4);
+}
+
+BOOST_AUTO_TEST_CASE(chow_liu_tree)
+{
+	// A node with four neighbors is replaced by a tree with three edges
+	Transform center = createTransform(5, 5, 0, 0.5, 0);
+	Marginalization marginalization(center);
+	for(IdType id = 4; id > 0; id--)
+	{
+		Transform tf = createTransform(id, 0.5 * id, 0, 0.2 * id, 0);
+		marginalization.addConstraint(id, center * tf, tf, createCovariance(0.01 * id, 0.001), false);
+	}
+	MarginalConstraintList constraints;
+	BOOST_REQUIRE(marginalization.computeChowLiuTree(constraints));
+	BOOST_CHECK_EQUAL(marginalization.getNumberOfNeighbors(), 4);
+	BOOST_REQUIRE_EQUAL(constraints.size(), 3);
+	
+	std::set<IdType> connected;
+	for(MarginalConstraintList::iterator c = constraints.begin(); c != constraints.end(); ++c)
+	{
+		BOOST_CHECK(c->source < c->target);
+		BOOST_CHECK(Eigen::LLT<Covariance>(c->covariance).info() == Eigen::Success);
+		connected.insert(c->source);
+		connected.insert(c->target);
+	}
+	BOOST_CHECK_EQUAL(connected.size(), 4);
+	
+	// A leaf only carries information about its own pose
+	Marginalization leaf(center);
+	leaf.addConstraint(1, center, Transform::Identity(), Covariance::Identity(), false);
+	BOOST_REQUIRE(leaf.computeChowLiuTree(constraints));
+	BOOST_CHECK_EQUAL(constraints.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(sparsify_mapper)
+{
+	Clock clock;
+	FileLogger logger(clock, "sparsification.log");
+	logger.setLogLevel(ERROR);
+	
+	GeneratorConfiguration config;
+	config.trajectory = TRAJECTORY_MANHATTAN;
+	config.area = 10;
+	SyntheticSensor sensor("synthetic", &logger, config);
+	PoseGraphGenerator generator(sensor, config);
+	
+	BoostMapper mapper(&logger);
+	NativeSolver solver(&logger);
+	mapper.registerSensor(&sensor);
+	mapper.setSolver(&solver);
+	mapper.setNeighborRadius(config.loop_range, config.max_loop_links);
+	
+	generator.addReadings(mapper, 200);
+	BOOST_REQUIRE(mapper.optimize());
+	size_t before = mapper.getVertexObjectsFromSensor("synthetic").size();
+	
+	BOOST_CHECK_THROW(mapper.marginalizeVertex(100000), std::out_of_range);
+	BOOST_CHECK(!mapper.marginalizeVertex(0));
+	BOOST_CHECK(!mapper.marginalizeVertex(mapper.getLastVertex().index));
+	
+	// Revisiting the small area leaves many redundant vertices
+	unsigned removed = mapper.sparsify("synthetic", 2.0);
+	BOOST_CHECK(removed > before / 2);
+	VertexObjectList vertices = mapper.getVertexObjectsFromSensor("synthetic");
+	BOOST_CHECK_EQUAL(vertices.size(), before - removed);
+	BOOST_CHECK_EQUAL(solver.getCorrections().size(), vertices.size() + 1);
+	
+	// All remaining edges connect remaining vertices
+	for(VertexObjectList::iterator v = vertices.begin(); v != vertices.end(); ++v)
+	{
+		EdgeObjectList edges = mapper.getOutEdges(v->index);
+		BOOST_CHECK(!edges.empty());
+		for(EdgeObjectList::iterator e = edges.begin(); e != edges.end(); ++e)
+		{
+			BOOST_CHECK_NO_THROW(mapper.getVertex(e->target));
+		}
+	}
+	
+	// The reduced graph keeps the optimized poses
+	BOOST_REQUIRE(mapper.optimize());
+	double max_error = 0;
+	vertices = mapper.getVertexObjectsFromSensor("synthetic");
+	for(VertexObjectList::iterator v = vertices.begin(); v != vertices.end(); ++v)
+	{
+		Transform pose = mapper.getVertex(v->index).corrected_pose;
+		max_error = std::max(max_error, (pose.translation() - v->corrected_pose.translation()).norm());
+	}
+	BOOST_CHECK_SMALL(max_error, 0.05);
+	
+	// Mapping continues on the reduced graph
+	generator.addReadings(mapper, 50);
+	BOOST_CHECK(mapper.optimize());
+	BOOST_CHECK(mapper.sparsify("synthetic", 2.0) > 0);
+	BOOST_CHECK(mapper.getVertexObjectsFromSensor("synthetic").size() < before);
+}
+
+class PayloadMeasurement : public SyntheticMeasurement
+{
+public:
+	PayloadMeasurement(const timeval& stamp, size_t size)
+	 : SyntheticMeasurement("r2", "synthetic", stamp, 0, Transform::Identity()), mSize(size) {}
+	
+	size_t getPayloadSize() const { return mSize; }
+	void releasePayload() { mSize = 0; }
+	
+private:
+	size_t mSize;
+};
+
+BOOST_AUTO_TEST_CASE(released_payload)
+{
+	Clock clock;
+	FileLogger logger(clock, "sparsification.log");
+	logger.setLogLevel(ERROR);
+	
+	GeneratorConfiguration config;
+	SyntheticSensor sensor("synthetic", &logger, config);
+	PoseGraphGenerator generator(sensor, config);
+	BoostMapper mapper(&logger);
+	mapper.registerSensor(&sensor);
+	generator.addReadings(mapper, 5);
+	
+	// The payload of a removed vertex is subtracted as it was when added
+	timeval stamp = mapper.getLastVertex().measurement->getTimestamp();
+	Measurement::Ptr first(new PayloadMeasurement(stamp, 1000));
+	Measurement::Ptr second(new PayloadMeasurement(stamp, 300));
+	Covariance cov = Covariance::Identity() * 0.01;
+	mapper.addExternalReading(first, mapper.getLastVertex().measurement->getUniqueId(), createTransform(1, 0, 0, 0, 0), cov, "synthetic");
+	mapper.addExternalReading(second, first->getUniqueId(), createTransform(1, 0, 0, 0, 0), cov, "synthetic");
+	BOOST_CHECK_EQUAL(mapper.getMemoryStats().getUsage("measurements").bytes, 1300);
+	
+	first->releasePayload();
+	BOOST_REQUIRE(mapper.marginalizeVertex(mapper.getVertex(first->getUniqueId()).index));
+	BOOST_CHECK_EQUAL(mapper.getMemoryStats().getUsage("measurements").bytes, 300);
+	BOOST_CHECK_EQUAL(mapper.getMemoryStats().getUsage("vertices").objects, 7);
+}
+
+class FixedNodeSolver : public NativeSolver
+{
+public:
+	FixedNodeSolver(Logger* logger) : NativeSolver(logger) {}
+	void removeNode(unsigned id) { throw UnsupportedOperation("removeNode"); }
+};
+
+BOOST_AUTO_TEST_CASE(unsupported_removal)
+{
+	Clock clock;
+	FileLogger logger(clock, "sparsification.log");
+	logger.setLogLevel(ERROR);
+	
+	GeneratorConfiguration config;
+	config.trajectory = TRAJECTORY_MANHATTAN;
+	config.area = 10;
+	SyntheticSensor sensor("synthetic", &logger, config);
+	PoseGraphGenerator generator(sensor, config);
+	
+	BoostMapper mapper(&logger);
+	FixedNodeSolver solver(&logger);
+	mapper.registerSensor(&sensor);
+	mapper.setSolver(&solver);
+	mapper.setNeighborRadius(config.loop_range, config.max_loop_links);
+	generator.addReadings(mapper, 50);
+	BOOST_REQUIRE(mapper.optimize());
+	
+	// The graph stays consistent with the solver, which cannot remove nodes
+	size_t before = mapper.getVertexObjectsFromSensor("synthetic").size();
+	BOOST_CHECK(!mapper.marginalizeVertex(10));
+	BOOST_CHECK_EQUAL(mapper.sparsify("synthetic", 2.0), 0);
+	BOOST_CHECK_EQUAL(mapper.getVertexObjectsFromSensor("synthetic").size(), before);
+	BOOST_CHECK_EQUAL(solver.getCorrections().size(), before + 1);
+	BOOST_CHECK_NO_THROW(mapper.getVertex(10));
+	BOOST_CHECK(mapper.optimize());
+}
+
+BOOST_AUTO_TEST_CASE(replay_removals)
+{
+	Clock clock;
+	FileLogger logger(clock, "sparsification.log");
+	logger.setLogLevel(ERROR);
+	std::remove("sparsification.journal");
+	
+	GeneratorConfiguration config;
+	config.trajectory = TRAJECTORY_MANHATTAN;
+	config.area = 10;
+	SyntheticSensor sensor("synthetic", &logger, config);
+	PoseGraphGenerator generator(sensor, config);
+	
+	BoostMapper original(&logger);
+	NativeSolver solver(&logger);
+	Journal* journal = new Journal(&logger, "sparsification.journal");
+	original.registerSensor(&sensor);
+	original.setSolver(&solver);
+	original.setJournal(journal);
+	original.setNeighborRadius(config.loop_range, config.max_loop_links);
+	generator.addReadings(original, 100);
+	BOOST_REQUIRE(original.optimize());
+	BOOST_REQUIRE(original.sparsify("synthetic", 2.0) > 0);
+	generator.addReadings(original, 20);
+	original.setJournal(NULL);
+	delete journal;
+	
+	// Removals of vertices from the same journal are compacted together
+	BoostMapper restored(&logger);
+	NativeSolver restored_solver(&logger);
+	restored.registerSensor(&sensor);
+	restored.setSolver(&restored_solver);
+	BOOST_REQUIRE(restored.replayJournal("sparsification.journal"));
+	VertexObjectList vertices = original.getVertexObjectsFromSensor("synthetic");
+	BOOST_CHECK_EQUAL(restored.getVertexObjectsFromSensor("synthetic").size(), vertices.size());
+	BOOST_CHECK_EQUAL(restored.getEdgeObjectsFromSensor("").size(), original.getEdgeObjectsFromSensor("").size());
+	BOOST_CHECK_EQUAL(restored.getLastVertex().index, original.getLastVertex().index);
+	for(VertexObjectList::iterator v = vertices.begin(); v != vertices.end(); ++v)
+	{
+		BOOST_CHECK_EQUAL(restored.getVertex(v->measurement->getUniqueId()).index, v->index);
+	}
+	BOOST_CHECK(restored.optimize());
+	BOOST_CHECK_EQUAL(restored_solver.getCorrections().size(), vertices.size() + 1);
+}
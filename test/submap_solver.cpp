@@ -0,0 +1,188 @@
+#define BOOST_TEST_MODULE "SubmapSolverTest"
+
+#include <SubmapSolver.hpp>
+#include <NativeSolver.hpp>
+#include <FileLogger.hpp>
+
+#include "SolverFixture.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace slam3d;
+
+// A loop closure from every fifth node to the node one turn later
+static bool nextTurn(unsigned source, unsigned target)
+{
+	return source % 5 == 0 && target == source + 21;
+}
+
+BOOST_AUTO_TEST_CASE(consistent_graph)
+{
+	Clock clock;
+	FileLogger logger(clock, "submap_solver.log");
+	SubmapSolverConfiguration config;
+	config.submap_size = 10;
+	SubmapSolver solver(&logger, config);
+	
+	// Without noise the anchors and all members end up at the ground truth
+	PoseList truth;
+	TestEdgeList edges;
+	createProblem(truth, edges, 95, 0, nextTurn);
+	fillSolver(solver, edges, truth.size());
+	BOOST_CHECK_EQUAL(solver.getNumberOfSubmaps(), 10);
+	BOOST_CHECK(solver.compute());
+	PoseList poses = getPoses(solver, truth.size());
+	for(size_t i = 0; i < truth.size(); i++)
+	{
+		BOOST_CHECK_SMALL(distance(truth[i], poses[i]), 1e-6);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(converges_to_full_solution)
+{
+	Clock clock;
+	FileLogger logger(clock, "submap_solver.log");
+	SubmapSolverConfiguration config;
+	config.submap_size = 10;
+	SubmapSolver submaps(&logger, config);
+	NativeSolver full(&logger);
+	
+	PoseList truth;
+	TestEdgeList edges;
+	createProblem(truth, edges, 120, 0.02, nextTurn);
+	fillSolver(submaps, edges, truth.size());
+	fillSolver(full, edges, truth.size());
+	BOOST_CHECK(full.compute());
+	double optimum = chi2(getPoses(full, truth.size()), edges);
+	
+	// Every call continues the alternation between submaps and anchors
+	double previous = chi2(getPoses(submaps, truth.size()), edges);
+	for(int i = 0; i < 10; i++)
+	{
+		BOOST_CHECK(submaps.compute());
+		double current = chi2(getPoses(submaps, truth.size()), edges);
+		BOOST_CHECK_LT(current, previous);
+		previous = current;
+	}
+	BOOST_TEST_MESSAGE("chi2 submaps: " << previous << ", full: " << optimum);
+	BOOST_CHECK_LT(previous, 3 * optimum);
+}
+
+BOOST_AUTO_TEST_CASE(parallel)
+{
+	Clock clock;
+	FileLogger logger(clock, "submap_solver.log");
+	SubmapSolverConfiguration config;
+	config.submap_size = 8;
+	SubmapSolver sequential(&logger, config);
+	config.threads = 4;
+	SubmapSolver parallel(&logger, config);
+	
+	// The submaps are independent, so threads must not change the result
+	PoseList truth;
+	TestEdgeList edges;
+	createProblem(truth, edges, 100, 0.02, nextTurn);
+	fillSolver(sequential, edges, truth.size());
+	fillSolver(parallel, edges, truth.size());
+	BOOST_CHECK(sequential.compute());
+	BOOST_CHECK(parallel.compute());
+	PoseList a = getPoses(sequential, truth.size());
+	PoseList b = getPoses(parallel, truth.size());
+	for(size_t i = 0; i < truth.size(); i++)
+	{
+		BOOST_CHECK_SMALL(distance(a[i], b[i]), 1e-12);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(local_changes)
+{
+	Clock clock;
+	FileLogger logger(clock, "submap_solver.log");
+	SubmapSolverConfiguration config;
+	config.submap_size = 10;
+	SubmapSolver solver(&logger, config);
+	
+	PoseList truth;
+	TestEdgeList edges;
+	createProblem(truth, edges, 45, 0, nextTurn);
+	fillSolver(solver, edges, truth.size());
+	BOOST_CHECK(solver.compute());
+	
+	// A new node with only an odometry constraint does not move any other node
+	Transform step = Transform::Identity();
+	step.translation() = Vector3(1, 0, 0);
+	solver.addNode(45, truth[44] * step);
+	solver.addConstraint(44, 45, step * randomTransform(0.1, 0.1), Covariance::Identity());
+	BOOST_CHECK(solver.compute());
+	const IdPoseVector& changed = solver.getChangedPoses();
+	BOOST_REQUIRE_EQUAL(changed.size(), 1);
+	BOOST_CHECK_EQUAL(changed[0].first, 45);
+	
+	// Nothing changes without new constraints
+	BOOST_CHECK(solver.compute());
+	BOOST_CHECK(solver.getChangedPoses().empty());
+}
+
+BOOST_AUTO_TEST_CASE(remove_nodes)
+{
+	Clock clock;
+	FileLogger logger(clock, "submap_solver.log");
+	SubmapSolverConfiguration config;
+	config.submap_size = 5;
+	SubmapSolver solver(&logger, config);
+	
+	PoseList truth;
+	TestEdgeList edges;
+	createProblem(truth, edges, 20, 0, nextTurn);
+	fillSolver(solver, edges, truth.size());
+	BOOST_CHECK_THROW(solver.removeNode(20), Solver::UnknownVertex);
+	
+	// Removing an anchor makes the next member the anchor of the submap
+	solver.removeNode(5);
+	BOOST_CHECK_EQUAL(solver.getNumberOfSubmaps(), 4);
+	BOOST_CHECK(solver.compute());
+	BOOST_CHECK_EQUAL(solver.getCorrections().size(), 19);
+	
+	for(unsigned id = 10; id < 15; id++)
+	{
+		solver.removeNode(id);
+	}
+	BOOST_CHECK_EQUAL(solver.getNumberOfSubmaps(), 3);
+	BOOST_CHECK(solver.compute());
+	PoseList poses = getPoses(solver, truth.size());
+	for(unsigned i = 0; i < truth.size(); i++)
+	{
+		if(i != 5 && (i < 10 || i >= 15))
+			BOOST_CHECK_SMALL(distance(truth[i], poses[i]), 1e-6);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(reuse_emptied_submap)
+{
+	Clock clock;
+	FileLogger logger(clock, "submap_solver.log");
+	SubmapSolverConfiguration config;
+	config.submap_size = 3;
+	SubmapSolver solver(&logger, config);
+	
+	Transform step = Transform::Identity();
+	step.translation() = Vector3(1, 0, 0);
+	Transform pose = Transform::Identity();
+	for(unsigned id = 0; id < 4; id++)
+	{
+		solver.addNode(id, pose);
+		if(id > 0)
+			solver.addConstraint(id - 1, id, step, Covariance::Identity());
+		pose = pose * step;
+	}
+	solver.setFixed(0);
+	BOOST_CHECK(solver.compute());
+	
+	// The node added to the emptied submap becomes its new anchor
+	solver.removeNode(3);
+	solver.addNode(4, pose);
+	solver.addConstraint(2, 4, step * step, Covariance::Identity());
+	BOOST_CHECK(solver.compute());
+	PoseList poses = getPoses(solver, 5);
+	BOOST_CHECK_SMALL(distance(poses[4], pose), 1e-6);
+}